@@ -0,0 +1,368 @@
+#!/bin/bash
+# Compile-time benchmarks on generated inputs, run after ./rebuild.sh
+#   ./bench.sh stream    peak memory of -stream against whole-file lowering
+#   ./bench.sh liveness  dataflow solver on functions with thousands of blocks
+#   ./bench.sh object    -c against assembling the .S with clang
+#   ./bench.sh codegen   backend on one function of 100k+ koopa insts
+#   ./bench.sh passes    time of each -O2 pass, with verifier
+#   ./bench.sh ir        building and printing the SSA IR of a huge function
+#   ./bench.sh analysis  dominators, loops and liveness of the SSA IR
+#   ./bench.sh lexer     fast lexer against flex on comment-heavy sources
+#   ./bench.sh regress   growth on the inputs saved by ./fuzz.sh search
+#   ./bench.sh embed     compile() of the library in process against exec
+#   ./bench.sh koopa-in  native koopa parser against libkoopa on -koopa-in
+#   ./bench.sh fast      -O0-fast straight from the AST against -O0
+#   ./bench.sh regalloc  allocators against stack slots, spills and insts run
+#   ./bench.sh table     constant tables of 100k-400k elements, in braces
+#                        of rows, and local tables of as many expressions
+#   ./bench.sh deep      frontend on 100k-term expressions under an 8 MB stack,
+#                        against a recursive build given as $2 if any
+set -e
+mkdir -p debug/bench
+
+gen_functions() {
+    # $1 functions, each with $2 statements
+    awk -v n="$1" -v m="$2" 'BEGIN {
+        print "int g[16];"
+        for (f = 0; f < n; f++) {
+            print "int f" f "(int x) {"
+            print "  int s = x;"
+            for (i = 0; i < m; i++)
+                print "  if (s > " i ") s = s - g[" i % 16 "]; else s = s + " i ";"
+            print "  return s;"
+            print "}"
+        }
+        print "int main() { return f0(getint()); }"
+    }'
+}
+
+gen_loops() {
+    # $1 functions, each with $2 loop nests of depth 2
+    awk -v n="$1" -v m="$2" 'BEGIN {
+        for (f = 0; f < n; f++) {
+            print "int f" f "(int n) {"
+            print "  int s = 0;"
+            for (i = 0; i < m; i++) {
+                print "  { int i = 0; while (i < n) { int j = 0;"
+                print "    while (j < i) { if (j > " i ") s = s + j; else s = s - 1; j = j + 1; }"
+                print "    i = i + 1; } }"
+            }
+            print "  return s;"
+            print "}"
+        }
+        print "int main() { return f0(getint()); }"
+    }'
+}
+
+gen_live() {
+    # one function with $1 variables, all live through a loop of $2 ifs
+    awk -v n="$1" -v m="$2" 'BEGIN {
+        print "int f(int n) {"
+        for (v = 0; v < n; v++) print "  int v" v " = n + " v ";"
+        print "  int i = 0;"
+        print "  while (i < n) {"
+        for (i = 0; i < m; i++) {
+            a = i % n; b = (i * 7 + 1) % n
+            print "    if (v" a " > " i ") v" a " = v" a " - v" b ";" \
+                " else v" b " = v" b " + " i ";"
+        }
+        print "    i = i + 1;"
+        print "  }"
+        printf "  return v0"
+        for (v = 1; v < n; v++) printf " + v" v
+        print ";"
+        print "}"
+        print "int main() { return f(getint()); }"
+    }'
+}
+
+gen_comments() {
+    # $1 functions, each with $2 commented statements on long names
+    awk -v n="$1" -v m="$2" 'BEGIN {
+        for (f = 0; f < n; f++) {
+            print "/* function " f ", generated to be mostly comments"
+            print " * and whitespace, like the output of other generators */"
+            print "int function_with_a_rather_long_name_" f \
+                "(int parameter_with_a_long_name) {"
+            print "    int accumulator_with_a_long_name = 0;"
+            for (i = 0; i < m; i++) {
+                print "    // statement " i " adds the parameter once more"
+                print "    accumulator_with_a_long_name =" \
+                    "    accumulator_with_a_long_name + " \
+                    "parameter_with_a_long_name;   /* " i " */"
+            }
+            print "    return accumulator_with_a_long_name;"
+            print "}"
+            print ""
+        }
+        print "int main() { return function_with_a_rather_long_name_0(1); }"
+    }'
+}
+
+gen_expression() {
+    # one expression of $1 terms, and a constant one folded by calc_val
+    awk -v n="$1" 'BEGIN {
+        ops[0] = "+"; ops[1] = "-"; ops[2] = "*"
+        printf "const int c = 1"
+        for (i = 1; i < n; i++) printf " %s %d", ops[i % 2], i % 7
+        print ";"
+        print "int main() {"
+        print "  int x = getint();"
+        printf "  return c + x"
+        for (i = 1; i < n; i++) printf " %s x", ops[i % 3]
+        print ";"
+        print "}"
+    }'
+}
+
+gen_table() {
+    # a constant table of $1 elements in rows of 4, and a local table of
+    # as many constant expressions
+    awk -v n="$1" 'BEGIN {
+        printf "const int t[%d][4] = {", n / 4
+        for (i = 0; i < n / 4; i++) {
+            printf "%s{", i ? ", " : ""
+            for (j = 0; j < 4; j++)
+                printf "%s%d", j ? ", " : "", (i * 4 + j) * 7919 % 1000
+            printf "}"
+        }
+        print "};"
+        print "int main() {"
+        printf "  int l[%d] = {", n
+        for (i = 0; i < n; i++) printf "%s%d * 3 + 1", i ? ", " : "", i % 97
+        print "};"
+        print "  int i = getint();"
+        print "  return t[i / 4][i % 4] + l[i];"
+        print "}"
+    }'
+}
+
+gen_nested() {
+    # $1 ifs nested in each other, and an expression nested $1 deep in
+    # parentheses and unary minuses
+    awk -v n="$1" 'BEGIN {
+        print "int main() {"
+        print "  int x = getint(), s = 0;"
+        for (i = 0; i < n; i++) print "  if (x > " i % 50 ") { s = s + 1;"
+        for (i = 0; i < n; i++) printf "}"
+        print ""
+        printf "  return s + "
+        for (i = 0; i < n; i++) printf "(-"
+        printf "x"
+        for (i = 0; i < n; i++) printf ")"
+        print ";"
+        print "}"
+    }'
+}
+
+measure() {
+    # peak rss and wall time of one compiler run
+    /usr/bin/time -f "  %C: %M KB, %e s" "$@" > /dev/null
+}
+
+case "$1" in
+    stream)
+        gen_functions 5000 100 > debug/bench/stream.c
+        wc -l debug/bench/stream.c
+        measure build/compiler -riscv debug/bench/stream.c -o debug/bench/stream.S
+        measure build/compiler -riscv debug/bench/stream.c -o debug/bench/stream.S -stream
+        ;;
+    liveness)
+        # after mem2reg every variable is an SSA value live around the loop
+        gen_live 2000 3000 > debug/bench/liveness.c
+        wc -l debug/bench/liveness.c
+        build/compiler -riscv debug/bench/liveness.c -o debug/bench/liveness.S \
+            -passes=mem2reg -analyze=liveness 2>&1 | grep liveness
+        ;;
+    object)
+        gen_functions 1000 100 > debug/bench/object.c
+        wc -l debug/bench/object.c
+        measure build/compiler -riscv debug/bench/object.c -o debug/bench/object.S
+        measure clang debug/bench/object.S -c -o debug/bench/object.o \
+            -target riscv32-unknown-linux-elf -march=rv32im -mabi=ilp32
+        measure build/compiler -riscv debug/bench/object.c -o debug/bench/object.o -c
+        ;;
+    codegen)
+        # bison stack limits a block to about 10k statements
+        gen_functions 1 9000 > debug/bench/codegen.c
+        wc -l debug/bench/codegen.c
+        measure build/compiler -riscv debug/bench/codegen.c -o debug/bench/codegen.S
+        ;;
+    passes)
+        gen_functions 1000 100 > debug/bench/passes.c
+        wc -l debug/bench/passes.c
+        build/compiler -riscv debug/bench/passes.c -o debug/bench/passes.S \
+            -O2 -verify -print-pipeline -time-passes
+        ;;
+    ir)
+        # the dumped text should compile to the same assembly
+        gen_functions 1 9000 > debug/bench/ir.c
+        wc -l debug/bench/ir.c
+        build/compiler -riscv debug/bench/ir.c -o debug/bench/ir.S -O0 \
+            -dump-ir=debug/bench/ir.koopa -time-passes 2>&1 | grep ir-
+        build/compiler -riscv debug/bench/ir.c -o debug/bench/ir0.S -O0
+        cmp debug/bench/ir.S debug/bench/ir0.S && echo "  same assembly"
+        ;;
+    analysis)
+        gen_loops 1 3000 > debug/bench/analysis.c
+        wc -l debug/bench/analysis.c
+        build/compiler -riscv debug/bench/analysis.c \
+            -o debug/bench/analysis.S -analyze=ir 2>&1 | grep analyses
+        ;;
+    lexer)
+        # -koopa is mostly lexing and parsing here
+        gen_comments 1000 200 > debug/bench/lexer.c
+        wc -c debug/bench/lexer.c
+        build/compiler -koopa debug/bench/lexer.c -o /dev/null -lexer=check \
+            2>&1 | grep Lexer
+        measure build/compiler -koopa debug/bench/lexer.c -o /dev/null \
+            -lexer=flex
+        measure build/compiler -koopa debug/bench/lexer.c -o /dev/null
+        ;;
+    regress)
+        ./fuzz.sh replay
+        ;;
+    embed)
+        # exec costs the same on any input, so it matters for small ones
+        gen_functions 1 10 > debug/bench/embed_small.c
+        gen_functions 100 100 > debug/bench/embed_large.c
+        wc -l debug/bench/embed_small.c debug/bench/embed_large.c
+        build/embed_bench build/compiler debug/bench/embed_small.c 200
+        build/embed_bench build/compiler debug/bench/embed_large.c 10
+        ;;
+    koopa-in)
+        # both parsers should give the same assembly
+        gen_functions 1000 100 > debug/bench/koopa_in.c
+        build/compiler -koopa debug/bench/koopa_in.c -o debug/bench/koopa_in.koopa
+        wc -c debug/bench/koopa_in.koopa
+        for parser in libkoopa native; do
+            echo "  $parser"
+            build/compiler -koopa-in debug/bench/koopa_in.koopa \
+                -o debug/bench/koopa_in_$parser.S -koopa-parser=$parser \
+                -time-passes 2>&1 | grep koopa-parse
+            measure build/compiler -koopa-in debug/bench/koopa_in.koopa \
+                -o debug/bench/koopa_in_$parser.S -koopa-parser=$parser
+        done
+        cmp debug/bench/koopa_in_libkoopa.S debug/bench/koopa_in_native.S &&
+            echo "  same assembly"
+        # other tools may call a function defined further down
+        cat > debug/bench/koopa_in_forward.koopa << EOF
+fun @main(): i32 {
+%entry:
+  %x = call @twice(21)
+  %y = add %x, 0
+  ret %y
+}
+
+fun @twice(@n: i32): i32 {
+%entry:
+  %r = mul @n, 2
+  ret %r
+}
+EOF
+        for parser in libkoopa native; do
+            build/compiler -koopa-in debug/bench/koopa_in_forward.koopa \
+                -o debug/bench/koopa_in_forward_$parser.S \
+                -koopa-parser=$parser
+        done
+        cmp debug/bench/koopa_in_forward_libkoopa.S \
+            debug/bench/koopa_in_forward_native.S &&
+            echo "  same assembly with a call before the callee"
+        # names the IR printer would generate are taken already
+        cat > debug/bench/koopa_in_names.koopa << EOF
+fun @main(): i32 {
+%b0:
+  %v0 = alloc i32
+  %v1 = alloc i32
+  store 0, %v0
+  store 0, %v1
+  jump %b1
+%b1:
+  %v2 = load %v0
+  %v3 = lt %v2, 10
+  br %v3, %b2, %b3
+%b2:
+  %v4 = load %v1
+  %v5 = load %v0
+  %v22 = add %v4, %v5
+  store %v22, %v1
+  %v21 = add %v5, 1
+  store %v21, %v0
+  jump %b1
+%b3:
+  %v8 = load %v1
+  ret %v8
+}
+EOF
+        for level in -O0 -O1 -O2; do
+            build/compiler -koopa-in debug/bench/koopa_in_names.koopa \
+                -o debug/bench/koopa_in_names$level.S $level
+        done
+        # set -e stops at the first level the names break
+        echo "  %vN and %bN names compile at -O0, -O1 and -O2"
+        ;;
+    fast)
+        gen_functions 1000 100 > debug/bench/fast.c
+        wc -l debug/bench/fast.c
+        measure build/compiler -riscv debug/bench/fast.c -o debug/bench/fast.S
+        measure build/compiler -riscv debug/bench/fast.c -o debug/bench/fast.S \
+            -O0-fast
+        ;;
+    regalloc)
+        # compile time on a huge function, which graph coloring leaves to
+        # linear scan
+        gen_functions 1 9000 > debug/bench/regalloc.c
+        wc -l debug/bench/regalloc.c
+        for kind in none linear graph; do
+            measure build/compiler -riscv debug/bench/regalloc.c \
+                -o debug/bench/regalloc.S -O2 -regalloc=$kind
+        done
+        # code of each allocator, and insts run under qemu if it's there
+        gen_loops 20 10 > debug/bench/regalloc_run.c
+        for kind in none linear graph; do
+            build/compiler -riscv debug/bench/regalloc_run.c \
+                -o debug/bench/regalloc_run.o -c -O2 -regalloc=$kind \
+                -stats=json | jq -r --arg kind "$kind" '.total |
+                "  \($kind): \(.spilled_values) spilled, " +
+                "\(.coalesced_moves) coalesced, \(.stack_loads) loads, " +
+                "\(.stack_stores) stores, \(.insts) insts"'
+            command -v qemu-riscv32-static > /dev/null || continue
+            ld.lld debug/bench/regalloc_run.o -L$CDE_LIBRARY_PATH/riscv32 \
+                -lsysy -o debug/bench/regalloc_run
+            echo 30 | qemu-riscv32-static -one-insn-per-tb -d exec,nochain \
+                -D debug/bench/regalloc_run.log debug/bench/regalloc_run || true
+            echo "    $(grep -c Trace debug/bench/regalloc_run.log) insts run"
+        done
+        ;;
+    table)
+        # initializer lists are parsed and folded in time linear in them
+        for n in 100000 200000 400000; do
+            gen_table $n > debug/bench/table_$n.c
+            wc -c debug/bench/table_$n.c
+            measure build/compiler -riscv debug/bench/table_$n.c \
+                -o debug/bench/table_$n.S
+        done
+        ;;
+    deep)
+        # the default stack of a shell, lowering must not recurse per term
+        # or per level, nor the parser give up at bison's default depth
+        gen_expression 100000 > debug/bench/deep.c
+        gen_nested 100000 > debug/bench/deep_nested.c
+        wc -c debug/bench/deep.c debug/bench/deep_nested.c
+        for input in deep deep_nested; do
+            (ulimit -s 8192
+             measure build/compiler -koopa debug/bench/$input.c -o /dev/null
+             measure build/compiler -riscv debug/bench/$input.c \
+                 -o debug/bench/$input.S)
+        done
+        # the recursive lowering only gets through with an unlimited stack
+        if [ -n "$2" ]; then
+            (ulimit -s unlimited
+             measure "$2" -koopa debug/bench/deep.c -o /dev/null)
+        fi
+        ;;
+    *)
+        echo "usage: $0 stream|liveness|object|codegen|passes|ir|analysis|lexer|regress|embed|koopa-in|fast|regalloc|table|deep"
+        exit 1
+        ;;
+esac
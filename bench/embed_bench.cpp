@@ -0,0 +1,76 @@
+// Time of compile() in process against exec of the compiler on the same
+// input, which is what a test runner or IDE saves by linking the library.
+//   embed_bench <compiler> <input> [runs]
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "compiler.h"
+
+extern char **environ;
+
+static double get_elapsed_ms(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static int exec_compiler(const char *compiler, const char *input) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    const char *argv[] = {compiler, "-riscv",       input,
+                          "-o",     "/dev/null", nullptr};
+    pid_t pid;
+    int ret = posix_spawn(&pid, compiler, &actions, nullptr, (char **)argv,
+                          environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (ret) return ret;
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <compiler> <input> [runs]"
+                  << std::endl;
+        return 1;
+    }
+    int runs = argc > 3 ? std::stoi(argv[3]) : 20;
+
+    std::ifstream in(argv[2]);
+    assert(in.is_open());
+    std::stringstream source;
+    source << in.rdbuf();
+    auto source_str = source.str();
+
+    // same output both ways
+    std::string buffer;
+    if (compile(source_str, COMPILE_RISCV, buffer)) return 1;
+    size_t size = buffer.size();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        int ret = compile(source_str, COMPILE_RISCV, buffer);
+        assert(!ret && buffer.size() == size);
+    }
+    double in_process_ms = get_elapsed_ms(start) / runs;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        if (exec_compiler(argv[1], argv[2])) return 1;
+    double exec_ms = get_elapsed_ms(start) / runs;
+
+    std::cout << "in process: " << in_process_ms << " ms, exec: " << exec_ms
+              << " ms, per compile of " << size << " bytes of assembly"
+              << std::endl;
+    return 0;
+}
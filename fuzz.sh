@@ -0,0 +1,333 @@
+#!/bin/bash
+# Compile-time fuzzer, looks for inputs whose compile time or peak memory
+# grows much faster than their size. Runs offline after ./rebuild.sh
+#   ./fuzz.sh search [rounds] [seed]  mutate programs, minimize and save hits
+#   ./fuzz.sh replay                  growth of each saved hit
+#   ./fuzz.sh gen <spec> <scale>      print the program of a spec
+#
+# A spec is one line of numbers driving a random program generator that
+# follows the statements and expressions of sysy.y:
+#   seed stmts depth init exprs names decl array assign if while block call
+#   flags
+# stmts is the number of statements, depth the deepest nesting, init the
+# length of array initializers, exprs the operands of an expression, and
+# names the pool of local names, which nested blocks declare again. The
+# next seven are weights of the statement kinds. flags are the params
+# that grow with the scale, s for stmts, d for depth, i for init and
+# e for exprs. A spec is a hit if, from scale s to 4s, its compile time
+# or memory grows faster than size^THRESHOLD.
+COMPILER=${COMPILER:-build/compiler}
+MODE=${MODE:--riscv}
+TIME=${TIME:-/usr/bin/time}
+THRESHOLD=${THRESHOLD:-1.5}
+TIMEOUT=${TIMEOUT:-20}
+FLOOR_MS=${FLOOR_MS:-50}  # noise below it, scale up first
+MAX_SCALE=${MAX_SCALE:-4096}
+HITS=bench/perf_regress.txt
+OUT=debug/fuzz
+mkdir -p $OUT bench
+
+SEEDS=(
+    "1 20 4 4 3 8 4 1 4 2 2 2 1 s"    # a bit of everything
+    "2 8 2 16 2 4 1 16 1 1 1 1 0 i"   # huge initializer lists
+    "3 20 20 2 2 4 2 0 2 1 1 8 0 sd"  # deep block nesting
+    "4 40 3 2 2 2 8 0 1 1 1 6 0 s"    # many scopes declaring the same names
+    "5 10 2 2 16 8 1 0 8 1 1 0 1 e"   # long expressions
+)
+
+gen_program() {
+    # $1 spec, $2 scale
+    awk -v spec="$1" -v scale="$2" '
+    function pick(   r, i) {
+        r = rand() * wsum
+        for (i = 1; i <= 7; i++) {
+            r -= w[i]
+            if (r < 0) return kinds[i]
+        }
+        return "assign"
+    }
+    function name() { return "v" int(rand() * names) }
+    function atom(   r) {
+        r = rand()
+        if (r < 0.5) return name()
+        if (r < 0.7) return "g[" int(rand() * 4) "]"
+        return int(rand() * 100)
+    }
+    function expr(len,   s, i) {
+        s = atom()
+        for (i = 1; i < len; i++)
+            s = s " " ops[1 + int(rand() * 6)] " " \
+                (rand() < 0.2 ? "(" atom() " - 1)" : atom())
+        return s
+    }
+    function array(   s, i) {
+        s = "int a" num_arrays++ "[" init "] = {"
+        for (i = 0; i < init; i++) s = s (i ? ", " : "") int(rand() * 100)
+        return s "};"
+    }
+    function leaf(k,   nm) {
+        if (k == "decl") {
+            nm = name()
+            if (!((d, nm) in declared)) {
+                declared[d, nm] = 1
+                return "int " nm " = " expr(exprs) ";"
+            }
+        }
+        if (k == "array") return array()
+        if (k == "call") return name() " = f(" expr(exprs) ", g);"
+        return name() " = " expr(exprs) ";"
+    }
+    # nested blocks redeclare names, at most once each
+    function open_block(kind,   i) {
+        d++
+        open_kind[d] = kind
+        num_stmts[d] = 0
+        for (i = 0; i < names; i++) delete declared[d, "v" i]
+    }
+    # capped, or the size of deep nests would be mostly indentation
+    function indent() { return sprintf("%" (2 * (d < 8 ? d : 8)) "s", "") }
+    # iteratively, deep nesting would overflow the stack of awk
+    function body(   k, ind) {
+        d = 1
+        while (budget > 0 || d > 1) {
+            ind = indent()
+            if (d > 1 && num_stmts[d] > 0 && (budget <= 0 || rand() < 0.3)) {
+                k = open_kind[d]
+                d--
+                ind = indent()
+                if (k == "if") {
+                    print ind "} else {"
+                    open_block("else")
+                } else if (k == "while") {
+                    print ind "  break;"
+                    print ind "}"
+                } else {
+                    print ind "}"
+                }
+                continue
+            }
+            budget--
+            num_stmts[d]++
+            k = pick()
+            if (d >= depth && (k == "if" || k == "while" || k == "block"))
+                k = "assign"
+            if (k == "if") {
+                print ind "if (" expr(2) ") {"
+                open_block("if")
+            } else if (k == "while") {
+                print ind "while (" expr(2) ") {"
+                open_block("while")
+            } else if (k == "block") {
+                print ind "{"
+                open_block("block")
+            } else {
+                print ind leaf(k)
+            }
+        }
+    }
+    BEGIN {
+        split(spec, p, " ")
+        srand(p[1])
+        stmts = p[2]; depth = p[3]; init = p[4]; exprs = p[5]; names = p[6]
+        if (p[14] ~ /s/) stmts *= scale
+        if (p[14] ~ /d/) depth *= scale
+        if (p[14] ~ /i/) init *= scale
+        if (p[14] ~ /e/) exprs *= scale
+        split("decl array assign if while block call", kinds, " ")
+        for (i = 1; i <= 7; i++) {
+            w[i] = p[6 + i]
+            wsum += w[i]
+        }
+        split("+ - * < == &&", ops, " ")
+
+        print "int g[4];"
+        print "int f(int x, int a[]) { return x + a[0]; }"
+        print "int main() {"
+        for (i = 0; i < names; i++) {
+            print "  int v" i " = " i ";"
+            declared[1, "v" i] = 1
+        }
+        budget = stmts
+        body()
+        print "  return v0;"
+        print "}"
+    }'
+}
+
+run_compiler() {
+    # $1 input, prints "ms kb status"
+    local start end status=0
+    start=$(date +%s%N)
+    $TIME -f "%M" -o $OUT/mem timeout $TIMEOUT \
+        $COMPILER $MODE $1 -o $OUT/out.S < /dev/null > /dev/null \
+        2> $OUT/err || status=$?
+    end=$(date +%s%N)
+    echo "$(((end - start) / 1000000)) $(tail -1 $OUT/mem) $status"
+}
+
+growth() {
+    # exponent of y over x, from (x1, y1) to (x2, y2)
+    awk -v x1="$1" -v y1="$2" -v x2="$3" -v y2="$4" 'BEGIN {
+        if (y1 < 1) y1 = 1
+        printf "%.2f", log(y2 / y1) / log(x2 / x1)
+    }'
+}
+
+# sets scale, exp_time, exp_mem and fail of a spec
+probe() {
+    local small large bytes1 bytes4
+    scale=1
+    fail=""
+    while true; do
+        gen_program "$1" $scale > $OUT/small.c
+        small=($(run_compiler $OUT/small.c))
+        if [ "${small[2]}" != 0 ]; then
+            fail="status ${small[2]} at scale $scale"
+            return
+        fi
+        if [ "${small[0]}" -ge $FLOOR_MS ] || [ $scale -ge $MAX_SCALE ]; then
+            break
+        fi
+        scale=$((scale * 2))
+    done
+    gen_program "$1" $((scale * 4)) > $OUT/large.c
+    large=($(run_compiler $OUT/large.c))
+    bytes1=$(wc -c < $OUT/small.c)
+    bytes4=$(wc -c < $OUT/large.c)
+    if [ $bytes4 -le $bytes1 ]; then
+        # nothing grows with the scale
+        exp_time=0
+        exp_mem=0
+        return
+    fi
+    exp_time=$(growth $bytes1 ${small[0]} $bytes4 ${large[0]})
+    exp_mem=$(growth $bytes1 ${small[1]} $bytes4 ${large[1]})
+    # a timeout is a lower bound, which is enough
+    if [ "${large[2]}" != 0 ] && [ "${large[2]}" != 124 ]; then
+        fail="status ${large[2]} at scale $((scale * 4))"
+    fi
+}
+
+is_hit() {
+    probe "$1"
+    [ -n "$fail" ] && return 0
+    awk -v t="$exp_time" -v m="$exp_mem" -v k="$THRESHOLD" \
+        'BEGIN { exit !(t > k || m > k) }'
+}
+
+# sets mutated, not in a subshell to keep RANDOM in sequence
+mutate() {
+    local p=($1) i
+    i=$((RANDOM % 14))
+    if [ $i = 13 ]; then
+        # grow another param, or stop growing one
+        local flag=${p[13]} f=sdie
+        f=${f:$((RANDOM % 4)):1}
+        if [[ $flag == *$f* ]]; then
+            [ ${#flag} -gt 1 ] && flag=${flag//$f/}
+        else
+            flag=$flag$f
+        fi
+        p[13]=$flag
+    elif [ $i = 0 ]; then
+        p[0]=$RANDOM
+    elif [ $((RANDOM % 2)) = 0 ]; then
+        p[$i]=$((p[i] * 2))
+    else
+        p[$i]=$((p[i] / 2))
+    fi
+    # at least one statement, level, element, operand and name
+    for i in 1 2 3 4 5; do [ ${p[i]} -ge 1 ] || p[$i]=1; done
+    mutated="${p[@]}"
+}
+
+# drop statement kinds and growing params while it's still a hit,
+# then halve the sizes, and scale weights and seed down to 1 if they
+# don't matter, so that hits of the same cause look the same
+minimize() {
+    local spec="$1" p i try
+    for i in 6 7 8 9 10 11 12; do
+        p=($spec)
+        [ ${p[i]} = 0 ] && continue
+        p[$i]=0
+        try="${p[@]}"
+        is_hit "$try" && spec=$try
+    done
+    for f in s d i e; do
+        p=($spec)
+        [[ ${p[13]} == *$f* ]] && [ ${#p[13]} -gt 1 ] || continue
+        p[13]=${p[13]//$f/}
+        try="${p[@]}"
+        is_hit "$try" && spec=$try
+    done
+    for i in 1 2 3 4 5; do
+        while true; do
+            p=($spec)
+            [ ${p[i]} -gt 1 ] || break
+            p[$i]=$((p[i] / 2))
+            try="${p[@]}"
+            is_hit "$try" && spec=$try || break
+        done
+    done
+    for i in 0 6 7 8 9 10 11 12; do
+        p=($spec)
+        [ ${p[i]} -gt 1 ] || continue
+        p[$i]=1
+        try="${p[@]}"
+        is_hit "$try" && spec=$try
+    done
+    minimized=$spec
+}
+
+report() {
+    if [ -n "$fail" ]; then
+        echo "$fail"
+    else
+        echo "time ^$exp_time, memory ^$exp_mem from scale $scale"
+    fi
+}
+
+save_hit() {
+    # $1 spec, with the last probe of it
+    local n
+    n=$(grep -vcs '^#' $HITS || true)
+    n=${n:-0}
+    gen_program "$1" $scale > $OUT/hit$n.c
+    echo "$1  # $(report)" >> $HITS
+    echo "  saved as $HITS line $((n + 1)), $OUT/hit$n.c"
+}
+
+case "$1" in
+    search)
+        rounds=${2:-100}
+        RANDOM=${3:-1}
+        for ((r = 0; r < rounds; r++)); do
+            mutate "${SEEDS[RANDOM % ${#SEEDS[@]}]}"
+            mutate "$mutated"
+            spec=$mutated
+            is_hit "$spec" || continue
+            echo "round $r: $spec, $(report)"
+            minimize "$spec"
+            spec=$minimized
+            # skip what's found already
+            grep -q "^$spec  #" $HITS 2> /dev/null && continue
+            is_hit "$spec"
+            echo "  minimized to $spec"
+            save_hit "$spec"
+        done
+        ;;
+    replay)
+        grep -v '^#' $HITS | while read -r line; do
+            spec=${line%%  #*}
+            probe "$spec"
+            echo "$spec: $(report)"
+        done
+        ;;
+    gen)
+        gen_program "$2" "$3"
+        ;;
+    *)
+        echo "usage: $0 search [rounds] [seed] | replay | gen <spec> <scale>"
+        exit 1
+        ;;
+esac
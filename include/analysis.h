@@ -0,0 +1,135 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dataflow.h"
+#include "ir.h"
+
+// CFG of an IR function, indexed by block ids.
+// Removed blocks have no edges and are unreachable.
+class IRCFG : public BlockGraph {
+   public:
+    IRCFG(const IRFunction &func);
+};
+
+// Dominator tree by the iterative algorithm of Cooper, Harvey and Kennedy,
+// which intersects paths up the tree in reverse postorder until fixed.
+class DominatorTree {
+   private:
+    std::vector<int> rpo_index;  // -1 if unreachable
+    // preorder numbers of the tree, a dominates b iff b is numbered within
+    // the subtree of a
+    std::vector<int> pre;
+    std::vector<int> last;
+
+    int _intersect(int a, int b) const;
+
+   public:
+    std::vector<int> idom;  // entry is its own idom, -1 if unreachable
+    std::vector<std::vector<int>> children;
+    std::vector<std::vector<int>> frontiers;
+    std::vector<int> preorder;  // reachable blocks, parents first
+    int num_iterations = 0;
+
+    DominatorTree(const BlockGraph &cfg);
+
+    bool dominates(int a, int b) const {
+        return pre[a] != -1 && pre[b] != -1 && pre[a] <= pre[b] &&
+               pre[b] <= last[a];
+    }
+};
+
+class Loop {
+   public:
+    int header;
+    int parent = -1;  // -1 if outermost
+    int depth = 1;
+    std::vector<int> latches;   // sources of back edges
+    std::vector<int> blocks;    // including the ones of nested loops
+    std::vector<int> children;  // directly nested loops
+};
+
+// Natural loops of back edges, whose targets dominate their sources.
+// Loops sharing a header are merged, and loops are nested by their bodies.
+class LoopForest {
+   public:
+    std::vector<Loop> loops;
+    std::vector<int> block_loop;  // innermost loop, -1 if in none
+    std::vector<int> roots;
+
+    LoopForest(const BlockGraph &cfg, const DominatorTree &dom);
+
+    int get_depth(int block) const {
+        int loop = block_loop[block];
+        return loop == -1 ? 0 : loops[loop].depth;
+    }
+    int get_max_depth() const;
+};
+
+// Values live at start and end of each block, like Liveness on raw
+// functions. Only values used out of their defining block get a bit.
+class IRLiveness {
+   private:
+    std::vector<int> value_bits;  // by value id, -1 if block local
+    std::vector<int> bit_values;
+
+   public:
+    DataflowResult result;
+
+    IRLiveness(const IRFunction &func, const BlockGraph &cfg);
+
+    int get_num_bits() const { return bit_values.size(); }
+    int get_value(int bit) const { return bit_values[bit]; }
+    int get_bit(int value) const { return value_bits[value]; }
+    const BitVector &get_live_in(int block) const { return result.in[block]; }
+    const BitVector &get_live_out(int block) const {
+        return result.out[block];
+    }
+};
+
+// What a transformation changed, so that only analyses depending on it
+// are dropped
+typedef enum {
+    IR_CHANGED_NONE = 0,
+    IR_CHANGED_INSTS = 1,  // insts or operands, but no edge
+    IR_CHANGED_CFG = 2,    // blocks or edges
+    IR_CHANGED_ALL = 3,
+} ir_change_t;
+
+typedef enum {
+    ANALYSIS_CFG,
+    ANALYSIS_DOMINATORS,
+    ANALYSIS_LOOPS,
+    ANALYSIS_LIVENESS,
+    ANALYSIS_NUM,
+} analysis_kind_t;
+
+// Analyses of one function, computed on first request and cached until
+// a transformation invalidates them
+class AnalysisManager {
+   private:
+    const IRFunction &func;
+    std::unique_ptr<IRCFG> cfg;
+    std::unique_ptr<DominatorTree> dom;
+    std::unique_ptr<LoopForest> loops;
+    std::unique_ptr<IRLiveness> liveness;
+
+   public:
+    // by analysis kind
+    int num_computed[ANALYSIS_NUM] = {};
+    double computed_ms[ANALYSIS_NUM] = {};
+
+    AnalysisManager(const IRFunction &func) : func(func) {}
+
+    const IRCFG &get_cfg();
+    const DominatorTree &get_dominators();
+    const LoopForest &get_loops();
+    const IRLiveness &get_liveness();
+
+    // drop analyses depending on changes, a mask of ir_change_t
+    void invalidate(int changes);
+};
+
+std::string to_analysis_kind(analysis_kind_t kind);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that lives as long as one function in backend.
+// Nothing is freed on its own, reset frees everything at once and keeps
+// the memory, so that later functions allocate nothing from the heap
+// unless they are bigger than any before.
+class Arena {
+   private:
+    class Chunk {
+       public:
+        std::unique_ptr<char[]> buf;
+        size_t size;
+    };
+    std::vector<Chunk> chunks;
+    char *cur = nullptr;
+    char *end = nullptr;
+    int num_heap_allocs = 0;
+
+    void _add_chunk(size_t min_size);
+
+   public:
+    static const size_t MIN_CHUNK_SIZE = 64 << 10;
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align) {
+        auto p = (char *)(((uintptr_t)cur + align - 1) & ~(align - 1));
+        if (!cur || p + size > end) {
+            _add_chunk(size + align);
+            p = (char *)(((uintptr_t)cur + align - 1) & ~(align - 1));
+        }
+        cur = p + size;
+        return p;
+    }
+    template <typename T>
+    T *allocate(size_t n) {
+        return (T *)allocate(n * sizeof(T), alignof(T));
+    }
+    // everything allocated is gone, memory is kept in a single chunk
+    void reset();
+
+    size_t get_capacity() const;
+    // chunks ever taken from the heap
+    int get_num_heap_allocs() const { return num_heap_allocs; }
+};
+
+// Allocator of std containers on an arena, or on the heap if it's null.
+// Containers on an arena have to be gone before the arena is reset.
+template <typename T>
+class ArenaAllocator {
+   public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena *arena;
+
+    ArenaAllocator(Arena *arena = nullptr) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        if (arena) return arena->allocate<T>(n);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n) {
+        if (!arena) std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena != b.arena;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
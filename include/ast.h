@@ -1,6 +1,8 @@
 #pragma once
 #include <cassert>
 #include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -15,6 +17,39 @@ class BaseAST {
     virtual void dump_koopa(IRGenerator &irgen, std::ostream &out) const = 0;
 };
 
+// Deep ASTs can't be destroyed recursively either. Nodes hand their
+// children over here, which are destroyed by the outermost call.
+void release_ast_children(
+    std::initializer_list<std::unique_ptr<BaseAST> *> children);
+void release_ast_children(std::vector<std::unique_ptr<BaseAST>> &children);
+
+// Statements and expressions could nest as deep as the input goes.
+// They're lowered by steps on irgen.tasks rather than recursion, so depth
+// costs heap only. A step could schedule the next stage of its node and
+// then its children, which run first since tasks are LIFO.
+class StepAST : public BaseAST {
+   public:
+    // run every step of this node and its children
+    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
+    virtual void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                                 int stage) const = 0;
+
+   protected:
+    void _schedule(IRGenerator &irgen, int stage) const {
+        irgen.tasks.push_back({this, stage});
+    }
+    // decls aren't stepped, they're dumped right away
+    static void _schedule(IRGenerator &irgen, std::ostream &out,
+                          const BaseAST *child);
+};
+
+// Streaming mode: parser hands over every CompUnit as soon as it's reduced,
+// instead of collecting them into StartAST.
+typedef std::function<void(std::unique_ptr<BaseAST>)> comp_unit_handler_t;
+
+// dump sysy library function decls, and register them in symbol table
+void dump_koopa_sysy_lib(IRGenerator &irgen, std::ostream &out);
+
 // Start          ::= CompUnit
 class StartAST : public BaseAST {
    public:
@@ -80,7 +115,6 @@ class InitValAST : public BaseAST {
     bool is_const;
     std::unique_ptr<BaseAST> exp;
     std::vector<std::unique_ptr<BaseAST>> init_vals;
-    InitValAST *next;  // only for optional part!
 
     void dump_koopa(IRGenerator &irgen, std::ostream &out) const override {
         assert(false);  // this function shouldn't be called
@@ -124,11 +158,13 @@ class FuncRParamAST : public BaseAST {
 };
 
 // Block         ::= "{" {BlockItem} "}";
-class BlockAST : public BaseAST {
+class BlockAST : public StepAST {
    public:
     std::vector<std::unique_ptr<BaseAST>> items;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
+    ~BlockAST() override { release_ast_children(items); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
 };
 
 typedef enum {
@@ -137,13 +173,15 @@ typedef enum {
 } block_item_ast_type;
 
 // BlockItem     ::= Decl | Stmt;
-class BlockItemAST : public BaseAST {
+class BlockItemAST : public StepAST {
    public:
     block_item_ast_type type;
     std::unique_ptr<BaseAST> item;
     BlockItemAST *next;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
+    ~BlockItemAST() override { release_ast_children({&item}); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
 };
 
 typedef enum {
@@ -162,7 +200,7 @@ typedef enum {
 //                 | Block
 //                 | "if" "(" Exp ")" Stmt ["else" Stmt]
 //                 | "return" [Exp] ";"
-class StmtAST : public BaseAST {
+class StmtAST : public StepAST {
    public:
     stmt_ast_type type;
     std::unique_ptr<BaseAST> lval;
@@ -172,16 +210,36 @@ class StmtAST : public BaseAST {
     std::unique_ptr<BaseAST> else_stmt;
     std::unique_ptr<BaseAST> do_stmt;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
+    ~StmtAST() override {
+        release_ast_children(
+            {&lval, &exp, &block, &then_stmt, &else_stmt, &do_stmt});
+    }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
 };
 
-class CalcAST : public BaseAST {
+class CalcAST : public StepAST {
    public:
     // Calculate AST's value, and store the result in the given reference.
     // calc_const forces to use const value, if not, raises errors.
     // Return true if we can determine that the calculated value is const
-    virtual bool calc_val(IRGenerator &irgen, int &result,
-                          bool calc_const) const = 0;
+    // The result is cached on the node, so every subtree is folded once.
+    bool calc_val(IRGenerator &irgen, int &result, bool calc_const) const;
+
+   protected:
+    // children folded before this node
+    virtual void _get_calc_children(
+        std::vector<const CalcAST *> &children) const = 0;
+    // fold this node, only called by calc_val when there's no cached result
+    virtual bool _calc_val(IRGenerator &irgen, int &result,
+                           bool calc_const) const = 0;
+    // folded result of a child, for _calc_val
+    static bool _get_child_val(const BaseAST *child, int &result);
+
+   private:
+    mutable bool is_val_cached = false;
+    mutable bool cached_is_const = false;
+    mutable int cached_val = 0;
 };
 
 // ConstExp      ::= Exp
@@ -192,9 +250,13 @@ class ExpAST : public CalcAST {
     std::unique_ptr<BaseAST> binary_exp;
     ExpAST *next;  // for array index only!
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
-    bool calc_val(IRGenerator &irgen, int &result,
-                  bool calc_const) const override;
+    ~ExpAST() override { release_ast_children({&binary_exp}); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
+    void _get_calc_children(
+        std::vector<const CalcAST *> &children) const override;
+    bool _calc_val(IRGenerator &irgen, int &result,
+                   bool calc_const) const override;
 };
 
 // MulExp        ::= UnaryExp | MulExp ("*" | "/" | "%") UnaryExp;
@@ -209,10 +271,15 @@ class BinaryExpAST : public CalcAST {
     std::unique_ptr<BaseAST> l_exp;
     std::unique_ptr<BaseAST> r_exp;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
-    void dump_koopa_land_lor(IRGenerator &irgen, std::ostream &out) const;
-    bool calc_val(IRGenerator &irgen, int &result,
-                  bool calc_const) const override;
+    ~BinaryExpAST() override { release_ast_children({&l_exp, &r_exp}); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
+    void dump_koopa_land_lor(IRGenerator &irgen, std::ostream &out,
+                             int stage) const;
+    void _get_calc_children(
+        std::vector<const CalcAST *> &children) const override;
+    bool _calc_val(IRGenerator &irgen, int &result,
+                   bool calc_const) const override;
 };
 
 typedef enum {
@@ -230,9 +297,16 @@ class UnaryExpAST : public CalcAST {
     std::string ident;
     std::vector<std::unique_ptr<BaseAST>> params;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
-    bool calc_val(IRGenerator &irgen, int &result,
-                  bool calc_const) const override;
+    ~UnaryExpAST() override {
+        release_ast_children({&unary_exp});
+        release_ast_children(params);
+    }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
+    void _get_calc_children(
+        std::vector<const CalcAST *> &children) const override;
+    bool _calc_val(IRGenerator &irgen, int &result,
+                   bool calc_const) const override;
 };
 
 typedef enum {
@@ -246,19 +320,34 @@ class PrimaryExpAST : public CalcAST {
     int number;
     std::unique_ptr<BaseAST> lval;
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
-    bool calc_val(IRGenerator &irgen, int &result,
-                  bool calc_const) const override;
+    ~PrimaryExpAST() override { release_ast_children({&lval}); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
+    void _get_calc_children(
+        std::vector<const CalcAST *> &children) const override;
+    bool _calc_val(IRGenerator &irgen, int &result,
+                   bool calc_const) const override;
 };
 
+typedef enum {
+    LVAL_STAGE_VAL,    // load value of lval
+    LVAL_STAGE_LOAD,   // load from the pointer parsed
+    LVAL_STAGE_PTR,    // pointer of lval, then each index takes 2 stages
+} lval_stage_t;
+
 class LValAST : public CalcAST {
    public:
     std::string ident;
     std::vector<std::unique_ptr<BaseAST>> indexes;  // optional array indexes
 
-    void dump_koopa(IRGenerator &irgen, std::ostream &out) const override;
-    bool calc_val(IRGenerator &irgen, int &result,
-                  bool calc_const) const override;
-    // dump all pointer references, and put the pointer on stack_val
-    void dump_koopa_parse_indexes(IRGenerator &irgen, std::ostream &out) const;
+    ~LValAST() override { release_ast_children(indexes); }
+    void dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                         int stage) const override;
+    void _get_calc_children(
+        std::vector<const CalcAST *> &children) const override;
+    bool _calc_val(IRGenerator &irgen, int &result,
+                   bool calc_const) const override;
+    // schedule dumping all pointer references,
+    // which put the pointer on stack_val
+    void schedule_parse_indexes(IRGenerator &irgen) const;
 };
\ No newline at end of file
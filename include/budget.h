@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "arena.h"
+#include "koopa.h"
+
+// Size and CFG complexity of a function, measured before optimizing it
+class FunctionMetrics {
+   public:
+    std::string name;
+    int num_values = 0;  // insts and block params
+    int num_blocks = 0;
+    int loop_depth = 0;  // maximum loop nesting depth
+
+    FunctionMetrics() {}
+    // scratch data on arena, if any
+    FunctionMetrics(koopa_raw_function_t func, Arena *arena = nullptr);
+};
+
+typedef enum {
+    OPT_STAGE_CHEAP,      // linear in function size
+    OPT_STAGE_EXPENSIVE,  // superlinear or iterative
+} opt_stage_cost_t;
+
+typedef enum {
+    OPT_DECISION_RUN,
+    OPT_DECISION_THROTTLE,  // run with reduced effort, e.g. fewer iterations
+    OPT_DECISION_SKIP,
+} opt_decision_t;
+
+// Compile-time budget of expensive optimization stages.
+// Every decision is logged, and a log could be replayed to get the exact
+// same decisions, no matter how long the stages take this time.
+class OptBudget {
+   private:
+    // size limits of a function, above which expensive stages are skipped.
+    // Above half of them, or when loops nest too deep, they're throttled.
+    int max_values = 20000;
+    int max_blocks = 4000;
+    int max_loop_depth = 8;
+    // time limits in ms of all stages run so far, 0 for unlimited
+    int func_time_ms = 0;
+    int total_time_ms = 0;
+
+    FunctionMetrics metrics;
+    double func_used_ms = 0;
+    double total_used_ms = 0;
+    std::chrono::steady_clock::time_point stage_start;
+    bool is_stage_running = false;
+
+    std::ofstream log;
+    std::map<std::pair<std::string, std::string>, opt_decision_t> replay;
+
+    opt_decision_t _decide(std::string stage, opt_stage_cost_t cost,
+                           std::string &reason);
+
+   public:
+    void set_time_limits(int func_ms, int total_ms);
+    void open_log(std::string file);
+    void load_replay(std::string file);
+
+    // measure a function before running any stage on it
+    void begin_function(koopa_raw_function_t func, Arena *arena = nullptr);
+    const FunctionMetrics &get_metrics() { return metrics; }
+
+    // ask for running a stage on current function, charge its time on end
+    opt_decision_t begin_stage(std::string stage, opt_stage_cost_t cost);
+    void end_stage();
+};
+
+std::string to_opt_decision(opt_decision_t decision);
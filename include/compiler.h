@@ -0,0 +1,56 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "budget.h"
+#include "koopa_parser.h"
+#include "lexer.h"
+#include "regalloc.h"
+#include "stats.h"
+
+typedef enum {
+    COMPILE_KOOPA,
+    COMPILE_RISCV,
+    COMPILE_OBJECT,  // riscv encoded into an ELF relocatable
+} compile_mode_t;
+
+class CompileOptions {
+   public:
+    int opt_level = 0;
+    std::string pipeline;  // explicit one if has_pipeline, could be empty
+    bool has_pipeline = false;
+    bool verify = false;
+    // parse, lower and dump one top-level unit at a time
+    bool is_streaming = false;
+    lexer_kind_t lexer = LEXER_FAST;
+    // riscv straight from the AST, without koopa or any pass in between
+    bool is_fast_path = false;
+    // source is koopa text, e.g. of other tools, rather than SysY
+    bool is_koopa_input = false;
+    koopa_parser_kind_t koopa_parser = KOOPA_PARSER_LIBKOOPA;
+    // slot of every value, or registers of values in the backend
+    regalloc_kind_t regalloc = REGALLOC_NONE;
+    // reports to stderr
+    bool analyze_liveness = false;
+    bool analyze_ir = false;
+    bool print_pipeline = false;
+    bool time_passes = false;
+    // optional, owned by the caller
+    OptBudget *budget = nullptr;
+    CompileStats *stats = nullptr;
+    std::ostream *ir_dump = nullptr;
+};
+
+// Compile SysY source all in memory, with no files in between, so that
+// tools and tests could call it in process. Returns 0 with the koopa text,
+// assembly or object written to out, or 1 if the source doesn't parse or
+// the pipeline is wrong. Text is written unit by unit as it's lowered,
+// only an object is held until the end. Not reentrant, the lexers and
+// parser are global.
+int compile(std::string_view source, compile_mode_t mode, std::ostream &out,
+            const CompileOptions &options = CompileOptions());
+// the same, with all of the output in buffer
+int compile(std::string_view source, compile_mode_t mode, std::string &buffer,
+            const CompileOptions &options = CompileOptions());
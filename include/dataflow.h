@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "koopa.h"
+#include "value_index.h"
+
+// Dense bitset, operated 64 bits at a time
+class BitVector {
+   private:
+    std::vector<uint64_t> words;
+    int size = 0;
+
+   public:
+    BitVector() {}
+    BitVector(int size, bool value = false);
+
+    int get_size() const { return size; }
+    int get_num_words() const { return words.size(); }
+    uint64_t *get_words() { return words.data(); }
+    const uint64_t *get_words() const { return words.data(); }
+
+    bool test(int i) const { return words[i >> 6] >> (i & 63) & 1; }
+    void set(int i) { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+    void reset(int i) { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+    void fill(bool value);
+    int count() const;
+    // first set bit no less than i, -1 if none
+    int find_next(int i) const;
+
+    // return whether this is changed
+    bool union_with(const BitVector &other);
+    bool intersect_with(const BitVector &other);
+    bool operator==(const BitVector &other) const {
+        return size == other.size && words == other.words;
+    }
+};
+
+// Edges of a control flow graph, blocks are indexed from 0.
+// Solvers only see this, so any IR could build one.
+class BlockGraph {
+   protected:
+    // find rpo and reachable blocks after edges are filled
+    void _compute_order();
+
+   public:
+    int entry = 0;
+    ArenaVector<ArenaVector<int>> succs;
+    ArenaVector<ArenaVector<int>> preds;
+    // reverse postorder of reachable blocks, then unreachable ones
+    ArenaVector<int> rpo;
+    std::vector<bool> reachable;
+
+    // edges on the heap if arena is null
+    BlockGraph(Arena *arena = nullptr)
+        : succs(arena), preds(arena), rpo(arena) {}
+
+    int get_num_blocks() const { return succs.size(); }
+};
+
+typedef std::unordered_map<
+    koopa_raw_basic_block_t, int, std::hash<koopa_raw_basic_block_t>,
+    std::equal_to<koopa_raw_basic_block_t>,
+    ArenaAllocator<std::pair<const koopa_raw_basic_block_t, int>>>
+    block_index_t;
+
+// Control flow graph of a koopa function, blocks are indexed by their order
+// in the function, so that entry block is 0
+class FunctionCFG : public BlockGraph {
+   public:
+    ArenaVector<koopa_raw_basic_block_t> blocks;
+    block_index_t block_index;
+
+    FunctionCFG(koopa_raw_function_t func, Arena *arena = nullptr);
+};
+
+// Values read by an inst, including args passed to target blocks
+void get_koopa_raw_value_operands(koopa_raw_value_t value,
+                                  std::vector<koopa_raw_value_t> &operands);
+
+typedef enum {
+    DATAFLOW_FORWARD,
+    DATAFLOW_BACKWARD,
+} dataflow_direction_t;
+
+typedef enum {
+    DATAFLOW_MEET_UNION,      // may problems, e.g. liveness
+    DATAFLOW_MEET_INTERSECT,  // must problems, e.g. available expressions
+} dataflow_meet_t;
+
+// Gen/kill problem, each block transfers in its direction by
+// result = gen | (input & ~kill)
+class DataflowProblem {
+   public:
+    dataflow_direction_t direction;
+    dataflow_meet_t meet;
+    int num_bits;
+    std::vector<BitVector> gen;
+    std::vector<BitVector> kill;
+    // value flowing into entry block (forward) or out of exit blocks
+    // (backward)
+    BitVector boundary;
+
+    DataflowProblem(dataflow_direction_t direction, dataflow_meet_t meet,
+                    int num_blocks, int num_bits);
+};
+
+// Values at start and end of each block, in program order
+class DataflowResult {
+   public:
+    std::vector<BitVector> in;
+    std::vector<BitVector> out;
+    int num_visits = 0;  // blocks transferred until fixed point
+};
+
+DataflowResult solve_dataflow(const BlockGraph &cfg,
+                              const DataflowProblem &problem);
+
+// Values live at start and end of each block.
+// Block params are defined at start of their block, and args passed by a
+// branch or jump are used at end of its block. Only values used out of
+// their defining block get a bit, the others are never live across blocks.
+class Liveness {
+   private:
+    std::vector<int> value_bits;  // by value index, -1 if block local
+    std::vector<koopa_raw_value_t> bit_values;
+
+   public:
+    FunctionCFG cfg;
+    ValueIndex values;
+    DataflowResult result;
+
+    Liveness(koopa_raw_function_t func);
+
+    int get_num_bits() const { return bit_values.size(); }
+    koopa_raw_value_t get_value(int bit) const { return bit_values[bit]; }
+    int get_bit(koopa_raw_value_t val) const {
+        int i = values.get_index(val);
+        return i == -1 ? -1 : value_bits[i];
+    }
+    const BitVector &get_live_in(koopa_raw_basic_block_t bb) const {
+        return result.in[cfg.block_index.at(bb)];
+    }
+    const BitVector &get_live_out(koopa_raw_basic_block_t bb) const {
+        return result.out[cfg.block_index.at(bb)];
+    }
+};
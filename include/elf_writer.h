@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mir.h"
+
+// Relocatable RV32IM ELF object.
+// Functions are encoded from machine IR as they're done, and the object is
+// written out after the whole program.
+class ElfWriter {
+   private:
+    typedef enum {
+        ELF_SECTION_UNDEF,
+        ELF_SECTION_TEXT,
+        ELF_SECTION_DATA,
+    } elf_section_t;
+
+    class Symbol {
+       public:
+        std::string name;
+        elf_section_t section = ELF_SECTION_UNDEF;
+        uint32_t value = 0;
+        uint32_t size = 0;
+        bool is_func = false;
+    };
+
+    class Reloc {
+       public:
+        uint32_t offset;
+        uint32_t type;
+        int symbol;
+        bool is_label;  // symbol indexes pcrel_labels rather than globals
+    };
+
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+    std::vector<Symbol> globals;
+    std::map<std::string, int> global_index;
+    // text offsets of auipc, referred by pcrel lo12 relocations
+    std::vector<uint32_t> pcrel_labels;
+    std::vector<Reloc> relocs;
+    int cur_data = -1;
+
+    int _get_global(std::string name);
+    void _emit_text(uint32_t code);
+    void _emit_data(uint32_t word);
+    void _encode_inst(const MachineInst &inst, uint32_t pc, int size,
+                      const std::map<std::string, uint32_t> &labels);
+
+   public:
+    void add_function(const MachineFunction &func);
+    void begin_data(std::string name);
+    void append_data_word(int32_t word);
+    void append_data_zero(int size);
+    void write(std::ostream &out);
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "koopa.h"
+
+// Mutable SSA IR of koopa programs, which optimizations rewrite in place.
+// Values, uses and blocks of a function live in dense arrays and refer to
+// each other by index, so analyses keep their data in plain arrays as well.
+// Insts of a block and blocks of a function are linked through these
+// indexes, and each value links all its uses, so that inserting, removing
+// and replacing insts take constant time.
+
+// Types are hash-consed in a table, equal types have equal ids
+class IRType {
+   public:
+    koopa_raw_type_tag_t tag;
+    int base = -1;            // elem of array, pointee, or ret of function
+    int len = 0;              // array length
+    std::vector<int> params;  // function params
+    int size = 0;             // in bytes, -1 for functions
+};
+
+class IRTypeTable {
+   private:
+    std::vector<IRType> types;
+    // int32 and unit are looked up most, others by their fields
+    int int32_id = -1;
+    int unit_id = -1;
+    std::unordered_map<uint64_t, int> ids;
+    std::map<std::vector<int>, int> function_ids;
+
+    int _insert(const IRType &type);
+
+   public:
+    int get_int32();
+    int get_unit();
+    int get_array(int base, int len);
+    int get_pointer(int base);
+    int get_function(std::vector<int> params, int ret);
+
+    const IRType &get(int id) const { return types[id]; }
+    int get_size(int id) const {  // in bytes
+        assert(types[id].size >= 0);
+        return types[id].size;
+    }
+    std::string to_string(int id) const;
+};
+
+// Initializer of a global alloc, an integer, zeroinit or aggregate
+class IRInit {
+   public:
+    koopa_raw_value_tag_t tag;
+    int type;
+    int value = 0;
+    std::vector<IRInit> elems;
+};
+
+class IRGlobal {
+   public:
+    std::string name;
+    int type;  // allocated type, the global itself is a pointer to it
+    IRInit init;
+};
+
+// An operand of an inst, linked in the use list of its value
+class IRUse {
+   public:
+    int user;
+    int value;  // -1 if the use is freed
+    int prev = -1;
+    int next = -1;
+};
+
+// Operands of insts, in order:
+//   load: src             store: value, dest
+//   get_ptr: src, index   get_elem_ptr: src, index
+//   binary: lhs, rhs      branch: cond, true args, false args
+//   jump: args            call: args
+//   return: value if any
+class IRValue {
+   public:
+    koopa_raw_value_tag_t tag;
+    int type;          // unit if the value has no result
+    std::string name;  // empty if unnamed
+    int block = -1;    // parent block of insts and block args
+    int prev = -1;     // sibling insts in block
+    int next = -1;
+    int first_use = -1;
+    std::vector<int> operands;  // uses by this value
+    // integer, binary op, index of arg, global, init, or callee function
+    int data = 0;
+    int targets[2] = {-1, -1};  // blocks of branch, or jump
+    int num_true_args = 0;
+    bool is_removed = false;
+};
+
+class IRBlock {
+   public:
+    std::string name;
+    std::vector<int> params;  // block args
+    int first_inst = -1;
+    int last_inst = -1;
+    int prev = -1;  // sibling blocks in function
+    int next = -1;
+    bool is_removed = false;
+};
+
+class IRFunction {
+   private:
+    // constants and globals used by this function, one value each
+    std::unordered_map<int, int> integers;
+    std::unordered_map<int, int> global_refs;
+    std::unordered_map<int, int> undefs;  // by type
+    std::vector<int> free_uses;
+
+    void _link_use(int use);
+    void _unlink_use(int use);
+
+   public:
+    std::string name;
+    int type;
+    IRTypeTable *types;
+    std::vector<int> params;  // func args
+    std::vector<IRValue> values;
+    std::vector<IRUse> uses;
+    std::vector<IRBlock> blocks;
+    std::vector<IRInit> inits;  // zeroinit and aggregates stored to allocs
+    int first_block = -1;  // entry
+    int last_block = -1;
+
+    IRFunction(std::string name, int type, IRTypeTable *types)
+        : name(name), type(type), types(types) {}
+    bool is_decl() const { return first_block == -1; }
+
+    // new values and blocks are out of any list until inserted
+    int new_value(koopa_raw_value_tag_t tag, int type, std::string name = "");
+    int new_block(std::string name = "");
+    int get_integer(int value);
+    int get_global(int global, int type);
+    int get_undef(int type);
+    int new_init(const IRInit &init);
+
+    // operands
+    int get_operand(int inst, int i) const {
+        return uses[values[inst].operands[i]].value;
+    }
+    int get_num_operands(int inst) const {
+        return values[inst].operands.size();
+    }
+    void add_operand(int inst, int value);
+    void set_operand(int inst, int i, int value);
+    void drop_operands(int inst);
+    int get_num_uses(int value) const;
+    // move all uses of from to to, from is left unused
+    void replace_all_uses_with(int from, int to);
+
+    // inst lists
+    void append_inst(int block, int inst);
+    void insert_inst_before(int before, int inst);
+    // unlink inst from its block and drop its operands, it must be unused
+    void remove_inst(int inst);
+    int get_terminator(int block) const { return blocks[block].last_inst; }
+
+    // block list
+    void append_block(int block);
+    void insert_block_after(int after, int block);
+    // unlink block and remove its insts and args, they must be unused
+    void remove_block(int block);
+    void get_succs(int block, ArenaVector<int> &succs) const;
+    int get_num_blocks() const { return blocks.size(); }
+    int get_num_values() const { return values.size(); }
+};
+
+class IRProgram {
+   public:
+    IRTypeTable types;
+    std::vector<IRGlobal> globals;
+    std::vector<IRFunction> funcs;
+
+    IRProgram() {}
+    // functions refer to types of the program
+    IRProgram(const IRProgram &) = delete;
+    IRProgram &operator=(const IRProgram &) = delete;
+
+    // see ir_koopa.cpp
+    void build(const koopa_raw_program_t &raw);
+    void print(std::ostream &out) const;
+};
@@ -2,13 +2,56 @@
 
 #include <cassert>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <set>
 #include <stack>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "koopa.h"
+
+typedef enum {
+    KOOPA_TYPE_INT32,
+    KOOPA_TYPE_ARRAY,
+    KOOPA_TYPE_POINTER,
+} koopa_type_tag_t;
+
+// Type of a symbol, created only by TypeTable, so that equal types are
+// the same object and compare by pointers
+class KoopaType {
+   public:
+    koopa_type_tag_t tag;
+    const KoopaType *base = nullptr;  // elem of array, or pointee
+    int len = 0;                      // array length
+    int size;                         // in bytes
+    int stride = 0;   // bytes stepped by an index of getelemptr or getptr
+    std::string str;  // in koopa, like [[i32, 3], 4]
+};
+
+class TypeTable {
+   private:
+    std::deque<KoopaType> types;  // never moved
+    const KoopaType *int32;
+    std::map<std::pair<const KoopaType *, int>, const KoopaType *> arrays;
+    std::map<const KoopaType *, const KoopaType *> pointers;
+
+   public:
+    TypeTable();
+    TypeTable(const TypeTable &) = delete;
+    TypeTable &operator=(const TypeTable &) = delete;
+
+    const KoopaType *get_int32() const { return int32; }
+    const KoopaType *get_array(const KoopaType *base, int len);
+    const KoopaType *get_pointer(const KoopaType *base);
+    // nested arrays of dims, outermost first, or elem itself if no dims
+    const KoopaType *get_array(const KoopaType *elem,
+                               const std::vector<int> &dims);
+};
+
 typedef enum {
     SYMBOL_TABLE_ENTRY_VAR,
     SYMBOL_TABLE_ENTRY_FUNC,
@@ -28,8 +71,7 @@ class SymbolTableEntry {
     std::string func_type;                // void or int
     std::vector<bool> is_func_param_ptr;  // func array type
     // array
-    std::vector<int> array_size;  // could be empty
-    bool is_ptr;                  // only occurs for array func param
+    const KoopaType *array_type;  // pointer for array func param
 };
 
 typedef std::map<std::string, SymbolTableEntry> symbol_table_block_t;
@@ -38,20 +80,31 @@ class SymbolTable {
    private:
     symbol_table_block_t global_table;
     std::vector<symbol_table_block_t> block_stack;  // local
+    // local entries of each name in block_stack, the innermost last,
+    // so that a lookup needn't walk every block nested deeply
+    std::unordered_map<std::string, std::vector<SymbolTableEntry *>>
+        local_entries;
     std::map<std::string, int> alias_cnt;
+    // streaming mode: koopa decls of global symbols,
+    // and global symbols used since last get_used_global_decls
+    std::map<std::string, std::string> global_decls;
+    std::set<std::string> used_globals;
 
     int _get_alias(std::string name);
     bool _get_local_table(symbol_table_block_t *&table);
     bool _get_entry(std::string name, SymbolTableEntry *&entry);
+    void _insert_entry(symbol_table_block_t *table, bool is_local,
+                       std::string name, const SymbolTableEntry &entry);
 
    public:
+    TypeTable types;
+
     // insert new entry
     void insert_var_entry(std::string name);
     void insert_const_var_entry(std::string name, int val);
     void insert_func_entry(std::string name, std::string func_type,
                            std::vector<bool> is_func_param_ptr);
-    void insert_array_entry(std::string name, std::vector<int> array_size,
-                            bool is_ptr = false);
+    void insert_array_entry(std::string name, const KoopaType *array_type);
 
     // get entry info
     bool is_global_symbol_table();
@@ -63,11 +116,15 @@ class SymbolTable {
     std::string get_func_entry_type(std::string name);
     bool is_func_param_ptr(std::string name, int index);
     bool is_ptr_array_entry(std::string name);
-    std::string get_array_entry_type(std::string name);
+    const KoopaType *get_array_entry_type(std::string name);
 
     // basic block stacking
     void push_block();
     void pop_block();
+
+    // streaming mode: declare global symbols used by the current unit
+    void insert_global_decl(std::string name, std::string decl);
+    std::string get_used_global_decls();
 };
 
 typedef enum {
@@ -100,12 +157,100 @@ class BasicBlockInfo {
           dst_continue(dst_continue) {}
 };
 
+// Target of the lowering from AST. Values are named as in koopa, like %3,
+// %x_0, @g or an integer, so are blocks like %bb_2, functions by idents.
+class IREmitter {
+   public:
+    typedef std::vector<std::pair<std::string, const KoopaType *>> params_t;
+
+    virtual ~IREmitter() = default;
+
+    virtual void lib_decl(std::ostream &out, const std::string &decl) = 0;
+    // init has every int32 of the global, zeroinit if it's empty
+    virtual void global_alloc(std::ostream &out, const std::string &name,
+                              const KoopaType *type,
+                              const std::vector<int> &init) = 0;
+    virtual void func_begin(std::ostream &out, const std::string &name,
+                            const params_t &params, bool is_int) = 0;
+    virtual void func_end(std::ostream &out) = 0;
+    virtual void block(std::ostream &out, const std::string &name) = 0;
+
+    virtual void alloc(std::ostream &out, const std::string &name,
+                       const KoopaType *type) = 0;
+    virtual void load(std::ostream &out, const std::string &dst,
+                      const std::string &src) = 0;
+    virtual void store(std::ostream &out, const std::string &val,
+                       const std::string &dst) = 0;
+    // every int32 of a local array
+    virtual void store_init(std::ostream &out, const std::string &dst,
+                            const KoopaType *type,
+                            const std::vector<int> &init) = 0;
+    virtual void get_ptr(std::ostream &out, const std::string &dst,
+                         const std::string &src,
+                         const std::string &index) = 0;
+    virtual void get_elem_ptr(std::ostream &out, const std::string &dst,
+                              const std::string &src,
+                              const std::string &index) = 0;
+    virtual void binary(std::ostream &out, const std::string &dst,
+                        koopa_raw_binary_op_t op, const std::string &lhs,
+                        const std::string &rhs) = 0;
+    // dst and val are empty for void
+    virtual void call(std::ostream &out, const std::string &dst,
+                      const std::string &func,
+                      const std::vector<std::string> &args) = 0;
+    virtual void branch(std::ostream &out, const std::string &cond,
+                        const std::string &true_bb,
+                        const std::string &false_bb) = 0;
+    virtual void jump(std::ostream &out, const std::string &target) = 0;
+    virtual void ret(std::ostream &out, const std::string &val) = 0;
+};
+
+// Koopa text, which is parsed again by the backend
+class KoopaEmitter : public IREmitter {
+   public:
+    void lib_decl(std::ostream &out, const std::string &decl) override;
+    void global_alloc(std::ostream &out, const std::string &name,
+                      const KoopaType *type,
+                      const std::vector<int> &init) override;
+    void func_begin(std::ostream &out, const std::string &name,
+                    const params_t &params, bool is_int) override;
+    void func_end(std::ostream &out) override;
+    void block(std::ostream &out, const std::string &name) override;
+
+    void alloc(std::ostream &out, const std::string &name,
+               const KoopaType *type) override;
+    void load(std::ostream &out, const std::string &dst,
+              const std::string &src) override;
+    void store(std::ostream &out, const std::string &val,
+               const std::string &dst) override;
+    void store_init(std::ostream &out, const std::string &dst,
+                    const KoopaType *type,
+                    const std::vector<int> &init) override;
+    void get_ptr(std::ostream &out, const std::string &dst,
+                 const std::string &src, const std::string &index) override;
+    void get_elem_ptr(std::ostream &out, const std::string &dst,
+                      const std::string &src,
+                      const std::string &index) override;
+    void binary(std::ostream &out, const std::string &dst,
+                koopa_raw_binary_op_t op, const std::string &lhs,
+                const std::string &rhs) override;
+    void call(std::ostream &out, const std::string &dst,
+              const std::string &func,
+              const std::vector<std::string> &args) override;
+    void branch(std::ostream &out, const std::string &cond,
+                const std::string &true_bb,
+                const std::string &false_bb) override;
+    void jump(std::ostream &out, const std::string &target) override;
+    void ret(std::ostream &out, const std::string &val) override;
+};
+
 class ControlFlow {
    private:
     std::map<std::string, BasicBlockInfo> cfg;
 
    public:
     std::string cur_block = "";
+    IREmitter *emitter = nullptr;  // of labels and jumps
 
     // inserting new blocks
     void insert_if(std::string name_then, std::string name_end);
@@ -123,6 +268,18 @@ class ControlFlow {
     basic_block_ending_status_t check_ending_status();
     void modify_ending_status(basic_block_ending_status_t status);
     void add_control_edge(std::string dst, std::string src = "");
+
+    // drop all the blocks after finishing a function
+    void reset();
+};
+
+class StepAST;
+
+// A pending step of lowering some AST node
+class LoweringTask {
+   public:
+    const StepAST *ast;
+    int stage;
 };
 
 // Save information when generating koopa IR
@@ -130,15 +287,26 @@ class IRGenerator {
    private:
     int cnt_val;
     int cnt_block;
+    KoopaEmitter koopa_emitter;
 
    public:
     IRGenerator() {
         cnt_val = 0;
         cnt_block = 0;
+        set_emitter(&koopa_emitter);
     }
+    IRGenerator(const IRGenerator &) = delete;
+    IRGenerator &operator=(const IRGenerator &) = delete;
     std::stack<std::string> stack_val;  // parse exp
+    std::vector<LoweringTask> tasks;    // steps of stmts and exps, LIFO
     SymbolTable symbol_table;
     ControlFlow control_flow;
+    IREmitter *emitter;  // koopa text by default
+
+    void set_emitter(IREmitter *emitter) {
+        this->emitter = emitter;
+        control_flow.emitter = emitter;
+    }
 
     std::string new_val() {
         auto val = cnt_val++;
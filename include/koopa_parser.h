@@ -0,0 +1,118 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "koopa.h"
+
+typedef enum {
+    KOOPA_PARSER_LIBKOOPA,
+    KOOPA_PARSER_NATIVE,
+} koopa_parser_kind_t;
+
+// Names to pointers by open addressing, only the slots used are cleared,
+// so that it keeps its memory from one function to the next
+class KoopaSymbolMap {
+   private:
+    std::vector<std::string_view> keys;  // empty if the slot is free
+    std::vector<const void *> values;
+    std::vector<size_t> used_slots;
+
+    size_t _find_slot(std::string_view name) const;
+    void _grow();
+
+   public:
+    KoopaSymbolMap() : keys(64), values(64, nullptr) {}
+
+    // nullptr if name isn't there
+    const void *find(std::string_view name) const {
+        return values[_find_slot(name)];
+    }
+    // false if name is there already
+    bool insert(std::string_view name, const void *value);
+    void clear();
+};
+
+// Single pass parser of koopa text, building the raw program of libkoopa
+// straight on an arena, without the program of libkoopa in between.
+// Blocks and functions could be used before they're defined, values not.
+// used_by slices are left empty, the backend never reads them.
+class KoopaParser {
+   private:
+    Arena arena;  // of the program parsed last
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    int line = 1;
+    std::string error;
+
+    koopa_raw_type_t int32_type = nullptr;
+    koopa_raw_type_t unit_type = nullptr;
+    std::unordered_map<koopa_raw_type_t, koopa_raw_type_t> pointer_types;
+    std::map<std::pair<koopa_raw_type_t, size_t>, koopa_raw_type_t>
+        array_types;
+
+    // names are views into the text
+    KoopaSymbolMap globals;
+    KoopaSymbolMap funcs;
+    KoopaSymbolMap locals;
+    KoopaSymbolMap blocks;
+    int num_undefined_blocks = 0;  // used by branches, not parsed yet
+    // calls to functions not defined yet, typed at the end, or checked
+    // if they're named and typed i32 already
+    std::vector<koopa_raw_value_data_t *> pending_calls;
+
+    // items of the slices being parsed, nested ones are pushed on top
+    std::vector<const void *> items;
+    std::vector<const void *> func_blocks;
+    std::vector<const void *> program_values;
+    std::vector<const void *> program_funcs;
+
+    bool _fail(const std::string &msg);
+    void _skip_space();
+    bool _eat(char c);
+    bool _expect(char c);
+    bool _eat_word(std::string_view word);
+    std::string_view _read_word();
+    std::string_view _read_symbol();
+    bool _read_int(int32_t &value);
+    bool _is_block_label();
+
+    const char *_copy_name(std::string_view name);
+    koopa_raw_slice_t _make_slice(size_t mark,
+                                  koopa_raw_slice_item_kind_t kind);
+    koopa_raw_slice_t _make_slice(std::vector<const void *> &list,
+                                  koopa_raw_slice_item_kind_t kind);
+    koopa_raw_value_data_t *_new_value(koopa_raw_type_t ty,
+                                       koopa_raw_value_tag_t tag);
+    koopa_raw_basic_block_data_t *_get_block(std::string_view name);
+    koopa_raw_function_data_t *_get_func(std::string_view name);
+
+    koopa_raw_type_t _get_pointer(koopa_raw_type_t base);
+    koopa_raw_type_t _get_array(koopa_raw_type_t base, size_t len);
+    koopa_raw_type_t _parse_type();
+    koopa_raw_value_t _parse_value(koopa_raw_type_t ty);
+    koopa_raw_value_t _parse_init(koopa_raw_type_t ty);
+    void _set_init_type(koopa_raw_value_t init, koopa_raw_type_t ty);
+    bool _parse_args(koopa_raw_slice_t &args, koopa_raw_slice_t params);
+
+    bool _parse_global();
+    bool _parse_func(bool is_decl);
+    bool _parse_block();
+    koopa_raw_value_t _parse_inst(std::string_view name, bool &is_end);
+
+   public:
+    KoopaParser() = default;
+    KoopaParser(const KoopaParser &) = delete;
+    KoopaParser &operator=(const KoopaParser &) = delete;
+
+    // raw is valid until the next parse, false with a message in err
+    // if text isn't a valid koopa program
+    bool parse(std::string_view text, koopa_raw_program_t &raw,
+               std::ostream &err);
+};
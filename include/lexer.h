@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+// Hand-written lexer giving the same tokens, values and line numbers as
+// the flex one in sysy.l. Whitespace, comment bodies and identifiers are
+// scanned a block of bytes at a time, 32 with AVX2, 16 with SSE2, or 8
+// by plain comparisons of each byte otherwise.
+class FastLexer {
+   private:
+    std::vector<char> buf;  // whole input, then zeros of a block at least
+    const char *cur = nullptr;
+    const char *end = nullptr;
+
+    const char *_skip_whitespace(const char *p);
+    const char *_skip_line_comment(const char *p);
+    const char *_skip_block_comment(const char *p);
+    const char *_skip_ident(const char *p);
+    void _pad();
+
+   public:
+    // read all of in, from where it is now
+    void load(FILE *in);
+    void load(std::string_view source);
+    // next token like yylex, 0 at the end, sets yylval and yylineno
+    int lex();
+};
+
+typedef enum {
+    LEXER_FLEX,
+    LEXER_FAST,
+} lexer_kind_t;
+
+// which lexer yylex goes to, fast one reads all of yyin at once
+void set_lexer(lexer_kind_t kind);
+// lex source instead of yyin from line 1, it has to outlive the parse
+void set_lexer_source(std::string_view source);
+// lex all of in with both lexers, and report the first difference
+bool check_lexers(FILE *in, std::ostream &err);
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+
+// RISC-V integer registers, numbered as they're encoded
+typedef enum {
+    REG_ZERO,
+    REG_RA,
+    REG_SP,
+    REG_GP,
+    REG_TP,
+    REG_T0,
+    REG_T1,
+    REG_T2,
+    REG_S0,
+    REG_S1,
+    REG_A0,
+    REG_A1,
+    REG_A2,
+    REG_A3,
+    REG_A4,
+    REG_A5,
+    REG_A6,
+    REG_A7,
+    REG_S2,
+    REG_S3,
+    REG_S4,
+    REG_S5,
+    REG_S6,
+    REG_S7,
+    REG_S8,
+    REG_S9,
+    REG_S10,
+    REG_S11,
+    REG_T3,
+    REG_T4,
+    REG_T5,
+    REG_T6,
+    REG_NONE,
+} riscv_reg_t;
+
+typedef enum {
+    // rd, rs1, rs2
+    RV_ADD,
+    RV_SUB,
+    RV_MUL,
+    RV_DIV,
+    RV_REM,
+    RV_AND,
+    RV_OR,
+    RV_XOR,
+    RV_SLL,
+    RV_SRL,
+    RV_SRA,
+    RV_SLT,
+    RV_SGT,
+    // rd, rs1
+    RV_SEQZ,
+    RV_SNEZ,
+    RV_MV,
+    // rd, rs1, imm
+    RV_ADDI,
+    RV_XORI,
+    // rd, imm
+    RV_LI,
+    // rd, imm(rs1)
+    RV_LW,
+    // rs2, imm(rs1)
+    RV_SW,
+    // rd, symbol
+    RV_LA,
+    // rs1, symbol
+    RV_BNEZ,
+    RV_BEQZ,
+    // symbol
+    RV_J,
+    RV_CALL,
+    // no operand
+    RV_RET,
+} riscv_opcode_t;
+
+class MachineInst {
+   public:
+    riscv_opcode_t op;
+    riscv_reg_t rd = REG_NONE;
+    riscv_reg_t rs1 = REG_NONE;
+    riscv_reg_t rs2 = REG_NONE;
+    int imm = 0;
+    // label, function or global name, owned by koopa raw program
+    const char *symbol = nullptr;
+
+    MachineInst(riscv_opcode_t op) : op(op) {}
+};
+
+class MachineBlock {
+   public:
+    const char *label;  // nullptr for prologue
+    ArenaVector<MachineInst> insts;
+
+    MachineBlock(const char *label, Arena *arena = nullptr)
+        : label(label), insts(arena) {}
+};
+
+class MachineFunction {
+   public:
+    const char *name = nullptr;
+    std::vector<MachineBlock> blocks;
+    Arena *arena = nullptr;  // of insts and scratch data of passes, if any
+};
+
+std::string to_riscv_reg(riscv_reg_t reg);
+std::string to_riscv_opcode(riscv_opcode_t op);
+// whether op writes rd
+bool has_riscv_rd(riscv_opcode_t op);
+void print_machine_function(const MachineFunction &func, std::ostream &out);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "budget.h"
+#include "koopa.h"
+#include "mir.h"
+
+typedef enum {
+    PASS_IR,       // on SSA IR, which is rebuilt into koopa raw program
+    PASS_KOOPA,    // on koopa raw function, before lowering
+    PASS_MACHINE,  // on machine function, before printing or encoding
+} pass_kind_t;
+
+// An optimization on one function, returns whether it changed anything.
+// IR passes return a mask of ir_change_t instead, to keep analyses which
+// are still valid.
+class Pass {
+   public:
+    const char *name;
+    pass_kind_t kind;
+    opt_stage_cost_t cost;
+    int (*run_ir)(IRFunction &func, AnalysisManager &analyses);
+    bool (*run_koopa)(koopa_raw_function_t func);
+    bool (*run_machine)(MachineFunction &func);
+};
+
+// Runs a pipeline of passes on every function.
+// Passes are asked from the budget as stages, and timed over the program.
+class PassManager {
+   private:
+    class PassStats {
+       public:
+        int runs = 0;
+        int changes = 0;
+        double ms = 0;
+    };
+
+    std::vector<const Pass *> pipeline;
+    std::vector<PassStats> stats;  // by pipeline position
+    PassStats verify_stats;
+    // work around passes, e.g. building the IR, in order of first record
+    std::vector<std::pair<std::string, PassStats>> other_stats;
+    int opt_level = 0;
+    bool verify = false;
+    OptBudget *budget = nullptr;
+
+    void _run_pass(int i, koopa_raw_function_t kfunc, MachineFunction *mfunc);
+    void _run_ir_pass(int i, IRFunction &func, AnalysisManager &analyses);
+    void _verify(const char *after, koopa_raw_function_t kfunc,
+                 const MachineFunction *mfunc);
+    void _verify_ir(const char *after, const IRFunction &func);
+
+   public:
+    // default pipeline of -O0, -O1 or -O2
+    void set_opt_level(int level);
+    // comma separated pass names, false if any name is unknown
+    bool set_pipeline(std::string names);
+    // check the function after every pass of its kind
+    void set_verify(bool value) { verify = value; }
+    void set_budget(OptBudget *budget) { this->budget = budget; }
+
+    // whether the program has to be rebuilt through the IR
+    bool has_ir_passes();
+    void run_ir_passes(IRFunction &func);
+    void run_koopa_passes(koopa_raw_function_t func);
+    void run_machine_passes(MachineFunction &func);
+    // time of other work, shown along with passes
+    void record_time(std::string name, double ms, int runs = 1);
+
+    void print_pipeline(std::ostream &out);
+    void print_timing(std::ostream &out);
+};
+
+// all known passes, nullptr if not found
+const Pass *find_pass(std::string name);
+
+// checkers, report the first problem found to err and return false
+bool verify_ir_function(const IRFunction &func, std::ostream &err);
+bool verify_koopa_raw_function(koopa_raw_function_t func, std::ostream &err);
+bool verify_machine_function(const MachineFunction &func, std::ostream &err);
+
+// IR passes, see ir_opt.cpp
+int promote_allocs(IRFunction &func, AnalysisManager &analyses);
+int eliminate_common_subexpressions(IRFunction &func,
+                                    AnalysisManager &analyses);
+int eliminate_dead_code(IRFunction &func, AnalysisManager &analyses);
+int propagate_constants(IRFunction &func, AnalysisManager &analyses);
+
+// machine passes, see machine_opt.cpp
+bool forward_stack_loads(MachineFunction &func);
+bool run_peephole(MachineFunction &func);
+bool fold_fallthrough_jumps(MachineFunction &func);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "koopa.h"
+#include "mir.h"
+#include "value_index.h"
+
+typedef enum {
+    REGALLOC_NONE,  // every value in a stack slot of its own
+    REGALLOC_LINEAR_SCAN,
+    REGALLOC_GRAPH_COLORING,  // slower, with fewer spills and moves
+} regalloc_kind_t;
+
+// Registers of values of a function, decided before lowering it.
+// Values without one are spilled, and live in stack slots as before.
+class RegisterAssignment {
+   public:
+    ValueIndex values;
+    std::vector<riscv_reg_t> regs;  // by value number, REG_NONE if spilled
+    // callee-saved registers taken, to be saved by the prologue
+    std::vector<riscv_reg_t> saved_regs;
+    int num_spilled = 0;
+    int num_coalesced = 0;  // moves whose ends share a register
+
+    // REG_NONE if val is spilled or isn't numbered
+    riscv_reg_t get_reg(koopa_raw_value_t val) const {
+        int i = values.get_index(val);
+        return i == -1 ? REG_NONE : regs[i];
+    }
+    bool is_spilled(koopa_raw_value_t val) const {
+        int i = values.get_index(val);
+        return i != -1 && regs[i] == REG_NONE;
+    }
+};
+
+// Live range of a value over insts in layout order, without holes.
+// Operands of an inst are used at an even position and its result is
+// defined right after, so that the result could take the register of an
+// operand which dies there.
+class LiveInterval {
+   public:
+    int value;  // number in ValueIndex
+    int start;
+    int end;
+    bool is_call_crossed = false;  // live through a call
+    bool is_call_arg = false;      // dies at a call, which reads it
+    riscv_reg_t reg = REG_NONE;
+};
+
+// Registers t0-t2 and t6 are left to lowering as scratch
+void allocate_registers_linear_scan(koopa_raw_function_t func,
+                                    RegisterAssignment &assignment);
+// Iterated register coalescing, spill costs weighted by loop depth
+void allocate_registers_graph_coloring(koopa_raw_function_t func,
+                                       RegisterAssignment &assignment);
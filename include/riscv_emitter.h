@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "elf_writer.h"
+#include "irgen.h"
+#include "mir.h"
+
+typedef enum {
+    EMITTED_VALUE_FRAME,   // address s0 + offset, of an alloc
+    EMITTED_VALUE_SLOT,    // in the word at s0 + offset
+    EMITTED_VALUE_GLOBAL,  // address of symbol
+    EMITTED_VALUE_PARAM,   // offset-th param of the function
+} emitted_value_tag_t;
+
+class EmittedValue {
+   public:
+    emitted_value_tag_t tag;
+    const KoopaType *ty;
+    int offset = 0;
+    const char *symbol = nullptr;
+};
+
+// RISC-V straight from the AST, for -O0-fast.
+// Values live in slots below s0, so the frame length is only needed by
+// the prologue, which is filled in at the end of the function. There's
+// no koopa text, no parsing and no StackFrame scan in between.
+class RiscvEmitter : public IREmitter {
+   private:
+    TypeTable &types;
+    ElfWriter *elf;  // assembly text if null
+    Arena arena;     // of the current function
+    MachineFunction mfunc;
+    // named as in koopa, globals are kept from one function to the next
+    std::unordered_map<std::string, EmittedValue> globals;
+    std::unordered_map<std::string, EmittedValue> locals;
+    int frame_length = 0;  // below s0
+    int max_stack_args = 0;
+
+    const char *_copy_symbol(const char *name);
+    const EmittedValue &_find(const std::string &name);
+    const EmittedValue &_new_slot(const std::string &name,
+                                  const KoopaType *ty);
+
+    void _dump_inst(riscv_opcode_t op, riscv_reg_t rd = REG_NONE,
+                    riscv_reg_t rs1 = REG_NONE, riscv_reg_t rs2 = REG_NONE);
+    void _dump_inst(riscv_opcode_t op, riscv_reg_t reg, riscv_reg_t base,
+                    int imm);
+    void _dump_inst(riscv_opcode_t op, riscv_reg_t rd, int imm);
+    void _dump_inst(riscv_opcode_t op, riscv_reg_t reg, const char *symbol);
+    void _dump_inst(riscv_opcode_t op, const char *symbol);
+    void _dump_frame_addr(riscv_reg_t reg, int offset);
+    void _dump_lw(riscv_reg_t reg, int offset);
+    void _dump_sw(riscv_reg_t reg, int offset);
+    void _dump_add_imm(riscv_reg_t reg, int imm);
+    void _load_value(const std::string &name, riscv_reg_t reg);
+    void _dump_ptr(const std::string &dst, const std::string &src,
+                   const std::string &index, int stride,
+                   const KoopaType *ty);
+
+   public:
+    RiscvEmitter(TypeTable &types, ElfWriter *elf = nullptr)
+        : types{types}, elf{elf} {}
+
+    void lib_decl(std::ostream &out, const std::string &decl) override {}
+    void global_alloc(std::ostream &out, const std::string &name,
+                      const KoopaType *type,
+                      const std::vector<int> &init) override;
+    void func_begin(std::ostream &out, const std::string &name,
+                    const params_t &params, bool is_int) override;
+    void func_end(std::ostream &out) override;
+    void block(std::ostream &out, const std::string &name) override;
+
+    void alloc(std::ostream &out, const std::string &name,
+               const KoopaType *type) override;
+    void load(std::ostream &out, const std::string &dst,
+              const std::string &src) override;
+    void store(std::ostream &out, const std::string &val,
+               const std::string &dst) override;
+    void store_init(std::ostream &out, const std::string &dst,
+                    const KoopaType *type,
+                    const std::vector<int> &init) override;
+    void get_ptr(std::ostream &out, const std::string &dst,
+                 const std::string &src, const std::string &index) override;
+    void get_elem_ptr(std::ostream &out, const std::string &dst,
+                      const std::string &src,
+                      const std::string &index) override;
+    void binary(std::ostream &out, const std::string &dst,
+                koopa_raw_binary_op_t op, const std::string &lhs,
+                const std::string &rhs) override;
+    void call(std::ostream &out, const std::string &dst,
+              const std::string &func,
+              const std::vector<std::string> &args) override;
+    void branch(std::ostream &out, const std::string &cond,
+                const std::string &true_bb,
+                const std::string &false_bb) override;
+    void jump(std::ostream &out, const std::string &target) override;
+    void ret(std::ostream &out, const std::string &val) override;
+};
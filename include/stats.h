@@ -0,0 +1,42 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "koopa.h"
+#include "mir.h"
+
+// Code quality numbers of one function
+class FunctionStats {
+   public:
+    std::string name;
+    int koopa_insts = 0;
+    int koopa_blocks = 0;
+    int frame_length = 0;
+    int spilled_values = 0;  // left in slots by register allocation
+    int coalesced_moves = 0;
+    // emitted by lowering, before machine passes
+    int stack_loads = 0;
+    int stack_stores = 0;
+    int large_offsets = 0;  // offsets out of imm12, addressed through t6
+    // final code, pseudo instructions are counted as they're printed
+    int insts = 0;
+    std::map<std::string, int> mnemonics;
+
+    void add(const FunctionStats &other);
+};
+
+// Statistics of all functions, dumped as json after compiling
+class CompileStats {
+   private:
+    std::vector<FunctionStats> functions;
+
+   public:
+    void begin_function(koopa_raw_function_t func);
+    FunctionStats &get_current() { return functions.back(); }
+    void end_function(const MachineFunction &func);
+
+    void dump_json(std::ostream &out);
+};
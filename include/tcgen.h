@@ -1,65 +1,31 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <set>
+#include <sstream>
 #include <stack>
 #include <utility>
 #include <vector>
 
+#include "budget.h"
+#include "dataflow.h"
+#include "elf_writer.h"
+#include "ir.h"
 #include "koopa.h"
+#include "koopa_parser.h"
+#include "mir.h"
+#include "pass.h"
+#include "regalloc.h"
+#include "stats.h"
+#include "value_index.h"
 
 class TargetCodeGenerator;
 
-class RegisterInfo {
-   public:
-    koopa_raw_value_t val;
-    RegisterInfo() : val(nullptr) {}
-};
-
-class RegisterFile {
-   private:
-    std::map<std::string, RegisterInfo> user_regs;
-
-   public:
-    RegisterFile() {
-        // innitialize user regs
-        for (int i = 0; i <= 7; i++) {
-            std::string name = "a" + std::to_string(i);
-            user_regs.insert(std::make_pair(name, RegisterInfo()));
-        }
-        for (int i = 0; i <= 6; i++) {
-            std::string name = "t" + std::to_string(i);
-            user_regs.insert(std::make_pair(name, RegisterInfo()));
-        }
-    }
-
-    bool exist_value(koopa_raw_value_t val) {
-        for (auto &e : user_regs)
-            if (e.second.val == val) return true;
-        return false;
-    }
-
-    std::string get_reg(koopa_raw_value_t val) {
-        for (auto &e : user_regs)
-            if (e.second.val == val) return e.first;
-        assert(false);
-    }
-
-    koopa_raw_value_t read_value(std::string reg) {
-        for (auto &e : user_regs)
-            if (e.first == reg) return e.second.val;
-        return nullptr;
-    }
-
-    void write_value(std::string reg, koopa_raw_value_t val) {
-        auto it = user_regs.find(reg);
-        assert(it != user_regs.end());
-        it->second.val = val;
-    }
-};
-
 typedef enum {
     STACK_INFO_SAVED_REGISTER,
     STACK_INFO_KOOPA_VALUE,
@@ -75,48 +41,111 @@ class StackInfo {
 
 class StackFrame {
    private:
-    std::map<std::string, StackInfo> saved_registers;
-    std::map<koopa_raw_value_t, StackInfo> koopa_values;
-    std::map<koopa_raw_value_t, StackInfo> alloc_memory;
+    // in order of their slots
+    ArenaVector<std::pair<riscv_reg_t, StackInfo>> saved_registers;
+    int saved_register_index[REG_NONE];
+    // slots of values by their numbers, and alloc memory of allocs
+    ValueIndex values;
+    ArenaVector<StackInfo> koopa_values;
+    ArenaVector<int> alloc_index;  // -1 if the value isn't an alloc
+    ArenaVector<StackInfo> alloc_memory;
     int length = 0;
 
-    void _insert_saved_registers(std::string name, StackInfo info);
+    void _insert_saved_registers(riscv_reg_t reg, StackInfo info);
     void _insert_koopa_value(koopa_raw_value_t val, StackInfo info);
     void _insert_alloc_memory(koopa_raw_value_t val, StackInfo info);
 
    public:
-    StackFrame(koopa_raw_function_t func);
+    // whether params have registers or slots, which prologue moves them to,
+    // otherwise they're only stored to allocs from where they're passed
+    bool has_param_values;
+
+    // values with a register of assignment, if any, get no slot
+    StackFrame(koopa_raw_function_t func, Arena *arena,
+               const RegisterAssignment *assignment = nullptr);
 
-    StackInfo get_saved_register(std::string name);
+    StackInfo get_saved_register(riscv_reg_t reg);
     StackInfo get_koopa_value(koopa_raw_value_t val);
     StackInfo get_alloc_memory(koopa_raw_value_t val);
-    
+
     int get_length() { return length; }
     friend TargetCodeGenerator;
 };
 
 class TargetCodeGenerator {
    public:
-    TargetCodeGenerator(const char *koopa_file, std::ostream &out);
+    // koopa units are fed by dump_riscv_unit
+    TargetCodeGenerator(std::ostream &out);
     ~TargetCodeGenerator();
 
-    int dump_riscv();
+    int dump_riscv_unit(const char *koopa_str);
+    void set_budget(OptBudget *budget) { this->budget = budget; }
+    // report liveness of every function to stderr
+    void set_analyze_liveness(bool value) { analyze_liveness = value; }
+    // report analyses of the SSA IR of every function to stderr
+    void set_analyze_ir(bool value) { analyze_ir = value; }
+    // encode into an object instead of printing assembly
+    void set_elf_writer(ElfWriter *elf) { this->elf = elf; }
+    void set_pass_manager(PassManager *passes) { this->passes = passes; }
+    void set_stats(CompileStats *stats) { this->stats = stats; }
+    // route the program through the SSA IR, and write its koopa text
+    void set_ir_dump(std::ostream *ir_dump) { this->ir_dump = ir_dump; }
+    // parser of koopa units, and of the IR printed back
+    void set_koopa_parser(koopa_parser_kind_t kind) { koopa_parser = kind; }
+    void set_regalloc(regalloc_kind_t kind) { regalloc = kind; }
 
    private:
-    RegisterFile regfiles;
+    // data of current function, frame and machine code, reset after it
+    Arena arena;
     std::stack<StackFrame> runtime_stack;
+    // registers of values, if current function is allocated
+    RegisterAssignment assignment;
+    bool is_allocated = false;
 
     koopa_raw_program_t raw;
     std::ostream &out;
     koopa_raw_program_builder_t builder;
-
-    void dump_riscv_inst(std::string inst, std::string reg_0, std::string reg_1,
-                         std::string reg_2);
-    void dump_lw(std::string reg, int offset, std::string base);
-    void dump_sw(std::string reg, int offset);
+    koopa_parser_kind_t koopa_parser = KOOPA_PARSER_LIBKOOPA;
+    KoopaParser native_parser;
+    // globals already dumped, which are only declared by later units
+    std::set<std::string> dumped_globals;
+    // optional, decides which optimizations each function could afford
+    OptBudget *budget = nullptr;
+    bool analyze_liveness = false;
+    bool analyze_ir = false;
+    ElfWriter *elf = nullptr;
+    regalloc_kind_t regalloc = REGALLOC_NONE;
+    PassManager *passes = nullptr;
+    CompileStats *stats = nullptr;
+    std::ostream *ir_dump = nullptr;
+
+    // machine code of current function, printed when it's done
+    MachineFunction mfunc;
+
+    void dump_riscv_inst(riscv_opcode_t op, riscv_reg_t rd = REG_NONE,
+                         riscv_reg_t rs1 = REG_NONE, riscv_reg_t rs2 = REG_NONE);
+    void dump_riscv_inst(riscv_opcode_t op, riscv_reg_t reg, riscv_reg_t base,
+                         int imm);
+    void dump_riscv_inst(riscv_opcode_t op, riscv_reg_t rd, int imm);
+    void dump_riscv_inst(riscv_opcode_t op, riscv_reg_t reg,
+                         const char *symbol);
+    void dump_riscv_inst(riscv_opcode_t op, const char *symbol);
+    void dump_lw(riscv_reg_t reg, int offset, riscv_reg_t base);
+    void dump_sw(riscv_reg_t reg, int offset);
     void dump_alloc_initializer(koopa_raw_value_t init, int offset);
     void dump_global_alloc_initializer(koopa_raw_value_t init);
-    bool load_value_to_reg(koopa_raw_value_t value, std::string reg);
+    bool load_value_to_reg(koopa_raw_value_t value, riscv_reg_t reg);
+    riscv_reg_t read_value_reg(koopa_raw_value_t value, riscv_reg_t scratch);
+    riscv_reg_t get_result_reg(koopa_raw_value_t value, riscv_reg_t scratch);
+    void write_result(koopa_raw_value_t value, riscv_reg_t reg);
+    void allocate_registers(koopa_raw_function_t func);
+    void dump_param_moves(koopa_raw_function_t func);
+    void dump_block_arg_moves(koopa_raw_slice_t args,
+                              koopa_raw_basic_block_t target);
+    void report_liveness(koopa_raw_function_t func);
+    void report_ir_analyses(const IRFunction &func);
+    void rebuild_raw_through_ir();
+    int parse_raw(const char *koopa_str);
 
     int dump_koopa_raw_slice(koopa_raw_slice_t slice);
     int dump_koopa_raw_function(koopa_raw_function_t func);
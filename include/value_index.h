@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+#include "koopa.h"
+
+// Dense numbering of koopa values of a function, so that data of values
+// lives in plain arrays. Numbers are found by open addressing on the
+// value pointers, which takes a single probe in most cases.
+class ValueIndex {
+   private:
+    ArenaVector<koopa_raw_value_t> values;
+    ArenaVector<koopa_raw_value_t> keys;  // table of 2^n slots
+    ArenaVector<int> numbers;
+    int shift = 60;  // 64 - log2(slots), take high bits of fibonacci hash
+
+    size_t _find_slot(koopa_raw_value_t val) const {
+        size_t mask = keys.size() - 1;
+        size_t slot = (uint64_t)(uintptr_t)val * 0x9e3779b97f4a7c15ull >> shift;
+        while (keys[slot] != nullptr && keys[slot] != val)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+    void _grow();
+
+   public:
+    // on the heap if arena is null
+    ValueIndex(Arena *arena = nullptr)
+        : values(arena), keys(16, nullptr, arena), numbers(16, -1, arena) {}
+    // function params, block params and insts with results,
+    // allocs are memory rather than values, so they're not numbered
+    ValueIndex(koopa_raw_function_t func);
+
+    // return number of val, a new one if it isn't numbered
+    int insert(koopa_raw_value_t val);
+
+    int get_size() const { return values.size(); }
+    koopa_raw_value_t get_value(int i) const { return values[i]; }
+    // -1 if not numbered, e.g. constants and globals
+    int get_index(koopa_raw_value_t val) const {
+        return numbers[_find_slot(val)];
+    }
+};
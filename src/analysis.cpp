@@ -0,0 +1,316 @@
+#include <analysis.h>
+
+#include <algorithm>
+#include <chrono>
+
+// IRCFG
+
+IRCFG::IRCFG(const IRFunction &func) {
+    assert(!func.is_decl());
+    int num_blocks = func.get_num_blocks();
+    entry = func.first_block;
+    succs.assign(num_blocks, ArenaVector<int>());
+    preds.assign(num_blocks, ArenaVector<int>());
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        func.get_succs(b, succs[b]);
+        for (int succ : succs[b]) preds[succ].push_back(b);
+    }
+    _compute_order();
+}
+
+// DominatorTree
+
+// walk both blocks up to their nearest common dominator,
+// a block is always numbered after its dominators in rpo
+int DominatorTree::_intersect(int a, int b) const {
+    while (a != b) {
+        while (rpo_index[a] > rpo_index[b]) a = idom[a];
+        while (rpo_index[b] > rpo_index[a]) b = idom[b];
+    }
+    return a;
+}
+
+DominatorTree::DominatorTree(const BlockGraph &cfg) {
+    int num_blocks = cfg.get_num_blocks();
+    rpo_index.assign(num_blocks, -1);
+    idom.assign(num_blocks, -1);
+    children.resize(num_blocks);
+    frontiers.resize(num_blocks);
+    pre.assign(num_blocks, -1);
+    last.assign(num_blocks, -1);
+    if (num_blocks == 0) return;
+
+    int num_reachable = 0;
+    while (num_reachable < num_blocks &&
+           cfg.reachable[cfg.rpo[num_reachable]]) {
+        rpo_index[cfg.rpo[num_reachable]] = num_reachable;
+        num_reachable++;
+    }
+
+    int entry = cfg.entry;
+    idom[entry] = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        num_iterations++;
+        for (int i = 1; i < num_reachable; i++) {
+            int b = cfg.rpo[i];
+            int new_idom = -1;
+            for (int pred : cfg.preds[b]) {
+                // not processed yet, or unreachable
+                if (idom[pred] == -1) continue;
+                new_idom = new_idom == -1 ? pred : _intersect(pred, new_idom);
+            }
+            if (idom[b] != new_idom) {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 1; i < num_reachable; i++) {
+        int b = cfg.rpo[i];
+        children[idom[b]].push_back(b);
+    }
+
+    // number the tree in preorder by an iterative DFS
+    std::vector<std::pair<int, size_t>> dfs_stack;
+    dfs_stack.push_back(std::make_pair(entry, 0));
+    pre[entry] = 0;
+    preorder.push_back(entry);
+    while (!dfs_stack.empty()) {
+        auto &top = dfs_stack.back();
+        int cur = top.first;
+        if (top.second == children[cur].size()) {
+            last[cur] = preorder.size() - 1;
+            dfs_stack.pop_back();
+            continue;
+        }
+        int child = children[cur][top.second++];
+        pre[child] = preorder.size();
+        preorder.push_back(child);
+        dfs_stack.push_back(std::make_pair(child, 0));
+    }
+
+    // a block is in frontiers of the blocks from its preds up to its idom
+    for (int i = 1; i < num_reachable; i++) {
+        int b = cfg.rpo[i];
+        for (int pred : cfg.preds[b]) {
+            if (rpo_index[pred] == -1) continue;
+            for (int runner = pred; runner != idom[b]; runner = idom[runner]) {
+                auto &frontier = frontiers[runner];
+                if (frontier.empty() || frontier.back() != b)
+                    frontier.push_back(b);
+            }
+        }
+    }
+}
+
+// LoopForest
+
+LoopForest::LoopForest(const BlockGraph &cfg, const DominatorTree &dom) {
+    int num_blocks = cfg.get_num_blocks();
+    block_loop.assign(num_blocks, -1);
+
+    // an inner header comes after its outer ones in rpo,
+    // so inner loops are found first, and outer loops take them in
+    std::vector<int> worklist;
+    for (int i = num_blocks - 1; i >= 0; i--) {
+        int header = cfg.rpo[i];
+        if (!cfg.reachable[header]) continue;
+        std::vector<int> latches;
+        for (int pred : cfg.preds[header]) {
+            if (!cfg.reachable[pred] || !dom.dominates(header, pred)) continue;
+            if (std::find(latches.begin(), latches.end(), pred) ==
+                latches.end())
+                latches.push_back(pred);
+        }
+        if (latches.empty()) continue;
+
+        int id = loops.size();
+        loops.push_back(Loop());
+        loops[id].header = header;
+        loops[id].latches = latches;
+        block_loop[header] = id;
+
+        // walk backward from latches, which stops at header
+        worklist = latches;
+        while (!worklist.empty()) {
+            int b = worklist.back();
+            worklist.pop_back();
+            int loop = block_loop[b];
+            if (loop == -1) {
+                block_loop[b] = id;
+                for (int pred : cfg.preds[b])
+                    if (cfg.reachable[pred]) worklist.push_back(pred);
+                continue;
+            }
+            while (loops[loop].parent != -1) loop = loops[loop].parent;
+            if (loop == id) continue;
+            // an inner loop, go on from the entries of its header
+            loops[loop].parent = id;
+            for (int pred : cfg.preds[loops[loop].header])
+                if (cfg.reachable[pred]) worklist.push_back(pred);
+        }
+    }
+
+    // parents are found after their children
+    for (int id = (int)loops.size() - 1; id >= 0; id--) {
+        auto &loop = loops[id];
+        if (loop.parent == -1) {
+            roots.push_back(id);
+        } else {
+            loop.depth = loops[loop.parent].depth + 1;
+            loops[loop.parent].children.push_back(id);
+        }
+    }
+    for (int b : cfg.rpo)
+        for (int loop = block_loop[b]; loop != -1; loop = loops[loop].parent)
+            loops[loop].blocks.push_back(b);
+}
+
+int LoopForest::get_max_depth() const {
+    int depth = 0;
+    for (auto &loop : loops) depth = std::max(depth, loop.depth);
+    return depth;
+}
+
+// IRLiveness
+
+IRLiveness::IRLiveness(const IRFunction &func, const BlockGraph &cfg) {
+    int num_values = func.get_num_values();
+
+    // constants are defined nowhere, function params in entry block,
+    // allocs are memory rather than values, so they're never live
+    std::vector<int> def_block(num_values, -1);
+    for (int param : func.params) def_block[param] = func.first_block;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        auto &block = func.blocks[b];
+        for (int param : block.params) def_block[param] = b;
+        for (int inst = block.first_inst; inst != -1;
+             inst = func.values[inst].next)
+            if (func.values[inst].tag != KOOPA_RVT_ALLOC) def_block[inst] = b;
+    }
+
+    value_bits.assign(num_values, -1);
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            for (int i = 0; i < func.get_num_operands(inst); i++) {
+                int use = func.get_operand(inst, i);
+                if (def_block[use] == -1 || def_block[use] == b ||
+                    value_bits[use] != -1)
+                    continue;
+                value_bits[use] = bit_values.size();
+                bit_values.push_back(use);
+            }
+        }
+    }
+
+    DataflowProblem problem(DATAFLOW_BACKWARD, DATAFLOW_MEET_UNION,
+                            cfg.get_num_blocks(), get_num_bits());
+
+    // walk each block backward: gen is used before defined, kill is defined
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        auto &block = func.blocks[b];
+        auto &gen = problem.gen[b];
+        auto &kill = problem.kill[b];
+        for (int inst = block.last_inst; inst != -1;
+             inst = func.values[inst].prev) {
+            int def = value_bits[inst];
+            if (def != -1) {
+                kill.set(def);
+                gen.reset(def);
+            }
+            for (int i = 0; i < func.get_num_operands(inst); i++) {
+                int use = value_bits[func.get_operand(inst, i)];
+                if (use != -1) gen.set(use);
+            }
+        }
+        for (int param : block.params) {
+            int def = value_bits[param];
+            if (def == -1) continue;
+            kill.set(def);
+            gen.reset(def);
+        }
+    }
+    result = solve_dataflow(cfg, problem);
+}
+
+// AnalysisManager
+
+static double get_elapsed_ms(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+const IRCFG &AnalysisManager::get_cfg() {
+    if (!cfg) {
+        auto start = std::chrono::steady_clock::now();
+        cfg.reset(new IRCFG(func));
+        num_computed[ANALYSIS_CFG]++;
+        computed_ms[ANALYSIS_CFG] += get_elapsed_ms(start);
+    }
+    return *cfg;
+}
+
+const DominatorTree &AnalysisManager::get_dominators() {
+    if (!dom) {
+        auto &graph = get_cfg();
+        auto start = std::chrono::steady_clock::now();
+        dom.reset(new DominatorTree(graph));
+        num_computed[ANALYSIS_DOMINATORS]++;
+        computed_ms[ANALYSIS_DOMINATORS] += get_elapsed_ms(start);
+    }
+    return *dom;
+}
+
+const LoopForest &AnalysisManager::get_loops() {
+    if (!loops) {
+        auto &graph = get_cfg();
+        auto &tree = get_dominators();
+        auto start = std::chrono::steady_clock::now();
+        loops.reset(new LoopForest(graph, tree));
+        num_computed[ANALYSIS_LOOPS]++;
+        computed_ms[ANALYSIS_LOOPS] += get_elapsed_ms(start);
+    }
+    return *loops;
+}
+
+const IRLiveness &AnalysisManager::get_liveness() {
+    if (!liveness) {
+        auto &graph = get_cfg();
+        auto start = std::chrono::steady_clock::now();
+        liveness.reset(new IRLiveness(func, graph));
+        num_computed[ANALYSIS_LIVENESS]++;
+        computed_ms[ANALYSIS_LIVENESS] += get_elapsed_ms(start);
+    }
+    return *liveness;
+}
+
+void AnalysisManager::invalidate(int changes) {
+    // liveness depends on both insts and edges, the others on edges only
+    if (changes & IR_CHANGED_CFG) {
+        cfg.reset();
+        dom.reset();
+        loops.reset();
+    }
+    if (changes) liveness.reset();
+}
+
+std::string to_analysis_kind(analysis_kind_t kind) {
+    switch (kind) {
+        case ANALYSIS_CFG:
+            return "cfg";
+        case ANALYSIS_DOMINATORS:
+            return "dominators";
+        case ANALYSIS_LOOPS:
+            return "loops";
+        case ANALYSIS_LIVENESS:
+            return "liveness";
+        default:
+            assert(false);
+    }
+    return "";
+}
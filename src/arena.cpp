@@ -0,0 +1,30 @@
+#include <arena.h>
+
+#include <algorithm>
+
+void Arena::_add_chunk(size_t min_size) {
+    size_t size = chunks.empty() ? MIN_CHUNK_SIZE : 2 * chunks.back().size;
+    size = std::max(size, min_size);
+    chunks.push_back(Chunk{std::unique_ptr<char[]>(new char[size]), size});
+    num_heap_allocs++;
+    cur = chunks.back().buf.get();
+    end = cur + size;
+}
+
+void Arena::reset() {
+    if (chunks.empty()) return;
+    if (chunks.size() > 1) {
+        // one chunk that fits all of this function next time
+        size_t size = get_capacity();
+        chunks.clear();
+        _add_chunk(size);
+    }
+    cur = chunks[0].buf.get();
+    end = cur + chunks[0].size;
+}
+
+size_t Arena::get_capacity() const {
+    size_t size = 0;
+    for (auto &chunk : chunks) size += chunk.size;
+    return size;
+}
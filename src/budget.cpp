@@ -0,0 +1,206 @@
+#include <budget.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "dataflow.h"
+
+FunctionMetrics::FunctionMetrics(koopa_raw_function_t func, Arena *arena) {
+    name = func->name;
+    num_blocks = func->bbs.len;
+    for (int i = 0; i < num_blocks; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        num_values += bb->params.len + bb->insts.len;
+    }
+    if (num_blocks == 0) return;
+
+    FunctionCFG cfg(func, arena);
+    const auto &succs = cfg.succs;
+    const auto &preds = cfg.preds;
+
+    // find back edges with an iterative DFS from entry,
+    // an edge to a block on DFS stack closes a loop
+    typedef enum { UNVISITED, ON_STACK, DONE } dfs_state_t;
+    ArenaVector<dfs_state_t> state(num_blocks, UNVISITED, arena);
+    ArenaVector<ArenaVector<int>> latches(num_blocks, ArenaVector<int>(arena),
+                                          arena);
+    ArenaVector<std::pair<int, size_t>> dfs_stack(arena);
+    dfs_stack.push_back(std::make_pair(0, 0));
+    state[0] = ON_STACK;
+    while (!dfs_stack.empty()) {
+        auto &top = dfs_stack.back();
+        int cur = top.first;
+        if (top.second == succs[cur].size()) {
+            state[cur] = DONE;
+            dfs_stack.pop_back();
+            continue;
+        }
+        int succ = succs[cur][top.second++];
+        if (state[succ] == ON_STACK) {
+            latches[succ].push_back(cur);
+        } else if (state[succ] == UNVISITED) {
+            state[succ] = ON_STACK;
+            dfs_stack.push_back(std::make_pair(succ, 0));
+        }
+    }
+
+    // every block of a natural loop is one level deeper
+    ArenaVector<int> depth(num_blocks, 0, arena);
+    ArenaVector<int> in_loop(num_blocks, -1, arena);
+    ArenaVector<int> worklist(arena);
+    for (int header = 0; header < num_blocks; header++) {
+        if (latches[header].empty()) continue;
+        worklist.clear();
+        in_loop[header] = header;
+        depth[header]++;
+        for (int latch : latches[header]) {
+            if (in_loop[latch] == header) continue;
+            in_loop[latch] = header;
+            depth[latch]++;
+            worklist.push_back(latch);
+        }
+        while (!worklist.empty()) {
+            int cur = worklist.back();
+            worklist.pop_back();
+            for (int pred : preds[cur]) {
+                if (in_loop[pred] == header || state[pred] == UNVISITED)
+                    continue;
+                in_loop[pred] = header;
+                depth[pred]++;
+                worklist.push_back(pred);
+            }
+        }
+    }
+    for (int d : depth) loop_depth = std::max(loop_depth, d);
+}
+
+std::string to_opt_decision(opt_decision_t decision) {
+    switch (decision) {
+        case OPT_DECISION_RUN:
+            return "run";
+        case OPT_DECISION_THROTTLE:
+            return "throttle";
+        case OPT_DECISION_SKIP:
+            return "skip";
+    }
+    assert(false);
+}
+
+void OptBudget::set_time_limits(int func_ms, int total_ms) {
+    func_time_ms = func_ms;
+    total_time_ms = total_ms;
+}
+
+void OptBudget::open_log(std::string file) {
+    log.open(file, std::ios::out);
+    assert(log.is_open());
+}
+
+// Read decisions from a previous log, in format of
+// "stage <func> <stage> <decision> ...", other lines are ignored
+void OptBudget::load_replay(std::string file) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        std::cerr << "OptBudget: can't open replay log " << file << std::endl;
+        assert(false);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string tag, func, stage, decision;
+        ss >> tag >> func >> stage >> decision;
+        if (tag != "stage") continue;
+        opt_decision_t d;
+        if (decision == "run")
+            d = OPT_DECISION_RUN;
+        else if (decision == "throttle")
+            d = OPT_DECISION_THROTTLE;
+        else if (decision == "skip")
+            d = OPT_DECISION_SKIP;
+        else {
+            std::cerr << "OptBudget: bad decision " << decision << std::endl;
+            assert(false);
+        }
+        replay[std::make_pair(func, stage)] = d;
+    }
+}
+
+void OptBudget::begin_function(koopa_raw_function_t func, Arena *arena) {
+    assert(!is_stage_running);
+    metrics = FunctionMetrics(func, arena);
+    func_used_ms = 0;
+    if (log.is_open())
+        log << "func " << metrics.name << " values " << metrics.num_values
+            << " blocks " << metrics.num_blocks << " loop_depth "
+            << metrics.loop_depth << std::endl;
+}
+
+opt_decision_t OptBudget::_decide(std::string stage, opt_stage_cost_t cost,
+                                  std::string &reason) {
+    if (!replay.empty()) {
+        auto it = replay.find(std::make_pair(metrics.name, stage));
+        if (it != replay.end()) {
+            reason = "replay";
+            return it->second;
+        }
+    }
+    if (cost == OPT_STAGE_CHEAP) return OPT_DECISION_RUN;
+
+    std::stringstream ss;
+    if (metrics.num_values > max_values) {
+        ss << "values " << metrics.num_values << " > " << max_values;
+    } else if (metrics.num_blocks > max_blocks) {
+        ss << "blocks " << metrics.num_blocks << " > " << max_blocks;
+    } else if (total_time_ms && total_used_ms > total_time_ms) {
+        ss << "total time " << (int)total_used_ms << "ms > " << total_time_ms
+           << "ms";
+    } else if (func_time_ms && func_used_ms > func_time_ms) {
+        ss << "func time " << (int)func_used_ms << "ms > " << func_time_ms
+           << "ms";
+    }
+    if (!ss.str().empty()) {
+        reason = ss.str();
+        return OPT_DECISION_SKIP;
+    }
+
+    if (metrics.num_values > max_values / 2) {
+        ss << "values " << metrics.num_values << " > " << max_values / 2;
+    } else if (metrics.num_blocks > max_blocks / 2) {
+        ss << "blocks " << metrics.num_blocks << " > " << max_blocks / 2;
+    } else if (metrics.loop_depth > max_loop_depth) {
+        ss << "loop_depth " << metrics.loop_depth << " > " << max_loop_depth;
+    }
+    if (!ss.str().empty()) {
+        reason = ss.str();
+        return OPT_DECISION_THROTTLE;
+    }
+    return OPT_DECISION_RUN;
+}
+
+opt_decision_t OptBudget::begin_stage(std::string stage,
+                                      opt_stage_cost_t cost) {
+    assert(!is_stage_running);
+    std::string reason;
+    auto decision = _decide(stage, cost, reason);
+    if (log.is_open()) {
+        log << "stage " << metrics.name << " " << stage << " "
+            << to_opt_decision(decision);
+        if (!reason.empty()) log << " (" << reason << ")";
+        log << std::endl;
+    }
+    if (decision != OPT_DECISION_SKIP) {
+        is_stage_running = true;
+        stage_start = std::chrono::steady_clock::now();
+    }
+    return decision;
+}
+
+void OptBudget::end_stage() {
+    assert(is_stage_running);
+    is_stage_running = false;
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - stage_start;
+    func_used_ms += elapsed.count();
+    total_used_ms += elapsed.count();
+}
@@ -1,24 +1,69 @@
 #include "ast.h"
 
-bool ExpAST::calc_val(IRGenerator &irgen, int &result, bool calc_const) const {
+bool CalcAST::calc_val(IRGenerator &irgen, int &result,
+                       bool calc_const) const {
+    // A node always sits at the same place of the symbol table,
+    // so its folding result never changes once calculated.
+    // Non-const result is recalculated for calc_const, to raise the error.
+    auto is_cached = [&](const CalcAST *ast) {
+        return ast->is_val_cached && (ast->cached_is_const || !calc_const);
+    };
+
+    // fold in post order with an explicit stack, a node is visited again
+    // after all its children are folded
+    std::vector<std::pair<const CalcAST *, bool>> work = {{this, false}};
+    std::vector<const CalcAST *> children;
+    while (!work.empty()) {
+        auto ast = work.back().first;
+        auto is_expanded = work.back().second;
+        work.pop_back();
+        if (is_cached(ast)) continue;
+        if (!is_expanded) {
+            work.push_back({ast, true});
+            children.clear();
+            ast->_get_calc_children(children);
+            for (auto child : children) work.push_back({child, false});
+            continue;
+        }
+        ast->cached_is_const =
+            ast->_calc_val(irgen, ast->cached_val, calc_const);
+        ast->is_val_cached = true;
+    }
+    result = cached_val;
+    return cached_is_const;
+}
+
+bool CalcAST::_get_child_val(const BaseAST *child, int &result) {
+    auto ast = dynamic_cast<const CalcAST *>(child);
+    assert(ast && ast->is_val_cached);
+    result = ast->cached_val;
+    return ast->cached_is_const;
+}
+
+void ExpAST::_get_calc_children(std::vector<const CalcAST *> &children) const {
+    children.push_back(dynamic_cast<CalcAST *>(binary_exp.get()));
+}
+
+bool ExpAST::_calc_val(IRGenerator &irgen, int &result,
+                       bool calc_const) const {
     // Sematically, you don't have to worry if exp is const.
     // An exp with var lval will pop false eventually.
-    bool ret = dynamic_cast<CalcAST *>(binary_exp.get())
-                   ->calc_val(irgen, result, calc_const);
-    return ret;
+    return _get_child_val(binary_exp.get(), result);
 }
 
-bool BinaryExpAST::calc_val(IRGenerator &irgen, int &result,
-                            bool calc_const) const {
-    int lhs, rhs;
-    bool ret = true;
+void BinaryExpAST::_get_calc_children(
+    std::vector<const CalcAST *> &children) const {
+    children.push_back(dynamic_cast<CalcAST *>(r_exp.get()));
+    children.push_back(dynamic_cast<CalcAST *>(l_exp.get()));
+}
 
-    ret =
-        ret &&
-        dynamic_cast<CalcAST *>(l_exp.get())->calc_val(irgen, lhs, calc_const);
-    ret =
-        ret &&
-        dynamic_cast<CalcAST *>(r_exp.get())->calc_val(irgen, rhs, calc_const);
+bool BinaryExpAST::_calc_val(IRGenerator &irgen, int &result,
+                             bool calc_const) const {
+    int lhs, rhs;
+    bool ret = _get_child_val(l_exp.get(), lhs);
+    ret = _get_child_val(r_exp.get(), rhs) && ret;
+    // operands of a non-const exp are meaningless, e.g. divisor may be 0
+    if (!ret) return false;
 
     // calc_val doesn't dump inst, needless to short circuit
     if (op == "+") {
@@ -55,12 +100,17 @@ bool BinaryExpAST::calc_val(IRGenerator &irgen, int &result,
     return ret;
 }
 
-bool UnaryExpAST::calc_val(IRGenerator &irgen, int &result,
-                           bool calc_const) const {
-    bool ret;
+void UnaryExpAST::_get_calc_children(
+    std::vector<const CalcAST *> &children) const {
+    if (type == UNARY_EXP_AST_TYPE_OP)
+        children.push_back(dynamic_cast<CalcAST *>(unary_exp.get()));
+}
 
-    ret = dynamic_cast<CalcAST *>(unary_exp.get())
-              ->calc_val(irgen, result, calc_const);
+bool UnaryExpAST::_calc_val(IRGenerator &irgen, int &result,
+                            bool calc_const) const {
+    // function call is never const
+    if (type == UNARY_EXP_AST_TYPE_FUNC) return false;
+    bool ret = _get_child_val(unary_exp.get(), result);
     if (op == "!") {
         result = !result;
     } else if (op == "-") {
@@ -73,20 +123,31 @@ bool UnaryExpAST::calc_val(IRGenerator &irgen, int &result,
     return ret;
 }
 
-bool PrimaryExpAST::calc_val(IRGenerator &irgen, int &result,
-                             bool calc_const) const {
+void PrimaryExpAST::_get_calc_children(
+    std::vector<const CalcAST *> &children) const {
+    if (type == PRIMARY_EXP_AST_TYPE_LVAL)
+        children.push_back(dynamic_cast<CalcAST *>(lval.get()));
+}
+
+bool PrimaryExpAST::_calc_val(IRGenerator &irgen, int &result,
+                              bool calc_const) const {
     if (type == PRIMARY_EXP_AST_TYPE_NUMBER) {
         result = number;
         return true;
     } else if (type == PRIMARY_EXP_AST_TYPE_LVAL) {
-        return dynamic_cast<CalcAST *>(lval.get())
-            ->calc_val(irgen, result, calc_const);
+        return _get_child_val(lval.get(), result);
     } else {
         assert(false);
     }
 }
 
-bool LValAST::calc_val(IRGenerator &irgen, int &result, bool calc_const) const {
+void LValAST::_get_calc_children(
+    std::vector<const CalcAST *> &children) const {
+    // indexes are never folded, array elements aren't const
+}
+
+bool LValAST::_calc_val(IRGenerator &irgen, int &result,
+                        bool calc_const) const {
     // When using this lval, it should have already existed in symbol table,
     // No matter you're assigning a const or var lval.
     auto type = irgen.symbol_table.get_entry_type(ident);
@@ -110,4 +171,4 @@ bool LValAST::calc_val(IRGenerator &irgen, int &result, bool calc_const) const {
         std::cerr << "LValAST: invalid type!" << std::endl;
         assert(false);
     }
-}
\ No newline at end of file
+}
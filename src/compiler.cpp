@@ -0,0 +1,171 @@
+#include <compiler.h>
+
+#include <memory>
+#include <sstream>
+
+#include "ast.h"
+#include "riscv_emitter.h"
+#include "tcgen.h"
+
+using namespace std;
+
+extern int yyparse(unique_ptr<BaseAST> &ast, comp_unit_handler_t &handler);
+
+// state of one compile, which main used to keep in globals
+class Compilation {
+   public:
+    const CompileOptions &options;
+    compile_mode_t mode;
+    OptBudget default_budget;
+    PassManager passes;
+    ElfWriter elf;
+
+    Compilation(const CompileOptions &options, compile_mode_t mode)
+        : options{options}, mode{mode} {}
+
+    void set_up_backend(TargetCodeGenerator &tcgen) {
+        tcgen.set_budget(get_budget());
+        tcgen.set_pass_manager(&passes);
+        if (options.stats) tcgen.set_stats(options.stats);
+        tcgen.set_analyze_liveness(options.analyze_liveness);
+        tcgen.set_analyze_ir(options.analyze_ir);
+        if (mode == COMPILE_OBJECT) tcgen.set_elf_writer(&elf);
+        if (options.ir_dump) tcgen.set_ir_dump(options.ir_dump);
+        tcgen.set_koopa_parser(options.koopa_parser);
+        tcgen.set_regalloc(options.regalloc);
+    }
+
+    OptBudget *get_budget() {
+        return options.budget ? options.budget : &default_budget;
+    }
+};
+
+// Parse, lower and dump one top-level unit at a time,
+// so that only the AST and IR of the current unit are alive.
+static int compile_streaming(Compilation &comp, std::ostream &out) {
+    IRGenerator irgen;
+    TargetCodeGenerator tcgen(out);
+    comp.set_up_backend(tcgen);
+    bool is_koopa = (comp.mode == COMPILE_KOOPA);
+    bool failed = false;
+
+    std::stringstream lib_decls;
+    dump_koopa_sysy_lib(irgen, lib_decls);
+    if (is_koopa) out << lib_decls.str();
+
+    comp_unit_handler_t handler = [&](unique_ptr<BaseAST> unit) {
+        if (failed) return;  // units after a failed one are skipped
+        std::stringstream unit_out;
+        unit->dump_koopa(irgen, unit_out);
+        unit.reset();
+
+        // unit with the decls it uses makes up a complete koopa program
+        auto prelude = irgen.symbol_table.get_used_global_decls();
+        if (is_koopa) {
+            out << unit_out.str() << std::endl;
+        } else {
+            auto koopa_str = prelude + unit_out.str();
+            if (tcgen.dump_riscv_unit(koopa_str.c_str())) failed = true;
+        }
+    };
+
+    unique_ptr<BaseAST> ast;
+    if (yyparse(ast, handler)) return 1;
+    return failed ? 1 : 0;
+}
+
+static int compile_whole(Compilation &comp, std::ostream &out) {
+    // lex & parse
+    unique_ptr<BaseAST> ast;
+    comp_unit_handler_t handler;  // collect all units into StartAST
+    if (yyparse(ast, handler)) return 1;
+
+    // ast -> IR
+    std::stringstream koopa;
+    IRGenerator irgen;
+    ast->dump_koopa(irgen, koopa);
+    ast.reset();
+    if (comp.mode == COMPILE_KOOPA) {
+        out << koopa.rdbuf();
+        return 0;
+    }
+
+    // IR -> riscv assembly, the whole program as a single unit
+    TargetCodeGenerator tcgen(out);
+    comp.set_up_backend(tcgen);
+    return tcgen.dump_riscv_unit(koopa.str().c_str());
+}
+
+// -O0-fast: the lowering of the AST emits riscv itself
+static int compile_fast_path(Compilation &comp, std::ostream &out) {
+    IRGenerator irgen;
+    auto elf = comp.mode == COMPILE_OBJECT ? &comp.elf : nullptr;
+    RiscvEmitter emitter(irgen.symbol_table.types, elf);
+    irgen.set_emitter(&emitter);
+
+    comp_unit_handler_t handler;  // collect all units into StartAST
+    if (comp.options.is_streaming) {
+        dump_koopa_sysy_lib(irgen, out);
+        handler = [&](unique_ptr<BaseAST> unit) {
+            unit->dump_koopa(irgen, out);
+        };
+    }
+    unique_ptr<BaseAST> ast;
+    if (yyparse(ast, handler)) return 1;
+    if (!comp.options.is_streaming) ast->dump_koopa(irgen, out);
+    return 0;
+}
+
+// koopa text as a single unit
+static int compile_koopa(Compilation &comp, std::string_view source,
+                         std::ostream &out) {
+    if (comp.mode == COMPILE_KOOPA) {
+        std::cerr << "Compiler: koopa input needs a riscv mode" << std::endl;
+        return 1;
+    }
+    TargetCodeGenerator tcgen(out);
+    comp.set_up_backend(tcgen);
+    return tcgen.dump_riscv_unit(std::string(source).c_str());
+}
+
+int compile(std::string_view source, compile_mode_t mode, std::ostream &out,
+            const CompileOptions &options) {
+    Compilation comp(options, mode);
+    comp.passes.set_budget(comp.get_budget());
+    comp.passes.set_opt_level(options.opt_level);
+    comp.passes.set_verify(options.verify);
+    if (options.has_pipeline && !comp.passes.set_pipeline(options.pipeline))
+        return 1;
+    if (options.print_pipeline) comp.passes.print_pipeline(std::cerr);
+
+    // an object is written as a whole after all functions, text the
+    // lowering leaves meanwhile is dropped
+    std::stringstream dropped;
+    std::ostream &text_out = mode == COMPILE_OBJECT ? dropped : out;
+    int ret;
+    if (options.is_koopa_input) {
+        ret = compile_koopa(comp, source, text_out);
+    } else {
+        set_lexer(options.lexer);
+        set_lexer_source(source);
+        if (options.is_fast_path && mode != COMPILE_KOOPA)
+            ret = compile_fast_path(comp, text_out);
+        else if (options.is_streaming)
+            ret = compile_streaming(comp, text_out);
+        else
+            ret = compile_whole(comp, text_out);
+    }
+    if (ret) return ret;
+    if (mode == COMPILE_OBJECT) comp.elf.write(out);
+
+    if (options.time_passes) comp.passes.print_timing(std::cerr);
+    return 0;
+}
+
+int compile(std::string_view source, compile_mode_t mode, std::string &buffer,
+            const CompileOptions &options) {
+    std::stringstream out;
+    int ret = compile(source, mode, out, options);
+    if (!ret) buffer = out.str();
+    return ret;
+}
@@ -56,7 +56,7 @@ void ControlFlow::init_entry_block(std::string name, std::ostream &out) {
     auto block_info = BasicBlockInfo();
     cfg.insert(std::make_pair(name, block_info));
     cur_block = name;
-    out << name << ":" << std::endl;
+    emitter->block(out, name);
 }
 
 // switch to target control flow.
@@ -72,7 +72,7 @@ bool ControlFlow::switch_control_flow(std::string name, std::ostream &out) {
         return false;
     }
     cur_block = name;
-    out << name << ":" << std::endl;
+    emitter->block(out, name);
     return true;
 }
 
@@ -102,7 +102,7 @@ void ControlFlow::add_control_edge(std::string dst, std::string src) {
 void ControlFlow::_break(std::ostream &out) {
     auto dst_break = cfg[cur_block].dst_break;
     assert(dst_break != "");
-    out << "  jump " << dst_break << std::endl;
+    emitter->jump(out, dst_break);
     modify_ending_status(BASIC_BLOCK_ENDING_STATUS_BREAK);
     add_control_edge(dst_break);
 }
@@ -110,7 +110,11 @@ void ControlFlow::_break(std::ostream &out) {
 void ControlFlow::_continue(std::ostream &out) {
     auto dst_continue = cfg[cur_block].dst_continue;
     assert(dst_continue != "");
-    out << "  jump " << dst_continue << std::endl;
+    emitter->jump(out, dst_continue);
     modify_ending_status(BASIC_BLOCK_ENDING_STATUS_CONTINUE);
     add_control_edge(dst_continue);
-}
\ No newline at end of file
+}
+void ControlFlow::reset() {
+    cfg.clear();
+    cur_block = "";
+}
@@ -0,0 +1,316 @@
+#include <dataflow.h>
+
+#include <algorithm>
+#include <utility>
+
+// BitVector
+
+BitVector::BitVector(int size, bool value)
+    : words((size + 63) >> 6, 0), size(size) {
+    if (value) fill(true);
+}
+
+void BitVector::fill(bool value) {
+    std::fill(words.begin(), words.end(), value ? ~(uint64_t)0 : 0);
+    // keep bits out of range cleared, so that words compare equal
+    if (value && (size & 63)) words.back() &= ((uint64_t)1 << (size & 63)) - 1;
+}
+
+int BitVector::count() const {
+    int cnt = 0;
+    for (auto w : words) cnt += __builtin_popcountll(w);
+    return cnt;
+}
+
+int BitVector::find_next(int i) const {
+    if (i >= size) return -1;
+    int w = i >> 6;
+    uint64_t word = words[w] & (~(uint64_t)0 << (i & 63));
+    while (true) {
+        if (word) return (w << 6) + __builtin_ctzll(word);
+        if (++w == (int)words.size()) return -1;
+        word = words[w];
+    }
+}
+
+bool BitVector::union_with(const BitVector &other) {
+    assert(size == other.size);
+    uint64_t changed = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+        auto old = words[w];
+        words[w] |= other.words[w];
+        changed |= old ^ words[w];
+    }
+    return changed;
+}
+
+bool BitVector::intersect_with(const BitVector &other) {
+    assert(size == other.size);
+    uint64_t changed = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+        auto old = words[w];
+        words[w] &= other.words[w];
+        changed |= old ^ words[w];
+    }
+    return changed;
+}
+
+// FunctionCFG
+
+FunctionCFG::FunctionCFG(koopa_raw_function_t func, Arena *arena)
+    : BlockGraph(arena),
+      blocks(arena),
+      block_index(block_index_t::allocator_type(arena)) {
+    int num_blocks = func->bbs.len;
+    blocks.reserve(num_blocks);
+    block_index.reserve(num_blocks);
+    for (int i = 0; i < num_blocks; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        blocks.push_back(bb);
+        block_index[bb] = i;
+    }
+
+    succs.assign(num_blocks, ArenaVector<int>(arena));
+    preds.assign(num_blocks, ArenaVector<int>(arena));
+    for (int i = 0; i < num_blocks; i++) {
+        auto insts = blocks[i]->insts;
+        if (insts.len == 0) continue;
+        auto term = (koopa_raw_value_t)insts.buffer[insts.len - 1];
+        if (term->kind.tag == KOOPA_RVT_BRANCH) {
+            succs[i].push_back(block_index[term->kind.data.branch.true_bb]);
+            succs[i].push_back(block_index[term->kind.data.branch.false_bb]);
+        } else if (term->kind.tag == KOOPA_RVT_JUMP) {
+            succs[i].push_back(block_index[term->kind.data.jump.target]);
+        }
+        for (int succ : succs[i]) preds[succ].push_back(i);
+    }
+
+    _compute_order();
+}
+
+void BlockGraph::_compute_order() {
+    // postorder by an iterative DFS from entry
+    int num_blocks = get_num_blocks();
+    reachable.assign(num_blocks, false);
+    rpo.clear();
+    if (num_blocks == 0) return;
+    std::vector<std::pair<int, size_t>> dfs_stack;
+    dfs_stack.push_back(std::make_pair(entry, 0));
+    reachable[entry] = true;
+    while (!dfs_stack.empty()) {
+        auto &top = dfs_stack.back();
+        int cur = top.first;
+        if (top.second == succs[cur].size()) {
+            rpo.push_back(cur);
+            dfs_stack.pop_back();
+            continue;
+        }
+        int succ = succs[cur][top.second++];
+        if (!reachable[succ]) {
+            reachable[succ] = true;
+            dfs_stack.push_back(std::make_pair(succ, 0));
+        }
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for (int i = 0; i < num_blocks; i++)
+        if (!reachable[i]) rpo.push_back(i);
+}
+
+static void append_slice(koopa_raw_slice_t slice,
+                         std::vector<koopa_raw_value_t> &operands) {
+    for (size_t i = 0; i < slice.len; i++)
+        operands.push_back((koopa_raw_value_t)slice.buffer[i]);
+}
+
+void get_koopa_raw_value_operands(koopa_raw_value_t value,
+                                  std::vector<koopa_raw_value_t> &operands) {
+    operands.clear();
+    const auto &kind = value->kind;
+    switch (kind.tag) {
+        case KOOPA_RVT_LOAD:
+            operands.push_back(kind.data.load.src);
+            break;
+        case KOOPA_RVT_STORE:
+            operands.push_back(kind.data.store.value);
+            operands.push_back(kind.data.store.dest);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            operands.push_back(kind.data.get_ptr.src);
+            operands.push_back(kind.data.get_ptr.index);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            operands.push_back(kind.data.get_elem_ptr.src);
+            operands.push_back(kind.data.get_elem_ptr.index);
+            break;
+        case KOOPA_RVT_BINARY:
+            operands.push_back(kind.data.binary.lhs);
+            operands.push_back(kind.data.binary.rhs);
+            break;
+        case KOOPA_RVT_BRANCH:
+            operands.push_back(kind.data.branch.cond);
+            append_slice(kind.data.branch.true_args, operands);
+            append_slice(kind.data.branch.false_args, operands);
+            break;
+        case KOOPA_RVT_JUMP:
+            append_slice(kind.data.jump.args, operands);
+            break;
+        case KOOPA_RVT_CALL:
+            append_slice(kind.data.call.args, operands);
+            break;
+        case KOOPA_RVT_RETURN:
+            if (kind.data.ret.value) operands.push_back(kind.data.ret.value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Solver
+
+DataflowProblem::DataflowProblem(dataflow_direction_t direction,
+                                 dataflow_meet_t meet, int num_blocks,
+                                 int num_bits)
+    : direction(direction),
+      meet(meet),
+      num_bits(num_bits),
+      gen(num_blocks, BitVector(num_bits)),
+      kill(num_blocks, BitVector(num_bits)),
+      boundary(num_bits) {}
+
+// result = gen | (input & ~kill), return whether result is changed
+static bool transfer(const BitVector &gen, const BitVector &kill,
+                     const BitVector &input, BitVector &result) {
+    auto g = gen.get_words();
+    auto k = kill.get_words();
+    auto i = input.get_words();
+    auto r = result.get_words();
+    uint64_t changed = 0;
+    for (int w = 0; w < result.get_num_words(); w++) {
+        auto word = g[w] | (i[w] & ~k[w]);
+        changed |= word ^ r[w];
+        r[w] = word;
+    }
+    return changed;
+}
+
+DataflowResult solve_dataflow(const BlockGraph &cfg,
+                              const DataflowProblem &problem) {
+    int num_blocks = cfg.get_num_blocks();
+    bool is_forward = problem.direction == DATAFLOW_FORWARD;
+    bool is_union = problem.meet == DATAFLOW_MEET_UNION;
+
+    DataflowResult result;
+    result.in.assign(num_blocks, BitVector(problem.num_bits, !is_union));
+    result.out.assign(num_blocks, BitVector(problem.num_bits, !is_union));
+    if (num_blocks == 0) return result;
+
+    // visit in reverse postorder, or postorder for backward problems
+    std::vector<int> order(cfg.rpo.begin(), cfg.rpo.end());
+    if (!is_forward) std::reverse(order.begin(), order.end());
+    std::vector<int> position(num_blocks);
+    for (int i = 0; i < num_blocks; i++) position[order[i]] = i;
+
+    // input is what flows into a block along the direction
+    auto &inputs = is_forward ? result.in : result.out;
+    auto &outputs = is_forward ? result.out : result.in;
+    const auto &sources = is_forward ? cfg.preds : cfg.succs;
+    const auto &sinks = is_forward ? cfg.succs : cfg.preds;
+
+    // worklist of positions, swept round by round in order
+    BitVector worklist(num_blocks, true);
+    int cursor = 0;
+    while (true) {
+        int pos = worklist.find_next(cursor);
+        if (pos == -1) pos = worklist.find_next(0);
+        if (pos == -1) break;
+        worklist.reset(pos);
+        cursor = pos + 1;
+        int bb = order[pos];
+        result.num_visits++;
+
+        auto &input = inputs[bb];
+        bool is_boundary =
+            is_forward ? bb == cfg.entry : cfg.succs[bb].empty();
+        if (is_boundary) {
+            input = problem.boundary;
+        } else if (!sources[bb].empty()) {
+            input.fill(!is_union);
+        }
+        for (int src : sources[bb]) {
+            if (is_union)
+                input.union_with(outputs[src]);
+            else
+                input.intersect_with(outputs[src]);
+        }
+
+        if (transfer(problem.gen[bb], problem.kill[bb], input, outputs[bb]))
+            for (int sink : sinks[bb]) worklist.set(position[sink]);
+    }
+    return result;
+}
+
+// Liveness
+
+Liveness::Liveness(koopa_raw_function_t func) : cfg(func), values(func) {
+    int num_blocks = cfg.get_num_blocks();
+    std::vector<koopa_raw_value_t> operands;
+
+    // give bits to values used out of their defining block,
+    // function params are defined in entry block
+    std::vector<int> def_block(values.get_size(), 0);
+    for (int i = 0; i < num_blocks; i++) {
+        auto bb = cfg.blocks[i];
+        for (size_t j = 0; j < bb->params.len; j++)
+            def_block[values.get_index(
+                (koopa_raw_value_t)bb->params.buffer[j])] = i;
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            int def = values.get_index((koopa_raw_value_t)bb->insts.buffer[j]);
+            if (def != -1) def_block[def] = i;
+        }
+    }
+    value_bits.assign(values.get_size(), -1);
+    for (int i = 0; i < num_blocks; i++) {
+        auto bb = cfg.blocks[i];
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            get_koopa_raw_value_operands(
+                (koopa_raw_value_t)bb->insts.buffer[j], operands);
+            for (auto operand : operands) {
+                int use = values.get_index(operand);
+                if (use == -1 || def_block[use] == i || value_bits[use] != -1)
+                    continue;
+                value_bits[use] = bit_values.size();
+                bit_values.push_back(operand);
+            }
+        }
+    }
+
+    DataflowProblem problem(DATAFLOW_BACKWARD, DATAFLOW_MEET_UNION, num_blocks,
+                            get_num_bits());
+
+    // walk each block backward: gen is used before defined, kill is defined
+    for (int i = 0; i < num_blocks; i++) {
+        auto bb = cfg.blocks[i];
+        auto &gen = problem.gen[i];
+        auto &kill = problem.kill[i];
+        for (int j = (int)bb->insts.len - 1; j >= 0; j--) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            int def = get_bit(inst);
+            if (def != -1) {
+                kill.set(def);
+                gen.reset(def);
+            }
+            get_koopa_raw_value_operands(inst, operands);
+            for (auto operand : operands) {
+                int use = get_bit(operand);
+                if (use != -1) gen.set(use);
+            }
+        }
+        for (size_t j = 0; j < bb->params.len; j++) {
+            int def = get_bit((koopa_raw_value_t)bb->params.buffer[j]);
+            if (def == -1) continue;
+            kill.set(def);
+            gen.reset(def);
+        }
+    }
+    result = solve_dataflow(cfg, problem);
+}
@@ -9,90 +9,10 @@ static bool is_symbol(std::string operand) {
     return c == '%' || c == '@';
 }
 
-// Aggregate
-
-typedef enum {
-    KOOPA_AGGREGATE_TYPE_INT,
-    KOOPA_AGGREGATE_TYPE_UNDEF,
-    KOOPA_AGGREGATE_TYPE_AGGREGATE,
-    KOOPA_AGGREGATE_TYPE_ZEROINIT,
-} koopa_aggregate_type_t;
-
-class KoopaAggregate {
-   public:
-    koopa_aggregate_type_t type;
-    int int_val;
-    std::vector<KoopaAggregate> aggs;
-
-    std::string to_string() {
-        if (type == KOOPA_AGGREGATE_TYPE_INT) {
-            return std::to_string(int_val);
-        } else if (type == KOOPA_AGGREGATE_TYPE_UNDEF) {
-            return "undef";
-        } else if (type == KOOPA_AGGREGATE_TYPE_ZEROINIT) {
-            return "zeroinit";
-        } else if (type == KOOPA_AGGREGATE_TYPE_AGGREGATE) {
-            std::string ret = "{ ";
-            auto len = aggs.size();
-            for (int i = 0; i < len; i++) {
-                ret += aggs[i].to_string();
-                if (i + 1 != len) ret += ", ";
-            }
-            ret += " }";
-            return ret;
-        } else {
-            assert(false);
-        }
-    }
-};
-
-// if begin == end, prod = 1
-static int reduce_prod(std::vector<int>::iterator begin,
-                       std::vector<int>::iterator end) {
-    int prod = 1;
-    for (auto it = begin; it != end; it++) {
-        prod *= *it;
-    }
-    return prod;
-}
-
-// aggregate a given piece of full array into one reg_agg
-static void simplify_aggregate_full_array(
-    std::vector<int>::iterator begin, std::vector<int>::iterator end,
-    std::vector<int>::iterator it_dim_begin,
-    std::vector<int>::iterator it_dim_end, KoopaAggregate &ret_agg) {
-    // zeroinit?
-    bool is_zeroinit = true;
-    for (auto it = begin; it != end; it++)
-        is_zeroinit = is_zeroinit && (*it == 0);
-
-    if (is_zeroinit) {
-        ret_agg.type = KOOPA_AGGREGATE_TYPE_ZEROINIT;
-    } else {
-        if (it_dim_begin == it_dim_end) {
-            assert(begin + 1 == end);
-            ret_agg.type = KOOPA_AGGREGATE_TYPE_INT;
-            ret_agg.int_val = *begin;
-        } else {
-            ret_agg.type = KOOPA_AGGREGATE_TYPE_AGGREGATE;
-            auto it_sub_dim_begin = it_dim_begin + 1;
-            auto it_sub_dim_end = it_dim_end;
-            auto interval = reduce_prod(it_sub_dim_begin, it_sub_dim_end);
-            for (int i = 0; i < *it_dim_begin; i++) {
-                KoopaAggregate sub_agg;
-                simplify_aggregate_full_array(
-                    begin + i * interval, begin + (i + 1) * interval,
-                    it_sub_dim_begin, it_sub_dim_end, sub_agg);
-                ret_agg.aggs.push_back(sub_agg);
-            }
-            assert(begin + interval * (*it_dim_begin) == end);
-        }
-    }
-}
+// Array initializers
 
 static void pad_zero_initval_aggregate(IRGenerator &irgen, InitValAST *ast,
-                                       std::vector<int>::iterator it_dim_begin,
-                                       std::vector<int>::iterator it_dim_end,
+                                       const KoopaType *type,
                                        std::vector<int> &full_array) {
     assert(ast->type == INIT_VAL_AST_TYPE_SUB_VALS);
     int i = 0;  // current index
@@ -111,78 +31,66 @@ static void pad_zero_initval_aggregate(IRGenerator &irgen, InitValAST *ast,
 
         } else {
             // list, check maximum alignment bound
-            int prod_dim = 1;  // current maximum boundary
-            auto it_sub_dim_begin = it_dim_begin;
-            auto it_sub_dim_end = it_dim_end;
-            for (; it_sub_dim_begin != it_dim_end; it_sub_dim_begin++) {
-                prod_dim = reduce_prod(it_sub_dim_begin, it_dim_end);
-                if (i % prod_dim == 0) {
-                    break;
-                }
-            }
-            assert(it_sub_dim_end !=
-                   it_sub_dim_begin);  // must be on some boundary
-            if (it_sub_dim_begin == it_dim_begin) {
+            auto sub_type = type;
+            for (; sub_type->tag == KOOPA_TYPE_ARRAY; sub_type = sub_type->base)
+                if (i % (sub_type->size / 4) == 0) break;
+            // must be on some boundary
+            assert(sub_type->tag == KOOPA_TYPE_ARRAY);
+            if (sub_type == type) {
                 assert(i == 0);  // must be a smaller boundary
-                it_sub_dim_begin++;
-                assert(it_sub_dim_begin != it_dim_end);
-                prod_dim = reduce_prod(it_sub_dim_begin, it_dim_end);
+                sub_type = sub_type->base;
+                assert(sub_type->tag == KOOPA_TYPE_ARRAY);
             }
-            pad_zero_initval_aggregate(irgen, p_sub_val, it_sub_dim_begin,
-                                       it_sub_dim_end, full_array);
-            i += prod_dim;
+            pad_zero_initval_aggregate(irgen, p_sub_val, sub_type, full_array);
+            i += sub_type->size / 4;
         }
     }
     // pad zero for all the remaining elements
-    int prod_dim = reduce_prod(it_dim_begin, it_dim_end);
-    for (; i < prod_dim; i++) full_array.push_back(0);
+    for (; i < type->size / 4; i++) full_array.push_back(0);
 }
 
-// This function promises a valid and simple aggregation result
+// every int32 of the array, with the missing ones padded zero
 static void analyze_initval_aggregate(IRGenerator &irgen, InitValAST *ast,
-                                      std::vector<int> &dims,
-                                      KoopaAggregate &ret_agg) {
-    assert(dims.size() != 0);
-    std::vector<int> full_array;
-
-    pad_zero_initval_aggregate(irgen, ast, dims.begin(), dims.end(),
-                               full_array);
-    int prod_dim = reduce_prod(dims.begin(), dims.end());
-    assert(full_array.size() == prod_dim);
-
-    simplify_aggregate_full_array(full_array.begin(), full_array.end(),
-                                  dims.begin(), dims.end(), ret_agg);
+                                      const KoopaType *type,
+                                      std::vector<int> &full_array) {
+    assert(type->tag == KOOPA_TYPE_ARRAY);
+    pad_zero_initval_aggregate(irgen, ast, type, full_array);
+    assert(full_array.size() == type->size / 4);
 }
 
 // dump koopa
 
-void StartAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    // dump sysy library function
-    out << "decl @getint(): i32" << std::endl;
-    out << "decl @getch(): i32" << std::endl;
-    out << "decl @getarray(*i32): i32" << std::endl;
-    out << "decl @putint(i32)" << std::endl;
-    out << "decl @putch(i32)" << std::endl;
-    out << "decl @putarray(i32, *i32)" << std::endl;
-    out << "decl @starttime()" << std::endl;
-    out << "decl @stoptime()" << std::endl;
+void dump_koopa_sysy_lib(IRGenerator &irgen, std::ostream &out) {
+    // name, return type, param is ptr, koopa decl
+    static const struct {
+        const char *name;
+        const char *func_type;
+        std::vector<bool> is_func_param_ptr;
+        const char *decl;
+    } sysy_lib[] = {
+        {"getint", "int", {}, "decl @getint(): i32"},
+        {"getch", "int", {}, "decl @getch(): i32"},
+        {"getarray", "int", {true}, "decl @getarray(*i32): i32"},
+        {"putint", "void", {false}, "decl @putint(i32)"},
+        {"putch", "void", {false}, "decl @putch(i32)"},
+        {"putarray", "void", {false, true}, "decl @putarray(i32, *i32)"},
+        {"starttime", "void", {}, "decl @starttime()"},
+        {"stoptime", "void", {}, "decl @stoptime()"},
+    };
+
+    for (auto &func : sysy_lib) {
+        irgen.emitter->lib_decl(out, func.decl);
+        // add these functions to global symbol table
+        irgen.symbol_table.insert_func_entry(func.name, func.func_type,
+                                             func.is_func_param_ptr);
+        irgen.symbol_table.insert_global_decl(func.name, func.decl);
+    }
     out << std::endl;
+}
 
-    // add these functions to global symbol table
-    irgen.symbol_table.insert_func_entry("getint", "int", std::vector<bool>());
-    irgen.symbol_table.insert_func_entry("getch", "int", std::vector<bool>());
-    irgen.symbol_table.insert_func_entry("getarray", "int",
-                                         std::vector<bool>({true}));
-    irgen.symbol_table.insert_func_entry("putint", "void",
-                                         std::vector<bool>({false}));
-    irgen.symbol_table.insert_func_entry("putch", "void",
-                                         std::vector<bool>({false}));
-    irgen.symbol_table.insert_func_entry("putarray", "void",
-                                         std::vector<bool>({false, true}));
-    irgen.symbol_table.insert_func_entry("starttime", "void",
-                                         std::vector<bool>());
-    irgen.symbol_table.insert_func_entry("stoptime", "void",
-                                         std::vector<bool>());
+void StartAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+    // dump sysy library function
+    dump_koopa_sysy_lib(irgen, out);
 
     // the actual dumping order is reverse!
     for (auto it = units.rbegin(); it != units.rend(); it++) {
@@ -219,7 +127,7 @@ void DeclDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
         } else {
             irgen.symbol_table.insert_var_entry(ident);
             if (irgen.symbol_table.is_global_symbol_table()) {
-                std::string store_val = "zeroinit";
+                std::vector<int> init;  // zeroinit if empty
                 if (init_val.get()) {
                     auto exp =
                         dynamic_cast<InitValAST *>(init_val.get())->exp.get();
@@ -227,12 +135,14 @@ void DeclDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
                     int exp_val;
                     assert(dynamic_cast<CalcAST *>(exp)->calc_val(
                         irgen, exp_val, true));
-                    store_val = std::to_string(exp_val);
+                    init.push_back(exp_val);
                 }
 
                 auto var_name = irgen.symbol_table.get_var_name(ident);
-                out << "global " << var_name << " = alloc i32, " << store_val
-                    << std::endl;
+                irgen.emitter->global_alloc(
+                    out, var_name, irgen.symbol_table.types.get_int32(), init);
+                irgen.symbol_table.insert_global_decl(
+                    ident, "global " + var_name + " = alloc i32, zeroinit");
 
             } else {
                 // store initial value to memory, if there is
@@ -247,11 +157,10 @@ void DeclDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
                 }
 
                 auto var_name = irgen.symbol_table.get_var_name(ident);
-                out << "  " << var_name << " = alloc i32" << std::endl;
-                if (init_val.get()) {
-                    out << "  store " << store_val << ", " << var_name
-                        << std::endl;
-                }
+                irgen.emitter->alloc(out, var_name,
+                                     irgen.symbol_table.types.get_int32());
+                if (init_val.get())
+                    irgen.emitter->store(out, store_val, var_name);
             }
         }
     } else {  // array
@@ -266,50 +175,36 @@ void DeclDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
         }
 
         // add to symbol table
-        irgen.symbol_table.insert_array_entry(ident, dims);
-
-        // infer array type
-        std::string array_type = "i32";
-        for (auto it = dims.rbegin(); it != dims.rend(); it++) {
-            array_type = "[" + array_type + ", " + std::to_string(*it) + "]";
-        }
+        auto &types = irgen.symbol_table.types;
+        auto type = types.get_array(types.get_int32(), dims);
+        irgen.symbol_table.insert_array_entry(ident, type);
 
         // global alloc / local alloc
+        auto array_name = irgen.symbol_table.get_array_name(ident);
+        std::vector<int> init;  // zeroinit if empty
+        if (init_val.get())
+            analyze_initval_aggregate(
+                irgen, dynamic_cast<InitValAST *>(init_val.get()), type, init);
         if (irgen.symbol_table.is_global_symbol_table()) {
-            auto array_name = irgen.symbol_table.get_array_name(ident);
-            out << "global " << array_name << " = alloc " << array_type;
-            if (init_val.get()) {
-                KoopaAggregate agg;
-                analyze_initval_aggregate(
-                    irgen, dynamic_cast<InitValAST *>(init_val.get()), dims,
-                    agg);
-                out << ", " << agg.to_string();
-            } else {
-                out << ", zeroinit" << std::endl;
-            }
-            out << std::endl;
+            irgen.emitter->global_alloc(out, array_name, type, init);
+            auto decl = "global " + array_name + " = alloc " + type->str;
+            irgen.symbol_table.insert_global_decl(ident, decl + ", zeroinit");
 
         } else {
-            auto array_name = irgen.symbol_table.get_array_name(ident);
-            out << "  " << array_name << " = alloc " << array_type << std::endl;
-            if (init_val.get()) {
-                KoopaAggregate agg;
-                analyze_initval_aggregate(
-                    irgen, dynamic_cast<InitValAST *>(init_val.get()), dims,
-                    agg);
-                out << "  store " << agg.to_string() << ", " << array_name
-                    << std::endl;
-            }
+            irgen.emitter->alloc(out, array_name, type);
+            if (init_val.get())
+                irgen.emitter->store_init(out, array_name, type, init);
         }
     }
 }
 
 void FuncDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    out << "fun @" << ident << "(";
     irgen.symbol_table.push_block();
 
     // dump param list
     std::vector<bool> is_func_param_ptr;
+    IREmitter::params_t emitted_params;
+    std::string decl_params;  // param types for streaming decl
     int cnt_param = 0;
     for (auto &param_ : params) {
         auto param = (FuncFParamAST *)(param_.get());
@@ -318,7 +213,7 @@ void FuncDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
         is_func_param_ptr.push_back(param->is_ptr);
 
         std::string param_name;
-        std::string param_type;
+        const KoopaType *param_type;
         if (param->is_ptr) {
             // infer param type
             std::vector<int> dims;
@@ -330,24 +225,28 @@ void FuncDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
                 dims.push_back(dim);
             }
 
-            irgen.symbol_table.insert_array_entry(param->ident, dims, true);
+            auto &types = irgen.symbol_table.types;
+            auto type = types.get_array(types.get_int32(), dims);
+            irgen.symbol_table.insert_array_entry(param->ident,
+                                                  types.get_pointer(type));
             param_name = irgen.symbol_table.get_array_name(param->ident);
             param_type = irgen.symbol_table.get_array_entry_type(param->ident);
 
         } else {
             irgen.symbol_table.insert_var_entry(param->ident);
             param_name = irgen.symbol_table.get_var_name(param->ident);
-            param_type = "i32";
+            param_type = irgen.symbol_table.types.get_int32();
         }
-        out << "@" << param_name.c_str() + 1;
-        out << ": " << param_type;
-        if (++cnt_param < params.size()) out << ", ";
+        emitted_params.push_back(
+            std::make_pair("@" + param_name.substr(1), param_type));
+        decl_params += param_type->str;
+        if (++cnt_param < params.size()) decl_params += ", ";
     }
-    out << ")";
 
     // dump func type
+    std::string decl = "decl @" + ident + "(" + decl_params + ")";
     if (func_type == "int") {
-        out << ": i32 ";
+        decl += ": i32";
     } else if (func_type == "void") {
     } else {
         std::cerr << "FuncDefAST: invalid func type: " << func_type
@@ -358,27 +257,15 @@ void FuncDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
     irgen.symbol_table.insert_func_entry(ident, func_type, is_func_param_ptr);
 
     // prepare the first basic block for control flow
-    out << "{" << std::endl;
+    irgen.emitter->func_begin(out, ident, emitted_params, func_type == "int");
     auto block_name = irgen.new_block();
     irgen.control_flow.init_entry_block(block_name, out);
 
     // duplicate formal parameters
-    cnt_param = 0;
-    for (auto &param_ : params) {
-        auto param = (FuncFParamAST *)(param_.get());
-        std::string param_name;
-        std::string param_type;
-        if (is_func_param_ptr[cnt_param]) {
-            param_name = irgen.symbol_table.get_array_name(param->ident);
-            param_type = irgen.symbol_table.get_array_entry_type(param->ident);
-        } else {
-            param_name = irgen.symbol_table.get_var_name(param->ident);
-            param_type = "i32";
-        }
-        out << "  " << param_name << " = alloc " << param_type << std::endl;
-        out << "  store @" << param_name.c_str() + 1 << ", " << param_name
-            << std::endl;
-        cnt_param++;
+    for (auto &param : emitted_params) {
+        auto local_name = "%" + param.first.substr(1);
+        irgen.emitter->alloc(out, local_name, param.second);
+        irgen.emitter->store(out, param.first, local_name);
     }
 
     block->dump_koopa(irgen, out);
@@ -390,177 +277,275 @@ void FuncDefAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
         irgen.control_flow.modify_ending_status(
             BASIC_BLOCK_ENDING_STATUS_RETURN);
         if (func_type == "int") {
-            out << "  ret 1919810" << std::endl;
+            irgen.emitter->ret(out, "1919810");
         } else if (func_type == "void") {
-            out << "  ret" << std::endl;
+            irgen.emitter->ret(out, "");
         } else {
             assert(false);
         }
     }
-    irgen.control_flow.cur_block = "";
+    irgen.control_flow.reset();
+
+    irgen.emitter->func_end(out);
+
+    irgen.symbol_table.insert_global_decl(ident, decl);
+}
+
+// release deep AST
+
+static std::vector<std::unique_ptr<BaseAST>> released_asts;
+static bool is_releasing_ast = false;
+
+static void release_ast_children() {
+    if (is_releasing_ast) return;  // an outer call will destroy them
+    is_releasing_ast = true;
+    while (!released_asts.empty()) {
+        auto ast = std::move(released_asts.back());
+        released_asts.pop_back();
+        ast.reset();
+    }
+    is_releasing_ast = false;
+}
+
+void release_ast_children(
+    std::initializer_list<std::unique_ptr<BaseAST> *> children) {
+    for (auto child : children)
+        if (*child) released_asts.push_back(std::move(*child));
+    release_ast_children();
+}
 
-    out << "}" << std::endl;
+void release_ast_children(std::vector<std::unique_ptr<BaseAST>> &children) {
+    for (auto &child : children)
+        if (child) released_asts.push_back(std::move(child));
+    release_ast_children();
 }
 
-void BlockAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    for (auto &item : items) {
-        // if block has ending status, early exit.
-        auto status = irgen.control_flow.check_ending_status();
-        if (status != BASIC_BLOCK_ENDING_STATUS_NULL) break;
-        item->dump_koopa(irgen, out);
+// dump stmts & exps by steps
+
+void StepAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+    // tasks below base belong to whoever is dumping this node
+    auto base = irgen.tasks.size();
+    _schedule(irgen, 0);
+    while (irgen.tasks.size() > base) {
+        auto task = irgen.tasks.back();
+        irgen.tasks.pop_back();
+        task.ast->dump_koopa_step(irgen, out, task.stage);
     }
 }
 
-void BlockItemAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    item->dump_koopa(irgen, out);
+void StepAST::_schedule(IRGenerator &irgen, std::ostream &out,
+                        const BaseAST *child) {
+    auto step_child = dynamic_cast<const StepAST *>(child);
+    if (step_child)
+        step_child->_schedule(irgen, 0);
+    else
+        child->dump_koopa(irgen, out);
+}
+
+// stage i: dump the ith item
+void BlockAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                               int stage) const {
+    if (stage == (int)items.size()) return;
+    // if block has ending status, early exit.
+    auto status = irgen.control_flow.check_ending_status();
+    if (status != BASIC_BLOCK_ENDING_STATUS_NULL) return;
+    _schedule(irgen, stage + 1);
+    _schedule(irgen, out, items[stage].get());
+}
+
+void BlockItemAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                                   int stage) const {
+    _schedule(irgen, out, item.get());
 }
 
-// dump next basic block while taking care of control flow
-static void dump_next_basic_block(BaseAST *stmt, std::string cur_block,
-                                  std::string end_block, IRGenerator &irgen,
-                                  std::ostream &out) {
-    // switch to current block
+// switch to a new basic block, before dumping a stmt into it
+static void begin_next_basic_block(std::string cur_block, IRGenerator &irgen,
+                                   std::ostream &out) {
     assert(irgen.control_flow.switch_control_flow(cur_block, out));
-    // dump to current block
-    stmt->dump_koopa(irgen, out);
-    // jump to ending when current block hasn't finished
+}
+
+// after dumping the stmt, jump to ending when current block hasn't finished
+static void end_next_basic_block(std::string end_block, IRGenerator &irgen,
+                                 std::ostream &out) {
     if (irgen.control_flow.check_ending_status() ==
         BASIC_BLOCK_ENDING_STATUS_NULL) {
-        out << "  jump " << end_block << std::endl;
+        irgen.emitter->jump(out, end_block);
         irgen.control_flow.modify_ending_status(BASIC_BLOCK_ENDING_STATUS_JUMP);
         irgen.control_flow.add_control_edge(end_block);
     }
 }
 
-void StmtAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+static std::string pop_stack_val(IRGenerator &irgen) {
+    auto val = irgen.stack_val.top();
+    irgen.stack_val.pop();
+    return val;
+}
+
+// Block names of if & while are kept on stack_val while dumping sub stmts,
+// which always leave stack_val as it was.
+void StmtAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                              int stage) const {
     if (type == STMT_AST_TYPE_ASSIGN) {
-        assert(exp.get() != nullptr);
-        exp->dump_koopa(irgen, out);
-        auto r_val = irgen.stack_val.top();
-        irgen.stack_val.pop();
-
-        // lval shouldn't be const
-        auto lval_name = dynamic_cast<LValAST *>(lval.get())->ident;
-        auto lval_type = irgen.symbol_table.get_entry_type(lval_name);
-        if (lval_type == SYMBOL_TABLE_ENTRY_VAR) {
-            assert(!irgen.symbol_table.is_const_var_entry(lval_name));
-            auto lval_var_name = irgen.symbol_table.get_var_name(lval_name);
-            out << "  store " << r_val << ", " << lval_var_name << std::endl;
-        } else if (lval_type == SYMBOL_TABLE_ENTRY_ARRAY) {
-            dynamic_cast<LValAST *>(lval.get())
-                ->dump_koopa_parse_indexes(irgen, out);
-            std::string ptr_index = irgen.stack_val.top();
-            irgen.stack_val.pop();
-            out << "  store " << r_val << ", " << ptr_index << std::endl;
-        } else {
-            std::cerr << "StmtAST: invalid lval type!" << std::endl;
-            assert(false);
+        auto lval_ast = dynamic_cast<LValAST *>(lval.get());
+        if (stage == 0) {
+            assert(exp.get() != nullptr);
+            _schedule(irgen, 1);
+            _schedule(irgen, out, exp.get());
+            return;
         }
+        if (stage == 1) {
+            // lval shouldn't be const
+            auto lval_name = lval_ast->ident;
+            auto lval_type = irgen.symbol_table.get_entry_type(lval_name);
+            if (lval_type == SYMBOL_TABLE_ENTRY_VAR) {
+                auto r_val = pop_stack_val(irgen);
+                assert(!irgen.symbol_table.is_const_var_entry(lval_name));
+                auto lval_var_name = irgen.symbol_table.get_var_name(lval_name);
+                irgen.emitter->store(out, r_val, lval_var_name);
+            } else if (lval_type == SYMBOL_TABLE_ENTRY_ARRAY) {
+                // keep r_val on stack until the pointer is parsed
+                _schedule(irgen, 2);
+                lval_ast->schedule_parse_indexes(irgen);
+            } else {
+                std::cerr << "StmtAST: invalid lval type!" << std::endl;
+                assert(false);
+            }
+            return;
+        }
+        std::string ptr_index = pop_stack_val(irgen);
+        auto r_val = pop_stack_val(irgen);
+        irgen.emitter->store(out, r_val, ptr_index);
 
     } else if (type == STMT_AST_TYPE_RETURN) {
-        if (exp.get() != nullptr) {
-            exp->dump_koopa(irgen, out);
-            auto ret_val = irgen.stack_val.top();
-            irgen.stack_val.pop();
-            out << "  ret " << ret_val << std::endl;
-        } else {
-            out << "  ret" << std::endl;
+        if (exp.get() != nullptr && stage == 0) {
+            _schedule(irgen, 1);
+            _schedule(irgen, out, exp.get());
+            return;
         }
+        if (exp.get() != nullptr)
+            irgen.emitter->ret(out, pop_stack_val(irgen));
+        else
+            irgen.emitter->ret(out, "");
         irgen.control_flow.modify_ending_status(
             BASIC_BLOCK_ENDING_STATUS_RETURN);  // block should return
 
     } else if (type == STMT_AST_TYPE_EXP) {
-        if (exp.get() != nullptr) {
-            exp->dump_koopa(irgen, out);
+        if (exp.get() != nullptr && stage == 0) {
+            _schedule(irgen, 1);
+            _schedule(irgen, out, exp.get());
+        } else if (exp.get() != nullptr) {
             irgen.stack_val.pop();  // no one use it
         }
 
     } else if (type == STMT_AST_TYPE_BLOCK) {
-        irgen.symbol_table.push_block();
-        block->dump_koopa(irgen, out);
-        irgen.symbol_table.pop_block();
+        if (stage == 0) {
+            irgen.symbol_table.push_block();
+            _schedule(irgen, 1);
+            _schedule(irgen, out, block.get());
+        } else {
+            irgen.symbol_table.pop_block();
+        }
 
     } else if (type == STMT_AST_TYPE_IF) {
-        // dump condition expression
-        assert(exp.get() != nullptr);
-        exp->dump_koopa(irgen, out);
-        auto cond = irgen.stack_val.top();
-        irgen.stack_val.pop();
-        // TODO: if cond is pre-determined, bypass the following procedure
-
-        // generate then, else, end basic blocks
         assert(then_stmt.get() != nullptr);
-        if (else_stmt.get() != nullptr) {
-            auto then_block_name = irgen.new_block();
-            auto end_block_name = irgen.new_block();
-            auto else_block_name = irgen.new_block();
-
-            // finish current block
-            irgen.control_flow.modify_ending_status(
-                BASIC_BLOCK_ENDING_STATUS_BRANCH);
-            out << "  br " << cond << ", " << then_block_name << ", "
-                << else_block_name << std::endl;
-
-            irgen.control_flow.insert_if_else(then_block_name, else_block_name,
-                                              end_block_name);
-
-            dump_next_basic_block(then_stmt.get(), then_block_name,
-                                  end_block_name, irgen, out);
-            dump_next_basic_block(else_stmt.get(), else_block_name,
-                                  end_block_name, irgen, out);
-
-            irgen.control_flow.switch_control_flow(end_block_name, out);
+        bool has_else = else_stmt.get() != nullptr;
+        if (stage == 0) {
+            // dump condition expression
+            assert(exp.get() != nullptr);
+            _schedule(irgen, 1);
+            _schedule(irgen, out, exp.get());
+            return;
+        }
+        if (stage == 1) {
+            auto cond = pop_stack_val(irgen);
+            // TODO: if cond is pre-determined, bypass the following procedure
 
-        } else {
+            // generate then, else, end basic blocks
             auto then_block_name = irgen.new_block();
             auto end_block_name = irgen.new_block();
+            auto else_block_name =
+                has_else ? irgen.new_block() : end_block_name;
 
             // finish current block
             irgen.control_flow.modify_ending_status(
                 BASIC_BLOCK_ENDING_STATUS_BRANCH);
-            out << "  br " << cond << ", " << then_block_name << ", "
-                << end_block_name << std::endl;
-
-            irgen.control_flow.insert_if(then_block_name, end_block_name);
-
-            dump_next_basic_block(then_stmt.get(), then_block_name,
-                                  end_block_name, irgen, out);
+            irgen.emitter->branch(out, cond, then_block_name,
+                                  else_block_name);
+
+            if (has_else)
+                irgen.control_flow.insert_if_else(
+                    then_block_name, else_block_name, end_block_name);
+            else
+                irgen.control_flow.insert_if(then_block_name, end_block_name);
+
+            irgen.stack_val.push(else_block_name);
+            irgen.stack_val.push(end_block_name);
+            begin_next_basic_block(then_block_name, irgen, out);
+            _schedule(irgen, 2);
+            _schedule(irgen, out, then_stmt.get());
+            return;
+        }
 
-            irgen.control_flow.switch_control_flow(end_block_name, out);
+        auto end_block_name = pop_stack_val(irgen);
+        auto else_block_name = pop_stack_val(irgen);
+        end_next_basic_block(end_block_name, irgen, out);
+        if (stage == 2 && has_else) {
+            irgen.stack_val.push(else_block_name);
+            irgen.stack_val.push(end_block_name);
+            begin_next_basic_block(else_block_name, irgen, out);
+            _schedule(irgen, 3);
+            _schedule(irgen, out, else_stmt.get());
+            return;
         }
+        irgen.control_flow.switch_control_flow(end_block_name, out);
 
     } else if (type == STMT_AST_TYPE_WHILE) {
         assert(exp.get() != nullptr);
         assert(do_stmt.get() != nullptr);
+        if (stage == 0) {
+            // generate entry, body, end block
+            auto entry_block_name = irgen.new_block();
+            auto body_block_name = irgen.new_block();
+            auto end_block_name = irgen.new_block();
 
-        // generate entry, body, end block
-        auto entry_block_name = irgen.new_block();
-        auto body_block_name = irgen.new_block();
-        auto end_block_name = irgen.new_block();
-
-        irgen.control_flow.insert_while(entry_block_name, body_block_name,
-                                        end_block_name);
-
-        // finish current block
-        out << "  jump " << entry_block_name << std::endl;
-        irgen.control_flow.modify_ending_status(BASIC_BLOCK_ENDING_STATUS_JUMP);
-
-        // dump entry block
-        assert(irgen.control_flow.switch_control_flow(entry_block_name, out));
+            irgen.control_flow.insert_while(entry_block_name, body_block_name,
+                                            end_block_name);
 
-        exp->dump_koopa(irgen, out);
-        auto cond = irgen.stack_val.top();
-        irgen.stack_val.pop();
-        // TODO: if cond is pre-determined, bypass the following procedure
+            // finish current block
+            irgen.emitter->jump(out, entry_block_name);
+            irgen.control_flow.modify_ending_status(
+                BASIC_BLOCK_ENDING_STATUS_JUMP);
+
+            // dump entry block
+            assert(irgen.control_flow.switch_control_flow(entry_block_name,
+                                                          out));
+            irgen.stack_val.push(entry_block_name);
+            irgen.stack_val.push(body_block_name);
+            irgen.stack_val.push(end_block_name);
+            _schedule(irgen, 1);
+            _schedule(irgen, out, exp.get());
+            return;
+        }
+        if (stage == 1) {
+            auto cond = pop_stack_val(irgen);
+            auto end_block_name = pop_stack_val(irgen);
+            auto body_block_name = pop_stack_val(irgen);
+            // TODO: if cond is pre-determined, bypass the following procedure
 
-        out << "  br " << cond << ", " << body_block_name << ", "
-            << end_block_name << std::endl;
-        irgen.control_flow.modify_ending_status(
-            BASIC_BLOCK_ENDING_STATUS_BRANCH);
+            irgen.emitter->branch(out, cond, body_block_name, end_block_name);
+            irgen.control_flow.modify_ending_status(
+                BASIC_BLOCK_ENDING_STATUS_BRANCH);
 
-        // dump body block, same as if-then-else stmt
-        dump_next_basic_block(do_stmt.get(), body_block_name, entry_block_name,
-                              irgen, out);
+            // dump body block, same as if-then-else stmt
+            irgen.stack_val.push(end_block_name);
+            begin_next_basic_block(body_block_name, irgen, out);
+            _schedule(irgen, 2);
+            _schedule(irgen, out, do_stmt.get());
+            return;
+        }
+        auto end_block_name = pop_stack_val(irgen);
+        auto entry_block_name = pop_stack_val(irgen);
+        end_next_basic_block(entry_block_name, irgen, out);
 
         // dump end block
         assert(irgen.control_flow.switch_control_flow(end_block_name, out));
@@ -576,64 +561,54 @@ void StmtAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
     }
 }
 
-void ExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    binary_exp->dump_koopa(irgen, out);
+void ExpAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                             int stage) const {
+    _schedule(irgen, out, binary_exp.get());
     return;  // needless to operate on stack
 }
 
-void BinaryExpAST::dump_koopa_land_lor(IRGenerator &irgen,
-                                       std::ostream &out) const {
+// stage 0: dump lhs
+// stage 1: short circuit, or dump rhs
+// stage 2: rhs after a const lhs
+// stage 3: rhs in its own block, with exp_val and end block on stack_val
+void BinaryExpAST::dump_koopa_land_lor(IRGenerator &irgen, std::ostream &out,
+                                       int stage) const {
     assert(op == "&&" || op == "||");
 
-    // dump lhs first
-    l_exp->dump_koopa(irgen, out);
-    auto l_val = irgen.stack_val.top();
-    irgen.stack_val.pop();
-
-    if (!is_symbol(l_val)) {
-        auto lhs = std::stoi(l_val);
-        if (op == "&&" && lhs == 0) {
-            irgen.stack_val.push("0");
-            return;
-        }
-        if (op == "||" && lhs != 0) {
-            irgen.stack_val.push("1");
-            return;
-        }
+    if (stage == 0) {
+        // dump lhs first
+        _schedule(irgen, 1);
+        _schedule(irgen, out, l_exp.get());
+        return;
+    }
 
-        // Knowing that lhs is const we directly dump rhs
-        r_exp->dump_koopa(irgen, out);
-        auto r_val = irgen.stack_val.top();
-        irgen.stack_val.pop();
+    if (stage == 1) {
+        auto l_val = pop_stack_val(irgen);
 
-        if (!is_symbol(r_val)) {
-            auto rhs = std::stoi(r_val);
-            if (rhs == 0) {
+        if (!is_symbol(l_val)) {
+            auto lhs = std::stoi(l_val);
+            if (op == "&&" && lhs == 0) {
                 irgen.stack_val.push("0");
                 return;
-            } else {
+            }
+            if (op == "||" && lhs != 0) {
                 irgen.stack_val.push("1");
                 return;
             }
 
-        } else {
-            // rhs is variable, we check if it's non-zero
-            auto lr_val = irgen.new_val();
-            out << "  " << lr_val << " = ne " << r_val << ", 0" << std::endl;
-            irgen.stack_val.push(lr_val);  // needless to &&
+            // Knowing that lhs is const we directly dump rhs
+            _schedule(irgen, 2);
+            _schedule(irgen, out, r_exp.get());
             return;
         }
 
-    } else {
         // not a symbol. prepare return val first
         // &&: exp_val = l_val ? r_val != 0 : 0;
         // ||: exp_val = l_val ? 1 : r_val != 0;
         auto exp_val = irgen.new_val();
-        out << "  " << exp_val << " = alloc i32" << std::endl;
-        if (op == "&&")
-            out << "  store " << 0 << ", " << exp_val << std::endl;
-        else
-            out << "  store " << 1 << ", " << exp_val << std::endl;
+        auto &types = irgen.symbol_table.types;
+        irgen.emitter->alloc(out, exp_val, types.get_int32());
+        irgen.emitter->store(out, op == "&&" ? "0" : "1", exp_val);
 
         // similar to if-then-end stmt
         auto then_block_name = irgen.new_block();
@@ -642,53 +617,82 @@ void BinaryExpAST::dump_koopa_land_lor(IRGenerator &irgen,
         // finish current block
         irgen.control_flow.modify_ending_status(
             BASIC_BLOCK_ENDING_STATUS_BRANCH);
-        if (op == "&&")
-            out << "  br " << l_val << ", " << then_block_name << ", "
-                << end_block_name << std::endl;  // l != 0 ? r : 0;
-        else
-            out << "  br " << l_val << ", " << end_block_name << ", "
-                << then_block_name << std::endl;  // l != 0 ? 1 : r;
+        if (op == "&&")  // l != 0 ? r : 0;
+            irgen.emitter->branch(out, l_val, then_block_name, end_block_name);
+        else  // l != 0 ? 1 : r;
+            irgen.emitter->branch(out, l_val, end_block_name, then_block_name);
 
         irgen.control_flow.insert_if(then_block_name, end_block_name);
         assert(irgen.control_flow.switch_control_flow(then_block_name, out));
 
-        r_exp->dump_koopa(irgen, out);
-        auto r_val = irgen.stack_val.top();
-        irgen.stack_val.pop();
-
-        auto lr_val = irgen.new_val();
-        out << "  " << lr_val << " = ne " << r_val << ", 0" << std::endl;
-        out << "  store " << lr_val << ", " << exp_val << std::endl;
+        irgen.stack_val.push(exp_val);
+        irgen.stack_val.push(end_block_name);
+        _schedule(irgen, 3);
+        _schedule(irgen, out, r_exp.get());
+        return;
+    }
 
-        assert(irgen.control_flow.check_ending_status() ==
-               BASIC_BLOCK_ENDING_STATUS_NULL);
-        out << "  jump " << end_block_name << std::endl;
-        irgen.control_flow.modify_ending_status(BASIC_BLOCK_ENDING_STATUS_JUMP);
-        irgen.control_flow.add_control_edge(end_block_name);
+    if (stage == 2) {
+        auto r_val = pop_stack_val(irgen);
 
-        assert(irgen.control_flow.switch_control_flow(end_block_name, out));
+        if (!is_symbol(r_val)) {
+            auto rhs = std::stoi(r_val);
+            if (rhs == 0) {
+                irgen.stack_val.push("0");
+                return;
+            } else {
+                irgen.stack_val.push("1");
+                return;
+            }
 
-        // load to register
-        auto ret_val = irgen.new_val();
-        out << "  " << ret_val << " = load " << exp_val << std::endl;
-        irgen.stack_val.push(ret_val);
-        return;
+        } else {
+            // rhs is variable, we check if it's non-zero
+            auto lr_val = irgen.new_val();
+            irgen.emitter->binary(out, lr_val, KOOPA_RBO_NOT_EQ, r_val, "0");
+            irgen.stack_val.push(lr_val);  // needless to &&
+            return;
+        }
     }
+
+    auto r_val = pop_stack_val(irgen);
+    auto end_block_name = pop_stack_val(irgen);
+    auto exp_val = pop_stack_val(irgen);
+
+    auto lr_val = irgen.new_val();
+    irgen.emitter->binary(out, lr_val, KOOPA_RBO_NOT_EQ, r_val, "0");
+    irgen.emitter->store(out, lr_val, exp_val);
+
+    assert(irgen.control_flow.check_ending_status() ==
+           BASIC_BLOCK_ENDING_STATUS_NULL);
+    irgen.emitter->jump(out, end_block_name);
+    irgen.control_flow.modify_ending_status(BASIC_BLOCK_ENDING_STATUS_JUMP);
+    irgen.control_flow.add_control_edge(end_block_name);
+
+    assert(irgen.control_flow.switch_control_flow(end_block_name, out));
+
+    // load to register
+    auto ret_val = irgen.new_val();
+    irgen.emitter->load(out, ret_val, exp_val);
+    irgen.stack_val.push(ret_val);
 }
 
-void BinaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+void BinaryExpAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                                   int stage) const {
     if (op == "&&" || op == "||") {
-        dump_koopa_land_lor(irgen, out);
+        dump_koopa_land_lor(irgen, out, stage);
         return;
     }
 
-    l_exp->dump_koopa(irgen, out);
-    auto l_val = irgen.stack_val.top();
-    irgen.stack_val.pop();
+    if (stage == 0) {
+        // lhs runs first, then rhs
+        _schedule(irgen, 1);
+        _schedule(irgen, out, r_exp.get());
+        _schedule(irgen, out, l_exp.get());
+        return;
+    }
 
-    r_exp->dump_koopa(irgen, out);
-    auto r_val = irgen.stack_val.top();
-    irgen.stack_val.pop();
+    auto r_val = pop_stack_val(irgen);
+    auto l_val = pop_stack_val(irgen);
 
     // Optimization: calculate directly if l_val and r_val are const
     if (!is_symbol(l_val) && !is_symbol(r_val)) {
@@ -726,45 +730,62 @@ void BinaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
     }
 
     // dump exp w.r.t. op
-    auto exp_val = irgen.new_val();
-    out << "  " << exp_val << " = ";
+    koopa_raw_binary_op_t koopa_op;
     if (op == "+")
-        out << "add ";
+        koopa_op = KOOPA_RBO_ADD;
     else if (op == "-") {
-        out << "sub ";
+        koopa_op = KOOPA_RBO_SUB;
     } else if (op == "*") {
-        out << "mul ";
+        koopa_op = KOOPA_RBO_MUL;
     } else if (op == "/") {
-        out << "div ";
+        koopa_op = KOOPA_RBO_DIV;
     } else if (op == "%") {
-        out << "mod ";
+        koopa_op = KOOPA_RBO_MOD;
     } else if (op == "<") {
-        out << "lt ";
+        koopa_op = KOOPA_RBO_LT;
     } else if (op == ">") {
-        out << "gt ";
+        koopa_op = KOOPA_RBO_GT;
     } else if (op == "<=") {
-        out << "le ";
+        koopa_op = KOOPA_RBO_LE;
     } else if (op == ">=") {
-        out << "ge ";
+        koopa_op = KOOPA_RBO_GE;
     } else if (op == "==") {
-        out << "eq ";
+        koopa_op = KOOPA_RBO_EQ;
     } else if (op == "!=") {
-        out << "ne ";
+        koopa_op = KOOPA_RBO_NOT_EQ;
     } else {
         std::cerr << "Invalid op: " << op << std::endl;
         assert(false);
     }
-    out << l_val << ", " << r_val << std::endl;
+    auto exp_val = irgen.new_val();
+    irgen.emitter->binary(out, exp_val, koopa_op, l_val, r_val);
     irgen.stack_val.push(exp_val);
 }
 
-void UnaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+
+// array param is passed as an lval
+static LValAST *get_array_param_lval(BaseAST *param) {
+    auto exp = dynamic_cast<ExpAST *>(param);
+    assert(exp);
+    auto prim_exp = dynamic_cast<PrimaryExpAST *>(exp->binary_exp.get());
+    assert(prim_exp);
+    assert(prim_exp->type == PRIMARY_EXP_AST_TYPE_LVAL);
+    return dynamic_cast<LValAST *>(prim_exp->lval.get());
+}
+
+// Function call dumps its params one by one,
+// stage 2i: dump ith param, stage 2i+1: take pointer of ith array param
+void UnaryExpAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                                  int stage) const {
     if (type == UNARY_EXP_AST_TYPE_OP) {
         // unary_op unary_exp
-        unary_exp->dump_koopa(irgen, out);
+        if (stage == 0) {
+            _schedule(irgen, 1);
+            _schedule(irgen, out, unary_exp.get());
+            return;
+        }
 
-        auto sub_val = irgen.stack_val.top();  // fetch sub expression's token
-        irgen.stack_val.pop();
+        auto sub_val = pop_stack_val(irgen);  // fetch sub expression's token
 
         // Optimization: calculate directly if sub_val is const
         if (!is_symbol(sub_val)) {
@@ -788,12 +809,10 @@ void UnaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
         std::string exp_val;
         if (op == "!") {
             exp_val = irgen.new_val();
-            out << "  " << exp_val << " = ";
-            out << "eq " << sub_val << ", 0" << std::endl;
+            irgen.emitter->binary(out, exp_val, KOOPA_RBO_EQ, sub_val, "0");
         } else if (op == "-") {
             exp_val = irgen.new_val();
-            out << "  " << exp_val << " = ";
-            out << "sub 0, " << sub_val << std::endl;
+            irgen.emitter->binary(out, exp_val, KOOPA_RBO_SUB, "0", sub_val);
         } else if (op == "+") {
             exp_val = sub_val;  // ignore
         } else {
@@ -803,65 +822,58 @@ void UnaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
 
         irgen.stack_val.push(exp_val);  // push exp token to stack
     } else if (type == UNARY_EXP_AST_TYPE_FUNC) {
-        // dump all the exp
-        std::vector<std::string> rparams;
-        int cnt_param = 0;
-        for (auto &param : params) {
-            if (irgen.symbol_table.is_func_param_ptr(ident, cnt_param)) {
-                auto exp = dynamic_cast<ExpAST *>(param.get());
-                assert(exp);
-                auto prim_exp =
-                    dynamic_cast<PrimaryExpAST *>(exp->binary_exp.get());
-                assert(prim_exp);
-                assert(prim_exp->type == PRIMARY_EXP_AST_TYPE_LVAL);
-                auto lval_exp = dynamic_cast<LValAST *>(prim_exp->lval.get());
-                lval_exp->dump_koopa_parse_indexes(irgen, out);
-
-                // get first element ptr
-                auto ptr_arr = irgen.stack_val.top();
-                irgen.stack_val.pop();
-                auto ptr_first_elem = irgen.new_val();
-                if (lval_exp->indexes.size() == 0 &&
-                    irgen.symbol_table.is_ptr_array_entry(lval_exp->ident)) {
-                    auto ptr_ttmp = irgen.new_val();
-                    out << "  " << ptr_ttmp << " = load " << ptr_arr
-                        << std::endl;
-                    out << "  " << ptr_first_elem << " = getptr " << ptr_ttmp
-                        << ", 0" << std::endl;
+        // rparams are left on stack_val until all of them are dumped
+        int cnt_param = stage / 2;
+        if (cnt_param < (int)params.size()) {
+            auto &param = params[cnt_param];
+            bool is_ptr =
+                irgen.symbol_table.is_func_param_ptr(ident, cnt_param);
+            auto lval_exp =
+                is_ptr ? get_array_param_lval(param.get()) : nullptr;
+
+            if (stage % 2 == 0) {
+                if (is_ptr) {
+                    _schedule(irgen, stage + 1);
+                    lval_exp->schedule_parse_indexes(irgen);
                 } else {
-                    out << "  " << ptr_first_elem << " = getelemptr " << ptr_arr
-                        << ", 0" << std::endl;
+                    _schedule(irgen, stage + 2);
+                    _schedule(irgen, out, param.get());
                 }
-                irgen.stack_val.push(ptr_first_elem);
+                return;
+            }
 
+            // get first element ptr
+            auto ptr_arr = pop_stack_val(irgen);
+            auto ptr_first_elem = irgen.new_val();
+            if (lval_exp->indexes.size() == 0 &&
+                irgen.symbol_table.is_ptr_array_entry(lval_exp->ident)) {
+                auto ptr_ttmp = irgen.new_val();
+                irgen.emitter->load(out, ptr_ttmp, ptr_arr);
+                irgen.emitter->get_ptr(out, ptr_first_elem, ptr_ttmp, "0");
             } else {
-                param->dump_koopa(irgen, out);
+                irgen.emitter->get_elem_ptr(out, ptr_first_elem, ptr_arr, "0");
             }
-            rparams.push_back(irgen.stack_val.top());
-            irgen.stack_val.pop();
-
-            cnt_param++;
+            irgen.stack_val.push(ptr_first_elem);
+            _schedule(irgen, stage + 1);
+            return;
         }
 
+        std::vector<std::string> rparams(params.size());
+        for (auto it = rparams.rbegin(); it != rparams.rend(); it++)
+            *it = pop_stack_val(irgen);
+
         assert(ident != "");
         auto func_type = irgen.symbol_table.get_func_entry_type(ident);
+        std::string ret_val;
         if (func_type == "int") {
-            auto ret_val = irgen.new_val();
-            out << "  " << ret_val << " = ";
+            ret_val = irgen.new_val();
             irgen.stack_val.push(ret_val);
         } else if (func_type == "void") {
-            out << "  ";
             irgen.stack_val.push("INVALID");  // keep consistent with other exp
         } else {
             std::cerr << "Unknown func type: " << func_type << std::endl;
         }
-        out << "call @" << ident << "(";
-        cnt_param = 0;
-        for (auto &param : rparams) {
-            out << param;
-            if (++cnt_param != rparams.size()) out << ", ";
-        }
-        out << ")" << std::endl;
+        irgen.emitter->call(out, ret_val, ident, rparams);
 
     } else {
         std::cerr << "Invalid unary exp type: " << type << std::endl;
@@ -869,14 +881,15 @@ void UnaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
     }
 }
 
-void PrimaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
+void PrimaryExpAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                                    int stage) const {
     if (type == PRIMARY_EXP_AST_TYPE_NUMBER) {
         // number
         irgen.stack_val.push(std::to_string(number));
         return;
     } else if (type == PRIMARY_EXP_AST_TYPE_LVAL) {
         // lval
-        lval->dump_koopa(irgen, out);
+        _schedule(irgen, out, lval.get());
         return;  // needless to operate on stack
     } else {
         std::cerr << "Invalid primary exp type: " << type << std::endl;
@@ -884,54 +897,64 @@ void PrimaryExpAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
     }
 }
 
-void LValAST::dump_koopa(IRGenerator &irgen, std::ostream &out) const {
-    auto type = irgen.symbol_table.get_entry_type(ident);
-    if (type == SYMBOL_TABLE_ENTRY_VAR) {
-        if (irgen.symbol_table.is_const_var_entry(ident)) {
-            int val = irgen.symbol_table.get_const_var_val(ident);
-            irgen.stack_val.push(std::to_string(val));
+void LValAST::dump_koopa_step(IRGenerator &irgen, std::ostream &out,
+                              int stage) const {
+    if (stage == LVAL_STAGE_VAL) {
+        auto type = irgen.symbol_table.get_entry_type(ident);
+        if (type == SYMBOL_TABLE_ENTRY_VAR) {
+            if (irgen.symbol_table.is_const_var_entry(ident)) {
+                int val = irgen.symbol_table.get_const_var_val(ident);
+                irgen.stack_val.push(std::to_string(val));
+            } else {
+                auto val = irgen.new_val();
+                auto aliased_name = irgen.symbol_table.get_var_name(ident);
+                irgen.emitter->load(out, val, aliased_name);
+                irgen.stack_val.push(val);
+            }
+        } else if (type == SYMBOL_TABLE_ENTRY_ARRAY) {
+            _schedule(irgen, LVAL_STAGE_LOAD);
+            schedule_parse_indexes(irgen);
         } else {
-            auto val = irgen.new_val();
-            auto aliased_name = irgen.symbol_table.get_var_name(ident);
-            out << "  " << val << " = load " << aliased_name << std::endl;
-            irgen.stack_val.push(val);
+            std::cerr << "LValAST: invalid type!" << std::endl;
+            assert(false);
         }
-    } else if (type == SYMBOL_TABLE_ENTRY_ARRAY) {
-        dump_koopa_parse_indexes(irgen, out);
-        std::string ptr_index = irgen.stack_val.top();
-        irgen.stack_val.pop();
+
+    } else if (stage == LVAL_STAGE_LOAD) {
+        std::string ptr_index = pop_stack_val(irgen);
         std::string val_name = irgen.new_val();
-        out << "  " << val_name << " = load " << ptr_index << std::endl;
+        irgen.emitter->load(out, val_name, ptr_index);
         irgen.stack_val.push(val_name);
+
+    } else if (stage == LVAL_STAGE_PTR) {
+        // array could be partially parsed
+        irgen.stack_val.push(irgen.symbol_table.get_array_name(ident));
+        _schedule(irgen, LVAL_STAGE_PTR + 1);
+
     } else {
-        std::cerr << "LValAST: invalid type!" << std::endl;
-        assert(false);
-    }
-}
+        // odd: dump the index (not necessarily const), even: take its pointer
+        int i = (stage - LVAL_STAGE_PTR - 1) / 2;
+        if (i == (int)indexes.size()) return;  // pointer is on stack_val
+        if ((stage - LVAL_STAGE_PTR) % 2 == 1) {
+            _schedule(irgen, stage + 1);
+            _schedule(irgen, out, indexes[i].get());
+            return;
+        }
 
-void LValAST::dump_koopa_parse_indexes(IRGenerator &irgen,
-                                       std::ostream &out) const {
-    // array could be partially parsed
-    std::string aliased_name = irgen.symbol_table.get_array_name(ident);
-    std::string ptr_index = aliased_name;
-    for (auto it_index = indexes.begin(); it_index != indexes.end();
-         it_index++) {
-        // dump the index (not necessarily const)
-        it_index->get()->dump_koopa(irgen, out);
-        auto dim = irgen.stack_val.top();
-        irgen.stack_val.pop();
+        auto dim = pop_stack_val(irgen);
+        auto ptr_index = pop_stack_val(irgen);
         std::string ptr_tmp = irgen.new_val();
-        if (it_index == indexes.begin() &&
-            irgen.symbol_table.is_ptr_array_entry(ident)) {
+        if (i == 0 && irgen.symbol_table.is_ptr_array_entry(ident)) {
             auto ptr_ttmp = irgen.new_val();
-            out << "  " << ptr_ttmp << " = load " << ptr_index << std::endl;
-            out << "  " << ptr_tmp << " = getptr " << ptr_ttmp << ", " << dim
-                << std::endl;
+            irgen.emitter->load(out, ptr_ttmp, ptr_index);
+            irgen.emitter->get_ptr(out, ptr_tmp, ptr_ttmp, dim);
         } else {
-            out << "  " << ptr_tmp << " = getelemptr " << ptr_index << ", "
-                << dim << std::endl;
+            irgen.emitter->get_elem_ptr(out, ptr_tmp, ptr_index, dim);
         }
-        ptr_index = ptr_tmp;
+        irgen.stack_val.push(ptr_tmp);
+        _schedule(irgen, stage + 1);
     }
-    irgen.stack_val.push(ptr_index);
-}
\ No newline at end of file
+}
+
+void LValAST::schedule_parse_indexes(IRGenerator &irgen) const {
+    _schedule(irgen, LVAL_STAGE_PTR);
+}
@@ -1,25 +1,83 @@
 #include <tcgen.h>
 
-TargetCodeGenerator::TargetCodeGenerator(const char *koopa_file,
-                                         std::ostream &out)
-    : out{out} {
-    koopa_program_t program;
-    koopa_error_code_t ret = koopa_parse_from_file(koopa_file, &program);
-    assert(ret == KOOPA_EC_SUCCESS);
-    builder = koopa_new_raw_program_builder();
-    raw = koopa_build_raw_program(builder, program);
-    koopa_delete_program(program);
-}
+TargetCodeGenerator::TargetCodeGenerator(std::ostream &out)
+    : out{out}, builder(nullptr) {}
 
 TargetCodeGenerator::~TargetCodeGenerator() {
-    koopa_delete_raw_program_builder(builder);
+    if (builder) koopa_delete_raw_program_builder(builder);
 }
 
-int TargetCodeGenerator::dump_riscv() {
-    int ret;
-    ret = dump_koopa_raw_slice(raw.values);
-    ret = dump_koopa_raw_slice(raw.funcs);
-    return ret;
+// Dump one self-contained unit of koopa program, then free its raw program.
+// Globals defined by earlier units are only declared here and skipped.
+int TargetCodeGenerator::dump_riscv_unit(const char *koopa_str) {
+    assert(builder == nullptr);
+    if (parse_raw(koopa_str)) return 1;
+
+    if (ir_dump || analyze_ir || (passes && passes->has_ir_passes()))
+        rebuild_raw_through_ir();
+    int dump_ret = dump_koopa_raw_slice(raw.values);
+    if (!dump_ret) dump_ret = dump_koopa_raw_slice(raw.funcs);
+
+    if (builder) koopa_delete_raw_program_builder(builder);
+    builder = nullptr;
+    return dump_ret;
+}
+
+// Parse koopa text into raw, in place of the raw program before,
+// non-zero if the native parser finds it invalid
+int TargetCodeGenerator::parse_raw(const char *koopa_str) {
+    auto start = std::chrono::steady_clock::now();
+    if (builder) koopa_delete_raw_program_builder(builder);
+    builder = nullptr;
+    if (koopa_parser == KOOPA_PARSER_NATIVE) {
+        if (!native_parser.parse(koopa_str, raw, std::cerr)) return 1;
+    } else {
+        koopa_program_t program;
+        koopa_error_code_t ret = koopa_parse_from_string(koopa_str, &program);
+        assert(ret == KOOPA_EC_SUCCESS);
+        builder = koopa_new_raw_program_builder();
+        raw = koopa_build_raw_program(builder, program);
+        koopa_delete_program(program);
+    }
+    std::chrono::duration<double, std::milli> parse_time =
+        std::chrono::steady_clock::now() - start;
+    if (passes) passes->record_time("koopa-parse", parse_time.count());
+    return 0;
+}
+
+// Build the SSA IR of the raw program, run IR passes on it, and parse its
+// koopa text back, so that the rest of backend still works on a raw program
+void TargetCodeGenerator::rebuild_raw_through_ir() {
+    auto start = std::chrono::steady_clock::now();
+    IRProgram ir;
+    ir.build(raw);
+    std::chrono::duration<double, std::milli> build_time =
+        std::chrono::steady_clock::now() - start;
+
+    // functions of the IR are in the same order as raw ones
+    for (size_t i = 0; i < ir.funcs.size(); i++) {
+        auto &func = ir.funcs[i];
+        if (func.is_decl()) continue;
+        if (analyze_ir) report_ir_analyses(func);
+        if (!passes) continue;
+        if (budget)
+            budget->begin_function((koopa_raw_function_t)raw.funcs.buffer[i]);
+        passes->run_ir_passes(func);
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::stringstream text;
+    ir.print(text);
+    std::chrono::duration<double, std::milli> print_time =
+        std::chrono::steady_clock::now() - start;
+    if (passes) {
+        passes->record_time("ir-build", build_time.count());
+        passes->record_time("ir-print", print_time.count());
+    }
+    if (ir_dump) *ir_dump << text.str();
+
+    auto ret = parse_raw(text.str().c_str());
+    assert(!ret);
 }
 
 // helper functions
@@ -104,50 +162,83 @@ std::string to_koopa_raw_type_tag(koopa_raw_type_tag_t tag) {
 
 // dump riscv inst
 
-void TargetCodeGenerator::dump_riscv_inst(std::string inst,
-                                          std::string reg_0 = "",
-                                          std::string reg_1 = "",
-                                          std::string reg_2 = "") {
-    out << "  ";
-    out << std::left << std::setw(6) << inst;
-    if (reg_0 == "")
-        out << std::endl;
-    else {
-        out << reg_0;
-        if (reg_1 == "")
-            out << std::endl;
-        else {
-            out << ", " << reg_1;
-            if (reg_2 == "")
-                out << std::endl;
-            else
-                out << ", " << reg_2 << std::endl;
-        }
-    }
+// append an inst to current machine block
+
+void TargetCodeGenerator::dump_riscv_inst(riscv_opcode_t op, riscv_reg_t rd,
+                                          riscv_reg_t rs1, riscv_reg_t rs2) {
+    MachineInst inst(op);
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+// sw stores reg to imm(base), others write reg
+void TargetCodeGenerator::dump_riscv_inst(riscv_opcode_t op, riscv_reg_t reg,
+                                          riscv_reg_t base, int imm) {
+    MachineInst inst(op);
+    if (op == RV_SW)
+        inst.rs2 = reg;
+    else
+        inst.rd = reg;
+    inst.rs1 = base;
+    inst.imm = imm;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+void TargetCodeGenerator::dump_riscv_inst(riscv_opcode_t op, riscv_reg_t rd,
+                                          int imm) {
+    MachineInst inst(op);
+    inst.rd = rd;
+    inst.imm = imm;
+    mfunc.blocks.back().insts.push_back(inst);
 }
 
-void TargetCodeGenerator::dump_lw(std::string reg, int offset,
-                                  std::string base = "sp") {
+// branches read reg, la writes it
+void TargetCodeGenerator::dump_riscv_inst(riscv_opcode_t op, riscv_reg_t reg,
+                                          const char *symbol) {
+    MachineInst inst(op);
+    if (op == RV_BNEZ || op == RV_BEQZ)
+        inst.rs1 = reg;
+    else
+        inst.rd = reg;
+    inst.symbol = symbol;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+void TargetCodeGenerator::dump_riscv_inst(riscv_opcode_t op,
+                                          const char *symbol) {
+    MachineInst inst(op);
+    inst.symbol = symbol;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+void TargetCodeGenerator::dump_lw(riscv_reg_t reg, int offset,
+                                  riscv_reg_t base = REG_SP) {
+    if (stats) stats->get_current().stack_loads++;
     if (offset <= 2047 && offset >= -2048) {
-        dump_riscv_inst("lw", reg, std::to_string(offset) + "(" + base + ")");
+        dump_riscv_inst(RV_LW, reg, base, offset);
     } else {
+        if (stats) stats->get_current().large_offsets++;
         // take an empty register for offset
         // TODO: before considering register allocation, we use t6
-        dump_riscv_inst("li", "t6", std::to_string(offset));
-        dump_riscv_inst("add", "t6", "t6", "sp");
-        dump_riscv_inst("lw", reg, "0(t6)");
+        dump_riscv_inst(RV_LI, REG_T6, offset);
+        dump_riscv_inst(RV_ADD, REG_T6, REG_T6, REG_SP);
+        dump_riscv_inst(RV_LW, reg, REG_T6, 0);
     }
 }
 
-void TargetCodeGenerator::dump_sw(std::string reg, int offset) {
+void TargetCodeGenerator::dump_sw(riscv_reg_t reg, int offset) {
+    if (stats) stats->get_current().stack_stores++;
     if (offset <= 2047 && offset >= -2048) {
-        dump_riscv_inst("sw", reg, std::to_string(offset) + "(sp)");
+        dump_riscv_inst(RV_SW, reg, REG_SP, offset);
     } else {
+        if (stats) stats->get_current().large_offsets++;
         // take an empty register for offset
         // TODO: before considering register allocation, we use t6
-        dump_riscv_inst("li", "t6", std::to_string(offset));
-        dump_riscv_inst("add", "t6", "t6", "sp");
-        dump_riscv_inst("sw", reg, "0(t6)");
+        dump_riscv_inst(RV_LI, REG_T6, offset);
+        dump_riscv_inst(RV_ADD, REG_T6, REG_T6, REG_SP);
+        dump_riscv_inst(RV_SW, reg, REG_T6, 0);
     }
 }
 
@@ -155,27 +246,242 @@ void TargetCodeGenerator::dump_sw(std::string reg, int offset) {
 // This operation is not necessarily successful,
 // caller should handle the exceptions
 bool TargetCodeGenerator::load_value_to_reg(koopa_raw_value_t value,
-                                            std::string reg) {
-    if (value->kind.tag == KOOPA_RVT_INTEGER) {
+                                            riscv_reg_t reg) {
+    auto value_reg = is_allocated ? assignment.get_reg(value) : REG_NONE;
+    if (value_reg != REG_NONE) {
+        dump_riscv_inst(RV_MV, reg, value_reg);
+    } else if (value->kind.tag == KOOPA_RVT_INTEGER) {
         // integer
-        auto int_val = std::to_string(value->kind.data.integer.value);
-        dump_riscv_inst("li", reg, int_val);
+        auto int_val = value->kind.data.integer.value;
+        dump_riscv_inst(RV_LI, reg, int_val);
+    } else if (is_allocated && value->kind.tag == KOOPA_RVT_ALLOC) {
+        // alloc memory is addressed from sp, with no slot of its address
+        auto offset = runtime_stack.top().get_alloc_memory(value).offset;
+        if (offset <= 2047) {
+            dump_riscv_inst(RV_ADDI, reg, REG_SP, offset);
+        } else {
+            dump_riscv_inst(RV_LI, reg, offset);
+            dump_riscv_inst(RV_ADD, reg, reg, REG_SP);
+        }
     } else if (value->kind.tag == KOOPA_RVT_ALLOC ||
                value->kind.tag == KOOPA_RVT_LOAD ||
                value->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
                value->kind.tag == KOOPA_RVT_GET_PTR ||
                value->kind.tag == KOOPA_RVT_BINARY ||
-               value->kind.tag == KOOPA_RVT_CALL) {
+               value->kind.tag == KOOPA_RVT_CALL ||
+               value->kind.tag == KOOPA_RVT_BLOCK_ARG_REF ||
+               (runtime_stack.top().has_param_values &&
+                value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)) {
         auto offset = runtime_stack.top().get_koopa_value(value).offset;
         dump_lw(reg, offset);
     } else if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-        dump_riscv_inst("la", reg, value->name + 1);
+        dump_riscv_inst(RV_LA, reg, value->name + 1);
+    } else if (value->kind.tag == KOOPA_RVT_UNDEF) {
+        // any value of reg does
     } else {
         return false;
     }
     return true;
 }
 
+// register holding value, which is loaded to scratch if it has none
+riscv_reg_t TargetCodeGenerator::read_value_reg(koopa_raw_value_t value,
+                                                riscv_reg_t scratch) {
+    auto reg = is_allocated ? assignment.get_reg(value) : REG_NONE;
+    if (reg != REG_NONE) return reg;
+    auto ok = load_value_to_reg(value, scratch);
+    assert(ok);
+    return scratch;
+}
+
+// register to compute value into, scratch if it's in a slot
+riscv_reg_t TargetCodeGenerator::get_result_reg(koopa_raw_value_t value,
+                                                riscv_reg_t scratch) {
+    auto reg = is_allocated ? assignment.get_reg(value) : REG_NONE;
+    return reg != REG_NONE ? reg : scratch;
+}
+
+// move value computed in reg to its register or slot
+void TargetCodeGenerator::write_result(koopa_raw_value_t value,
+                                       riscv_reg_t reg) {
+    auto value_reg = is_allocated ? assignment.get_reg(value) : REG_NONE;
+    if (value_reg == REG_NONE) {
+        auto offset = runtime_stack.top().get_koopa_value(value).offset;
+        dump_sw(reg, offset);
+    } else if (value_reg != reg) {
+        dump_riscv_inst(RV_MV, value_reg, reg);
+    }
+}
+
+// Decide registers of values, unless they stay in slots.
+// Graph coloring falls back to linear scan on functions too large for it.
+void TargetCodeGenerator::allocate_registers(koopa_raw_function_t func) {
+    is_allocated = false;
+    if (regalloc == REGALLOC_NONE) return;
+    auto cost = regalloc == REGALLOC_GRAPH_COLORING ? OPT_STAGE_EXPENSIVE
+                                                    : OPT_STAGE_CHEAP;
+    auto decision = budget ? budget->begin_stage("regalloc", cost)
+                           : OPT_DECISION_RUN;
+    if (decision == OPT_DECISION_SKIP && cost == OPT_STAGE_EXPENSIVE) {
+        // throttled to linear scan, which is cheap
+        decision = budget->begin_stage("regalloc-linear", OPT_STAGE_CHEAP);
+        if (decision == OPT_DECISION_RUN) decision = OPT_DECISION_THROTTLE;
+    }
+    if (decision == OPT_DECISION_SKIP) return;
+
+    auto start = std::chrono::steady_clock::now();
+    if (regalloc == REGALLOC_GRAPH_COLORING &&
+        decision == OPT_DECISION_RUN)
+        allocate_registers_graph_coloring(func, assignment);
+    else
+        allocate_registers_linear_scan(func, assignment);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (budget) budget->end_stage();
+    if (passes) passes->record_time("regalloc", elapsed.count());
+    is_allocated = true;
+}
+
+// Move params from where they're passed to their registers or slots.
+// Those in a0-a7 go first, since stack params could be given a0-a7.
+void TargetCodeGenerator::dump_param_moves(koopa_raw_function_t func) {
+    auto &frame = runtime_stack.top();
+    for (size_t i = 0; i < func->params.len; i++) {
+        auto param = (koopa_raw_value_t)func->params.buffer[i];
+        auto reg = is_allocated ? assignment.get_reg(param) : REG_NONE;
+        if (i < 8) {
+            auto arg_reg = (riscv_reg_t)(REG_A0 + i);
+            if (reg == REG_NONE)
+                dump_sw(arg_reg, frame.get_koopa_value(param).offset);
+            else if (reg != arg_reg)
+                dump_riscv_inst(RV_MV, reg, arg_reg);
+        }
+    }
+    for (size_t i = 8; i < func->params.len; i++) {
+        auto param = (koopa_raw_value_t)func->params.buffer[i];
+        auto reg = is_allocated ? assignment.get_reg(param) : REG_NONE;
+        int offset = (i - 8) * 4;
+        if (reg != REG_NONE) {
+            dump_lw(reg, offset, REG_S0);
+        } else {
+            dump_lw(REG_T0, offset, REG_S0);
+            dump_sw(REG_T0, frame.get_koopa_value(param).offset);
+        }
+    }
+}
+
+namespace {
+
+// A copy into a block param. Locations are registers, then slots of block
+// params after them by offset, or -1 for values no copy could overwrite.
+class BlockArgMove {
+   public:
+    int dst;
+    koopa_raw_value_t src;  // nullptr if it's saved to src_loc, a register
+    int src_loc;
+};
+
+}  // namespace
+
+// Move args into params of target, as copies done at once.
+// A copy is done once no other one reads its destination, and copies
+// reading each other in a cycle are freed by saving one destination to t1.
+void TargetCodeGenerator::dump_block_arg_moves(
+    koopa_raw_slice_t args, koopa_raw_basic_block_t target) {
+    if (args.len == 0) return;
+    auto &frame = runtime_stack.top();
+    auto get_location = [&](koopa_raw_value_t value) {
+        auto reg = is_allocated ? assignment.get_reg(value) : REG_NONE;
+        if (reg != REG_NONE) return (int)reg;
+        if (value->kind.tag != KOOPA_RVT_BLOCK_ARG_REF) return -1;
+        return REG_NONE + 1 + frame.get_koopa_value(value).offset;
+    };
+
+    std::vector<BlockArgMove> moves;
+    std::unordered_map<int, int> num_reads;  // of pending copies by location
+    for (size_t i = 0; i < args.len; i++) {
+        auto src = (koopa_raw_value_t)args.buffer[i];
+        auto param = (koopa_raw_value_t)target->params.buffer[i];
+        BlockArgMove move{get_location(param), src, get_location(src)};
+        if (src->kind.tag == KOOPA_RVT_UNDEF || move.dst == move.src_loc)
+            continue;
+        moves.push_back(move);
+        num_reads[move.src_loc]++;
+    }
+
+    while (!moves.empty()) {
+        size_t i = 0;
+        while (i < moves.size() && num_reads[moves[i].dst]) i++;
+        if (i == moves.size()) {
+            i = 0;
+            int dst = moves[0].dst;
+            if (dst < REG_NONE)
+                dump_riscv_inst(RV_MV, REG_T1, (riscv_reg_t)dst);
+            else
+                dump_lw(REG_T1, dst - REG_NONE - 1);
+            for (auto &move : moves) {
+                if (move.src_loc != dst) continue;
+                move.src = nullptr;
+                move.src_loc = REG_T1;
+            }
+            num_reads[REG_T1] = num_reads[dst];
+            num_reads[dst] = 0;
+        }
+
+        auto &move = moves[i];
+        if (move.dst < REG_NONE) {
+            auto dst = (riscv_reg_t)move.dst;
+            if (move.src)
+                load_value_to_reg(move.src, dst);
+            else
+                dump_riscv_inst(RV_MV, dst, (riscv_reg_t)move.src_loc);
+        } else {
+            auto reg = move.src ? read_value_reg(move.src, REG_T0)
+                                : (riscv_reg_t)move.src_loc;
+            dump_sw(reg, move.dst - REG_NONE - 1);
+        }
+        num_reads[move.src_loc]--;
+        moves.erase(moves.begin() + i);
+    }
+}
+
+// solve liveness of a function, report its size and cost
+void TargetCodeGenerator::report_liveness(koopa_raw_function_t func) {
+    auto start = std::chrono::steady_clock::now();
+    Liveness liveness(func);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    int max_live = 0;
+    for (auto &live_in : liveness.result.in)
+        max_live = std::max(max_live, live_in.count());
+    std::cerr << "liveness " << func->name << ": "
+              << liveness.cfg.get_num_blocks() << " blocks, "
+              << liveness.values.get_size() << " values, "
+              << liveness.get_num_bits() << " live across blocks, "
+              << liveness.result.num_visits << " visits, max live-in "
+              << max_live << ", " << std::fixed << std::setprecision(3)
+              << elapsed.count() << " ms" << std::endl;
+}
+
+// compute every analysis of a function, report their sizes and costs
+void TargetCodeGenerator::report_ir_analyses(const IRFunction &func) {
+    AnalysisManager analyses(func);
+    auto &dom = analyses.get_dominators();
+    auto &loops = analyses.get_loops();
+    auto &liveness = analyses.get_liveness();
+    double ms = 0;
+    for (int kind = 0; kind < ANALYSIS_NUM; kind++)
+        ms += analyses.computed_ms[kind];
+    std::cerr << "analyses " << func.name << ": "
+              << analyses.get_cfg().get_num_blocks() << " blocks, "
+              << dom.num_iterations << " dominator iterations, "
+              << loops.loops.size() << " loops of max depth "
+              << loops.get_max_depth() << ", " << liveness.get_num_bits()
+              << " live across blocks, " << std::fixed << std::setprecision(3)
+              << ms << " ms" << std::endl;
+}
+
 void TargetCodeGenerator::dump_alloc_initializer(koopa_raw_value_t init,
                                                  int offset) {
     // std::cerr << "dump alloc initializer: " << offset << std::endl;
@@ -186,15 +492,15 @@ void TargetCodeGenerator::dump_alloc_initializer(koopa_raw_value_t init,
         int init_size = get_koopa_raw_value_size(init->ty);
         assert(init_size > 0);
         for (int i = 0; i < init_size; i += 4) {
-            dump_sw("zero", offset + i);
+            dump_sw(REG_ZERO, offset + i);
         }
     } else if (init_type == KOOPA_RVT_INTEGER) {
         auto int_val = init->kind.data.integer.value;
         if (int_val == 0) {
-            dump_sw("zero", offset);
+            dump_sw(REG_ZERO, offset);
         } else {
-            dump_riscv_inst("li", "t0", std::to_string(int_val));
-            dump_sw("t0", offset);
+            dump_riscv_inst(RV_LI, REG_T0, int_val);
+            dump_sw(REG_T0, offset);
         }
     } else if (init_type == KOOPA_RVT_AGGREGATE) {
         auto elems = init->kind.data.aggregate.elems;
@@ -217,9 +523,15 @@ void TargetCodeGenerator::dump_global_alloc_initializer(
     if (init_type == KOOPA_RVT_ZERO_INIT) {
         int init_size = get_koopa_raw_value_size(init->ty);
         assert(init_size > 0);
-        out << "  .zero " << init_size << std::endl;
+        if (elf)
+            elf->append_data_zero(init_size);
+        else
+            out << "  .zero " << init_size << std::endl;
     } else if (init_type == KOOPA_RVT_INTEGER) {
-        out << "  .word " << init->kind.data.integer.value << std::endl;
+        if (elf)
+            elf->append_data_word(init->kind.data.integer.value);
+        else
+            out << "  .word " << init->kind.data.integer.value << std::endl;
     } else if (init_type == KOOPA_RVT_AGGREGATE) {
         auto elems = init->kind.data.aggregate.elems;
         for (int i = 0; i < elems.len; i++) {
@@ -257,24 +569,34 @@ int TargetCodeGenerator::dump_koopa_raw_function(koopa_raw_function_t func) {
     if (func->bbs.len == 0) {
         return 0;  // func decl, should be ignored
     }
+    if (budget) budget->begin_function(func, &arena);
+    if (analyze_liveness) report_liveness(func);
+    if (passes) passes->run_koopa_passes(func);
+    if (stats) stats->begin_function(func);
+    allocate_registers(func);
+    if (stats && is_allocated) {
+        stats->get_current().spilled_values = assignment.num_spilled;
+        stats->get_current().coalesced_moves = assignment.num_coalesced;
+    }
 
     // function statement
 
     // function name, ignore first character
-    out << "  .text" << std::endl;
-    out << "  .globl " << func->name + 1 << std::endl;
-    out << func->name + 1 << ":" << std::endl;
+    mfunc.name = func->name + 1;
+    mfunc.arena = &arena;
+    mfunc.blocks.push_back(MachineBlock(nullptr, &arena));
 
-    runtime_stack.push(StackFrame(func));
+    runtime_stack.emplace(func, &arena, is_allocated ? &assignment : nullptr);
 
     // prologue
     // set up stack frame
     int frame_length = runtime_stack.top().get_length();
+    if (stats) stats->get_current().frame_length = frame_length;
     if (frame_length <= 2048)
-        dump_riscv_inst("addi", "sp", "sp", std::to_string(-frame_length));
+        dump_riscv_inst(RV_ADDI, REG_SP, REG_SP, -frame_length);
     else {
-        dump_riscv_inst("li", "t0", std::to_string(-frame_length));
-        dump_riscv_inst("add", "sp", "sp", "t0");
+        dump_riscv_inst(RV_LI, REG_T0, -frame_length);
+        dump_riscv_inst(RV_ADD, REG_SP, REG_SP, REG_T0);
         // length will never be used, so everyone can use t0 later
     }
     // save callee registers
@@ -284,23 +606,36 @@ int TargetCodeGenerator::dump_koopa_raw_function(koopa_raw_function_t func) {
         dump_sw(reg, offset);
     }
     // set up s0  TODO: only > 8 func param need this
-    if (frame_length <= 2048)
-        dump_riscv_inst("addi", "s0", "sp", std::to_string(frame_length));
+    if (frame_length < 2048)
+        dump_riscv_inst(RV_ADDI, REG_S0, REG_SP, frame_length);
     else {
-        dump_riscv_inst("li", "t0", std::to_string(frame_length));
-        dump_riscv_inst("add", "s0", "sp", "t0");
+        dump_riscv_inst(RV_LI, REG_T0, frame_length);
+        dump_riscv_inst(RV_ADD, REG_S0, REG_SP, REG_T0);
     }
+    if (runtime_stack.top().has_param_values) dump_param_moves(func);
 
     int ret = dump_koopa_raw_slice(func->bbs);
     runtime_stack.pop();
-    out << std::endl;
 
+    if (passes) passes->run_machine_passes(mfunc);
+    if (stats) stats->end_function(mfunc);
+
+    // final pass
+    if (elf)
+        elf->add_function(mfunc);
+    else
+        print_machine_function(mfunc, out);
+
+    // nothing of this function on the arena is alive from here
+    mfunc.blocks.clear();
+    arena.reset();
+    is_allocated = false;
     return ret;
 }
 
 int TargetCodeGenerator::dump_koopa_raw_basic_block(
     koopa_raw_basic_block_t bb) {
-    out << bb->name + 1 << ":" << std::endl;
+    mfunc.blocks.push_back(MachineBlock(bb->name + 1, &arena));
     int ret = dump_koopa_raw_slice(bb->insts);
     return ret;
 }
@@ -340,83 +675,80 @@ int TargetCodeGenerator::dump_koopa_raw_value(koopa_raw_value_t value) {
 
 int TargetCodeGenerator::dump_koopa_raw_value_binary(koopa_raw_value_t value) {
     auto op = value->kind.data.binary.op;
-    std::string lhs = "t1", rhs = "t2";
+    riscv_reg_t lhs = REG_T1, rhs = REG_T2;
 
     auto lhs_val = value->kind.data.binary.lhs;
-    assert(load_value_to_reg(lhs_val, lhs));
+    lhs = read_value_reg(lhs_val, lhs);
     auto rhs_val = value->kind.data.binary.rhs;
-    assert(load_value_to_reg(rhs_val, rhs));
+    rhs = read_value_reg(rhs_val, rhs);
 
     // TODO: use i instr to simplify!
 
     // given op type, dump the value
-    auto reg = "t0";
+    auto reg = get_result_reg(value, REG_T0);
     if (op == KOOPA_RBO_NOT_EQ) {
-        dump_riscv_inst("xor", reg, lhs, rhs);
-        dump_riscv_inst("snez", reg, reg);
+        dump_riscv_inst(RV_XOR, reg, lhs, rhs);
+        dump_riscv_inst(RV_SNEZ, reg, reg);
     } else if (op == KOOPA_RBO_EQ) {
-        dump_riscv_inst("xor", reg, lhs, rhs);
-        dump_riscv_inst("seqz", reg, reg);
+        dump_riscv_inst(RV_XOR, reg, lhs, rhs);
+        dump_riscv_inst(RV_SEQZ, reg, reg);
     } else if (op == KOOPA_RBO_GT) {
-        dump_riscv_inst("sgt", reg, lhs, rhs);
+        dump_riscv_inst(RV_SGT, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_LT) {
-        dump_riscv_inst("slt", reg, lhs, rhs);
+        dump_riscv_inst(RV_SLT, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_GE) {  // not less than
-        dump_riscv_inst("slt", reg, lhs, rhs);
-        dump_riscv_inst("xori", reg, reg, "1");
+        dump_riscv_inst(RV_SLT, reg, lhs, rhs);
+        dump_riscv_inst(RV_XORI, reg, reg, 1);
     } else if (op == KOOPA_RBO_LE) {  // not greater than
-        dump_riscv_inst("sgt", reg, lhs, rhs);
-        dump_riscv_inst("xori", reg, reg, "1");
+        dump_riscv_inst(RV_SGT, reg, lhs, rhs);
+        dump_riscv_inst(RV_XORI, reg, reg, 1);
     } else if (op == KOOPA_RBO_ADD) {
-        std::string inst = "add";
-        dump_riscv_inst(inst, reg, lhs, rhs);
+        dump_riscv_inst(RV_ADD, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_SUB) {
-        dump_riscv_inst("sub", reg, lhs, rhs);
+        dump_riscv_inst(RV_SUB, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_MUL) {
-        dump_riscv_inst("mul", reg, lhs, rhs);
+        dump_riscv_inst(RV_MUL, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_DIV) {
-        dump_riscv_inst("div", reg, lhs, rhs);
+        dump_riscv_inst(RV_DIV, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_MOD) {
-        dump_riscv_inst("rem", reg, lhs, rhs);
+        dump_riscv_inst(RV_REM, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_AND) {
-        std::string inst = "and";
-        dump_riscv_inst(inst, reg, lhs, rhs);
+        dump_riscv_inst(RV_AND, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_OR) {
-        std::string inst = "or";
-        dump_riscv_inst(inst, reg, lhs, rhs);
+        dump_riscv_inst(RV_OR, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_XOR) {
-        std::string inst = "xor";
-        dump_riscv_inst(inst, reg, lhs, rhs);
+        dump_riscv_inst(RV_XOR, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_SHL) {
-        dump_riscv_inst("shl", reg, lhs, rhs);
+        dump_riscv_inst(RV_SLL, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_SHR) {
-        dump_riscv_inst("shr", reg, lhs, rhs);
+        dump_riscv_inst(RV_SRL, reg, lhs, rhs);
     } else if (op == KOOPA_RBO_SAR) {
-        dump_riscv_inst("sar", reg, lhs, rhs);
+        dump_riscv_inst(RV_SRA, reg, lhs, rhs);
     } else {
         std::cerr << "Invalid operator for binary inst." << std::endl;
         assert(false);
     }
 
     // write the result
-    auto offset = runtime_stack.top().get_koopa_value(value).offset;
-    dump_sw(reg, offset);
+    write_result(value, reg);
 
     return 0;
 }
 
 int TargetCodeGenerator::dump_koopa_raw_value_load(koopa_raw_value_t value) {
     // dereference the pointer
-    std::string reg = "t0";
+    riscv_reg_t reg = get_result_reg(value, REG_T0);
 
     auto src = value->kind.data.load.src;
-    assert(load_value_to_reg(src, reg));
-
-    dump_riscv_inst("lw", reg, "0(" + reg + ")");
+    if (is_allocated && src->kind.tag == KOOPA_RVT_ALLOC) {
+        dump_lw(reg, runtime_stack.top().get_alloc_memory(src).offset);
+    } else {
+        auto src_reg = read_value_reg(src, reg);
+        dump_riscv_inst(RV_LW, reg, src_reg, 0);
+    }
 
     // record value result onto stack
-    auto val_offset = runtime_stack.top().get_koopa_value(value).offset;
-    dump_sw(reg, val_offset);
+    write_result(value, reg);
     return 0;
 }
 
@@ -434,27 +766,30 @@ int TargetCodeGenerator::dump_koopa_raw_value_store(koopa_raw_value_t value) {
 
     } else if (dst_base_type->tag == KOOPA_RTT_INT32 ||
                dst_base_type->tag == KOOPA_RTT_POINTER) {
-        std::string src_reg = "t0";  // what need to be stored
-        if (src->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
+        riscv_reg_t src_reg = REG_T0;  // what need to be stored
+        if (!runtime_stack.top().has_param_values &&
+            src->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
             auto index = src->kind.data.func_arg_ref.index;
             if (index < 8) {
-                src_reg = "a" + std::to_string(index);
+                src_reg = (riscv_reg_t)(REG_A0 + index);
             } else {
                 // assume s0 has been set up
                 int offset = (index - 8) * 4;
-                dump_lw(src_reg, offset, "s0");
+                dump_lw(src_reg, offset, REG_S0);
             }
         } else if (src->kind.tag == KOOPA_RVT_ZERO_INIT) {
-            dump_riscv_inst("li", src_reg, std::to_string(0));
+            dump_riscv_inst(RV_LI, src_reg, 0);
         } else {
-            assert(load_value_to_reg(src, src_reg));
+            src_reg = read_value_reg(src, src_reg);
         }
 
-        // load dst address
-        std::string dst_reg = "t6";
-        assert(load_value_to_reg(dst, dst_reg));
-
-        dump_riscv_inst("sw", src_reg, "0(" + dst_reg + ")");
+        if (is_allocated && dst->kind.tag == KOOPA_RVT_ALLOC) {
+            dump_sw(src_reg, runtime_stack.top().get_alloc_memory(dst).offset);
+        } else {
+            // load dst address
+            riscv_reg_t dst_reg = read_value_reg(dst, REG_T6);
+            dump_riscv_inst(RV_SW, src_reg, dst_reg, 0);
+        }
 
     } else {
         std::cerr << "Store: invalid dst base type" << std::endl;
@@ -467,7 +802,7 @@ int TargetCodeGenerator::dump_koopa_raw_value_return(koopa_raw_value_t value) {
     // move operand to a0
     auto ret_val = value->kind.data.ret.value;
     if (ret_val != nullptr) {
-        assert(load_value_to_reg(ret_val, "a0"));
+        assert(load_value_to_reg(ret_val, REG_A0));
     }
 
     // epilogue
@@ -480,33 +815,55 @@ int TargetCodeGenerator::dump_koopa_raw_value_return(koopa_raw_value_t value) {
 
     // pop stack frame
     auto frame_length = runtime_stack.top().get_length();
-    if (frame_length <= 2048)
-        dump_riscv_inst("addi", "sp", "sp", std::to_string(frame_length));
+    if (frame_length < 2048)
+        dump_riscv_inst(RV_ADDI, REG_SP, REG_SP, frame_length);
     else {
-        dump_riscv_inst("li", "t0", std::to_string(frame_length));
-        dump_riscv_inst("add", "sp", "sp", "t0");
+        dump_riscv_inst(RV_LI, REG_T0, frame_length);
+        dump_riscv_inst(RV_ADD, REG_SP, REG_SP, REG_T0);
     }
-    dump_riscv_inst("ret");
+    dump_riscv_inst(RV_RET);
     return 0;
 }
 
+// Args are moved on the edge taken, after the branch is decided
 int TargetCodeGenerator::dump_koopa_raw_value_branch(koopa_raw_value_t value) {
-    std::string reg = "t0";
-    auto cond = value->kind.data.branch.cond;
-    assert(load_value_to_reg(cond, reg));
-
-    auto true_bb_name = value->kind.data.branch.true_bb->name + 1;
-    auto false_bb_name = value->kind.data.branch.false_bb->name + 1;
-
-    dump_riscv_inst("bnez", reg, true_bb_name);
-    dump_riscv_inst("j", false_bb_name);
+    auto &branch = value->kind.data.branch;
+    riscv_reg_t reg = read_value_reg(branch.cond, REG_T0);
+
+    auto true_bb_name = branch.true_bb->name + 1;
+    auto false_bb_name = branch.false_bb->name + 1;
+
+    if (branch.true_args.len == 0) {
+        dump_riscv_inst(RV_BNEZ, reg, true_bb_name);
+        dump_block_arg_moves(branch.false_args, branch.false_bb);
+        dump_riscv_inst(RV_J, false_bb_name);
+    } else if (branch.false_args.len == 0) {
+        dump_riscv_inst(RV_BEQZ, reg, false_bb_name);
+        dump_block_arg_moves(branch.true_args, branch.true_bb);
+        dump_riscv_inst(RV_J, true_bb_name);
+    } else {
+        // false edge takes a block of its own, named after this block
+        auto bb_label = mfunc.blocks.back().label;
+        size_t len = strlen(bb_label);
+        auto label = arena.allocate<char>(len + sizeof("_false"));
+        memcpy(label, bb_label, len);
+        memcpy(label + len, "_false", sizeof("_false"));
+
+        dump_riscv_inst(RV_BEQZ, reg, label);
+        dump_block_arg_moves(branch.true_args, branch.true_bb);
+        dump_riscv_inst(RV_J, true_bb_name);
+        mfunc.blocks.push_back(MachineBlock(label, &arena));
+        dump_block_arg_moves(branch.false_args, branch.false_bb);
+        dump_riscv_inst(RV_J, false_bb_name);
+    }
 
     return 0;
 }
 
 int TargetCodeGenerator::dump_koopa_raw_value_jump(koopa_raw_value_t value) {
-    auto bb_name = value->kind.data.jump.target->name + 1;
-    dump_riscv_inst("j", bb_name);
+    auto target = value->kind.data.jump.target;
+    dump_block_arg_moves(value->kind.data.jump.args, target);
+    dump_riscv_inst(RV_J, target->name + 1);
 
     return 0;
 }
@@ -519,22 +876,20 @@ int TargetCodeGenerator::dump_koopa_raw_value_call(koopa_raw_value_t value) {
     for (int i = 0; i < args.len; i++) {
         koopa_raw_value_t val = (koopa_raw_value_t)args.buffer[i];
         if (i < 8) {
-            auto reg = "a" + std::to_string(i);
+            auto reg = (riscv_reg_t)(REG_A0 + i);
             load_value_to_reg(val, reg);
         } else {
-            auto reg = "t0";  // nobody use it for now
-            load_value_to_reg(val, reg);
+            auto reg = read_value_reg(val, REG_T0);
             dump_sw(reg, (i - 8) * 4);
         }
     }
     auto callee_name = value->kind.data.call.callee->name;
-    dump_riscv_inst("call", callee_name + 1);
+    dump_riscv_inst(RV_CALL, callee_name + 1);
 
     // set return value if there is
     auto ret_type = value->ty->tag;
     if (ret_type == KOOPA_RTT_INT32) {
-        auto offset = runtime_stack.top().get_koopa_value(value).offset;
-        dump_sw("a0", offset);
+        write_result(value, REG_A0);
     } else if (ret_type == KOOPA_RTT_UNIT) {
     } else {
         auto tag = to_koopa_raw_type_tag(ret_type);
@@ -546,16 +901,16 @@ int TargetCodeGenerator::dump_koopa_raw_value_call(koopa_raw_value_t value) {
 }
 
 int TargetCodeGenerator::dump_koopa_raw_value_alloc(koopa_raw_value_t value) {
-    // return the alloced address
-    std::string tmp_reg = "t0";
+    // return the alloced address, which is computed by users if allocated
+    if (is_allocated) return 0;
+    riscv_reg_t tmp_reg = REG_T0;
 
     auto alloc_info = runtime_stack.top().get_alloc_memory(value);
     if (alloc_info.offset <= 2047) {
-        dump_riscv_inst("addi", tmp_reg, "sp",
-                        std::to_string(alloc_info.offset));
+        dump_riscv_inst(RV_ADDI, tmp_reg, REG_SP, alloc_info.offset);
     } else {
-        dump_riscv_inst("li", tmp_reg, std::to_string(alloc_info.offset));
-        dump_riscv_inst("add", tmp_reg, tmp_reg, "sp");
+        dump_riscv_inst(RV_LI, tmp_reg, alloc_info.offset);
+        dump_riscv_inst(RV_ADD, tmp_reg, tmp_reg, REG_SP);
     }
 
     auto val_offset = runtime_stack.top().get_koopa_value(value).offset;
@@ -565,11 +920,19 @@ int TargetCodeGenerator::dump_koopa_raw_value_alloc(koopa_raw_value_t value) {
 
 int TargetCodeGenerator::dump_koopa_raw_value_global_alloc(
     koopa_raw_value_t value) {
+    if (!dumped_globals.insert(value->name).second) return 0;
+
+    auto init = value->kind.data.global_alloc.init;
+    if (elf) {
+        elf->begin_data(value->name + 1);
+        dump_global_alloc_initializer(init);
+        return 0;
+    }
+
     out << "  .data" << std::endl;
     out << "  .globl " << value->name + 1 << std::endl;
     out << value->name + 1 << ":" << std::endl;
 
-    auto init = value->kind.data.global_alloc.init;
     dump_global_alloc_initializer(init);
 
     out << std::endl;
@@ -578,17 +941,17 @@ int TargetCodeGenerator::dump_koopa_raw_value_global_alloc(
 
 int TargetCodeGenerator::dump_koopa_raw_value_get_elem_ptr(
     koopa_raw_value_t value) {
-    std::string base_reg = "t0";
-    std::string index_reg = "t1";
-    std::string elem_size_reg = "t2";
+    riscv_reg_t base_reg = REG_T0;
+    riscv_reg_t index_reg = REG_T1;
+    riscv_reg_t elem_size_reg = REG_T2;
 
     // load base ptr address
     auto src = value->kind.data.get_ptr.src;
-    load_value_to_reg(src, base_reg);
+    base_reg = read_value_reg(src, base_reg);
 
     // calculate index
     auto index = value->kind.data.get_elem_ptr.index;
-    assert(load_value_to_reg(index, index_reg));
+    auto index_val_reg = read_value_reg(index, index_reg);
 
     // elem size
     assert(src->ty->tag == KOOPA_RTT_POINTER);
@@ -596,40 +959,40 @@ int TargetCodeGenerator::dump_koopa_raw_value_get_elem_ptr(
     assert(ptr_base_ty->tag == KOOPA_RTT_ARRAY);
     auto elem_ty = ptr_base_ty->data.array.base;
     int elem_size = get_koopa_raw_value_size(elem_ty);
-    dump_riscv_inst("li", elem_size_reg, std::to_string(elem_size));
+    dump_riscv_inst(RV_LI, elem_size_reg, elem_size);
 
-    dump_riscv_inst("mul", index_reg, index_reg, elem_size_reg);
-    dump_riscv_inst("add", base_reg, base_reg, index_reg);
+    dump_riscv_inst(RV_MUL, index_reg, index_val_reg, elem_size_reg);
+    auto reg = get_result_reg(value, REG_T0);
+    dump_riscv_inst(RV_ADD, reg, base_reg, index_reg);
 
     // record value result
-    auto val_offset = runtime_stack.top().get_koopa_value(value).offset;
-    dump_sw(base_reg, val_offset);
+    write_result(value, reg);
     return 0;
 }
 
 int TargetCodeGenerator::dump_koopa_raw_value_get_ptr(koopa_raw_value_t value) {
-    std::string base_reg = "t0";
-    std::string index_reg = "t1";
-    std::string elem_size_reg = "t2";
+    riscv_reg_t base_reg = REG_T0;
+    riscv_reg_t index_reg = REG_T1;
+    riscv_reg_t elem_size_reg = REG_T2;
 
     // load base ptr address
     auto src = value->kind.data.get_ptr.src;
-    load_value_to_reg(src, base_reg);
+    base_reg = read_value_reg(src, base_reg);
 
     // calculate index
     auto index = value->kind.data.get_ptr.index;
-    assert(load_value_to_reg(index, index_reg));
+    auto index_val_reg = read_value_reg(index, index_reg);
 
     // base ptr's base (...) size
     assert(src->ty->tag == KOOPA_RTT_POINTER);
     auto ptr_base_ty = src->ty->data.pointer.base;
     int elem_size = get_koopa_raw_value_size(ptr_base_ty);
-    dump_riscv_inst("li", elem_size_reg, std::to_string(elem_size));
+    dump_riscv_inst(RV_LI, elem_size_reg, elem_size);
 
-    dump_riscv_inst("mul", index_reg, index_reg, elem_size_reg);
-    dump_riscv_inst("add", base_reg, base_reg, index_reg);
+    dump_riscv_inst(RV_MUL, index_reg, index_val_reg, elem_size_reg);
+    auto reg = get_result_reg(value, REG_T0);
+    dump_riscv_inst(RV_ADD, reg, base_reg, index_reg);
 
-    auto val_offset = runtime_stack.top().get_koopa_value(value).offset;
-    dump_sw(base_reg, val_offset);
+    write_result(value, reg);
     return 0;
 }
@@ -0,0 +1,441 @@
+#include <elf_writer.h>
+
+#include <cassert>
+#include <cstring>
+#include <elf.h>
+
+// instruction formats of RV32IM
+
+static uint32_t encode_r(uint32_t funct7, riscv_reg_t rs2, riscv_reg_t rs1,
+                         uint32_t funct3, riscv_reg_t rd, uint32_t opcode) {
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+           opcode;
+}
+
+static uint32_t encode_i(int32_t imm, riscv_reg_t rs1, uint32_t funct3,
+                         riscv_reg_t rd, uint32_t opcode) {
+    assert(imm >= -2048 && imm <= 2047);
+    return (uint32_t)imm << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t encode_s(int32_t imm, riscv_reg_t rs2, riscv_reg_t rs1,
+                         uint32_t funct3, uint32_t opcode) {
+    assert(imm >= -2048 && imm <= 2047);
+    uint32_t u = imm;
+    return (u >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+           (u & 0x1f) << 7 | opcode;
+}
+
+static uint32_t encode_b(int32_t imm, riscv_reg_t rs2, riscv_reg_t rs1,
+                         uint32_t funct3) {
+    assert(imm >= -4096 && imm <= 4094 && imm % 2 == 0);
+    uint32_t u = imm;
+    return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | rs2 << 20 |
+           rs1 << 15 | funct3 << 12 | (u >> 1 & 0xf) << 8 |
+           (u >> 11 & 1) << 7 | 0x63;
+}
+
+static uint32_t encode_u(uint32_t imm20, riscv_reg_t rd, uint32_t opcode) {
+    return (imm20 & 0xfffff) << 12 | rd << 7 | opcode;
+}
+
+static uint32_t encode_j(int32_t imm, riscv_reg_t rd) {
+    if (imm < -(1 << 20) || imm >= (1 << 20)) {
+        std::cerr << "ElfWriter: jump out of range " << imm << std::endl;
+        assert(false);
+    }
+    uint32_t u = imm;
+    return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 |
+           (u >> 12 & 0xff) << 12 | rd << 7 | 0x6f;
+}
+
+static bool is_imm12(int32_t imm) { return imm >= -2048 && imm <= 2047; }
+
+// upper 20 bits, rounded so that the sign extended lower 12 bits add up
+static uint32_t get_hi20(int32_t imm) {
+    return ((uint32_t)imm + 0x800) >> 12 & 0xfffff;
+}
+
+static int32_t get_lo12(int32_t imm) {
+    return (int32_t)((uint32_t)imm - (get_hi20(imm) << 12));
+}
+
+// bytes of a pseudo instruction after expansion
+static int get_inst_size(const MachineInst &inst, bool is_far) {
+    switch (inst.op) {
+        case RV_LI:
+            return is_imm12(inst.imm) || get_lo12(inst.imm) == 0 ? 4 : 8;
+        case RV_LA:
+        case RV_CALL:
+            return 8;
+        case RV_BNEZ:
+        case RV_BEQZ:
+            return is_far ? 8 : 4;
+        default:
+            return 4;
+    }
+}
+
+int ElfWriter::_get_global(std::string name) {
+    auto it = global_index.find(name);
+    if (it != global_index.end()) return it->second;
+    Symbol symbol;
+    symbol.name = name;
+    globals.push_back(symbol);
+    global_index[name] = globals.size() - 1;
+    return globals.size() - 1;
+}
+
+void ElfWriter::_emit_text(uint32_t code) {
+    for (int i = 0; i < 4; i++) text.push_back(code >> (8 * i) & 0xff);
+}
+
+void ElfWriter::_emit_data(uint32_t word) {
+    for (int i = 0; i < 4; i++) data.push_back(word >> (8 * i) & 0xff);
+}
+
+void ElfWriter::_encode_inst(const MachineInst &inst, uint32_t pc, int size,
+                             const std::map<std::string, uint32_t> &labels) {
+    switch (inst.op) {
+        case RV_ADD:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 0, inst.rd, 0x33));
+            break;
+        case RV_SUB:
+            _emit_text(encode_r(0x20, inst.rs2, inst.rs1, 0, inst.rd, 0x33));
+            break;
+        case RV_SLL:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 1, inst.rd, 0x33));
+            break;
+        case RV_SLT:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 2, inst.rd, 0x33));
+            break;
+        case RV_SGT:  // slt with operands swapped
+            _emit_text(encode_r(0, inst.rs1, inst.rs2, 2, inst.rd, 0x33));
+            break;
+        case RV_XOR:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 4, inst.rd, 0x33));
+            break;
+        case RV_SRL:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 5, inst.rd, 0x33));
+            break;
+        case RV_SRA:
+            _emit_text(encode_r(0x20, inst.rs2, inst.rs1, 5, inst.rd, 0x33));
+            break;
+        case RV_OR:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 6, inst.rd, 0x33));
+            break;
+        case RV_AND:
+            _emit_text(encode_r(0, inst.rs2, inst.rs1, 7, inst.rd, 0x33));
+            break;
+        case RV_MUL:
+            _emit_text(encode_r(1, inst.rs2, inst.rs1, 0, inst.rd, 0x33));
+            break;
+        case RV_DIV:
+            _emit_text(encode_r(1, inst.rs2, inst.rs1, 4, inst.rd, 0x33));
+            break;
+        case RV_REM:
+            _emit_text(encode_r(1, inst.rs2, inst.rs1, 6, inst.rd, 0x33));
+            break;
+        case RV_SEQZ:  // sltiu rd, rs1, 1
+            _emit_text(encode_i(1, inst.rs1, 3, inst.rd, 0x13));
+            break;
+        case RV_SNEZ:  // sltu rd, zero, rs1
+            _emit_text(encode_r(0, inst.rs1, REG_ZERO, 3, inst.rd, 0x33));
+            break;
+        case RV_MV:  // addi rd, rs1, 0
+            _emit_text(encode_i(0, inst.rs1, 0, inst.rd, 0x13));
+            break;
+        case RV_ADDI:
+            _emit_text(encode_i(inst.imm, inst.rs1, 0, inst.rd, 0x13));
+            break;
+        case RV_XORI:
+            _emit_text(encode_i(inst.imm, inst.rs1, 4, inst.rd, 0x13));
+            break;
+        case RV_LI:
+            if (is_imm12(inst.imm)) {
+                _emit_text(encode_i(inst.imm, REG_ZERO, 0, inst.rd, 0x13));
+            } else {
+                _emit_text(encode_u(get_hi20(inst.imm), inst.rd, 0x37));
+                if (size == 8)
+                    _emit_text(encode_i(get_lo12(inst.imm), inst.rd, 0,
+                                        inst.rd, 0x13));
+            }
+            break;
+        case RV_LW:
+            _emit_text(encode_i(inst.imm, inst.rs1, 2, inst.rd, 0x03));
+            break;
+        case RV_SW:
+            _emit_text(encode_s(inst.imm, inst.rs2, inst.rs1, 2, 0x23));
+            break;
+        case RV_LA:  // auipc rd, %pcrel_hi(sym); addi rd, rd, %pcrel_lo(pc)
+            relocs.push_back(
+                {pc, R_RISCV_PCREL_HI20, _get_global(inst.symbol), false});
+            relocs.push_back({pc + 4, R_RISCV_PCREL_LO12_I,
+                              (int)pcrel_labels.size(), true});
+            pcrel_labels.push_back(pc);
+            _emit_text(encode_u(0, inst.rd, 0x17));
+            _emit_text(encode_i(0, inst.rd, 0, inst.rd, 0x13));
+            break;
+        case RV_CALL:  // auipc ra, 0; jalr ra, 0(ra)
+            relocs.push_back({pc, R_RISCV_CALL, _get_global(inst.symbol), false});
+            _emit_text(encode_u(0, REG_RA, 0x17));
+            _emit_text(encode_i(0, REG_RA, 0, REG_RA, 0x67));
+            break;
+        case RV_BNEZ: {
+            int32_t target = labels.at(inst.symbol);
+            if (size == 4) {  // bne rs1, zero, target
+                _emit_text(encode_b(target - pc, REG_ZERO, inst.rs1, 1));
+            } else {  // beq rs1, zero, 8; j target
+                _emit_text(encode_b(8, REG_ZERO, inst.rs1, 0));
+                _emit_text(encode_j(target - (pc + 4), REG_ZERO));
+            }
+            break;
+        }
+        case RV_BEQZ: {
+            int32_t target = labels.at(inst.symbol);
+            if (size == 4) {  // beq rs1, zero, target
+                _emit_text(encode_b(target - pc, REG_ZERO, inst.rs1, 0));
+            } else {  // bne rs1, zero, 8; j target
+                _emit_text(encode_b(8, REG_ZERO, inst.rs1, 1));
+                _emit_text(encode_j(target - (pc + 4), REG_ZERO));
+            }
+            break;
+        }
+        case RV_J:
+            _emit_text(encode_j(labels.at(inst.symbol) - pc, REG_ZERO));
+            break;
+        case RV_RET:  // jalr zero, 0(ra)
+            _emit_text(encode_i(0, REG_RA, 0, REG_ZERO, 0x67));
+            break;
+    }
+}
+
+// Lay out a function, then encode it.
+// Branches out of range are expanded until every one fits.
+void ElfWriter::add_function(const MachineFunction &func) {
+    uint32_t base = text.size();
+
+    std::vector<const MachineInst *> insts;
+    for (auto &block : func.blocks)
+        for (auto &inst : block.insts) insts.push_back(&inst);
+    std::vector<bool> is_far(insts.size(), false);
+    std::vector<uint32_t> offsets(insts.size());
+    std::map<std::string, uint32_t> labels;
+
+    bool changed = true;
+    while (changed) {
+        labels.clear();
+        uint32_t offset = base;
+        size_t k = 0;
+        for (auto &block : func.blocks) {
+            if (block.label) labels[block.label] = offset;
+            for (size_t j = 0; j < block.insts.size(); j++, k++) {
+                offsets[k] = offset;
+                offset += get_inst_size(*insts[k], is_far[k]);
+            }
+        }
+        changed = false;
+        for (k = 0; k < insts.size(); k++) {
+            auto op = insts[k]->op;
+            if ((op != RV_BNEZ && op != RV_BEQZ) || is_far[k]) continue;
+            int32_t dist = labels.at(insts[k]->symbol) - offsets[k];
+            if (dist < -4096 || dist > 4094) {
+                is_far[k] = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t k = 0; k < insts.size(); k++)
+        _encode_inst(*insts[k], offsets[k], get_inst_size(*insts[k], is_far[k]),
+                     labels);
+
+    auto &symbol = globals[_get_global(func.name)];
+    assert(symbol.section == ELF_SECTION_UNDEF);
+    symbol.section = ELF_SECTION_TEXT;
+    symbol.value = base;
+    symbol.size = text.size() - base;
+    symbol.is_func = true;
+}
+
+void ElfWriter::begin_data(std::string name) {
+    cur_data = _get_global(name);
+    auto &symbol = globals[cur_data];
+    assert(symbol.section == ELF_SECTION_UNDEF);
+    symbol.section = ELF_SECTION_DATA;
+    symbol.value = data.size();
+}
+
+void ElfWriter::append_data_word(int32_t word) {
+    assert(cur_data != -1);
+    _emit_data(word);
+    globals[cur_data].size += 4;
+}
+
+void ElfWriter::append_data_zero(int size) {
+    assert(cur_data != -1);
+    data.insert(data.end(), size, 0);
+    globals[cur_data].size += size;
+}
+
+// Layout: ELF header, .text, .data, .rela.text, .symtab, .strtab, .shstrtab,
+// then section headers. Fields are written in host order, which is little
+// endian as RISC-V.
+void ElfWriter::write(std::ostream &out) {
+    enum {
+        SEC_NULL,
+        SEC_TEXT,
+        SEC_RELA_TEXT,
+        SEC_DATA,
+        SEC_SYMTAB,
+        SEC_STRTAB,
+        SEC_SHSTRTAB,
+        SEC_NUM,
+    };
+
+    std::string strtab(1, '\0');
+    auto add_str = [](std::string &table, std::string str) {
+        uint32_t index = table.size();
+        table += str;
+        table.push_back('\0');
+        return index;
+    };
+
+    // local labels go before globals
+    std::vector<Elf32_Sym> symtab(1);
+    memset(&symtab[0], 0, sizeof(Elf32_Sym));
+    for (size_t i = 0; i < pcrel_labels.size(); i++) {
+        Elf32_Sym sym;
+        memset(&sym, 0, sizeof(sym));
+        sym.st_name = add_str(strtab, ".Lpcrel_hi" + std::to_string(i));
+        sym.st_value = pcrel_labels[i];
+        sym.st_info = ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE);
+        sym.st_shndx = SEC_TEXT;
+        symtab.push_back(sym);
+    }
+    int first_global = symtab.size();
+    for (auto &global : globals) {
+        Elf32_Sym sym;
+        memset(&sym, 0, sizeof(sym));
+        sym.st_name = add_str(strtab, global.name);
+        sym.st_value = global.value;
+        sym.st_size = global.size;
+        if (global.section == ELF_SECTION_TEXT) {
+            sym.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+            sym.st_shndx = SEC_TEXT;
+        } else if (global.section == ELF_SECTION_DATA) {
+            sym.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_OBJECT);
+            sym.st_shndx = SEC_DATA;
+        } else {
+            sym.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+            sym.st_shndx = SHN_UNDEF;
+        }
+        symtab.push_back(sym);
+    }
+
+    std::vector<Elf32_Rela> rela;
+    for (auto &reloc : relocs) {
+        int sym_index = reloc.is_label ? 1 + reloc.symbol
+                                       : first_global + reloc.symbol;
+        Elf32_Rela r;
+        r.r_offset = reloc.offset;
+        r.r_info = ELF32_R_INFO(sym_index, reloc.type);
+        r.r_addend = 0;
+        rela.push_back(r);
+    }
+
+    std::string shstrtab(1, '\0');
+    Elf32_Shdr shdrs[SEC_NUM];
+    memset(shdrs, 0, sizeof(shdrs));
+    auto align4 = [](uint32_t x) { return (x + 3) & ~3u; };
+
+    uint32_t offset = sizeof(Elf32_Ehdr);
+    auto &sh_text = shdrs[SEC_TEXT];
+    sh_text.sh_name = add_str(shstrtab, ".text");
+    sh_text.sh_type = SHT_PROGBITS;
+    sh_text.sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sh_text.sh_offset = offset;
+    sh_text.sh_size = text.size();
+    sh_text.sh_addralign = 4;
+    offset = align4(offset + text.size());
+
+    auto &sh_data = shdrs[SEC_DATA];
+    sh_data.sh_name = add_str(shstrtab, ".data");
+    sh_data.sh_type = SHT_PROGBITS;
+    sh_data.sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh_data.sh_offset = offset;
+    sh_data.sh_size = data.size();
+    sh_data.sh_addralign = 4;
+    offset = align4(offset + data.size());
+
+    auto &sh_rela = shdrs[SEC_RELA_TEXT];
+    sh_rela.sh_name = add_str(shstrtab, ".rela.text");
+    sh_rela.sh_type = SHT_RELA;
+    sh_rela.sh_flags = SHF_INFO_LINK;
+    sh_rela.sh_offset = offset;
+    sh_rela.sh_size = rela.size() * sizeof(Elf32_Rela);
+    sh_rela.sh_link = SEC_SYMTAB;
+    sh_rela.sh_info = SEC_TEXT;
+    sh_rela.sh_addralign = 4;
+    sh_rela.sh_entsize = sizeof(Elf32_Rela);
+    offset += sh_rela.sh_size;
+
+    auto &sh_symtab = shdrs[SEC_SYMTAB];
+    sh_symtab.sh_name = add_str(shstrtab, ".symtab");
+    sh_symtab.sh_type = SHT_SYMTAB;
+    sh_symtab.sh_offset = offset;
+    sh_symtab.sh_size = symtab.size() * sizeof(Elf32_Sym);
+    sh_symtab.sh_link = SEC_STRTAB;
+    sh_symtab.sh_info = first_global;
+    sh_symtab.sh_addralign = 4;
+    sh_symtab.sh_entsize = sizeof(Elf32_Sym);
+    offset += sh_symtab.sh_size;
+
+    auto &sh_strtab = shdrs[SEC_STRTAB];
+    sh_strtab.sh_name = add_str(shstrtab, ".strtab");
+    sh_strtab.sh_type = SHT_STRTAB;
+    sh_strtab.sh_offset = offset;
+    sh_strtab.sh_size = strtab.size();
+    sh_strtab.sh_addralign = 1;
+    offset += strtab.size();
+
+    auto &sh_shstrtab = shdrs[SEC_SHSTRTAB];
+    sh_shstrtab.sh_name = add_str(shstrtab, ".shstrtab");
+    sh_shstrtab.sh_type = SHT_STRTAB;
+    sh_shstrtab.sh_offset = offset;
+    sh_shstrtab.sh_size = shstrtab.size();
+    sh_shstrtab.sh_addralign = 1;
+    offset = align4(offset + shstrtab.size());
+
+    Elf32_Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_RISCV;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_flags = 0;  // soft float, no compressed insts
+    ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+    ehdr.e_shoff = offset;
+    ehdr.e_shentsize = sizeof(Elf32_Shdr);
+    ehdr.e_shnum = SEC_NUM;
+    ehdr.e_shstrndx = SEC_SHSTRTAB;
+
+    auto pad_to = [&out](uint32_t pos) {
+        while ((uint32_t)out.tellp() < pos) out.put('\0');
+    };
+    out.write((const char *)&ehdr, sizeof(ehdr));
+    out.write((const char *)text.data(), text.size());
+    pad_to(sh_data.sh_offset);
+    out.write((const char *)data.data(), data.size());
+    pad_to(sh_rela.sh_offset);
+    out.write((const char *)rela.data(), sh_rela.sh_size);
+    out.write((const char *)symtab.data(), sh_symtab.sh_size);
+    out.write(strtab.data(), strtab.size());
+    out.write(shstrtab.data(), shstrtab.size());
+    pad_to(ehdr.e_shoff);
+    out.write((const char *)shdrs, sizeof(shdrs));
+}
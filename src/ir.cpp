@@ -0,0 +1,320 @@
+#include <ir.h>
+
+#include <cassert>
+
+// IRTypeTable
+
+// sizes are computed once here, bases are always inserted first
+int IRTypeTable::_insert(const IRType &type) {
+    types.push_back(type);
+    auto &back = types.back();
+    if (type.tag == KOOPA_RTT_INT32 || type.tag == KOOPA_RTT_POINTER)
+        back.size = 4;
+    else if (type.tag == KOOPA_RTT_ARRAY)
+        back.size = types[type.base].size * type.len;
+    else if (type.tag == KOOPA_RTT_FUNCTION)
+        back.size = -1;
+    return types.size() - 1;
+}
+
+int IRTypeTable::get_int32() {
+    if (int32_id == -1) {
+        IRType type;
+        type.tag = KOOPA_RTT_INT32;
+        int32_id = _insert(type);
+    }
+    return int32_id;
+}
+
+int IRTypeTable::get_unit() {
+    if (unit_id == -1) {
+        IRType type;
+        type.tag = KOOPA_RTT_UNIT;
+        unit_id = _insert(type);
+    }
+    return unit_id;
+}
+
+int IRTypeTable::get_array(int base, int len) {
+    uint64_t key = (uint64_t)KOOPA_RTT_ARRAY << 62 | (uint64_t)base << 32 |
+                   (uint32_t)len;
+    auto it = ids.find(key);
+    if (it != ids.end()) return it->second;
+    IRType type;
+    type.tag = KOOPA_RTT_ARRAY;
+    type.base = base;
+    type.len = len;
+    return ids[key] = _insert(type);
+}
+
+int IRTypeTable::get_pointer(int base) {
+    uint64_t key = (uint64_t)KOOPA_RTT_POINTER << 62 | (uint64_t)base << 32;
+    auto it = ids.find(key);
+    if (it != ids.end()) return it->second;
+    IRType type;
+    type.tag = KOOPA_RTT_POINTER;
+    type.base = base;
+    return ids[key] = _insert(type);
+}
+
+int IRTypeTable::get_function(std::vector<int> params, int ret) {
+    auto key = params;
+    key.push_back(ret);
+    auto it = function_ids.find(key);
+    if (it != function_ids.end()) return it->second;
+    IRType type;
+    type.tag = KOOPA_RTT_FUNCTION;
+    type.base = ret;
+    type.params = params;
+    return function_ids[key] = _insert(type);
+}
+
+std::string IRTypeTable::to_string(int id) const {
+    auto &type = types[id];
+    switch (type.tag) {
+        case KOOPA_RTT_INT32:
+            return "i32";
+        case KOOPA_RTT_UNIT:
+            return "unit";
+        case KOOPA_RTT_ARRAY:
+            return "[" + to_string(type.base) + ", " +
+                   std::to_string(type.len) + "]";
+        case KOOPA_RTT_POINTER:
+            return "*" + to_string(type.base);
+        case KOOPA_RTT_FUNCTION: {
+            std::string str = "(";
+            for (size_t i = 0; i < type.params.size(); i++)
+                str += (i ? ", " : "") + to_string(type.params[i]);
+            str += ")";
+            if (types[type.base].tag != KOOPA_RTT_UNIT)
+                str += ": " + to_string(type.base);
+            return str;
+        }
+    }
+    assert(false);
+    return "";
+}
+
+// IRFunction: values
+
+int IRFunction::new_value(koopa_raw_value_tag_t tag, int type,
+                          std::string name) {
+    values.emplace_back();
+    auto &value = values.back();
+    value.tag = tag;
+    value.type = type;
+    value.name = std::move(name);
+    return values.size() - 1;
+}
+
+int IRFunction::new_block(std::string name) {
+    blocks.emplace_back();
+    blocks.back().name = std::move(name);
+    return blocks.size() - 1;
+}
+
+int IRFunction::get_integer(int value) {
+    auto it = integers.find(value);
+    if (it != integers.end()) return it->second;
+    int id = new_value(KOOPA_RVT_INTEGER, types->get_int32());
+    values[id].data = value;
+    integers[value] = id;
+    return id;
+}
+
+int IRFunction::get_global(int global, int type) {
+    auto it = global_refs.find(global);
+    if (it != global_refs.end()) return it->second;
+    int id = new_value(KOOPA_RVT_GLOBAL_ALLOC, type);
+    values[id].data = global;
+    global_refs[global] = id;
+    return id;
+}
+
+int IRFunction::get_undef(int type) {
+    auto it = undefs.find(type);
+    if (it != undefs.end()) return it->second;
+    int id = new_value(KOOPA_RVT_UNDEF, type);
+    undefs[type] = id;
+    return id;
+}
+
+int IRFunction::new_init(const IRInit &init) {
+    int id = new_value(init.tag, init.type);
+    values[id].data = inits.size();
+    inits.push_back(init);
+    return id;
+}
+
+// IRFunction: uses
+
+void IRFunction::_link_use(int use) {
+    auto &u = uses[use];
+    auto &val = values[u.value];
+    u.prev = -1;
+    u.next = val.first_use;
+    if (val.first_use != -1) uses[val.first_use].prev = use;
+    val.first_use = use;
+}
+
+void IRFunction::_unlink_use(int use) {
+    auto &u = uses[use];
+    if (u.prev != -1)
+        uses[u.prev].next = u.next;
+    else
+        values[u.value].first_use = u.next;
+    if (u.next != -1) uses[u.next].prev = u.prev;
+    u.prev = u.next = -1;
+}
+
+void IRFunction::add_operand(int inst, int value) {
+    int use;
+    if (!free_uses.empty()) {
+        use = free_uses.back();
+        free_uses.pop_back();
+    } else {
+        use = uses.size();
+        uses.push_back(IRUse());
+    }
+    uses[use].user = inst;
+    uses[use].value = value;
+    _link_use(use);
+    values[inst].operands.push_back(use);
+}
+
+void IRFunction::set_operand(int inst, int i, int value) {
+    int use = values[inst].operands[i];
+    _unlink_use(use);
+    uses[use].value = value;
+    _link_use(use);
+}
+
+void IRFunction::drop_operands(int inst) {
+    for (int use : values[inst].operands) {
+        _unlink_use(use);
+        uses[use].value = -1;
+        free_uses.push_back(use);
+    }
+    values[inst].operands.clear();
+}
+
+int IRFunction::get_num_uses(int value) const {
+    int cnt = 0;
+    for (int use = values[value].first_use; use != -1; use = uses[use].next)
+        cnt++;
+    return cnt;
+}
+
+void IRFunction::replace_all_uses_with(int from, int to) {
+    assert(from != to);
+    int use = values[from].first_use;
+    while (use != -1) {
+        int next = uses[use].next;
+        uses[use].value = to;
+        _link_use(use);
+        use = next;
+    }
+    values[from].first_use = -1;
+}
+
+// IRFunction: lists
+
+void IRFunction::append_inst(int block, int inst) {
+    auto &b = blocks[block];
+    auto &val = values[inst];
+    val.block = block;
+    val.prev = b.last_inst;
+    val.next = -1;
+    if (b.last_inst != -1)
+        values[b.last_inst].next = inst;
+    else
+        b.first_inst = inst;
+    b.last_inst = inst;
+}
+
+void IRFunction::insert_inst_before(int before, int inst) {
+    auto &val = values[inst];
+    auto &pos = values[before];
+    val.block = pos.block;
+    val.prev = pos.prev;
+    val.next = before;
+    if (pos.prev != -1)
+        values[pos.prev].next = inst;
+    else
+        blocks[pos.block].first_inst = inst;
+    pos.prev = inst;
+}
+
+void IRFunction::remove_inst(int inst) {
+    auto &val = values[inst];
+    assert(val.first_use == -1);
+    auto &b = blocks[val.block];
+    if (val.prev != -1)
+        values[val.prev].next = val.next;
+    else
+        b.first_inst = val.next;
+    if (val.next != -1)
+        values[val.next].prev = val.prev;
+    else
+        b.last_inst = val.prev;
+    drop_operands(inst);
+    val.prev = val.next = val.block = -1;
+    val.is_removed = true;
+}
+
+void IRFunction::append_block(int block) {
+    auto &b = blocks[block];
+    b.prev = last_block;
+    b.next = -1;
+    if (last_block != -1)
+        blocks[last_block].next = block;
+    else
+        first_block = block;
+    last_block = block;
+}
+
+void IRFunction::insert_block_after(int after, int block) {
+    auto &b = blocks[block];
+    b.prev = after;
+    b.next = blocks[after].next;
+    if (b.next != -1)
+        blocks[b.next].prev = block;
+    else
+        last_block = block;
+    blocks[after].next = block;
+}
+
+void IRFunction::remove_block(int block) {
+    auto &b = blocks[block];
+    // drop all operands first, insts of the block may use each other
+    for (int inst = b.first_inst; inst != -1; inst = values[inst].next)
+        drop_operands(inst);
+    while (b.last_inst != -1) remove_inst(b.last_inst);
+    for (int param : b.params) {
+        assert(values[param].first_use == -1);
+        values[param].is_removed = true;
+    }
+    if (b.prev != -1)
+        blocks[b.prev].next = b.next;
+    else
+        first_block = b.next;
+    if (b.next != -1)
+        blocks[b.next].prev = b.prev;
+    else
+        last_block = b.prev;
+    b.prev = b.next = -1;
+    b.is_removed = true;
+}
+
+void IRFunction::get_succs(int block, ArenaVector<int> &succs) const {
+    succs.clear();
+    int term = blocks[block].last_inst;
+    if (term == -1) return;
+    auto &val = values[term];
+    if (val.tag == KOOPA_RVT_BRANCH) {
+        succs.push_back(val.targets[0]);
+        succs.push_back(val.targets[1]);
+    } else if (val.tag == KOOPA_RVT_JUMP) {
+        succs.push_back(val.targets[0]);
+    }
+}
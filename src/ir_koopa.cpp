@@ -0,0 +1,446 @@
+#include <ir.h>
+
+#include <cassert>
+#include <sstream>
+#include <unordered_set>
+
+#include "value_index.h"
+
+// Building from raw program
+
+namespace {
+
+class IRBuilder {
+   public:
+    IRProgram &prog;
+    std::unordered_map<koopa_raw_type_t, int> types;
+    std::unordered_map<koopa_raw_value_t, int> globals;
+    std::unordered_map<koopa_raw_function_t, int> funcs;
+
+    IRBuilder(IRProgram &prog) : prog(prog) {}
+
+    int get_type(koopa_raw_type_t ty) {
+        if (ty->tag == KOOPA_RTT_INT32) return prog.types.get_int32();
+        if (ty->tag == KOOPA_RTT_UNIT) return prog.types.get_unit();
+        auto it = types.find(ty);
+        if (it != types.end()) return it->second;
+        int id;
+        if (ty->tag == KOOPA_RTT_ARRAY) {
+            id = prog.types.get_array(get_type(ty->data.array.base),
+                                      ty->data.array.len);
+        } else if (ty->tag == KOOPA_RTT_POINTER) {
+            id = prog.types.get_pointer(get_type(ty->data.pointer.base));
+        } else {
+            std::vector<int> params;
+            auto slice = ty->data.function.params;
+            for (size_t i = 0; i < slice.len; i++)
+                params.push_back(get_type((koopa_raw_type_t)slice.buffer[i]));
+            id = prog.types.get_function(params,
+                                         get_type(ty->data.function.ret));
+        }
+        types[ty] = id;
+        return id;
+    }
+
+    void build_init(koopa_raw_value_t val, IRInit &init) {
+        init.tag = val->kind.tag;
+        init.type = get_type(val->ty);
+        if (init.tag == KOOPA_RVT_INTEGER) {
+            init.value = val->kind.data.integer.value;
+        } else if (init.tag == KOOPA_RVT_AGGREGATE) {
+            auto elems = val->kind.data.aggregate.elems;
+            init.elems.resize(elems.len);
+            for (size_t i = 0; i < elems.len; i++)
+                build_init((koopa_raw_value_t)elems.buffer[i], init.elems[i]);
+        } else {
+            assert(init.tag == KOOPA_RVT_ZERO_INIT);
+        }
+    }
+
+    void build_function(koopa_raw_function_t raw, IRFunction &func);
+};
+
+void IRBuilder::build_function(koopa_raw_function_t raw, IRFunction &func) {
+    // raw values are numbered as they're defined, ids by these numbers
+    ValueIndex index;
+    std::vector<int> ids;
+    std::unordered_map<koopa_raw_basic_block_t, int> blocks;
+    size_t num_insts = raw->params.len;
+    for (size_t i = 0; i < raw->bbs.len; i++)
+        num_insts += ((koopa_raw_basic_block_t)raw->bbs.buffer[i])->insts.len;
+    ids.reserve(num_insts);
+    blocks.reserve(raw->bbs.len);
+    // with room for constants
+    func.values.reserve(num_insts + num_insts / 4);
+    func.uses.reserve(num_insts * 2);
+    func.blocks.reserve(raw->bbs.len);
+    auto define = [&](koopa_raw_value_t val, int id) {
+        int i = index.insert(val);
+        assert(i == (int)ids.size());
+        ids.push_back(id);
+    };
+
+    for (size_t i = 0; i < raw->params.len; i++) {
+        auto param = (koopa_raw_value_t)raw->params.buffer[i];
+        int id = func.new_value(KOOPA_RVT_FUNC_ARG_REF, get_type(param->ty),
+                                param->name ? param->name : "");
+        func.values[id].data = i;
+        func.params.push_back(id);
+        define(param, id);
+    }
+
+    // values are defined before operands are filled,
+    // since a use may come before its def in block order
+    for (size_t i = 0; i < raw->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)raw->bbs.buffer[i];
+        int block = func.new_block(bb->name ? bb->name : "");
+        func.append_block(block);
+        blocks[bb] = block;
+        for (size_t j = 0; j < bb->params.len; j++) {
+            auto param = (koopa_raw_value_t)bb->params.buffer[j];
+            int id = func.new_value(KOOPA_RVT_BLOCK_ARG_REF,
+                                    get_type(param->ty),
+                                    param->name ? param->name : "");
+            func.values[id].data = j;
+            func.values[id].block = block;
+            func.blocks[block].params.push_back(id);
+            define(param, id);
+        }
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            int id = func.new_value(inst->kind.tag, get_type(inst->ty),
+                                    inst->name ? inst->name : "");
+            func.append_inst(block, id);
+            define(inst, id);
+        }
+    }
+
+    auto get_value = [&](koopa_raw_value_t val) {
+        int i = index.get_index(val);
+        if (i != -1) return ids[i];
+        if (val->kind.tag == KOOPA_RVT_INTEGER)
+            return func.get_integer(val->kind.data.integer.value);
+        if (val->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+            return func.get_global(globals.at(val), get_type(val->ty));
+        if (val->kind.tag == KOOPA_RVT_UNDEF)
+            return func.get_undef(get_type(val->ty));
+        // initializer of a local array
+        IRInit init;
+        build_init(val, init);
+        return func.new_init(init);
+    };
+    auto add_slice = [&](int id, koopa_raw_slice_t slice) {
+        for (size_t i = 0; i < slice.len; i++)
+            func.add_operand(id, get_value((koopa_raw_value_t)slice.buffer[i]));
+    };
+
+    for (size_t i = 0; i < raw->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)raw->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            int id = ids[index.get_index(inst)];
+            auto &kind = inst->kind;
+            switch (kind.tag) {
+                case KOOPA_RVT_ALLOC:
+                    break;
+                case KOOPA_RVT_LOAD:
+                    func.add_operand(id, get_value(kind.data.load.src));
+                    break;
+                case KOOPA_RVT_STORE:
+                    func.add_operand(id, get_value(kind.data.store.value));
+                    func.add_operand(id, get_value(kind.data.store.dest));
+                    break;
+                case KOOPA_RVT_GET_PTR:
+                    func.add_operand(id, get_value(kind.data.get_ptr.src));
+                    func.add_operand(id, get_value(kind.data.get_ptr.index));
+                    break;
+                case KOOPA_RVT_GET_ELEM_PTR:
+                    func.add_operand(id,
+                                     get_value(kind.data.get_elem_ptr.src));
+                    func.add_operand(id,
+                                     get_value(kind.data.get_elem_ptr.index));
+                    break;
+                case KOOPA_RVT_BINARY:
+                    func.values[id].data = kind.data.binary.op;
+                    func.add_operand(id, get_value(kind.data.binary.lhs));
+                    func.add_operand(id, get_value(kind.data.binary.rhs));
+                    break;
+                case KOOPA_RVT_BRANCH:
+                    func.values[id].targets[0] =
+                        blocks.at(kind.data.branch.true_bb);
+                    func.values[id].targets[1] =
+                        blocks.at(kind.data.branch.false_bb);
+                    func.values[id].num_true_args =
+                        kind.data.branch.true_args.len;
+                    func.add_operand(id, get_value(kind.data.branch.cond));
+                    add_slice(id, kind.data.branch.true_args);
+                    add_slice(id, kind.data.branch.false_args);
+                    break;
+                case KOOPA_RVT_JUMP:
+                    func.values[id].targets[0] =
+                        blocks.at(kind.data.jump.target);
+                    add_slice(id, kind.data.jump.args);
+                    break;
+                case KOOPA_RVT_CALL:
+                    func.values[id].data = funcs.at(kind.data.call.callee);
+                    add_slice(id, kind.data.call.args);
+                    break;
+                case KOOPA_RVT_RETURN:
+                    if (kind.data.ret.value)
+                        func.add_operand(id, get_value(kind.data.ret.value));
+                    break;
+                default:
+                    std::cerr << "IRBuilder: unexpected inst in "
+                              << raw->name << std::endl;
+                    assert(false);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void IRProgram::build(const koopa_raw_program_t &raw) {
+    IRBuilder builder(*this);
+    for (size_t i = 0; i < raw.values.len; i++) {
+        auto val = (koopa_raw_value_t)raw.values.buffer[i];
+        assert(val->kind.tag == KOOPA_RVT_GLOBAL_ALLOC);
+        IRGlobal global;
+        global.name = val->name;
+        global.type = builder.get_type(val->ty->data.pointer.base);
+        builder.build_init(val->kind.data.global_alloc.init, global.init);
+        builder.globals[val] = globals.size();
+        globals.push_back(global);
+    }
+    // functions may call the ones after them
+    for (size_t i = 0; i < raw.funcs.len; i++) {
+        auto func = (koopa_raw_function_t)raw.funcs.buffer[i];
+        builder.funcs[func] = funcs.size();
+        funcs.push_back(
+            IRFunction(func->name, builder.get_type(func->ty), &types));
+    }
+    for (size_t i = 0; i < raw.funcs.len; i++) {
+        auto func = (koopa_raw_function_t)raw.funcs.buffer[i];
+        if (func->bbs.len) builder.build_function(func, funcs[i]);
+    }
+}
+
+// Printing as koopa text
+
+static const char *binary_op_names[] = {
+    "ne",  "eq", "gt", "lt",  "ge",  "le",  "add", "sub", "mul",
+    "div", "mod", "and", "or", "xor", "shl", "shr", "sar",
+};
+
+static void print_init(const IRInit &init, std::ostream &out) {
+    if (init.tag == KOOPA_RVT_INTEGER) {
+        out << init.value;
+    } else if (init.tag == KOOPA_RVT_ZERO_INIT) {
+        out << "zeroinit";
+    } else {
+        out << "{ ";
+        for (size_t i = 0; i < init.elems.size(); i++) {
+            if (i) out << ", ";
+            print_init(init.elems[i], out);
+        }
+        out << " }";
+    }
+}
+
+namespace {
+
+// Unnamed values and blocks are named by their indexes,
+// which never clash with the %<number> and %bb_<number> of the frontend
+class IRPrinter {
+   public:
+    const IRProgram &prog;
+    const IRFunction &func;
+    std::ostream &out;
+
+    // names of the function, which generated names must not take
+    std::unordered_set<std::string> used_names;
+    std::vector<std::string> value_names;  // generated, by value id
+    std::vector<std::string> block_names;  // generated, by block id
+
+    IRPrinter(const IRProgram &prog, const IRFunction &func, std::ostream &out)
+        : prog(prog),
+          func(func),
+          out(out),
+          value_names(func.values.size()),
+          block_names(func.blocks.size()) {
+        for (auto &val : func.values)
+            if (!val.name.empty()) used_names.insert(val.name);
+        for (auto &block : func.blocks)
+            if (!block.name.empty()) used_names.insert(block.name);
+    }
+
+    // prefix and id, with a suffix bumped until no name of input takes it
+    std::string generate_name(const char *prefix, int id) {
+        std::string name = prefix + std::to_string(id);
+        std::string base = name;
+        for (int i = 1; used_names.count(name); i++)
+            name = base + "_" + std::to_string(i);
+        used_names.insert(name);
+        return name;
+    }
+
+    std::string get_type(int type) { return prog.types.to_string(type); }
+
+    std::string get_name(int id) {
+        auto &val = func.values[id];
+        switch (val.tag) {
+            case KOOPA_RVT_INTEGER:
+                return std::to_string(val.data);
+            case KOOPA_RVT_UNDEF:
+                return "undef";
+            case KOOPA_RVT_GLOBAL_ALLOC:
+                return prog.globals[val.data].name;
+            case KOOPA_RVT_ZERO_INIT:
+            case KOOPA_RVT_AGGREGATE: {
+                std::stringstream init;
+                print_init(func.inits[val.data], init);
+                return init.str();
+            }
+            default:
+                if (!val.name.empty()) return val.name;
+                if (value_names[id].empty())
+                    value_names[id] = generate_name("%v", id);
+                return value_names[id];
+        }
+    }
+
+    std::string get_block_name(int block) {
+        auto &name = func.blocks[block].name;
+        if (!name.empty()) return name;
+        if (block_names[block].empty())
+            block_names[block] = generate_name("%b", block);
+        return block_names[block];
+    }
+
+    void print_target(int block, int inst, int first, int num) {
+        out << get_block_name(block);
+        if (!num) return;
+        out << "(";
+        for (int i = 0; i < num; i++)
+            out << (i ? ", " : "")
+                << get_name(func.get_operand(inst, first + i));
+        out << ")";
+    }
+
+    void print_inst(int id);
+    void print_function();
+};
+
+void IRPrinter::print_inst(int id) {
+    auto &val = func.values[id];
+    out << "  ";
+    if (prog.types.get(val.type).tag != KOOPA_RTT_UNIT)
+        out << get_name(id) << " = ";
+    auto opr = [&](int i) { return get_name(func.get_operand(id, i)); };
+    switch (val.tag) {
+        case KOOPA_RVT_ALLOC:
+            out << "alloc " << get_type(prog.types.get(val.type).base);
+            break;
+        case KOOPA_RVT_LOAD:
+            out << "load " << opr(0);
+            break;
+        case KOOPA_RVT_STORE:
+            out << "store " << opr(0) << ", " << opr(1);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            out << "getptr " << opr(0) << ", " << opr(1);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            out << "getelemptr " << opr(0) << ", " << opr(1);
+            break;
+        case KOOPA_RVT_BINARY:
+            out << binary_op_names[val.data] << " " << opr(0) << ", "
+                << opr(1);
+            break;
+        case KOOPA_RVT_BRANCH: {
+            int num_false = func.get_num_operands(id) - 1 - val.num_true_args;
+            out << "br " << opr(0) << ", ";
+            print_target(val.targets[0], id, 1, val.num_true_args);
+            out << ", ";
+            print_target(val.targets[1], id, 1 + val.num_true_args, num_false);
+            break;
+        }
+        case KOOPA_RVT_JUMP:
+            out << "jump ";
+            print_target(val.targets[0], id, 0, func.get_num_operands(id));
+            break;
+        case KOOPA_RVT_CALL:
+            out << "call " << prog.funcs[val.data].name << "(";
+            for (int i = 0; i < func.get_num_operands(id); i++)
+                out << (i ? ", " : "") << opr(i);
+            out << ")";
+            break;
+        case KOOPA_RVT_RETURN:
+            out << "ret";
+            if (func.get_num_operands(id)) out << " " << opr(0);
+            break;
+        default:
+            assert(false);
+    }
+    out << std::endl;
+}
+
+void IRPrinter::print_function() {
+    auto &type = prog.types.get(func.type);
+    bool has_ret = prog.types.get(type.base).tag != KOOPA_RTT_UNIT;
+    out << "fun " << func.name << "(";
+    for (size_t i = 0; i < func.params.size(); i++) {
+        int param = func.params[i];
+        out << (i ? ", " : "") << get_name(param) << ": "
+            << get_type(func.values[param].type);
+    }
+    out << ")";
+    if (has_ret) out << ": " << get_type(type.base);
+    out << " {" << std::endl;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        auto &block = func.blocks[b];
+        out << get_block_name(b);
+        if (!block.params.empty()) {
+            out << "(";
+            for (size_t i = 0; i < block.params.size(); i++) {
+                int param = block.params[i];
+                out << (i ? ", " : "") << get_name(param) << ": "
+                    << get_type(func.values[param].type);
+            }
+            out << ")";
+        }
+        out << ":" << std::endl;
+        for (int inst = block.first_inst; inst != -1;
+             inst = func.values[inst].next)
+            print_inst(inst);
+    }
+    out << "}" << std::endl;
+}
+
+}  // namespace
+
+void IRProgram::print(std::ostream &out) const {
+    for (auto &func : funcs) {
+        if (!func.is_decl()) continue;
+        auto &type = types.get(func.type);
+        out << "decl " << func.name << "(";
+        for (size_t i = 0; i < type.params.size(); i++)
+            out << (i ? ", " : "") << types.to_string(type.params[i]);
+        out << ")";
+        if (types.get(type.base).tag != KOOPA_RTT_UNIT)
+            out << ": " << types.to_string(type.base);
+        out << std::endl;
+    }
+    for (auto &global : globals) {
+        out << std::endl
+            << "global " << global.name << " = alloc "
+            << types.to_string(global.type) << ", ";
+        print_init(global.init, out);
+        out << std::endl;
+    }
+    for (auto &func : funcs) {
+        if (func.is_decl()) continue;
+        out << std::endl;
+        IRPrinter(*this, func, out).print_function();
+    }
+}
@@ -0,0 +1,912 @@
+#include <pass.h>
+
+#include <cassert>
+#include <cstdint>
+
+// mem2reg
+
+// Allocs of i32 or pointers, only loaded and stored to as a whole,
+// hold values which SSA values could carry instead
+static bool is_promotable(const IRFunction &func, int alloc) {
+    auto &types = *func.types;
+    int base = types.get(func.values[alloc].type).base;
+    auto tag = types.get(base).tag;
+    if (tag != KOOPA_RTT_INT32 && tag != KOOPA_RTT_POINTER) return false;
+    for (int use = func.values[alloc].first_use; use != -1;
+         use = func.uses[use].next) {
+        auto &user = func.values[func.uses[use].user];
+        if (user.tag == KOOPA_RVT_LOAD) continue;
+        // stored to, but not stored somewhere as an address
+        if (user.tag == KOOPA_RVT_STORE && user.operands[1] == use) {
+            auto stored = func.values[func.uses[user.operands[0]].value].tag;
+            if (stored != KOOPA_RVT_ZERO_INIT && stored != KOOPA_RVT_AGGREGATE)
+                continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Promote allocs to SSA values by Cytron's algorithm. Block params are
+// placed at iterated dominance frontiers of stores where the alloc is live
+// in, then loads are renamed to the stores reaching them, in preorder of
+// the dominator tree.
+int promote_allocs(IRFunction &func, AnalysisManager &analyses) {
+    std::vector<int> allocs;
+    std::vector<int> alloc_index(func.get_num_values(), -1);  // by value id
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            if (func.values[inst].tag != KOOPA_RVT_ALLOC ||
+                !is_promotable(func, inst))
+                continue;
+            alloc_index[inst] = allocs.size();
+            allocs.push_back(inst);
+        }
+    }
+    if (allocs.empty()) return IR_CHANGED_NONE;
+
+    // alloc of a load or store, -1 if it isn't promoted
+    auto get_alloc = [&](int inst) {
+        auto tag = func.values[inst].tag;
+        if (tag != KOOPA_RVT_LOAD && tag != KOOPA_RVT_STORE) return -1;
+        return alloc_index[func.get_operand(inst,
+                                            tag == KOOPA_RVT_STORE ? 1 : 0)];
+    };
+
+    // blocks storing each alloc, and ones loading it before any store
+    int num_allocs = allocs.size();
+    std::vector<std::vector<int>> def_blocks(num_allocs);
+    std::vector<std::vector<int>> use_blocks(num_allocs);
+    std::vector<int> last_def(num_allocs, -1);  // blocks seen last
+    std::vector<int> last_access(num_allocs, -1);
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            int a = get_alloc(inst);
+            if (a == -1) continue;
+            if (func.values[inst].tag == KOOPA_RVT_STORE && last_def[a] != b) {
+                last_def[a] = b;
+                def_blocks[a].push_back(b);
+            } else if (func.values[inst].tag == KOOPA_RVT_LOAD &&
+                       last_access[a] != b) {
+                use_blocks[a].push_back(b);
+            }
+            last_access[a] = b;
+        }
+    }
+
+    auto &cfg = analyses.get_cfg();
+    auto &dom = analyses.get_dominators();
+    int num_blocks = func.get_num_blocks();
+    // marks of blocks by the alloc being placed, never cleared
+    std::vector<int> is_def(num_blocks, -1);
+    std::vector<int> is_live(num_blocks, -1);
+    std::vector<int> is_placed(num_blocks, -1);
+    // new params of each block, with their allocs
+    std::vector<std::vector<std::pair<int, int>>> new_params(num_blocks);
+    std::vector<int> undefs(num_allocs);
+    std::vector<int> worklist;
+    for (int a = 0; a < num_allocs; a++) {
+        int type = func.types->get(func.values[allocs[a]].type).base;
+        undefs[a] = func.get_undef(type);
+        for (int b : def_blocks[a]) is_def[b] = a;
+
+        // live in from blocks loading it first, up to blocks storing it
+        worklist = use_blocks[a];
+        for (int b : worklist) is_live[b] = a;
+        while (!worklist.empty()) {
+            int b = worklist.back();
+            worklist.pop_back();
+            for (int pred : cfg.preds[b]) {
+                if (is_live[pred] == a || is_def[pred] == a) continue;
+                is_live[pred] = a;
+                worklist.push_back(pred);
+            }
+        }
+
+        worklist = def_blocks[a];
+        while (!worklist.empty()) {
+            int b = worklist.back();
+            worklist.pop_back();
+            for (int f : dom.frontiers[b]) {
+                if (is_placed[f] == a) continue;
+                is_placed[f] = a;
+                if (is_def[f] != a) worklist.push_back(f);
+                if (is_live[f] != a) continue;
+                int param = func.new_value(KOOPA_RVT_BLOCK_ARG_REF, type);
+                func.values[param].block = f;
+                func.values[param].data = func.blocks[f].params.size();
+                func.blocks[f].params.push_back(param);
+                new_params[f].push_back(std::make_pair(a, param));
+            }
+        }
+    }
+
+    // current value of each alloc, restored when leaving a subtree
+    std::vector<int> current = undefs;
+    std::vector<std::pair<int, int>> undo;
+    auto set_current = [&](int a, int value) {
+        undo.push_back(std::make_pair(a, current[a]));
+        current[a] = value;
+    };
+    std::vector<int> args;
+    auto add_args = [&](int term, int target) {
+        for (auto &it : new_params[target])
+            func.add_operand(term, current[it.first]);
+    };
+    auto rename_block = [&](int b) {
+        for (auto &it : new_params[b]) set_current(it.first, it.second);
+        int inst = func.blocks[b].first_inst;
+        while (inst != -1) {
+            int next = func.values[inst].next;
+            int a = get_alloc(inst);
+            if (a != -1 && func.values[inst].tag == KOOPA_RVT_LOAD) {
+                func.replace_all_uses_with(inst, current[a]);
+                func.remove_inst(inst);
+            } else if (a != -1) {
+                set_current(a, func.get_operand(inst, 0));
+                func.remove_inst(inst);
+            }
+            inst = next;
+        }
+
+        // pass current values to new params of successors
+        int term = func.get_terminator(b);
+        auto &val = func.values[term];
+        if (val.tag == KOOPA_RVT_JUMP) {
+            add_args(term, val.targets[0]);
+        } else if (val.tag == KOOPA_RVT_BRANCH &&
+                   (!new_params[val.targets[0]].empty() ||
+                    !new_params[val.targets[1]].empty())) {
+            // true args go in the middle of operands
+            args.clear();
+            for (int i = 0; i < func.get_num_operands(term); i++)
+                args.push_back(func.get_operand(term, i));
+            func.drop_operands(term);
+            int num_true = val.num_true_args;
+            for (int i = 0; i <= num_true; i++)
+                func.add_operand(term, args[i]);
+            add_args(term, val.targets[0]);
+            val.num_true_args = func.get_num_operands(term) - 1;
+            for (size_t i = num_true + 1; i < args.size(); i++)
+                func.add_operand(term, args[i]);
+            add_args(term, val.targets[1]);
+        }
+    };
+
+    // preorder of dominator tree, with undo marks of blocks on the path
+    std::vector<std::pair<int, size_t>> dfs_stack;
+    std::vector<size_t> marks;
+    dfs_stack.push_back(std::make_pair(func.first_block, 0));
+    marks.push_back(undo.size());
+    rename_block(func.first_block);
+    while (!dfs_stack.empty()) {
+        int b = dfs_stack.back().first;
+        size_t i = dfs_stack.back().second++;
+        if (i < dom.children[b].size()) {
+            int child = dom.children[b][i];
+            dfs_stack.push_back(std::make_pair(child, 0));
+            marks.push_back(undo.size());
+            rename_block(child);
+            continue;
+        }
+        for (size_t j = undo.size(); j > marks.back(); j--)
+            current[undo[j - 1].first] = undo[j - 1].second;
+        undo.resize(marks.back());
+        marks.pop_back();
+        dfs_stack.pop_back();
+    }
+
+    // unreachable blocks see no store from reachable ones
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        if (dom.idom[b] != -1) continue;
+        current = undefs;
+        rename_block(b);
+    }
+    for (int alloc : allocs) func.remove_inst(alloc);
+    return IR_CHANGED_INSTS;
+}
+
+// dce
+
+// Whether memory at ptr is only stored to, through pointers derived from
+// it, which are collected into derived
+static bool is_write_only(const IRFunction &func, int ptr,
+                          std::vector<int> &derived) {
+    derived.push_back(ptr);
+    for (int use = func.values[ptr].first_use; use != -1;
+         use = func.uses[use].next) {
+        int user = func.uses[use].user;
+        auto &val = func.values[user];
+        if (val.tag == KOOPA_RVT_STORE && val.operands[1] == use) continue;
+        if ((val.tag == KOOPA_RVT_GET_ELEM_PTR ||
+             val.tag == KOOPA_RVT_GET_PTR) &&
+            val.operands[0] == use && is_write_only(func, user, derived))
+            continue;
+        return false;
+    }
+    return true;
+}
+
+// Drop args passed to removed params of targets of a jump or branch
+static void drop_dead_args(IRFunction &func, int term,
+                           const std::vector<char> &is_live) {
+    auto &val = func.values[term];
+    int first_arg = val.tag == KOOPA_RVT_BRANCH ? 1 : 0;
+    int num_targets = val.tag == KOOPA_RVT_BRANCH ? 2 : 1;
+    int num_args[2] = {func.get_num_operands(term) - first_arg, 0};
+    if (val.tag == KOOPA_RVT_BRANCH) {
+        num_args[1] = num_args[0] - val.num_true_args;
+        num_args[0] = val.num_true_args;
+    }
+
+    std::vector<int> operands;
+    for (int i = 0; i < func.get_num_operands(term); i++)
+        operands.push_back(func.get_operand(term, i));
+    func.drop_operands(term);
+    int opr = 0;
+    for (; opr < first_arg; opr++) func.add_operand(term, operands[opr]);
+    for (int t = 0; t < num_targets; t++) {
+        auto &params = func.blocks[val.targets[t]].params;
+        int num_kept = 0;
+        for (int i = 0; i < num_args[t]; i++, opr++) {
+            if (!is_live[params[i]]) continue;
+            func.add_operand(term, operands[opr]);
+            num_kept++;
+        }
+        if (t == 0 && val.tag == KOOPA_RVT_BRANCH) val.num_true_args = num_kept;
+    }
+}
+
+// Turn a branch into a jump to the target it always takes
+static void fold_branch(IRFunction &func, int term, bool is_true) {
+    auto &val = func.values[term];
+    int num_operands = func.get_num_operands(term);
+    int first = is_true ? 1 : 1 + val.num_true_args;
+    int last = is_true ? 1 + val.num_true_args : num_operands;
+    std::vector<int> args;
+    for (int i = first; i < last; i++)
+        args.push_back(func.get_operand(term, i));
+    func.drop_operands(term);
+    for (int arg : args) func.add_operand(term, arg);
+    val.tag = KOOPA_RVT_JUMP;
+    val.targets[0] = val.targets[is_true ? 0 : 1];
+    val.targets[1] = -1;
+    val.num_true_args = 0;
+}
+
+// Mark-and-sweep dead code elimination. Branches on integers are folded
+// and blocks left unreachable are removed first. Then values are marked
+// live from stores, calls and terminators, and the rest are removed.
+// A block param is live only if it's used by live values, and args passed
+// to it are live only then. Stores to allocs which are never read are dead
+// along with the allocs.
+int eliminate_dead_code(IRFunction &func, AnalysisManager &analyses) {
+    int changes = IR_CHANGED_NONE;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        int term = func.get_terminator(b);
+        if (func.values[term].tag != KOOPA_RVT_BRANCH) continue;
+        auto &cond = func.values[func.get_operand(term, 0)];
+        if (cond.tag != KOOPA_RVT_INTEGER) continue;
+        fold_branch(func, term, cond.data != 0);
+        changes |= IR_CHANGED_ALL;
+    }
+    analyses.invalidate(changes);
+    auto &cfg = analyses.get_cfg();
+
+    // values of unreachable blocks are only used in unreachable blocks
+    std::vector<int> unreachable;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next)
+        if (!cfg.reachable[b]) unreachable.push_back(b);
+    for (int b : unreachable)
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next)
+            func.drop_operands(inst);
+    for (int b : unreachable) func.remove_block(b);
+    if (!unreachable.empty()) changes |= IR_CHANGED_CFG;
+
+    std::vector<char> is_dead_store(func.get_num_values(), false);
+    std::vector<int> derived;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            if (func.values[inst].tag != KOOPA_RVT_ALLOC) continue;
+            derived.clear();
+            if (!is_write_only(func, inst, derived)) continue;
+            for (int ptr : derived)
+                for (int use = func.values[ptr].first_use; use != -1;
+                     use = func.uses[use].next)
+                    if (func.values[func.uses[use].user].tag ==
+                        KOOPA_RVT_STORE)
+                        is_dead_store[func.uses[use].user] = true;
+        }
+    }
+
+    std::vector<char> is_live(func.get_num_values(), false);
+    std::vector<int> worklist;
+    auto mark = [&](int value) {
+        if (is_live[value]) return;
+        is_live[value] = true;
+        worklist.push_back(value);
+    };
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            auto tag = func.values[inst].tag;
+            if ((tag == KOOPA_RVT_STORE && !is_dead_store[inst]) ||
+                tag == KOOPA_RVT_CALL || tag == KOOPA_RVT_BRANCH ||
+                tag == KOOPA_RVT_JUMP || tag == KOOPA_RVT_RETURN)
+                mark(inst);
+        }
+    }
+    while (!worklist.empty()) {
+        int value = worklist.back();
+        worklist.pop_back();
+        auto &val = func.values[value];
+        if (val.tag == KOOPA_RVT_BLOCK_ARG_REF) {
+            // the arg of each edge to the block
+            for (int pred : cfg.preds[val.block]) {
+                if (!cfg.reachable[pred]) continue;
+                int term = func.get_terminator(pred);
+                auto &t = func.values[term];
+                if (t.tag == KOOPA_RVT_JUMP) {
+                    mark(func.get_operand(term, val.data));
+                    continue;
+                }
+                if (t.targets[0] == val.block)
+                    mark(func.get_operand(term, 1 + val.data));
+                if (t.targets[1] == val.block)
+                    mark(func.get_operand(term,
+                                          1 + t.num_true_args + val.data));
+            }
+            continue;
+        }
+        // args of jumps and branches are marked by params taking them
+        int num_operands = val.tag == KOOPA_RVT_JUMP     ? 0
+                           : val.tag == KOOPA_RVT_BRANCH ? 1
+                                                         : val.operands.size();
+        for (int i = 0; i < num_operands; i++)
+            mark(func.get_operand(value, i));
+    }
+
+    // sweep, dropping uses of dead values before removing them
+    std::vector<int> dead;
+    bool has_dead_params = false;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        for (int param : func.blocks[b].params)
+            has_dead_params |= !is_live[param];
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            if (is_live[inst]) continue;
+            func.drop_operands(inst);
+            dead.push_back(inst);
+        }
+    }
+    if (has_dead_params) {
+        for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+            int term = func.get_terminator(b);
+            auto tag = func.values[term].tag;
+            if (tag == KOOPA_RVT_JUMP || tag == KOOPA_RVT_BRANCH)
+                drop_dead_args(func, term, is_live);
+        }
+        for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+            auto &params = func.blocks[b].params;
+            size_t num_kept = 0;
+            for (int param : params) {
+                if (!is_live[param]) {
+                    func.values[param].is_removed = true;
+                    continue;
+                }
+                func.values[param].data = num_kept;
+                params[num_kept++] = param;
+            }
+            params.resize(num_kept);
+        }
+    }
+    for (int inst : dead) func.remove_inst(inst);
+    if (!dead.empty() || has_dead_params) changes |= IR_CHANGED_INSTS;
+    return changes;
+}
+
+// gvn
+
+namespace {
+
+// A pure inst by its op and operands, equal keys give equal results
+class ExprKey {
+   public:
+    koopa_raw_value_tag_t tag;
+    int op;
+    int lhs;
+    int rhs;
+
+    bool operator==(const ExprKey &other) const {
+        return tag == other.tag && op == other.op && lhs == other.lhs &&
+               rhs == other.rhs;
+    }
+};
+
+class ExprKeyHash {
+   public:
+    size_t operator()(const ExprKey &key) const {
+        uint64_t h = (uint64_t)key.tag << 56 ^ (uint64_t)key.op << 48 ^
+                     (uint64_t)(uint32_t)key.lhs << 24 ^ (uint32_t)key.rhs;
+        return std::hash<uint64_t>()(h);
+    }
+};
+
+// Where a pointer points, as an offset into an alloc or global if known
+class PointerInfo {
+   public:
+    int base = -1;  // -1 if unknown
+    bool has_offset = false;
+    int offset = 0;  // in bytes
+};
+
+// Pointers are told apart by their bases and offsets. Pointers of unknown
+// base, e.g. params, only reach globals and allocs whose address escapes.
+class AliasInfo {
+   private:
+    const IRFunction &func;
+    std::vector<PointerInfo> pointers;
+    std::vector<char> is_computed;
+    std::vector<char> escapes;  // of allocs, 2 if not computed
+
+    bool _escapes(int ptr) {
+        for (int use = func.values[ptr].first_use; use != -1;
+             use = func.uses[use].next) {
+            int user = func.uses[use].user;
+            auto &val = func.values[user];
+            if (val.tag == KOOPA_RVT_LOAD) continue;
+            if (val.tag == KOOPA_RVT_STORE && val.operands[1] == use) continue;
+            if ((val.tag == KOOPA_RVT_GET_ELEM_PTR ||
+                 val.tag == KOOPA_RVT_GET_PTR) &&
+                val.operands[0] == use && !_escapes(user))
+                continue;
+            return true;
+        }
+        return false;
+    }
+
+   public:
+    AliasInfo(const IRFunction &func)
+        : func(func),
+          pointers(func.get_num_values()),
+          is_computed(func.get_num_values(), false),
+          escapes(func.get_num_values(), 2) {}
+
+    const PointerInfo &get(int ptr) {
+        if (is_computed[ptr]) return pointers[ptr];
+        auto &val = func.values[ptr];
+        PointerInfo info;
+        if (val.tag == KOOPA_RVT_ALLOC || val.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+            info.base = ptr;
+            info.has_offset = true;
+        } else if (val.tag == KOOPA_RVT_GET_ELEM_PTR ||
+                   val.tag == KOOPA_RVT_GET_PTR) {
+            int src = func.get_operand(ptr, 0);
+            int index = func.get_operand(ptr, 1);
+            info = get(src);
+            // elems of arrays pointed to, or things pointed to
+            auto &types = *func.types;
+            int elem = types.get(func.values[src].type).base;
+            if (val.tag == KOOPA_RVT_GET_ELEM_PTR) elem = types.get(elem).base;
+            if (func.values[index].tag == KOOPA_RVT_INTEGER)
+                info.offset += func.values[index].data * types.get_size(elem);
+            else
+                info.has_offset = false;
+        }
+        is_computed[ptr] = true;
+        return pointers[ptr] = info;
+    }
+
+    // an alloc whose address no one else could see
+    bool is_local(int base) {
+        if (base == -1 || func.values[base].tag != KOOPA_RVT_ALLOC)
+            return false;
+        if (escapes[base] == 2) escapes[base] = _escapes(base);
+        return !escapes[base];
+    }
+
+    int get_access_size(int ptr) {
+        auto &types = *func.types;
+        return types.get_size(types.get(func.values[ptr].type).base);
+    }
+
+    bool may_alias(int p, int q) {
+        auto a = get(p);
+        auto b = get(q);
+        if (a.base != -1 && b.base != -1) {
+            if (a.base != b.base) return false;
+            if (!a.has_offset || !b.has_offset) return true;
+            return a.offset < b.offset + get_access_size(q) &&
+                   b.offset < a.offset + get_access_size(p);
+        }
+        return !is_local(a.base != -1 ? a.base : b.base);
+    }
+};
+
+// A load or store, whose address holds value until memory changes
+class AvailableLoad {
+   public:
+    int address;
+    int value;  // -1 if it's overwritten
+};
+
+}  // namespace
+
+// loads a scope tracks at most, so that stores scan few of them
+static const int MAX_AVAILABLE_LOADS = 64;
+
+// Dominator-based value numbering. Pure insts are looked up in a table
+// scoped by the dominator tree, and replaced by an equal one dominating
+// them. Loads are replaced by values loaded or stored before them, until
+// a store which may alias them or a call writing memory it could see.
+// Memory is only known through blocks whose single pred is their idom.
+int eliminate_common_subexpressions(IRFunction &func,
+                                    AnalysisManager &analyses) {
+    auto &cfg = analyses.get_cfg();
+    auto &dom = analyses.get_dominators();
+    AliasInfo alias(func);
+    std::unordered_map<ExprKey, int, ExprKeyHash> exprs;
+    std::vector<ExprKey> expr_undo;
+    std::vector<AvailableLoad> loads;
+    std::vector<std::pair<int, int>> load_undo;  // index, value before
+    int first_load = 0;  // loads before are from other paths
+    bool changed = false;
+
+    auto kill_loads = [&](auto may_write) {
+        for (int i = first_load; i < (int)loads.size(); i++) {
+            if (loads[i].value == -1 || !may_write(loads[i].address))
+                continue;
+            load_undo.push_back(std::make_pair(i, loads[i].value));
+            loads[i].value = -1;
+        }
+    };
+    auto add_load = [&](int address, int value) {
+        if ((int)loads.size() - first_load < MAX_AVAILABLE_LOADS)
+            loads.push_back(AvailableLoad{address, value});
+    };
+    auto replace = [&](int inst, int value) {
+        func.replace_all_uses_with(inst, value);
+        func.remove_inst(inst);
+        changed = true;
+    };
+
+    auto number_block = [&](int b) {
+        if (cfg.preds[b].size() != 1 || cfg.preds[b][0] != dom.idom[b])
+            first_load = loads.size();
+        int inst = func.blocks[b].first_inst;
+        while (inst != -1) {
+            int next = func.values[inst].next;
+            auto &val = func.values[inst];
+            if (val.tag == KOOPA_RVT_BINARY ||
+                val.tag == KOOPA_RVT_GET_ELEM_PTR ||
+                val.tag == KOOPA_RVT_GET_PTR) {
+                ExprKey key{val.tag, val.data, func.get_operand(inst, 0),
+                            func.get_operand(inst, 1)};
+                auto op = (koopa_raw_binary_op_t)val.data;
+                bool is_commutative =
+                    val.tag == KOOPA_RVT_BINARY &&
+                    (op == KOOPA_RBO_NOT_EQ || op == KOOPA_RBO_EQ ||
+                     op == KOOPA_RBO_ADD || op == KOOPA_RBO_MUL ||
+                     op == KOOPA_RBO_AND || op == KOOPA_RBO_OR ||
+                     op == KOOPA_RBO_XOR);
+                if (is_commutative && key.lhs > key.rhs)
+                    std::swap(key.lhs, key.rhs);
+                auto it = exprs.find(key);
+                if (it != exprs.end()) {
+                    replace(inst, it->second);
+                } else {
+                    exprs[key] = inst;
+                    expr_undo.push_back(key);
+                }
+            } else if (val.tag == KOOPA_RVT_LOAD) {
+                int address = func.get_operand(inst, 0);
+                int found = -1;
+                for (int i = loads.size() - 1; i >= first_load; i--) {
+                    if (loads[i].address == address && loads[i].value != -1) {
+                        found = loads[i].value;
+                        break;
+                    }
+                }
+                if (found != -1)
+                    replace(inst, found);
+                else
+                    add_load(address, inst);
+            } else if (val.tag == KOOPA_RVT_STORE) {
+                int value = func.get_operand(inst, 0);
+                int address = func.get_operand(inst, 1);
+                kill_loads([&](int other) {
+                    return alias.may_alias(other, address);
+                });
+                auto tag = func.values[value].tag;
+                if (tag != KOOPA_RVT_ZERO_INIT && tag != KOOPA_RVT_AGGREGATE)
+                    add_load(address, value);
+            } else if (val.tag == KOOPA_RVT_CALL) {
+                kill_loads([&](int other) {
+                    return !alias.is_local(alias.get(other).base);
+                });
+            }
+            inst = next;
+        }
+    };
+
+    // preorder of dominator tree, restoring tables when leaving subtrees
+    class Scope {
+       public:
+        int block;
+        size_t next_child;
+        size_t num_exprs;
+        size_t num_loads;
+        size_t num_load_undo;
+        int first_load;
+    };
+    std::vector<Scope> scopes;
+    auto enter = [&](int b) {
+        scopes.push_back(Scope{b, 0, expr_undo.size(), loads.size(),
+                               load_undo.size(), first_load});
+        number_block(b);
+    };
+    enter(func.first_block);
+    while (!scopes.empty()) {
+        auto &scope = scopes.back();
+        if (scope.next_child < dom.children[scope.block].size()) {
+            enter(dom.children[scope.block][scope.next_child++]);
+            continue;
+        }
+        while (expr_undo.size() > scope.num_exprs) {
+            exprs.erase(expr_undo.back());
+            expr_undo.pop_back();
+        }
+        while (load_undo.size() > scope.num_load_undo) {
+            loads[load_undo.back().first].value = load_undo.back().second;
+            load_undo.pop_back();
+        }
+        loads.resize(scope.num_loads);
+        first_load = scope.first_load;
+        scopes.pop_back();
+    }
+    return changed ? IR_CHANGED_INSTS : IR_CHANGED_NONE;
+}
+
+// sccp
+
+namespace {
+
+typedef enum {
+    LATTICE_UNKNOWN,  // not reached by any executable path yet
+    LATTICE_CONSTANT,
+    LATTICE_OVERDEFINED,
+} lattice_kind_t;
+
+class LatticeValue {
+   public:
+    lattice_kind_t kind = LATTICE_UNKNOWN;
+    int value = 0;
+
+    // lower to the meet with other, return whether it was lowered
+    bool meet(const LatticeValue &other) {
+        if (other.kind == LATTICE_UNKNOWN || kind == LATTICE_OVERDEFINED)
+            return false;
+        if (kind == LATTICE_UNKNOWN) {
+            *this = other;
+            return true;
+        }
+        if (other.kind == LATTICE_CONSTANT && other.value == value)
+            return false;
+        kind = LATTICE_OVERDEFINED;
+        return true;
+    }
+};
+
+}  // namespace
+
+// Fold a binary op as riscv computes it on i32, false for division by zero
+static bool fold_binary(koopa_raw_binary_op_t op, int lhs, int rhs,
+                        int &result) {
+    uint32_t l = lhs, r = rhs;
+    switch (op) {
+        case KOOPA_RBO_NOT_EQ: result = lhs != rhs; break;
+        case KOOPA_RBO_EQ: result = lhs == rhs; break;
+        case KOOPA_RBO_GT: result = lhs > rhs; break;
+        case KOOPA_RBO_LT: result = lhs < rhs; break;
+        case KOOPA_RBO_GE: result = lhs >= rhs; break;
+        case KOOPA_RBO_LE: result = lhs <= rhs; break;
+        case KOOPA_RBO_ADD: result = l + r; break;
+        case KOOPA_RBO_SUB: result = l - r; break;
+        case KOOPA_RBO_MUL: result = l * r; break;
+        case KOOPA_RBO_DIV:
+            if (rhs == 0) return false;
+            result = (int64_t)lhs / rhs;
+            break;
+        case KOOPA_RBO_MOD:
+            if (rhs == 0) return false;
+            result = (int64_t)lhs % rhs;
+            break;
+        case KOOPA_RBO_AND: result = l & r; break;
+        case KOOPA_RBO_OR: result = l | r; break;
+        case KOOPA_RBO_XOR: result = l ^ r; break;
+        case KOOPA_RBO_SHL: result = l << (r & 31); break;
+        case KOOPA_RBO_SHR: result = l >> (r & 31); break;
+        case KOOPA_RBO_SAR: result = lhs >> (r & 31); break;
+        default: return false;
+    }
+    return true;
+}
+
+// Sparse conditional constant propagation. Values start unknown and are
+// lowered to constants or overdefined, only along edges found executable,
+// so that a branch on a constant leaves its other side unvisited. Then
+// constants replace values, branches taking one side become jumps and
+// blocks never executed are removed.
+int propagate_constants(IRFunction &func, AnalysisManager &analyses) {
+    auto &cfg = analyses.get_cfg();
+    int num_values = func.get_num_values();
+    std::vector<LatticeValue> lattice(num_values);
+    std::vector<char> is_executable(func.blocks.size(), false);
+    // by block * 2 + target index of its terminator
+    std::vector<char> is_edge_executable(func.blocks.size() * 2, false);
+    std::vector<std::pair<int, int>> edge_worklist;
+    std::vector<int> value_worklist;
+
+    auto get = [&](int value) {
+        auto &val = func.values[value];
+        LatticeValue lv;
+        if (val.tag == KOOPA_RVT_INTEGER) {
+            lv.kind = LATTICE_CONSTANT;
+            lv.value = val.data;
+        } else if (val.block != -1) {
+            lv = lattice[value];
+        } else {
+            lv.kind = LATTICE_OVERDEFINED;  // undef, params and globals
+        }
+        return lv;
+    };
+    auto lower = [&](int value, const LatticeValue &lv) {
+        if (lattice[value].meet(lv)) value_worklist.push_back(value);
+    };
+    // params meet args of every executable edge to the block
+    auto visit_params = [&](int b) {
+        auto &params = func.blocks[b].params;
+        for (size_t i = 0; i < params.size(); i++) {
+            LatticeValue lv;
+            for (int pred : cfg.preds[b]) {
+                int term = func.get_terminator(pred);
+                auto &t = func.values[term];
+                if (t.tag == KOOPA_RVT_JUMP) {
+                    if (is_edge_executable[pred * 2])
+                        lv.meet(get(func.get_operand(term, i)));
+                    continue;
+                }
+                if (t.targets[0] == b && is_edge_executable[pred * 2])
+                    lv.meet(get(func.get_operand(term, 1 + i)));
+                if (t.targets[1] == b && is_edge_executable[pred * 2 + 1])
+                    lv.meet(get(func.get_operand(term,
+                                                 1 + t.num_true_args + i)));
+            }
+            lower(params[i], lv);
+        }
+    };
+    auto mark_edge = [&](int b, int t) {
+        if (is_edge_executable[b * 2 + t]) {
+            visit_params(func.values[func.get_terminator(b)].targets[t]);
+            return;
+        }
+        is_edge_executable[b * 2 + t] = true;
+        edge_worklist.emplace_back(b, t);
+    };
+    auto visit_inst = [&](int inst) {
+        auto &val = func.values[inst];
+        switch (val.tag) {
+            case KOOPA_RVT_BINARY: {
+                auto lhs = get(func.get_operand(inst, 0));
+                auto rhs = get(func.get_operand(inst, 1));
+                LatticeValue lv;
+                if (lhs.kind == LATTICE_OVERDEFINED ||
+                    rhs.kind == LATTICE_OVERDEFINED) {
+                    lv.kind = LATTICE_OVERDEFINED;
+                } else if (lhs.kind == LATTICE_CONSTANT &&
+                           rhs.kind == LATTICE_CONSTANT) {
+                    lv.kind = fold_binary((koopa_raw_binary_op_t)val.data,
+                                          lhs.value, rhs.value, lv.value)
+                                  ? LATTICE_CONSTANT
+                                  : LATTICE_OVERDEFINED;
+                }
+                lower(inst, lv);
+                break;
+            }
+            case KOOPA_RVT_BRANCH: {
+                auto cond = get(func.get_operand(inst, 0));
+                if (cond.kind == LATTICE_CONSTANT) {
+                    mark_edge(val.block, cond.value ? 0 : 1);
+                } else if (cond.kind == LATTICE_OVERDEFINED) {
+                    mark_edge(val.block, 0);
+                    mark_edge(val.block, 1);
+                }
+                break;
+            }
+            case KOOPA_RVT_JUMP:
+                mark_edge(val.block, 0);
+                break;
+            case KOOPA_RVT_STORE:
+            case KOOPA_RVT_RETURN:
+                break;
+            default:
+                lower(inst, LatticeValue{LATTICE_OVERDEFINED, 0});
+                break;
+        }
+    };
+    auto visit_block = [&](int b) {
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next)
+            visit_inst(inst);
+    };
+
+    is_executable[func.first_block] = true;
+    visit_block(func.first_block);
+    while (!edge_worklist.empty() || !value_worklist.empty()) {
+        while (!edge_worklist.empty()) {
+            auto [b, t] = edge_worklist.back();
+            edge_worklist.pop_back();
+            int target = func.values[func.get_terminator(b)].targets[t];
+            visit_params(target);
+            if (is_executable[target]) continue;
+            is_executable[target] = true;
+            visit_block(target);
+        }
+        while (!value_worklist.empty()) {
+            int value = value_worklist.back();
+            value_worklist.pop_back();
+            for (int use = func.values[value].first_use; use != -1;
+                 use = func.uses[use].next) {
+                int user = func.uses[use].user;
+                if (is_executable[func.values[user].block]) visit_inst(user);
+            }
+        }
+    }
+
+    // replace constants, new integers may grow values
+    int changes = IR_CHANGED_NONE;
+    std::vector<std::pair<int, int>> constants;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        if (!is_executable[b]) continue;
+        for (int param : func.blocks[b].params)
+            if (lattice[param].kind == LATTICE_CONSTANT)
+                constants.emplace_back(param, lattice[param].value);
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next)
+            if (func.values[inst].tag == KOOPA_RVT_BINARY &&
+                lattice[inst].kind == LATTICE_CONSTANT)
+                constants.emplace_back(inst, lattice[inst].value);
+    }
+    for (auto [value, c] : constants) {
+        func.replace_all_uses_with(value, func.get_integer(c));
+        if (func.values[value].tag == KOOPA_RVT_BINARY)
+            func.remove_inst(value);
+    }
+    if (!constants.empty()) changes |= IR_CHANGED_INSTS;
+
+    std::vector<int> unreachable;
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        if (!is_executable[b]) {
+            unreachable.push_back(b);
+            continue;
+        }
+        int term = func.get_terminator(b);
+        if (func.values[term].tag != KOOPA_RVT_BRANCH) continue;
+        if (is_edge_executable[b * 2] && is_edge_executable[b * 2 + 1])
+            continue;
+        assert(is_edge_executable[b * 2] || is_edge_executable[b * 2 + 1]);
+        fold_branch(func, term, is_edge_executable[b * 2]);
+        changes |= IR_CHANGED_ALL;
+    }
+    for (int b : unreachable)
+        for (int inst = func.blocks[b].first_inst; inst != -1;
+             inst = func.values[inst].next)
+            func.drop_operands(inst);
+    for (int b : unreachable) func.remove_block(b);
+    if (!unreachable.empty()) changes |= IR_CHANGED_ALL;
+    return changes;
+}
@@ -0,0 +1,201 @@
+#include "irgen.h"
+
+// Aggregate
+
+typedef enum {
+    KOOPA_AGGREGATE_TYPE_INT,
+    KOOPA_AGGREGATE_TYPE_UNDEF,
+    KOOPA_AGGREGATE_TYPE_AGGREGATE,
+    KOOPA_AGGREGATE_TYPE_ZEROINIT,
+} koopa_aggregate_type_t;
+
+class KoopaAggregate {
+   public:
+    koopa_aggregate_type_t type;
+    int int_val;
+    std::vector<KoopaAggregate> aggs;
+
+    std::string to_string() {
+        if (type == KOOPA_AGGREGATE_TYPE_INT) {
+            return std::to_string(int_val);
+        } else if (type == KOOPA_AGGREGATE_TYPE_UNDEF) {
+            return "undef";
+        } else if (type == KOOPA_AGGREGATE_TYPE_ZEROINIT) {
+            return "zeroinit";
+        } else if (type == KOOPA_AGGREGATE_TYPE_AGGREGATE) {
+            std::string ret = "{ ";
+            auto len = aggs.size();
+            for (int i = 0; i < len; i++) {
+                ret += aggs[i].to_string();
+                if (i + 1 != len) ret += ", ";
+            }
+            ret += " }";
+            return ret;
+        } else {
+            assert(false);
+        }
+    }
+};
+
+typedef std::vector<int>::const_iterator full_array_it_t;
+
+// aggregate a given piece of full array into one reg_agg
+static void simplify_aggregate_full_array(full_array_it_t begin,
+                                          full_array_it_t end,
+                                          const KoopaType *type,
+                                          KoopaAggregate &ret_agg) {
+    // zeroinit?
+    bool is_zeroinit = true;
+    for (auto it = begin; it != end; it++)
+        is_zeroinit = is_zeroinit && (*it == 0);
+
+    if (is_zeroinit) {
+        ret_agg.type = KOOPA_AGGREGATE_TYPE_ZEROINIT;
+    } else {
+        if (type->tag == KOOPA_TYPE_INT32) {
+            assert(begin + 1 == end);
+            ret_agg.type = KOOPA_AGGREGATE_TYPE_INT;
+            ret_agg.int_val = *begin;
+        } else {
+            ret_agg.type = KOOPA_AGGREGATE_TYPE_AGGREGATE;
+            auto interval = type->stride / 4;
+            for (int i = 0; i < type->len; i++) {
+                KoopaAggregate sub_agg;
+                simplify_aggregate_full_array(begin + i * interval,
+                                              begin + (i + 1) * interval,
+                                              type->base, sub_agg);
+                ret_agg.aggs.push_back(sub_agg);
+            }
+            assert(begin + interval * type->len == end);
+        }
+    }
+}
+
+static std::string to_koopa_aggregate(const KoopaType *type,
+                                      const std::vector<int> &init) {
+    assert(init.size() == type->size / 4);
+    KoopaAggregate agg;
+    simplify_aggregate_full_array(init.begin(), init.end(), type, agg);
+    return agg.to_string();
+}
+
+static const char *to_koopa_binary_op(koopa_raw_binary_op_t op) {
+    static const char *names[] = {
+        "ne",  "eq",  "gt",  "lt",  "ge",  "le", "add", "sub", "mul",
+        "div", "mod", "and", "or",  "xor", "shl", "shr", "sar",
+    };
+    assert(op < sizeof(names) / sizeof(names[0]));
+    return names[op];
+}
+
+// KoopaEmitter
+
+void KoopaEmitter::lib_decl(std::ostream &out, const std::string &decl) {
+    out << decl << std::endl;
+}
+
+void KoopaEmitter::global_alloc(std::ostream &out, const std::string &name,
+                                const KoopaType *type,
+                                const std::vector<int> &init) {
+    out << "global " << name << " = alloc " << type->str;
+    if (type->tag == KOOPA_TYPE_INT32) {
+        out << ", " << (init.empty() ? "zeroinit" : std::to_string(init[0]))
+            << std::endl;
+        return;
+    }
+    if (!init.empty())
+        out << ", " << to_koopa_aggregate(type, init);
+    else
+        out << ", zeroinit" << std::endl;
+    out << std::endl;
+}
+
+void KoopaEmitter::func_begin(std::ostream &out, const std::string &name,
+                              const params_t &params, bool is_int) {
+    out << "fun @" << name << "(";
+    int cnt_param = 0;
+    for (auto &param : params) {
+        out << param.first << ": " << param.second->str;
+        if (++cnt_param < params.size()) out << ", ";
+    }
+    out << ")";
+    if (is_int) out << ": i32 ";
+    out << "{" << std::endl;
+}
+
+void KoopaEmitter::func_end(std::ostream &out) { out << "}" << std::endl; }
+
+void KoopaEmitter::block(std::ostream &out, const std::string &name) {
+    out << name << ":" << std::endl;
+}
+
+void KoopaEmitter::alloc(std::ostream &out, const std::string &name,
+                         const KoopaType *type) {
+    out << "  " << name << " = alloc " << type->str << std::endl;
+}
+
+void KoopaEmitter::load(std::ostream &out, const std::string &dst,
+                        const std::string &src) {
+    out << "  " << dst << " = load " << src << std::endl;
+}
+
+void KoopaEmitter::store(std::ostream &out, const std::string &val,
+                         const std::string &dst) {
+    out << "  store " << val << ", " << dst << std::endl;
+}
+
+void KoopaEmitter::store_init(std::ostream &out, const std::string &dst,
+                              const KoopaType *type,
+                              const std::vector<int> &init) {
+    store(out, to_koopa_aggregate(type, init), dst);
+}
+
+void KoopaEmitter::get_ptr(std::ostream &out, const std::string &dst,
+                           const std::string &src, const std::string &index) {
+    out << "  " << dst << " = getptr " << src << ", " << index << std::endl;
+}
+
+void KoopaEmitter::get_elem_ptr(std::ostream &out, const std::string &dst,
+                                const std::string &src,
+                                const std::string &index) {
+    out << "  " << dst << " = getelemptr " << src << ", " << index
+        << std::endl;
+}
+
+void KoopaEmitter::binary(std::ostream &out, const std::string &dst,
+                          koopa_raw_binary_op_t op, const std::string &lhs,
+                          const std::string &rhs) {
+    out << "  " << dst << " = " << to_koopa_binary_op(op) << " " << lhs
+        << ", " << rhs << std::endl;
+}
+
+void KoopaEmitter::call(std::ostream &out, const std::string &dst,
+                        const std::string &func,
+                        const std::vector<std::string> &args) {
+    out << "  ";
+    if (!dst.empty()) out << dst << " = ";
+    out << "call @" << func << "(";
+    int cnt_arg = 0;
+    for (auto &arg : args) {
+        out << arg;
+        if (++cnt_arg != args.size()) out << ", ";
+    }
+    out << ")" << std::endl;
+}
+
+void KoopaEmitter::branch(std::ostream &out, const std::string &cond,
+                          const std::string &true_bb,
+                          const std::string &false_bb) {
+    out << "  br " << cond << ", " << true_bb << ", " << false_bb << std::endl;
+}
+
+void KoopaEmitter::jump(std::ostream &out, const std::string &target) {
+    out << "  jump " << target << std::endl;
+}
+
+void KoopaEmitter::ret(std::ostream &out, const std::string &val) {
+    if (val.empty())
+        out << "  ret" << std::endl;
+    else
+        out << "  ret " << val << std::endl;
+}
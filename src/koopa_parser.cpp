@@ -0,0 +1,725 @@
+#include <koopa_parser.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// KoopaSymbolMap
+
+size_t KoopaSymbolMap::_find_slot(std::string_view name) const {
+    size_t mask = keys.size() - 1;
+    size_t slot = std::hash<std::string_view>()(name) & mask;
+    while (!keys[slot].empty() && keys[slot] != name) slot = (slot + 1) & mask;
+    return slot;
+}
+
+bool KoopaSymbolMap::insert(std::string_view name, const void *value) {
+    auto slot = _find_slot(name);
+    if (!keys[slot].empty()) return false;
+    keys[slot] = name;
+    values[slot] = value;
+    used_slots.push_back(slot);
+    // keep load factor under 1/2
+    if (used_slots.size() * 2 > keys.size()) _grow();
+    return true;
+}
+
+void KoopaSymbolMap::_grow() {
+    std::vector<std::pair<std::string_view, const void *>> entries;
+    for (auto slot : used_slots)
+        entries.push_back(std::make_pair(keys[slot], values[slot]));
+    keys.assign(keys.size() * 2, std::string_view());
+    values.assign(values.size() * 2, nullptr);
+    used_slots.clear();
+    for (auto &entry : entries) {
+        auto slot = _find_slot(entry.first);
+        keys[slot] = entry.first;
+        values[slot] = entry.second;
+        used_slots.push_back(slot);
+    }
+}
+
+void KoopaSymbolMap::clear() {
+    for (auto slot : used_slots) {
+        keys[slot] = std::string_view();
+        values[slot] = nullptr;
+    }
+    used_slots.clear();
+}
+
+// tokens
+
+bool KoopaParser::_fail(const std::string &msg) {
+    if (error.empty()) error = "line " + std::to_string(line) + ": " + msg;
+    cur = end;  // nothing more to parse
+    return false;
+}
+
+void KoopaParser::_skip_space() {
+    while (cur < end) {
+        char c = *cur;
+        if (c == '\n') {
+            line++;
+            cur++;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            cur++;
+        } else if (c == '/' && cur + 1 < end && cur[1] == '/') {
+            while (cur < end && *cur != '\n') cur++;
+        } else if (c == '/' && cur + 1 < end && cur[1] == '*') {
+            for (cur += 2; cur < end; cur++) {
+                if (cur[0] == '*' && cur + 1 < end && cur[1] == '/') break;
+                if (cur[0] == '\n') line++;
+            }
+            if (cur == end) {
+                _fail("unterminated comment");
+                break;
+            }
+            cur += 2;
+        } else {
+            break;
+        }
+    }
+}
+
+bool KoopaParser::_eat(char c) {
+    _skip_space();
+    if (cur == end || *cur != c) return false;
+    cur++;
+    return true;
+}
+
+bool KoopaParser::_expect(char c) {
+    if (_eat(c)) return true;
+    return _fail(std::string("expected '") + c + "'");
+}
+
+static bool _is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// a keyword or an op, which the next char doesn't continue
+bool KoopaParser::_eat_word(std::string_view word) {
+    _skip_space();
+    size_t len = word.size();
+    if ((size_t)(end - cur) < len || memcmp(cur, word.data(), len))
+        return false;
+    if (cur + len < end && _is_ident_char(cur[len])) return false;
+    cur += len;
+    return true;
+}
+
+std::string_view KoopaParser::_read_word() {
+    _skip_space();
+    auto start = cur;
+    while (cur < end && _is_ident_char(*cur)) cur++;
+    return std::string_view(start, cur - start);
+}
+
+// with its '@' or '%'
+std::string_view KoopaParser::_read_symbol() {
+    _skip_space();
+    auto start = cur;
+    if (cur < end && (*cur == '@' || *cur == '%')) {
+        cur++;
+        while (cur < end && _is_ident_char(*cur)) cur++;
+    }
+    if (cur - start < 2) {
+        _fail("expected a symbol");
+        return std::string_view();
+    }
+    return std::string_view(start, cur - start);
+}
+
+bool KoopaParser::_read_int(int32_t &value) {
+    bool is_negative = _eat('-');
+    _skip_space();
+    if (cur == end || !isdigit((unsigned char)*cur))
+        return _fail("expected an integer");
+    // wraps like the 32-bit ints of koopa
+    uint32_t abs = 0;
+    while (cur < end && isdigit((unsigned char)*cur))
+        abs = abs * 10 + (*cur++ - '0');
+    value = (int32_t)(is_negative ? 0u - abs : abs);
+    return true;
+}
+
+// whether a block starts here, rather than a value used by ret
+bool KoopaParser::_is_block_label() {
+    _skip_space();
+    if (cur == end || (*cur != '%' && *cur != '@')) return false;
+    auto p = cur + 1;
+    while (p < end && _is_ident_char(*p)) p++;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p < end && (*p == ':' || *p == '(');
+}
+
+// raw program on the arena
+
+const char *KoopaParser::_copy_name(std::string_view name) {
+    auto str = arena.allocate<char>(name.size() + 1);
+    memcpy(str, name.data(), name.size());
+    str[name.size()] = '\0';
+    return str;
+}
+
+// items from mark up, which are popped
+koopa_raw_slice_t KoopaParser::_make_slice(size_t mark,
+                                           koopa_raw_slice_item_kind_t kind) {
+    koopa_raw_slice_t slice;
+    slice.buffer = nullptr;
+    slice.len = items.size() - mark;
+    slice.kind = kind;
+    if (slice.len) {
+        auto buffer = arena.allocate<const void *>(slice.len);
+        std::copy(items.begin() + mark, items.end(), buffer);
+        slice.buffer = buffer;
+    }
+    items.resize(mark);
+    return slice;
+}
+
+koopa_raw_slice_t KoopaParser::_make_slice(std::vector<const void *> &list,
+                                           koopa_raw_slice_item_kind_t kind) {
+    size_t mark = items.size();
+    items.insert(items.end(), list.begin(), list.end());
+    list.clear();
+    return _make_slice(mark, kind);
+}
+
+koopa_raw_value_data_t *KoopaParser::_new_value(koopa_raw_type_t ty,
+                                                koopa_raw_value_tag_t tag) {
+    auto value = arena.allocate<koopa_raw_value_data_t>(1);
+    memset(value, 0, sizeof(*value));
+    value->ty = ty;
+    value->used_by.kind = KOOPA_RSIK_VALUE;
+    value->kind.tag = tag;
+    return value;
+}
+
+// an undefined block has insts of unknown kind until it's parsed
+koopa_raw_basic_block_data_t *KoopaParser::_get_block(std::string_view name) {
+    auto block = (koopa_raw_basic_block_data_t *)blocks.find(name);
+    if (block) return block;
+    block = arena.allocate<koopa_raw_basic_block_data_t>(1);
+    memset(block, 0, sizeof(*block));
+    block->name = _copy_name(name);
+    block->params.kind = KOOPA_RSIK_VALUE;
+    block->used_by.kind = KOOPA_RSIK_VALUE;
+    block->insts.kind = KOOPA_RSIK_UNKNOWN;
+    blocks.insert(name, block);
+    num_undefined_blocks++;
+    return block;
+}
+
+// an undefined function has no type until it's parsed
+koopa_raw_function_data_t *KoopaParser::_get_func(std::string_view name) {
+    auto func = (koopa_raw_function_data_t *)funcs.find(name);
+    if (func) return func;
+    func = arena.allocate<koopa_raw_function_data_t>(1);
+    memset(func, 0, sizeof(*func));
+    func->name = _copy_name(name);
+    func->params.kind = KOOPA_RSIK_VALUE;
+    func->bbs.kind = KOOPA_RSIK_BASIC_BLOCK;
+    funcs.insert(name, func);
+    return func;
+}
+
+// types
+
+koopa_raw_type_t KoopaParser::_get_pointer(koopa_raw_type_t base) {
+    auto &type = pointer_types[base];
+    if (!type) {
+        auto kind = arena.allocate<koopa_raw_type_kind_t>(1);
+        kind->tag = KOOPA_RTT_POINTER;
+        kind->data.pointer.base = base;
+        type = kind;
+    }
+    return type;
+}
+
+koopa_raw_type_t KoopaParser::_get_array(koopa_raw_type_t base, size_t len) {
+    auto &type = array_types[std::make_pair(base, len)];
+    if (!type) {
+        auto kind = arena.allocate<koopa_raw_type_kind_t>(1);
+        kind->tag = KOOPA_RTT_ARRAY;
+        kind->data.array.base = base;
+        kind->data.array.len = len;
+        type = kind;
+    }
+    return type;
+}
+
+koopa_raw_type_t KoopaParser::_parse_type() {
+    if (_eat('*')) {
+        auto base = _parse_type();
+        return base ? _get_pointer(base) : nullptr;
+    }
+    if (_eat('[')) {
+        auto base = _parse_type();
+        int32_t len;
+        if (!base || !_expect(',') || !_read_int(len) || !_expect(']'))
+            return nullptr;
+        if (len <= 0) {
+            _fail("array of length " + std::to_string(len));
+            return nullptr;
+        }
+        return _get_array(base, len);
+    }
+    if (_eat('(')) {
+        size_t mark = items.size();
+        if (!_eat(')')) {
+            do {
+                auto param = _parse_type();
+                if (!param) return nullptr;
+                items.push_back(param);
+            } while (_eat(','));
+            if (!_expect(')')) return nullptr;
+        }
+        auto ret = unit_type;
+        if (_eat(':') && !(ret = _parse_type())) return nullptr;
+        auto kind = arena.allocate<koopa_raw_type_kind_t>(1);
+        kind->tag = KOOPA_RTT_FUNCTION;
+        kind->data.function.params = _make_slice(mark, KOOPA_RSIK_TYPE);
+        kind->data.function.ret = ret;
+        return kind;
+    }
+    if (_eat_word("i32")) return int32_type;
+    _fail("expected a type");
+    return nullptr;
+}
+
+// values
+
+// ty is only for undef
+koopa_raw_value_t KoopaParser::_parse_value(koopa_raw_type_t ty) {
+    _skip_space();
+    if (cur < end && (*cur == '%' || *cur == '@')) {
+        auto name = _read_symbol();
+        auto value = (koopa_raw_value_t)locals.find(name);
+        if (!value) value = (koopa_raw_value_t)globals.find(name);
+        if (!value) _fail("undefined value " + std::string(name));
+        return value;
+    }
+    if (_eat_word("undef")) return _new_value(ty, KOOPA_RVT_UNDEF);
+    int32_t integer;
+    if (!_read_int(integer)) return nullptr;
+    auto value = _new_value(int32_type, KOOPA_RVT_INTEGER);
+    value->kind.data.integer.value = integer;
+    return value;
+}
+
+// a value, or zeroinit or aggregate of ty,
+// which could be null if it's known later, see _set_init_type
+koopa_raw_value_t KoopaParser::_parse_init(koopa_raw_type_t ty) {
+    if (_eat_word("zeroinit")) return _new_value(ty, KOOPA_RVT_ZERO_INIT);
+    if (!_eat('{')) return _parse_value(ty);
+
+    koopa_raw_type_t elem_ty = nullptr;
+    if (ty) {
+        if (ty->tag != KOOPA_RTT_ARRAY) {
+            _fail("aggregate of a non-array type");
+            return nullptr;
+        }
+        elem_ty = ty->data.array.base;
+    }
+    size_t mark = items.size();
+    do {
+        auto elem = _parse_init(elem_ty);
+        if (!elem) return nullptr;
+        items.push_back(elem);
+    } while (_eat(','));
+    if (!_expect('}')) return nullptr;
+    if (ty && items.size() - mark != ty->data.array.len) {
+        _fail("aggregate of a wrong length");
+        return nullptr;
+    }
+    auto aggregate = _new_value(ty, KOOPA_RVT_AGGREGATE);
+    aggregate->kind.data.aggregate.elems = _make_slice(mark, KOOPA_RSIK_VALUE);
+    return aggregate;
+}
+
+void KoopaParser::_set_init_type(koopa_raw_value_t init, koopa_raw_type_t ty) {
+    if (init->ty) return;
+    ((koopa_raw_value_data_t *)init)->ty = ty;
+    if (init->kind.tag != KOOPA_RVT_AGGREGATE) return;
+    auto elems = init->kind.data.aggregate.elems;
+    if (ty->tag != KOOPA_RTT_ARRAY || elems.len != ty->data.array.len) {
+        _fail("aggregate doesn't match the type stored to");
+        return;
+    }
+    for (size_t i = 0; i < elems.len; i++)
+        _set_init_type((koopa_raw_value_t)elems.buffer[i],
+                       ty->data.array.base);
+}
+
+// values after '(' up to ')', typed by params if they're known,
+// which are values of block params or types of function params
+bool KoopaParser::_parse_args(koopa_raw_slice_t &args,
+                              koopa_raw_slice_t params) {
+    size_t mark = items.size();
+    if (!_eat(')')) {
+        do {
+            size_t i = items.size() - mark;
+            auto ty = int32_type;
+            if (i < params.len && params.kind == KOOPA_RSIK_VALUE)
+                ty = ((koopa_raw_value_t)params.buffer[i])->ty;
+            else if (i < params.len)
+                ty = (koopa_raw_type_t)params.buffer[i];
+            auto arg = _parse_value(ty);
+            if (!arg) return false;
+            items.push_back(arg);
+        } while (_eat(','));
+        if (!_expect(')')) return false;
+    }
+    args = _make_slice(mark, KOOPA_RSIK_VALUE);
+    return true;
+}
+
+// program
+
+// global SYMBOL = alloc TYPE, INITIALIZER
+bool KoopaParser::_parse_global() {
+    auto name = _read_symbol();
+    if (name.empty() || !_expect('=')) return false;
+    if (!_eat_word("alloc")) return _fail("expected alloc");
+    auto ty = _parse_type();
+    if (!ty || !_expect(',')) return false;
+    auto init = _parse_init(ty);
+    if (!init) return false;
+
+    auto value = _new_value(_get_pointer(ty), KOOPA_RVT_GLOBAL_ALLOC);
+    value->name = _copy_name(name);
+    value->kind.data.global_alloc.init = init;
+    if (!globals.insert(name, value))
+        return _fail("redefined " + std::string(name));
+    program_values.push_back(value);
+    return true;
+}
+
+// fun SYMBOL(SYMBOL: TYPE, ...): TYPE { BLOCK ... }
+// decl SYMBOL(TYPE, ...): TYPE
+bool KoopaParser::_parse_func(bool is_decl) {
+    auto name = _read_symbol();
+    if (name.empty()) return false;
+    auto func = _get_func(name);
+    if (func->ty) return _fail("redefined " + std::string(name));
+    if (!_expect('(')) return false;
+    locals.clear();
+    blocks.clear();
+    num_undefined_blocks = 0;
+
+    // params of a decl are only types
+    size_t mark = items.size();
+    if (!_eat(')')) {
+        do {
+            if (is_decl) {
+                auto ty = _parse_type();
+                if (!ty) return false;
+                items.push_back(ty);
+                continue;
+            }
+            auto param_name = _read_symbol();
+            if (param_name.empty() || !_expect(':')) return false;
+            auto ty = _parse_type();
+            if (!ty) return false;
+            auto param = _new_value(ty, KOOPA_RVT_FUNC_ARG_REF);
+            param->name = _copy_name(param_name);
+            param->kind.data.func_arg_ref.index = items.size() - mark;
+            if (!locals.insert(param_name, param))
+                return _fail("redefined " + std::string(param_name));
+            items.push_back(param);
+        } while (_eat(','));
+        if (!_expect(')')) return false;
+    }
+    auto ret = unit_type;
+    if (_eat(':') && !(ret = _parse_type())) return false;
+
+    auto ty = arena.allocate<koopa_raw_type_kind_t>(1);
+    ty->tag = KOOPA_RTT_FUNCTION;
+    ty->data.function.ret = ret;
+    if (is_decl) {
+        ty->data.function.params = _make_slice(mark, KOOPA_RSIK_TYPE);
+    } else {
+        size_t num_params = items.size() - mark;
+        for (size_t i = 0; i < num_params; i++)
+            items.push_back(((koopa_raw_value_t)items[mark + i])->ty);
+        ty->data.function.params =
+            _make_slice(mark + num_params, KOOPA_RSIK_TYPE);
+        func->params = _make_slice(mark, KOOPA_RSIK_VALUE);
+    }
+    func->ty = ty;
+    program_funcs.push_back(func);
+    if (is_decl) return true;
+
+    if (!_expect('{')) return false;
+    while (!_eat('}'))
+        if (!_parse_block()) return false;
+    if (func_blocks.empty()) return _fail("function without blocks");
+    if (num_undefined_blocks)
+        return _fail("branch to an undefined block in " + std::string(name));
+    func->bbs = _make_slice(func_blocks, KOOPA_RSIK_BASIC_BLOCK);
+    return true;
+}
+
+// SYMBOL(SYMBOL: TYPE, ...): INST ... END_INST
+bool KoopaParser::_parse_block() {
+    auto name = _read_symbol();
+    if (name.empty()) return false;
+    auto block = _get_block(name);
+    if (block->insts.kind != KOOPA_RSIK_UNKNOWN)
+        return _fail("redefined " + std::string(name));
+
+    size_t mark = items.size();
+    if (_eat('(')) {
+        do {
+            auto param_name = _read_symbol();
+            if (param_name.empty() || !_expect(':')) return false;
+            auto ty = _parse_type();
+            if (!ty) return false;
+            auto param = _new_value(ty, KOOPA_RVT_BLOCK_ARG_REF);
+            param->name = _copy_name(param_name);
+            param->kind.data.block_arg_ref.index = items.size() - mark;
+            if (!locals.insert(param_name, param))
+                return _fail("redefined " + std::string(param_name));
+            items.push_back(param);
+        } while (_eat(','));
+        if (!_expect(')')) return false;
+    }
+    block->params = _make_slice(mark, KOOPA_RSIK_VALUE);
+    if (!_expect(':')) return false;
+    // defined from here, even if its insts are still parsed
+    block->insts.kind = KOOPA_RSIK_VALUE;
+    num_undefined_blocks--;
+    func_blocks.push_back(block);
+
+    bool is_end = false;
+    while (!is_end) {
+        _skip_space();
+        std::string_view inst_name;
+        if (cur < end && (*cur == '%' || *cur == '@')) {
+            inst_name = _read_symbol();
+            if (!_expect('=')) return false;
+        }
+        auto inst = _parse_inst(inst_name, is_end);
+        if (!inst) return false;
+        items.push_back(inst);
+    }
+    block->insts = _make_slice(mark, KOOPA_RSIK_VALUE);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    koopa_raw_binary_op_t op;
+} binary_ops[] = {
+    {"ne", KOOPA_RBO_NOT_EQ}, {"eq", KOOPA_RBO_EQ},   {"gt", KOOPA_RBO_GT},
+    {"lt", KOOPA_RBO_LT},     {"ge", KOOPA_RBO_GE},   {"le", KOOPA_RBO_LE},
+    {"add", KOOPA_RBO_ADD},   {"sub", KOOPA_RBO_SUB}, {"mul", KOOPA_RBO_MUL},
+    {"div", KOOPA_RBO_DIV},   {"mod", KOOPA_RBO_MOD}, {"and", KOOPA_RBO_AND},
+    {"or", KOOPA_RBO_OR},     {"xor", KOOPA_RBO_XOR}, {"shl", KOOPA_RBO_SHL},
+    {"shr", KOOPA_RBO_SHR},   {"sar", KOOPA_RBO_SAR},
+};
+
+// null if it fails, is_end is set after br, jump and ret
+koopa_raw_value_t KoopaParser::_parse_inst(std::string_view name,
+                                           bool &is_end) {
+    auto op = _read_word();
+    koopa_raw_value_data_t *inst = nullptr;
+
+    if (op == "alloc") {
+        auto ty = _parse_type();
+        if (!ty) return nullptr;
+        inst = _new_value(_get_pointer(ty), KOOPA_RVT_ALLOC);
+    } else if (op == "load") {
+        auto src = _parse_value(nullptr);
+        if (!src) return nullptr;
+        if (src->ty->tag != KOOPA_RTT_POINTER) {
+            _fail("load of a non-pointer");
+            return nullptr;
+        }
+        inst = _new_value(src->ty->data.pointer.base, KOOPA_RVT_LOAD);
+        inst->kind.data.load.src = src;
+    } else if (op == "store") {
+        // an initializer takes its type from dest
+        auto value = _parse_init(nullptr);
+        if (!value || !_expect(',')) return nullptr;
+        auto dest = _parse_value(nullptr);
+        if (!dest) return nullptr;
+        if (dest->ty->tag != KOOPA_RTT_POINTER) {
+            _fail("store to a non-pointer");
+            return nullptr;
+        }
+        _set_init_type(value, dest->ty->data.pointer.base);
+        inst = _new_value(unit_type, KOOPA_RVT_STORE);
+        inst->kind.data.store.value = value;
+        inst->kind.data.store.dest = dest;
+    } else if (op == "getptr" || op == "getelemptr") {
+        auto src = _parse_value(nullptr);
+        if (!src || !_expect(',')) return nullptr;
+        auto index = _parse_value(int32_type);
+        if (!index) return nullptr;
+        auto ty = src->ty;
+        if (ty->tag != KOOPA_RTT_POINTER) {
+            _fail(std::string(op) + " of a non-pointer");
+            return nullptr;
+        }
+        if (op == "getptr") {
+            inst = _new_value(ty, KOOPA_RVT_GET_PTR);
+            inst->kind.data.get_ptr.src = src;
+            inst->kind.data.get_ptr.index = index;
+        } else {
+            auto base = ty->data.pointer.base;
+            if (base->tag != KOOPA_RTT_ARRAY) {
+                _fail("getelemptr of a non-array pointer");
+                return nullptr;
+            }
+            inst = _new_value(_get_pointer(base->data.array.base),
+                              KOOPA_RVT_GET_ELEM_PTR);
+            inst->kind.data.get_elem_ptr.src = src;
+            inst->kind.data.get_elem_ptr.index = index;
+        }
+    } else if (op == "br") {
+        inst = _new_value(unit_type, KOOPA_RVT_BRANCH);
+        auto &branch = inst->kind.data.branch;
+        branch.cond = _parse_value(int32_type);
+        if (!branch.cond || !_expect(',')) return nullptr;
+        auto true_name = _read_symbol();
+        if (true_name.empty()) return nullptr;
+        auto true_bb = _get_block(true_name);
+        branch.true_bb = true_bb;
+        branch.true_args.kind = KOOPA_RSIK_VALUE;
+        if (_eat('(') && !_parse_args(branch.true_args, true_bb->params))
+            return nullptr;
+        if (!_expect(',')) return nullptr;
+        auto false_name = _read_symbol();
+        if (false_name.empty()) return nullptr;
+        auto false_bb = _get_block(false_name);
+        branch.false_bb = false_bb;
+        branch.false_args.kind = KOOPA_RSIK_VALUE;
+        if (_eat('(') && !_parse_args(branch.false_args, false_bb->params))
+            return nullptr;
+        is_end = true;
+    } else if (op == "jump") {
+        inst = _new_value(unit_type, KOOPA_RVT_JUMP);
+        auto &jump = inst->kind.data.jump;
+        auto target_name = _read_symbol();
+        if (target_name.empty()) return nullptr;
+        auto target = _get_block(target_name);
+        jump.target = target;
+        jump.args.kind = KOOPA_RSIK_VALUE;
+        if (_eat('(') && !_parse_args(jump.args, target->params))
+            return nullptr;
+        is_end = true;
+    } else if (op == "ret") {
+        inst = _new_value(unit_type, KOOPA_RVT_RETURN);
+        _skip_space();
+        if (cur < end && *cur != '}' && !_is_block_label()) {
+            inst->kind.data.ret.value = _parse_value(int32_type);
+            if (!inst->kind.data.ret.value) return nullptr;
+        }
+        is_end = true;
+    } else if (op == "call") {
+        auto callee_name = _read_symbol();
+        if (callee_name.empty() || !_expect('(')) return nullptr;
+        auto callee = _get_func(callee_name);
+        koopa_raw_slice_t params = {nullptr, 0, KOOPA_RSIK_TYPE};
+        if (callee->ty) params = callee->ty->data.function.params;
+        inst = _new_value(nullptr, KOOPA_RVT_CALL);
+        inst->kind.data.call.callee = callee;
+        if (!_parse_args(inst->kind.data.call.args, params)) return nullptr;
+        if (callee->ty) {
+            inst->ty = callee->ty->data.function.ret;
+        } else {
+            // a result used before the callee is parsed could only be i32
+            if (!name.empty()) inst->ty = int32_type;
+            pending_calls.push_back(inst);
+        }
+    } else {
+        for (auto &binary_op : binary_ops) {
+            if (op != binary_op.name) continue;
+            auto lhs = _parse_value(int32_type);
+            if (!lhs || !_expect(',')) return nullptr;
+            auto rhs = _parse_value(int32_type);
+            if (!rhs) return nullptr;
+            inst = _new_value(int32_type, KOOPA_RVT_BINARY);
+            inst->kind.data.binary.op = binary_op.op;
+            inst->kind.data.binary.lhs = lhs;
+            inst->kind.data.binary.rhs = rhs;
+            break;
+        }
+        if (!inst) {
+            _fail("unknown instruction " + std::string(op));
+            return nullptr;
+        }
+    }
+
+    if (!name.empty()) {
+        inst->name = _copy_name(name);
+        if (!locals.insert(name, inst)) {
+            _fail("redefined " + std::string(name));
+            return nullptr;
+        }
+    }
+    return inst;
+}
+
+bool KoopaParser::parse(std::string_view text, koopa_raw_program_t &raw,
+                        std::ostream &err) {
+    arena.reset();
+    cur = text.data();
+    end = cur + text.size();
+    line = 1;
+    error.clear();
+    pointer_types.clear();
+    array_types.clear();
+    globals.clear();
+    funcs.clear();
+    locals.clear();
+    blocks.clear();
+    pending_calls.clear();
+    items.clear();
+    func_blocks.clear();
+    program_values.clear();
+    program_funcs.clear();
+
+    auto int32 = arena.allocate<koopa_raw_type_kind_t>(1);
+    int32->tag = KOOPA_RTT_INT32;
+    int32_type = int32;
+    auto unit = arena.allocate<koopa_raw_type_kind_t>(1);
+    unit->tag = KOOPA_RTT_UNIT;
+    unit_type = unit;
+
+    while (true) {
+        _skip_space();
+        if (cur == end) break;
+        bool is_ok;
+        if (_eat_word("global"))
+            is_ok = _parse_global();
+        else if (_eat_word("fun"))
+            is_ok = _parse_func(false);
+        else if (_eat_word("decl"))
+            is_ok = _parse_func(true);
+        else
+            is_ok = _fail("expected global, fun or decl");
+        if (!is_ok) break;
+    }
+
+    for (auto call : pending_calls) {
+        if (!error.empty()) break;
+        auto callee = call->kind.data.call.callee;
+        auto ret = callee->ty ? callee->ty->data.function.ret : nullptr;
+        if (!callee->ty)
+            error = "undefined function " + std::string(callee->name);
+        else if (call->ty && call->ty != ret)
+            error = "result of " + std::string(callee->name) + " isn't i32";
+        else
+            call->ty = ret;
+    }
+    if (!error.empty()) {
+        err << "KoopaParser: " << error << std::endl;
+        return false;
+    }
+    raw.values = _make_slice(program_values, KOOPA_RSIK_VALUE);
+    raw.funcs = _make_slice(program_funcs, KOOPA_RSIK_FUNCTION);
+    return true;
+}
@@ -0,0 +1,360 @@
+#include <lexer.h>
+
+#include <cassert>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "sysy.tab.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+extern FILE *yyin;
+extern int yylineno;
+int flex_lex();  // scanner generated from sysy.l
+void yyrestart(FILE *in);
+
+// Masks of a block, bit i for byte i, through the widest vectors we have
+
+#if defined(__AVX2__)
+
+static const int LEX_BLOCK = 32;
+static const uint32_t LEX_BLOCK_BITS = 0xffffffffu;
+typedef __m256i lex_vec_t;
+
+static inline lex_vec_t _load(const char *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+static inline lex_vec_t _splat(char c) { return _mm256_set1_epi8(c); }
+static inline lex_vec_t _or(lex_vec_t a, lex_vec_t b) {
+    return _mm256_or_si256(a, b);
+}
+static inline lex_vec_t _eq(lex_vec_t v, char c) {
+    return _mm256_cmpeq_epi8(v, _splat(c));
+}
+// lo <= v <= hi for ascii bounds, bytes above 0x7f are negative
+static inline lex_vec_t _in(lex_vec_t v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _splat(lo - 1)),
+                            _mm256_cmpgt_epi8(_splat(hi + 1), v));
+}
+static inline uint32_t _bits(lex_vec_t v) { return _mm256_movemask_epi8(v); }
+
+#elif defined(__SSE2__)
+
+static const int LEX_BLOCK = 16;
+static const uint32_t LEX_BLOCK_BITS = 0xffffu;
+typedef __m128i lex_vec_t;
+
+static inline lex_vec_t _load(const char *p) {
+    return _mm_loadu_si128((const __m128i *)p);
+}
+static inline lex_vec_t _splat(char c) { return _mm_set1_epi8(c); }
+static inline lex_vec_t _or(lex_vec_t a, lex_vec_t b) {
+    return _mm_or_si128(a, b);
+}
+static inline lex_vec_t _eq(lex_vec_t v, char c) {
+    return _mm_cmpeq_epi8(v, _splat(c));
+}
+static inline lex_vec_t _in(lex_vec_t v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _splat(lo - 1)),
+                         _mm_cmpgt_epi8(_splat(hi + 1), v));
+}
+static inline uint32_t _bits(lex_vec_t v) { return _mm_movemask_epi8(v); }
+
+#endif
+
+static inline bool _is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool _is_ident(char c) {
+    return (unsigned)((c | 0x20) - 'a') < 26 || (unsigned)(c - '0') < 10 ||
+           c == '_';
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+static inline uint32_t _mask_eq(const char *p, char c) {
+    return _bits(_eq(_load(p), c));
+}
+
+static inline uint32_t _mask_whitespace(const char *p) {
+    auto v = _load(p);
+    return _bits(_or(_or(_eq(v, ' '), _eq(v, '\t')),
+                     _or(_eq(v, '\n'), _eq(v, '\r'))));
+}
+
+static inline uint32_t _mask_ident(const char *p) {
+    auto v = _load(p);
+    // setting bit 5 maps upper case letters to lower case ones
+    auto letter = _in(_or(v, _splat(0x20)), 'a', 'z');
+    return _bits(_or(_or(letter, _in(v, '0', '9')), _eq(v, '_')));
+}
+
+#else
+
+static const int LEX_BLOCK = 8;
+static const uint32_t LEX_BLOCK_BITS = 0xffu;
+
+static inline uint32_t _mask_eq(const char *p, char c) {
+    uint32_t mask = 0;
+    for (int i = 0; i < LEX_BLOCK; i++) mask |= (uint32_t)(p[i] == c) << i;
+    return mask;
+}
+
+static inline uint32_t _mask_whitespace(const char *p) {
+    uint32_t mask = 0;
+    for (int i = 0; i < LEX_BLOCK; i++)
+        mask |= (uint32_t)_is_whitespace(p[i]) << i;
+    return mask;
+}
+
+static inline uint32_t _mask_ident(const char *p) {
+    uint32_t mask = 0;
+    for (int i = 0; i < LEX_BLOCK; i++) mask |= (uint32_t)_is_ident(p[i]) << i;
+    return mask;
+}
+
+#endif
+
+// bits below i
+static inline uint32_t _below(int i) { return (1u << i) - 1; }
+
+// FastLexer
+
+void FastLexer::load(FILE *in) {
+    buf.clear();
+    char chunk[1 << 16];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), in)) > 0)
+        buf.insert(buf.end(), chunk, chunk + len);
+    _pad();
+}
+
+void FastLexer::load(std::string_view source) {
+    buf.assign(source.begin(), source.end());
+    _pad();
+}
+
+void FastLexer::_pad() {
+    size_t size = buf.size();
+    // scans stop at zeros, and may read a whole block past them
+    buf.resize(size + 2 * LEX_BLOCK, 0);
+    cur = buf.data();
+    end = cur + size;
+}
+
+// all the scans below stop at the zeros past the input, if not earlier
+
+const char *FastLexer::_skip_whitespace(const char *p) {
+    while (true) {
+        uint32_t rest = ~_mask_whitespace(p) & LEX_BLOCK_BITS;
+        uint32_t newlines = _mask_eq(p, '\n');
+        if (rest) {
+            int i = __builtin_ctz(rest);
+            yylineno += __builtin_popcount(newlines & _below(i));
+            return p + i;
+        }
+        yylineno += __builtin_popcount(newlines);
+        p += LEX_BLOCK;
+    }
+}
+
+// up to the newline, which is left to whitespace
+const char *FastLexer::_skip_line_comment(const char *p) {
+    for (p += 2; p < end; p += LEX_BLOCK) {
+        uint32_t newlines = _mask_eq(p, '\n');
+        if (newlines) return p + __builtin_ctz(newlines);
+    }
+    return end;
+}
+
+// the comment ends at the first "*/" after "/*",
+// nullptr if it never ends, then it's lexed as '/' and '*' like flex does
+const char *FastLexer::_skip_block_comment(const char *p) {
+    int lines = 0;
+    for (p += 2; p < end; p += LEX_BLOCK) {
+        uint32_t stars = _mask_eq(p, '*');
+        uint32_t newlines = _mask_eq(p, '\n');
+        for (; stars; stars &= stars - 1) {
+            int i = __builtin_ctz(stars);
+            if (p[i + 1] != '/') continue;
+            yylineno += lines + __builtin_popcount(newlines & _below(i));
+            return p + i + 2;
+        }
+        lines += __builtin_popcount(newlines);
+    }
+    return nullptr;
+}
+
+const char *FastLexer::_skip_ident(const char *p) {
+    while (true) {
+        uint32_t rest = ~_mask_ident(p) & LEX_BLOCK_BITS;
+        if (rest) return p + __builtin_ctz(rest);
+        p += LEX_BLOCK;
+    }
+}
+
+static int _get_keyword(const char *s, size_t len) {
+    static const struct {
+        const char *word;
+        int token;
+    } keywords[] = {
+        {"int", INT},     {"void", VOID},   {"return", RETURN},
+        {"const", CONST}, {"if", IF},       {"else", ELSE},
+        {"while", WHILE}, {"break", BREAK}, {"continue", CONTINUE},
+    };
+    for (auto &keyword : keywords)
+        if (strlen(keyword.word) == len && !memcmp(keyword.word, s, len))
+            return keyword.token;
+    return IDENT;
+}
+
+int FastLexer::lex() {
+    while (true) {
+        cur = _skip_whitespace(cur);
+        if (cur == end) return 0;
+        if (cur[0] != '/') break;
+        if (cur[1] == '/') {
+            cur = _skip_line_comment(cur);
+        } else if (cur[1] == '*') {
+            auto next = _skip_block_comment(cur);
+            if (!next) break;
+            cur = next;
+        } else {
+            break;
+        }
+    }
+
+    const char *start = cur;
+    char c = *cur;
+    if (c == '_' || (unsigned)((c | 0x20) - 'a') < 26) {
+        cur = _skip_ident(cur + 1);
+        int token = _get_keyword(start, cur - start);
+        if (token == IDENT) yylval.str_val = new std::string(start, cur);
+        return token;
+    }
+
+    if ((unsigned)(c - '0') < 10) {
+        if (c != '0') {
+            while ((unsigned)(*cur - '0') < 10) cur++;
+        } else if ((cur[1] | 0x20) == 'x' && isxdigit((unsigned char)cur[2])) {
+            cur += 2;
+            while (isxdigit((unsigned char)*cur)) cur++;
+        } else {
+            cur++;
+            while ((unsigned)(*cur - '0') < 8) cur++;
+        }
+        // the byte after a number never continues it
+        yylval.int_val = strtol(start, nullptr, 0);
+        return INT_CONST;
+    }
+
+    static const struct {
+        char op[3];
+        int token;
+    } ops[] = {
+        {"<=", LE}, {">=", GE},  {"==", EQ},
+        {"!=", NE}, {"&&", LAND}, {"||", LOR},
+    };
+    for (auto &op : ops) {
+        if (c != op.op[0] || cur[1] != op.op[1]) continue;
+        cur += 2;
+        yylval.str_val = new std::string(op.op);
+        return op.token;
+    }
+    cur++;
+    return c;
+}
+
+// yylex, by the lexer chosen
+
+static lexer_kind_t lexer_kind = LEXER_FAST;
+static FastLexer fast_lexer;
+static bool is_loaded = false;
+static FILE *source_file = nullptr;
+
+void set_lexer(lexer_kind_t kind) { lexer_kind = kind; }
+
+void set_lexer_source(std::string_view source) {
+    yylineno = 1;
+    if (lexer_kind == LEXER_FAST) {
+        fast_lexer.load(source);
+        is_loaded = true;
+        return;
+    }
+    // flex reads a FILE, which could be opened over the memory
+    if (source_file) fclose(source_file);
+    source_file = fmemopen((void *)source.data(), source.size(), "r");
+    assert(source_file);
+    yyrestart(source_file);
+}
+
+int yylex() {
+    if (lexer_kind == LEXER_FLEX) return flex_lex();
+    if (!is_loaded) {
+        fast_lexer.load(yyin);
+        is_loaded = true;
+    }
+    return fast_lexer.lex();
+}
+
+static bool _has_str_val(int token) {
+    return token == IDENT || token == LE || token == GE || token == EQ ||
+           token == NE || token == LAND || token == LOR;
+}
+
+static std::string _get_token_str(int token, const YYSTYPE &val) {
+    auto str = "token " + std::to_string(token);
+    if (_has_str_val(token)) str += " " + *val.str_val;
+    if (token == INT_CONST) str += " " + std::to_string(val.int_val);
+    return str;
+}
+
+bool check_lexers(FILE *in, std::ostream &err) {
+    long start = ftell(in);
+    assert(start != -1);
+    FastLexer lexer;
+    lexer.load(in);
+    fseek(in, start, SEEK_SET);
+    yyrestart(in);
+
+    bool is_same = true;
+    int num_tokens = 0;
+    int flex_line = yylineno = 1, fast_line = 1;
+    while (true) {
+        yylineno = flex_line;
+        int flex_token = flex_lex();
+        auto flex_val = yylval;
+        flex_line = yylineno;
+        yylineno = fast_line;
+        int fast_token = lexer.lex();
+        auto fast_val = yylval;
+        fast_line = yylineno;
+
+        auto flex_str = _get_token_str(flex_token, flex_val);
+        auto fast_str = _get_token_str(fast_token, fast_val);
+        if (_has_str_val(flex_token)) delete flex_val.str_val;
+        if (_has_str_val(fast_token)) delete fast_val.str_val;
+        if (flex_str != fast_str || flex_line != fast_line) {
+            err << "Lexer: token " << num_tokens << " differs, flex gives "
+                << flex_str << " at line " << flex_line << ", fast gives "
+                << fast_str << " at line " << fast_line << std::endl;
+            is_same = false;
+            break;
+        }
+        if (!flex_token) break;
+        num_tokens++;
+    }
+
+    // leave in for the parser as it was
+    fseek(in, start, SEEK_SET);
+    yyrestart(in);
+    yylineno = 1;
+    if (is_same) err << "Lexer: same " << num_tokens << " tokens" << std::endl;
+    return is_same;
+}
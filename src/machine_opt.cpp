@@ -0,0 +1,128 @@
+#include <pass.h>
+
+#include <cstring>
+#include <map>
+
+// Every koopa value is stored to its stack slot and loaded right back by its
+// users. Within a block, remember which register still holds each sp slot,
+// and turn loads of such slots into moves.
+bool forward_stack_loads(MachineFunction &func) {
+    bool changed = false;
+    // sp offset -> register holding it
+    typedef std::pair<const int, riscv_reg_t> slot_t;
+    std::map<int, riscv_reg_t, std::less<int>, ArenaAllocator<slot_t>> slots(
+        ArenaAllocator<slot_t>(func.arena));
+    auto kill_reg = [&](riscv_reg_t reg) {
+        for (auto it = slots.begin(); it != slots.end();) {
+            if (it->second == reg)
+                it = slots.erase(it);
+            else
+                ++it;
+        }
+    };
+
+    for (auto &block : func.blocks) {
+        // labels are jumped to from anywhere
+        slots.clear();
+        ArenaVector<MachineInst> insts(block.insts.get_allocator());
+        for (auto &inst : block.insts) {
+            if (inst.op == RV_SW) {
+                // other bases may point into stack, e.g. alloc memory
+                if (inst.rs1 == REG_SP)
+                    slots[inst.imm] = inst.rs2;
+                else
+                    slots.clear();
+            } else if (inst.op == RV_LW && inst.rs1 == REG_SP &&
+                       slots.count(inst.imm)) {
+                auto src = slots[inst.imm];
+                changed = true;
+                if (src == inst.rd) continue;
+                MachineInst mv(RV_MV);
+                mv.rd = inst.rd;
+                mv.rs1 = src;
+                kill_reg(inst.rd);
+                insts.push_back(mv);
+                continue;
+            } else if (inst.op == RV_CALL) {
+                // callee clobbers caller-saved registers and memory
+                slots.clear();
+            } else if (has_riscv_rd(inst.op)) {
+                if (inst.rd == REG_SP) {
+                    slots.clear();
+                } else {
+                    kill_reg(inst.rd);
+                    if (inst.op == RV_LW && inst.rs1 == REG_SP)
+                        slots[inst.imm] = inst.rd;
+                }
+            }
+            insts.push_back(inst);
+        }
+        block.insts.swap(insts);
+    }
+    return changed;
+}
+
+// Local rewrites of adjacent instructions
+bool run_peephole(MachineFunction &func) {
+    bool changed = false;
+    for (auto &block : func.blocks) {
+        ArenaVector<MachineInst> insts(block.insts.get_allocator());
+        for (auto &inst : block.insts) {
+            // mv r, r & addi r, r, 0
+            if ((inst.op == RV_MV || (inst.op == RV_ADDI && inst.imm == 0)) &&
+                inst.rd == inst.rs1) {
+                changed = true;
+                continue;
+            }
+            if (inst.op == RV_LW && !insts.empty()) {
+                auto &prev = insts.back();
+                bool same_addr = prev.rs1 == inst.rs1 && prev.imm == inst.imm;
+                // sw a, off(b); lw c, off(b)
+                if (prev.op == RV_SW && same_addr) {
+                    changed = true;
+                    if (prev.rs2 == inst.rd) continue;
+                    MachineInst mv(RV_MV);
+                    mv.rd = inst.rd;
+                    mv.rs1 = prev.rs2;
+                    insts.push_back(mv);
+                    continue;
+                }
+                // lw c, off(b); lw c, off(b), unless c is b
+                if (prev.op == RV_LW && same_addr && prev.rd == inst.rd &&
+                    prev.rd != prev.rs1) {
+                    changed = true;
+                    continue;
+                }
+            }
+            insts.push_back(inst);
+        }
+        block.insts.swap(insts);
+    }
+    return changed;
+}
+
+// Drop jumps to the next block, and invert branches over them:
+//   bnez r, next; j other  ->  beqz r, other
+bool fold_fallthrough_jumps(MachineFunction &func) {
+    bool changed = false;
+    for (size_t i = 0; i + 1 < func.blocks.size(); i++) {
+        auto &insts = func.blocks[i].insts;
+        auto next = func.blocks[i + 1].label;
+        if (insts.empty() || insts.back().op != RV_J || !next) continue;
+        auto &jump = insts.back();
+        if (!strcmp(jump.symbol, next)) {
+            insts.pop_back();
+            changed = true;
+            continue;
+        }
+        if (insts.size() < 2) continue;
+        auto &branch = insts[insts.size() - 2];
+        if (branch.op == RV_BNEZ && !strcmp(branch.symbol, next)) {
+            branch.op = RV_BEQZ;
+            branch.symbol = jump.symbol;
+            insts.pop_back();
+            changed = true;
+        }
+    }
+    return changed;
+}
@@ -3,65 +3,139 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
-#include <memory>
-#include "ast.h"
-#include "tcgen.h"
+#include "compiler.h"
 
 using namespace std;
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
+// optional flags
+static bool dump_stats = false;
+static bool check_lexer = false;
+static OptBudget budget;
+static CompileStats stats;
+static std::fstream ir_dump;
 
 int main(int argc, const char *argv[]) {
-    assert(argc == 5);
+    assert(argc >= 5);
     auto mode = std::string(argv[1]);
     auto input = std::string(argv[2]);
     auto output = std::string(argv[4]);
 
-    yyin = fopen(input.c_str(), "r");
-    assert(yyin);
+    if (mode != "-koopa" && mode != "-riscv" && mode != "-perf" &&
+        mode != "-koopa-in") {
+        std::cerr << "Compiler: unrecognized mode " << mode << std::endl;
+        return 1;
+    }
 
-    // lex & parse
-    unique_ptr<BaseAST> ast;
-    auto ret = yyparse(ast);
-    assert(!ret);
+    int budget_func_ms = 0, budget_total_ms = 0;
+    CompileOptions options;
+    // -perf optimizes by default
+    options.opt_level = mode == "-perf" ? 2 : 0;
+    if (mode == "-perf") options.regalloc = REGALLOC_GRAPH_COLORING;
+    options.budget = &budget;
+    if (mode == "-koopa-in") {
+        // koopa of other tools to riscv, by the native parser by default
+        options.is_koopa_input = true;
+        options.koopa_parser = KOOPA_PARSER_NATIVE;
+    }
+    bool emit_object = false;
+    for (int i = 5; i < argc; i++) {
+        auto option = std::string(argv[i]);
+        auto eq = option.find('=');
+        auto key = option.substr(0, eq);
+        auto value = eq == std::string::npos ? "" : option.substr(eq + 1);
+        if (option == "-stream") {
+            options.is_streaming = true;
+        } else if (option == "-c") {
+            emit_object = true;
+        } else if (option == "-O0" || option == "-O1" || option == "-O2") {
+            options.opt_level = option[2] - '0';
+            options.is_fast_path = false;
+            // values get registers from -O1 on, colored at -O2
+            options.regalloc = option == "-O0"   ? REGALLOC_NONE
+                               : option == "-O1" ? REGALLOC_LINEAR_SCAN
+                                                 : REGALLOC_GRAPH_COLORING;
+        } else if (option == "-O0-fast") {
+            options.opt_level = 0;
+            options.is_fast_path = true;
+            options.regalloc = REGALLOC_NONE;
+        } else if (key == "-passes") {
+            // explicit pipeline, could be empty
+            options.pipeline = value;
+            options.has_pipeline = true;
+        } else if (option == "-verify") {
+            options.verify = true;
+        } else if (option == "-time-passes") {
+            options.time_passes = true;
+        } else if (option == "-stats=json") {
+            // to stdout, which is otherwise unused
+            dump_stats = true;
+        } else if (option == "-print-pipeline") {
+            options.print_pipeline = true;
+        } else if (key == "-dump-ir" && !value.empty()) {
+            // koopa text printed back from the SSA IR
+            ir_dump.open(value, ios::out);
+            assert(ir_dump.is_open());
+            options.ir_dump = &ir_dump;
+        } else if (option == "-regalloc=none") {
+            options.regalloc = REGALLOC_NONE;
+        } else if (option == "-regalloc=linear") {
+            options.regalloc = REGALLOC_LINEAR_SCAN;
+        } else if (option == "-regalloc=graph") {
+            options.regalloc = REGALLOC_GRAPH_COLORING;
+        } else if (option == "-lexer=flex") {
+            options.lexer = LEXER_FLEX;
+        } else if (option == "-koopa-parser=native") {
+            options.koopa_parser = KOOPA_PARSER_NATIVE;
+        } else if (option == "-koopa-parser=libkoopa") {
+            options.koopa_parser = KOOPA_PARSER_LIBKOOPA;
+        } else if (option == "-lexer=check") {
+            // both lexers should give the same tokens
+            check_lexer = true;
+        } else if (option == "-analyze=liveness") {
+            options.analyze_liveness = true;
+        } else if (option == "-analyze=ir") {
+            options.analyze_ir = true;
+        } else if (key == "-budget-log" && !value.empty()) {
+            budget.open_log(value);
+        } else if (key == "-budget-replay" && !value.empty()) {
+            budget.load_replay(value);
+        } else if (key == "-budget-func-ms" && !value.empty()) {
+            budget_func_ms = std::stoi(value);
+        } else if (key == "-budget-total-ms" && !value.empty()) {
+            budget_total_ms = std::stoi(value);
+        } else {
+            std::cerr << "Compiler: unrecognized option " << option
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (emit_object && mode == "-koopa") {
+        std::cerr << "Compiler: -c needs a riscv mode" << std::endl;
+        return 1;
+    }
 
-    std::fstream out;
-    std::string koopa_file = "a.koopa";
-    std::string assembly_file = "a.S";
+    budget.set_time_limits(budget_func_ms, budget_total_ms);
+    if (dump_stats) options.stats = &stats;
 
-    // ast -> IR
-    out.open(koopa_file, ios::out);
-    assert(out.is_open());
-    IRGenerator irgen;
-    ast->dump_koopa(irgen, out);
-    out.close();
+    FILE *in = fopen(input.c_str(), "r");
+    assert(in);
+    if (check_lexer && !check_lexers(in, std::cerr)) return 1;
+    std::string source;
+    char chunk[1 << 16];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), in)) > 0)
+        source.append(chunk, len);
+    fclose(in);
 
-    // IR -> riscv assembly
-    out.open(assembly_file, ios::out);
+    compile_mode_t compile_mode = COMPILE_RISCV;
+    if (mode == "-koopa") compile_mode = COMPILE_KOOPA;
+    if (emit_object) compile_mode = COMPILE_OBJECT;
+    std::fstream out(output, ios::out | ios::binary);
     assert(out.is_open());
-    TargetCodeGenerator tcgen(koopa_file.c_str(), out);
-    assert(!tcgen.dump_riscv());
-    out.close();
-
-    // copy to output
-    std::fstream in;
-    if (mode == "-koopa") {
-        in.open(koopa_file, ios::in);
-    } else if (mode == "-riscv" || mode == "-perf") {
-        in.open(assembly_file, ios::in);
-    } else {
-        std::cerr << "Compiler: unrecognized mode " << mode << std::endl;
-        return 1;
-    }
-    out.open(output, ios::out);
-    assert(in);
-    assert(out);
-    out << in.rdbuf();
-    in.close();
+    if (compile(source, compile_mode, out, options)) return 1;
     out.close();
 
+    if (dump_stats) stats.dump_json(std::cout);
     std::cerr << "Compiler: Finished!" << std::endl;
-
     return 0;
 }
@@ -0,0 +1,145 @@
+#include <mir.h>
+
+#include <cassert>
+#include <iomanip>
+
+std::string to_riscv_reg(riscv_reg_t reg) {
+    static const char *names[] = {
+        "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2",
+        "s0",   "s1", "a0", "a1", "a2",  "a3",  "a4", "a5",
+        "a6",   "a7", "s2", "s3", "s4",  "s5",  "s6", "s7",
+        "s8",   "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+    };
+    assert(reg != REG_NONE);
+    return names[reg];
+}
+
+std::string to_riscv_opcode(riscv_opcode_t op) {
+    switch (op) {
+        case RV_ADD:
+            return "add";
+        case RV_SUB:
+            return "sub";
+        case RV_MUL:
+            return "mul";
+        case RV_DIV:
+            return "div";
+        case RV_REM:
+            return "rem";
+        case RV_AND:
+            return "and";
+        case RV_OR:
+            return "or";
+        case RV_XOR:
+            return "xor";
+        case RV_SLL:
+            return "sll";
+        case RV_SRL:
+            return "srl";
+        case RV_SRA:
+            return "sra";
+        case RV_SLT:
+            return "slt";
+        case RV_SGT:
+            return "sgt";
+        case RV_SEQZ:
+            return "seqz";
+        case RV_SNEZ:
+            return "snez";
+        case RV_MV:
+            return "mv";
+        case RV_ADDI:
+            return "addi";
+        case RV_XORI:
+            return "xori";
+        case RV_LI:
+            return "li";
+        case RV_LW:
+            return "lw";
+        case RV_SW:
+            return "sw";
+        case RV_LA:
+            return "la";
+        case RV_BNEZ:
+            return "bnez";
+        case RV_BEQZ:
+            return "beqz";
+        case RV_J:
+            return "j";
+        case RV_CALL:
+            return "call";
+        case RV_RET:
+            return "ret";
+    }
+    assert(false);
+}
+
+bool has_riscv_rd(riscv_opcode_t op) {
+    switch (op) {
+        case RV_SW:
+        case RV_BNEZ:
+        case RV_BEQZ:
+        case RV_J:
+        case RV_CALL:
+        case RV_RET:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void print_machine_inst(const MachineInst &inst, std::ostream &out) {
+    out << "  " << std::left << std::setw(6) << to_riscv_opcode(inst.op);
+    switch (inst.op) {
+        case RV_SEQZ:
+        case RV_SNEZ:
+        case RV_MV:
+            out << to_riscv_reg(inst.rd) << ", " << to_riscv_reg(inst.rs1);
+            break;
+        case RV_ADDI:
+        case RV_XORI:
+            out << to_riscv_reg(inst.rd) << ", " << to_riscv_reg(inst.rs1)
+                << ", " << inst.imm;
+            break;
+        case RV_LI:
+            out << to_riscv_reg(inst.rd) << ", " << inst.imm;
+            break;
+        case RV_LW:
+            out << to_riscv_reg(inst.rd) << ", " << inst.imm << "("
+                << to_riscv_reg(inst.rs1) << ")";
+            break;
+        case RV_SW:
+            out << to_riscv_reg(inst.rs2) << ", " << inst.imm << "("
+                << to_riscv_reg(inst.rs1) << ")";
+            break;
+        case RV_LA:
+            out << to_riscv_reg(inst.rd) << ", " << inst.symbol;
+            break;
+        case RV_BNEZ:
+        case RV_BEQZ:
+            out << to_riscv_reg(inst.rs1) << ", " << inst.symbol;
+            break;
+        case RV_J:
+        case RV_CALL:
+            out << inst.symbol;
+            break;
+        case RV_RET:
+            break;
+        default:
+            out << to_riscv_reg(inst.rd) << ", " << to_riscv_reg(inst.rs1)
+                << ", " << to_riscv_reg(inst.rs2);
+            break;
+    }
+    out << "\n";
+}
+
+void print_machine_function(const MachineFunction &func, std::ostream &out) {
+    out << "  .text\n";
+    out << "  .globl " << func.name << "\n";
+    out << func.name << ":\n";
+    for (auto &block : func.blocks) {
+        if (block.label) out << block.label << ":\n";
+        for (auto &inst : block.insts) print_machine_inst(inst, out);
+    }
+    out << std::endl;
+}
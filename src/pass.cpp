@@ -0,0 +1,443 @@
+#include <pass.h>
+
+#include <cassert>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <unordered_set>
+
+#include "dataflow.h"
+
+static const Pass passes[] = {
+    // scalar allocs to SSA values with block params
+    {"mem2reg", PASS_IR, OPT_STAGE_CHEAP, promote_allocs, nullptr, nullptr},
+    // constants through block params, dropping branches never taken
+    {"sccp", PASS_IR, OPT_STAGE_CHEAP, propagate_constants, nullptr,
+     nullptr},
+    // pure insts and loads computed before on every path to them
+    {"gvn", PASS_IR, OPT_STAGE_CHEAP, eliminate_common_subexpressions,
+     nullptr, nullptr},
+    // unused values, unreachable blocks and stores never read
+    {"dce", PASS_IR, OPT_STAGE_CHEAP, eliminate_dead_code, nullptr, nullptr},
+    // reuse registers just stored to stack instead of loading them again
+    {"load-forward", PASS_MACHINE, OPT_STAGE_CHEAP, nullptr, nullptr,
+     forward_stack_loads},
+    {"peephole", PASS_MACHINE, OPT_STAGE_CHEAP, nullptr, nullptr,
+     run_peephole},
+    {"jump-fold", PASS_MACHINE, OPT_STAGE_CHEAP, nullptr, nullptr,
+     fold_fallthrough_jumps},
+};
+
+const Pass *find_pass(std::string name) {
+    for (auto &pass : passes)
+        if (name == pass.name) return &pass;
+    return nullptr;
+}
+
+// Pipeline
+
+void PassManager::set_opt_level(int level) {
+    assert(level >= 0 && level <= 2);
+    opt_level = level;
+    if (level == 0)
+        set_pipeline("");
+    else if (level == 1)
+        set_pipeline("mem2reg,sccp,dce,peephole,jump-fold");
+    else
+        set_pipeline("mem2reg,sccp,gvn,dce,load-forward,peephole,jump-fold");
+}
+
+bool PassManager::set_pipeline(std::string names) {
+    pipeline.clear();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name.empty()) continue;
+        auto pass = find_pass(name);
+        if (!pass) {
+            std::cerr << "PassManager: unknown pass " << name << std::endl;
+            return false;
+        }
+        pipeline.push_back(pass);
+    }
+    stats.assign(pipeline.size(), PassStats());
+    return true;
+}
+
+bool PassManager::has_ir_passes() {
+    for (auto pass : pipeline)
+        if (pass->kind == PASS_IR) return true;
+    return false;
+}
+
+// Analyses are shared by passes on the function, until a pass changes what
+// they depend on
+void PassManager::run_ir_passes(IRFunction &func) {
+    if (verify) _verify_ir("building", func);
+    AnalysisManager analyses(func);
+    for (int i = 0; i < (int)pipeline.size(); i++)
+        if (pipeline[i]->kind == PASS_IR) _run_ir_pass(i, func, analyses);
+    for (int kind = 0; kind < ANALYSIS_NUM; kind++) {
+        if (!analyses.num_computed[kind]) continue;
+        record_time(to_analysis_kind((analysis_kind_t)kind),
+                    analyses.computed_ms[kind], analyses.num_computed[kind]);
+    }
+}
+
+void PassManager::run_koopa_passes(koopa_raw_function_t func) {
+    if (verify) _verify("input", func, nullptr);
+    for (int i = 0; i < (int)pipeline.size(); i++)
+        if (pipeline[i]->kind == PASS_KOOPA) _run_pass(i, func, nullptr);
+}
+
+void PassManager::run_machine_passes(MachineFunction &func) {
+    if (verify) _verify("lowering", nullptr, &func);
+    for (int i = 0; i < (int)pipeline.size(); i++)
+        if (pipeline[i]->kind == PASS_MACHINE) _run_pass(i, nullptr, &func);
+}
+
+void PassManager::record_time(std::string name, double ms, int runs) {
+    for (auto &it : other_stats) {
+        if (it.first != name) continue;
+        it.second.runs += runs;
+        it.second.ms += ms;
+        return;
+    }
+    other_stats.push_back(std::make_pair(name, PassStats()));
+    other_stats.back().second.runs = runs;
+    other_stats.back().second.ms = ms;
+}
+
+void PassManager::_run_pass(int i, koopa_raw_function_t kfunc,
+                            MachineFunction *mfunc) {
+    auto pass = pipeline[i];
+    if (budget && budget->begin_stage(pass->name, pass->cost) ==
+                      OPT_DECISION_SKIP)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    bool changed = pass->kind == PASS_KOOPA ? pass->run_koopa(kfunc)
+                                            : pass->run_machine(*mfunc);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (budget) budget->end_stage();
+
+    stats[i].runs++;
+    stats[i].changes += changed;
+    stats[i].ms += elapsed.count();
+    if (verify && changed) _verify(pass->name, kfunc, mfunc);
+}
+
+void PassManager::_run_ir_pass(int i, IRFunction &func,
+                               AnalysisManager &analyses) {
+    auto pass = pipeline[i];
+    if (budget && budget->begin_stage(pass->name, pass->cost) ==
+                      OPT_DECISION_SKIP)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    int changes = pass->run_ir(func, analyses);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (budget) budget->end_stage();
+    analyses.invalidate(changes);
+
+    stats[i].runs++;
+    stats[i].changes += changes != IR_CHANGED_NONE;
+    stats[i].ms += elapsed.count();
+    if (verify && changes) _verify_ir(pass->name, func);
+}
+
+void PassManager::_verify_ir(const char *after, const IRFunction &func) {
+    auto start = std::chrono::steady_clock::now();
+    std::stringstream err;
+    if (!verify_ir_function(func, err)) {
+        std::cerr << "PassManager: bad function " << func.name.substr(1)
+                  << " after " << after << ": " << err.str() << std::endl;
+        assert(false);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    verify_stats.runs++;
+    verify_stats.ms += elapsed.count();
+}
+
+void PassManager::_verify(const char *after, koopa_raw_function_t kfunc,
+                          const MachineFunction *mfunc) {
+    auto start = std::chrono::steady_clock::now();
+    std::stringstream err;
+    bool ok = mfunc ? verify_machine_function(*mfunc, err)
+                    : verify_koopa_raw_function(kfunc, err);
+    if (!ok) {
+        auto name = mfunc ? mfunc->name : kfunc->name + 1;
+        std::cerr << "PassManager: bad function " << name << " after "
+                  << after << ": " << err.str() << std::endl;
+        assert(false);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    verify_stats.runs++;
+    verify_stats.ms += elapsed.count();
+}
+
+void PassManager::print_pipeline(std::ostream &out) {
+    out << "pipeline -O" << opt_level << (verify ? " (verified)" : "")
+        << ":" << std::endl;
+    if (pipeline.empty()) out << "  (empty)" << std::endl;
+    for (auto pass : pipeline) {
+        auto kind = pass->kind == PASS_IR      ? "ir"
+                    : pass->kind == PASS_KOOPA ? "koopa"
+                                               : "machine";
+        out << "  " << std::left << std::setw(8) << kind << " "
+            << std::setw(16) << pass->name
+            << (pass->cost == OPT_STAGE_CHEAP ? "cheap" : "expensive")
+            << std::endl;
+    }
+}
+
+void PassManager::print_timing(std::ostream &out) {
+    auto print_row = [&](std::string name, const PassStats &s) {
+        out << "  " << std::left << std::setw(16) << name << std::right
+            << std::setw(8) << s.runs << std::setw(10) << s.changes
+            << std::setw(12) << std::fixed << std::setprecision(3) << s.ms
+            << std::endl;
+    };
+    out << "  " << std::left << std::setw(16) << "pass" << std::right
+        << std::setw(8) << "runs" << std::setw(10) << "changed"
+        << std::setw(12) << "ms" << std::endl;
+    double total = 0;
+    for (int i = 0; i < (int)pipeline.size(); i++) {
+        print_row(pipeline[i]->name, stats[i]);
+        total += stats[i].ms;
+    }
+    for (auto &it : other_stats) {
+        print_row(it.first, it.second);
+        total += it.second.ms;
+    }
+    if (verify) {
+        print_row("verify", verify_stats);
+        total += verify_stats.ms;
+    }
+    out << "  " << std::left << std::setw(16) << "total" << std::right
+        << std::setw(30) << std::fixed << std::setprecision(3) << total
+        << std::endl;
+}
+
+// Verifiers
+
+static bool is_terminator(koopa_raw_value_t val) {
+    auto tag = val->kind.tag;
+    return tag == KOOPA_RVT_BRANCH || tag == KOOPA_RVT_JUMP ||
+           tag == KOOPA_RVT_RETURN;
+}
+
+// values owned by no function, which could be used anywhere
+static bool is_global_value(koopa_raw_value_t val) {
+    switch (val->kind.tag) {
+        case KOOPA_RVT_INTEGER:
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+        case KOOPA_RVT_AGGREGATE:
+        case KOOPA_RVT_GLOBAL_ALLOC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool verify_ir_function(const IRFunction &func, std::ostream &err) {
+    if (func.is_decl()) return true;
+    auto is_ir_terminator = [](const IRValue &val) {
+        return val.tag == KOOPA_RVT_BRANCH || val.tag == KOOPA_RVT_JUMP ||
+               val.tag == KOOPA_RVT_RETURN;
+    };
+    auto is_bad_block = [&](int block) {
+        return block < 0 || block >= func.get_num_blocks() ||
+               func.blocks[block].is_removed;
+    };
+
+    for (int b = func.first_block; b != -1; b = func.blocks[b].next) {
+        auto &block = func.blocks[b];
+        auto name = block.name.empty() ? "%b" + std::to_string(b) : block.name;
+        if (block.is_removed) {
+            err << "block " << name << " is removed but listed";
+            return false;
+        }
+        if (block.last_inst == -1 ||
+            !is_ir_terminator(func.values[block.last_inst])) {
+            err << "block " << name << " has no terminator";
+            return false;
+        }
+        for (int inst = block.first_inst; inst != -1;
+             inst = func.values[inst].next) {
+            auto &val = func.values[inst];
+            if (val.block != b || val.is_removed) {
+                err << "block " << name << " lists a foreign inst";
+                return false;
+            }
+            if (inst != block.last_inst && is_ir_terminator(val)) {
+                err << "block " << name << " has a terminator in middle";
+                return false;
+            }
+            for (size_t i = 0; i < val.operands.size(); i++) {
+                auto &use = func.uses[val.operands[i]];
+                if (use.user != inst || use.value < 0 ||
+                    func.values[use.value].is_removed) {
+                    err << "block " << name << " uses a removed value";
+                    return false;
+                }
+            }
+            // args passed must match params of targets
+            int num_targets = val.tag == KOOPA_RVT_BRANCH ? 2
+                              : val.tag == KOOPA_RVT_JUMP ? 1
+                                                          : 0;
+            for (int t = 0; t < num_targets; t++) {
+                int target = val.targets[t];
+                if (is_bad_block(target)) {
+                    err << "block " << name << " jumps to a removed block";
+                    return false;
+                }
+                int num_args = val.tag == KOOPA_RVT_JUMP ? val.operands.size()
+                               : t == 0 ? val.num_true_args
+                                        : val.operands.size() - 1 -
+                                              val.num_true_args;
+                if (num_args != (int)func.blocks[target].params.size()) {
+                    err << "block " << name << " passes " << num_args
+                        << " args to a block of "
+                        << func.blocks[target].params.size() << " params";
+                    return false;
+                }
+            }
+        }
+    }
+
+    // every use is listed by the value it uses
+    for (int v = 0; v < func.get_num_values(); v++) {
+        for (int use = func.values[v].first_use; use != -1;
+             use = func.uses[use].next) {
+            if (func.uses[use].value != v) {
+                err << "use list of value " << v << " is broken";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool verify_koopa_raw_function(koopa_raw_function_t func, std::ostream &err) {
+    std::unordered_set<koopa_raw_basic_block_t> bbs;
+    std::unordered_set<koopa_raw_value_t> defined;
+    for (size_t i = 0; i < func->params.len; i++)
+        defined.insert((koopa_raw_value_t)func->params.buffer[i]);
+    for (size_t i = 0; i < func->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        bbs.insert(bb);
+        for (size_t j = 0; j < bb->params.len; j++)
+            defined.insert((koopa_raw_value_t)bb->params.buffer[j]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+            defined.insert((koopa_raw_value_t)bb->insts.buffer[j]);
+    }
+
+    auto ret_ty = func->ty->data.function.ret;
+    std::vector<koopa_raw_value_t> operands;
+    for (size_t i = 0; i < func->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        auto insts = bb->insts;
+        if (insts.len == 0 ||
+            !is_terminator((koopa_raw_value_t)insts.buffer[insts.len - 1])) {
+            err << "block " << bb->name << " has no terminator";
+            return false;
+        }
+
+        for (size_t j = 0; j < insts.len; j++) {
+            auto val = (koopa_raw_value_t)insts.buffer[j];
+            const auto &kind = val->kind;
+            if (j + 1 < insts.len && is_terminator(val)) {
+                err << "block " << bb->name << " has a terminator in middle";
+                return false;
+            }
+
+            get_koopa_raw_value_operands(val, operands);
+            for (auto opr : operands) {
+                if (!is_global_value(opr) && !defined.count(opr)) {
+                    err << "block " << bb->name << " uses a value not in "
+                        << "this function";
+                    return false;
+                }
+            }
+
+            if (kind.tag == KOOPA_RVT_BINARY) {
+                if (kind.data.binary.lhs->ty->tag != KOOPA_RTT_INT32 ||
+                    kind.data.binary.rhs->ty->tag != KOOPA_RTT_INT32) {
+                    err << "block " << bb->name << " has a non-i32 binary";
+                    return false;
+                }
+            } else if (kind.tag == KOOPA_RVT_BRANCH) {
+                if (!bbs.count(kind.data.branch.true_bb) ||
+                    !bbs.count(kind.data.branch.false_bb)) {
+                    err << "block " << bb->name << " branches out";
+                    return false;
+                }
+            } else if (kind.tag == KOOPA_RVT_JUMP) {
+                if (!bbs.count(kind.data.jump.target)) {
+                    err << "block " << bb->name << " jumps out";
+                    return false;
+                }
+            } else if (kind.tag == KOOPA_RVT_CALL) {
+                auto callee_ty = kind.data.call.callee->ty;
+                if (kind.data.call.args.len !=
+                    callee_ty->data.function.params.len) {
+                    err << "block " << bb->name << " calls "
+                        << kind.data.call.callee->name << " with "
+                        << kind.data.call.args.len << " args";
+                    return false;
+                }
+            } else if (kind.tag == KOOPA_RVT_RETURN) {
+                bool has_value = kind.data.ret.value != nullptr;
+                if (has_value != (ret_ty->tag != KOOPA_RTT_UNIT)) {
+                    err << "block " << bb->name << " returns a wrong type";
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool verify_machine_function(const MachineFunction &func, std::ostream &err) {
+    std::set<std::string> labels;
+    for (auto &block : func.blocks)
+        if (block.label) labels.insert(block.label);
+
+    for (auto &block : func.blocks) {
+        auto label = block.label ? block.label : "prologue";
+        for (auto &inst : block.insts) {
+            auto op = inst.op;
+            bool has_rd = has_riscv_rd(op);
+            bool has_rs1 = op <= RV_ADDI || op == RV_XORI || op == RV_LW ||
+                           op == RV_SW || op == RV_BNEZ || op == RV_BEQZ;
+            bool has_rs2 = op <= RV_SGT || op == RV_SW;
+            if ((has_rd && inst.rd == REG_NONE) ||
+                (has_rs1 && inst.rs1 == REG_NONE) ||
+                (has_rs2 && inst.rs2 == REG_NONE)) {
+                err << "block " << label << " has " << to_riscv_opcode(op)
+                    << " without a register";
+                return false;
+            }
+            if ((op == RV_BNEZ || op == RV_BEQZ || op == RV_J) &&
+                !labels.count(inst.symbol)) {
+                err << "block " << label << " jumps to unknown "
+                    << inst.symbol;
+                return false;
+            }
+            if (op == RV_LW || op == RV_SW || op == RV_ADDI || op == RV_XORI) {
+                if (inst.imm < -2048 || inst.imm > 2047) {
+                    err << "block " << label << " has " << to_riscv_opcode(op)
+                        << " with imm " << inst.imm;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,714 @@
+#include <regalloc.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_set>
+
+#include "analysis.h"
+#include "dataflow.h"
+
+// in order of preference, caller-saved ones need no saving in prologue
+static const riscv_reg_t caller_saved_regs[] = {
+    REG_T3, REG_T4, REG_T5, REG_A0, REG_A1, REG_A2,
+    REG_A3, REG_A4, REG_A5, REG_A6, REG_A7,
+};
+static const riscv_reg_t callee_saved_regs[] = {
+    REG_S1, REG_S2, REG_S3, REG_S4,  REG_S5,  REG_S6,
+    REG_S7, REG_S8, REG_S9, REG_S10, REG_S11,
+};
+
+static bool is_callee_saved(riscv_reg_t reg) {
+    return reg == REG_S1 || (reg >= REG_S2 && reg <= REG_S11);
+}
+
+// Calls clobber caller-saved registers, and their args are moved into
+// a0-a7 one by one, which mustn't overwrite args not moved yet
+static bool is_reg_allowed(const LiveInterval &interval, riscv_reg_t reg) {
+    if (interval.is_call_crossed) return is_callee_saved(reg);
+    if (interval.is_call_arg) return reg < REG_A0 || reg > REG_A7;
+    return true;
+}
+
+// Intervals by value number, empty ones (start > end) are never used.
+// Function params are defined at 0, block params and values live into a
+// block at the start of it.
+static std::vector<LiveInterval> build_live_intervals(
+    koopa_raw_function_t func, const Liveness &liveness) {
+    auto &values = liveness.values;
+    std::vector<LiveInterval> intervals(values.get_size());
+    for (int i = 0; i < values.get_size(); i++) {
+        intervals[i].value = i;
+        intervals[i].start = INT_MAX;
+        intervals[i].end = -1;
+    }
+    auto extend = [&](koopa_raw_value_t val, int pos) {
+        int i = values.get_index(val);
+        if (i == -1) return;
+        intervals[i].start = std::min(intervals[i].start, pos);
+        intervals[i].end = std::max(intervals[i].end, pos);
+    };
+    auto extend_live = [&](const BitVector &live, int pos) {
+        for (int bit = live.find_next(0); bit != -1;
+             bit = live.find_next(bit + 1))
+            extend(liveness.get_value(bit), pos);
+    };
+
+    for (size_t i = 0; i < func->params.len; i++)
+        extend((koopa_raw_value_t)func->params.buffer[i], 0);
+
+    std::vector<int> calls;  // positions, ascending
+    std::vector<koopa_raw_value_t> operands;
+    int pos = 0;
+    for (int b = 0; b < liveness.cfg.get_num_blocks(); b++) {
+        auto bb = liveness.cfg.blocks[b];
+        pos += 2;
+        for (size_t j = 0; j < bb->params.len; j++)
+            extend((koopa_raw_value_t)bb->params.buffer[j], pos);
+        extend_live(liveness.result.in[b], pos);
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            pos += 2;
+            get_koopa_raw_value_operands(inst, operands);
+            for (auto operand : operands) extend(operand, pos);
+            if (inst->kind.tag == KOOPA_RVT_CALL) calls.push_back(pos);
+            extend(inst, pos + 1);
+        }
+        extend_live(liveness.result.out[b], pos + 1);
+    }
+
+    for (auto &interval : intervals) {
+        if (interval.start > interval.end) continue;
+        auto call = std::upper_bound(calls.begin(), calls.end(),
+                                     interval.start);
+        if (call == calls.end()) continue;
+        interval.is_call_crossed = *call < interval.end;
+        interval.is_call_arg = *call == interval.end;
+    }
+    return intervals;
+}
+
+void allocate_registers_linear_scan(koopa_raw_function_t func,
+                                    RegisterAssignment &assignment) {
+    Liveness liveness(func);
+    auto intervals = build_live_intervals(func, liveness);
+
+    std::vector<LiveInterval *> order;
+    for (auto &interval : intervals)
+        if (interval.start <= interval.end) order.push_back(&interval);
+    std::stable_sort(order.begin(), order.end(),
+                     [](const LiveInterval *a, const LiveInterval *b) {
+                         return a->start < b->start;
+                     });
+
+    bool is_free[REG_NONE];
+    std::fill(is_free, is_free + REG_NONE, true);
+    bool is_saved[REG_NONE] = {};
+    std::vector<LiveInterval *> active;  // holding a register
+    auto take = [&](LiveInterval *interval, riscv_reg_t reg) {
+        interval->reg = reg;
+        is_free[reg] = false;
+        is_saved[reg] = is_saved[reg] || is_callee_saved(reg);
+        active.push_back(interval);
+    };
+
+    for (auto cur : order) {
+        // expire intervals ended before cur
+        for (size_t i = 0; i < active.size();) {
+            if (active[i]->end < cur->start) {
+                is_free[active[i]->reg] = true;
+                active[i] = active.back();
+                active.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        // params stay where they're passed if they can
+        auto reg = REG_NONE;
+        auto val = liveness.values.get_value(cur->value);
+        if (val->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+            val->kind.data.func_arg_ref.index < 8) {
+            auto arg_reg =
+                (riscv_reg_t)(REG_A0 + val->kind.data.func_arg_ref.index);
+            if (is_free[arg_reg] && is_reg_allowed(*cur, arg_reg))
+                reg = arg_reg;
+        }
+        for (auto r : caller_saved_regs) {
+            if (reg != REG_NONE) break;
+            if (is_free[r] && is_reg_allowed(*cur, r)) reg = r;
+        }
+        for (auto r : callee_saved_regs) {
+            if (reg != REG_NONE) break;
+            if (is_free[r]) reg = r;
+        }
+        if (reg != REG_NONE) {
+            take(cur, reg);
+            continue;
+        }
+
+        // spill the one ending last, which frees its register the longest
+        LiveInterval *victim = nullptr;
+        size_t victim_index = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (!is_reg_allowed(*cur, active[i]->reg)) continue;
+            if (!victim || active[i]->end > victim->end) {
+                victim = active[i];
+                victim_index = i;
+            }
+        }
+        if (victim && victim->end > cur->end) {
+            reg = victim->reg;
+            victim->reg = REG_NONE;
+            active[victim_index] = active.back();
+            active.pop_back();
+            is_free[reg] = true;
+            take(cur, reg);
+        }
+    }
+
+    assignment.regs.assign(intervals.size(), REG_NONE);
+    assignment.saved_regs.clear();
+    assignment.num_spilled = 0;
+    assignment.num_coalesced = 0;
+    for (auto &interval : intervals) {
+        assignment.regs[interval.value] = interval.reg;
+        if (interval.start <= interval.end && interval.reg == REG_NONE)
+            assignment.num_spilled++;
+    }
+    for (auto reg : callee_saved_regs)
+        if (is_saved[reg]) assignment.saved_regs.push_back(reg);
+    assignment.values = std::move(liveness.values);
+}
+
+// Graph coloring
+
+static const int NUM_CALLER_SAVED =
+    sizeof(caller_saved_regs) / sizeof(caller_saved_regs[0]);
+static const int NUM_COLORS =
+    NUM_CALLER_SAVED +
+    sizeof(callee_saved_regs) / sizeof(callee_saved_regs[0]);
+
+// colors are in order of preference
+static riscv_reg_t to_color_reg(int color) {
+    if (color < NUM_CALLER_SAVED) return caller_saved_regs[color];
+    return callee_saved_regs[color - NUM_CALLER_SAVED];
+}
+
+static int to_reg_color(riscv_reg_t reg) {
+    for (int color = 0; color < NUM_COLORS; color++)
+        if (to_color_reg(color) == reg) return color;
+    assert(false);
+    return -1;
+}
+
+typedef enum {
+    NODE_PRECOLORED,
+    NODE_INITIAL,
+    NODE_SIMPLIFY,  // low degree and not move related
+    NODE_FREEZE,    // low degree and move related
+    NODE_SPILL,     // high degree
+    NODE_SPILLED,
+    NODE_COALESCED,
+    NODE_COLORED,
+    NODE_SELECT,  // on select stack
+} node_state_t;
+
+typedef enum {
+    MOVE_WORKLIST,  // might be coalesced
+    MOVE_ACTIVE,    // not ready to be coalesced yet
+    MOVE_COALESCED,
+    MOVE_CONSTRAINED,  // ends interfere
+    MOVE_FROZEN,       // given up
+} move_state_t;
+
+class GraphMove {
+   public:
+    int src;
+    int dst;
+    move_state_t state = MOVE_WORKLIST;
+};
+
+// Iterated register coalescing of George and Appel.
+// Nodes are the registers to allocate, precolored, and then the values.
+// Spilled values are loaded into scratch registers by lowering, so that
+// one round of coloring is enough, and no code is rewritten.
+class GraphColoring {
+   private:
+    std::vector<node_state_t> state;
+    std::vector<std::vector<int>> adj_list;  // of values only
+    std::unordered_set<uint64_t> adj_set;
+    std::vector<int> degree;
+    std::vector<std::vector<int>> move_list;
+    std::vector<GraphMove> moves;
+    std::vector<int> alias;
+    std::vector<int> color;
+    std::vector<double> cost;
+    // nodes and moves leave worklists lazily, by their states
+    std::vector<int> simplify_worklist;
+    std::vector<int> freeze_worklist;
+    std::vector<int> spill_worklist;
+    std::vector<int> move_worklist;
+    std::vector<int> select_stack;
+
+    bool _is_adjacent(int u, int v) const {
+        if (u > v) std::swap(u, v);
+        return adj_set.count((uint64_t)u << 32 | v);
+    }
+    bool _is_move_related(int n) const;
+    int _pop(std::vector<int> &worklist, node_state_t node_state);
+    int _get_alias(int n) const;
+    void _push(int n, node_state_t node_state);
+    void _decrement_degree(int m);
+    void _enable_moves(int n);
+    void _add_worklist(int u);
+    bool _is_ok(int t, int r) const;
+    bool _is_conservative(int u, int v) const;
+    void _combine(int u, int v);
+    void _freeze_moves(int u);
+
+    void _make_worklist();
+    void _simplify(int n);
+    void _coalesce(int m);
+    bool _select_spill();
+    void _assign_colors();
+
+   public:
+    int num_coalesced = 0;
+
+    GraphColoring(int num_values);
+
+    int get_value_node(int value) const { return NUM_COLORS + value; }
+    int get_reg_node(riscv_reg_t reg) const { return to_reg_color(reg); }
+    void add_edge(int u, int v);
+    void add_move(int src, int dst);
+    void add_cost(int n, double weight) { cost[n] += weight; }
+
+    void run();
+    // REG_NONE if spilled
+    riscv_reg_t get_reg(int n) const {
+        n = _get_alias(n);
+        return state[n] == NODE_SPILLED ? REG_NONE : to_color_reg(color[n]);
+    }
+};
+
+GraphColoring::GraphColoring(int num_values) {
+    int num_nodes = NUM_COLORS + num_values;
+    state.assign(num_nodes, NODE_INITIAL);
+    adj_list.resize(num_nodes);
+    degree.assign(num_nodes, 0);
+    move_list.resize(num_nodes);
+    alias.assign(num_nodes, -1);
+    color.assign(num_nodes, -1);
+    cost.assign(num_nodes, 0);
+    for (int i = 0; i < NUM_COLORS; i++) {
+        state[i] = NODE_PRECOLORED;
+        degree[i] = INT_MAX / 2;
+        color[i] = i;
+    }
+}
+
+void GraphColoring::add_edge(int u, int v) {
+    if (u == v || _is_adjacent(u, v)) return;
+    adj_set.insert((uint64_t)std::min(u, v) << 32 | std::max(u, v));
+    if (state[u] != NODE_PRECOLORED) {
+        adj_list[u].push_back(v);
+        degree[u]++;
+    }
+    if (state[v] != NODE_PRECOLORED) {
+        adj_list[v].push_back(u);
+        degree[v]++;
+    }
+}
+
+void GraphColoring::add_move(int src, int dst) {
+    if (src == dst) return;
+    GraphMove move;
+    move.src = src;
+    move.dst = dst;
+    move_list[src].push_back(moves.size());
+    move_list[dst].push_back(moves.size());
+    move_worklist.push_back(moves.size());
+    moves.push_back(move);
+}
+
+bool GraphColoring::_is_move_related(int n) const {
+    for (int m : move_list[n])
+        if (moves[m].state == MOVE_ACTIVE || moves[m].state == MOVE_WORKLIST)
+            return true;
+    return false;
+}
+
+int GraphColoring::_pop(std::vector<int> &worklist, node_state_t node_state) {
+    while (!worklist.empty()) {
+        int n = worklist.back();
+        worklist.pop_back();
+        if (state[n] == node_state) return n;
+    }
+    return -1;
+}
+
+int GraphColoring::_get_alias(int n) const {
+    while (state[n] == NODE_COALESCED) n = alias[n];
+    return n;
+}
+
+void GraphColoring::_push(int n, node_state_t node_state) {
+    state[n] = node_state;
+    if (node_state == NODE_SIMPLIFY)
+        simplify_worklist.push_back(n);
+    else if (node_state == NODE_FREEZE)
+        freeze_worklist.push_back(n);
+    else if (node_state == NODE_SPILL)
+        spill_worklist.push_back(n);
+}
+
+void GraphColoring::_decrement_degree(int m) {
+    if (state[m] == NODE_PRECOLORED) return;
+    if (degree[m]-- != NUM_COLORS) return;
+    _enable_moves(m);
+    for (int t : adj_list[m])
+        if (state[t] != NODE_SELECT && state[t] != NODE_COALESCED)
+            _enable_moves(t);
+    if (state[m] == NODE_SPILL)
+        _push(m, _is_move_related(m) ? NODE_FREEZE : NODE_SIMPLIFY);
+}
+
+void GraphColoring::_enable_moves(int n) {
+    for (int m : move_list[n]) {
+        if (moves[m].state != MOVE_ACTIVE) continue;
+        moves[m].state = MOVE_WORKLIST;
+        move_worklist.push_back(m);
+    }
+}
+
+void GraphColoring::_add_worklist(int u) {
+    if (state[u] == NODE_FREEZE && !_is_move_related(u) &&
+        degree[u] < NUM_COLORS)
+        _push(u, NODE_SIMPLIFY);
+}
+
+// George: t is no threat to r taking its color
+bool GraphColoring::_is_ok(int t, int r) const {
+    return degree[t] < NUM_COLORS || state[t] == NODE_PRECOLORED ||
+           _is_adjacent(t, r);
+}
+
+// Briggs: the union has less than K neighbors of high degree
+bool GraphColoring::_is_conservative(int u, int v) const {
+    std::unordered_set<int> high;
+    for (int n : {u, v}) {
+        for (int t : adj_list[n]) {
+            if (state[t] == NODE_SELECT || state[t] == NODE_COALESCED)
+                continue;
+            if (degree[t] >= NUM_COLORS) high.insert(t);
+        }
+    }
+    return (int)high.size() < NUM_COLORS;
+}
+
+void GraphColoring::_combine(int u, int v) {
+    state[v] = NODE_COALESCED;
+    alias[v] = u;
+    move_list[u].insert(move_list[u].end(), move_list[v].begin(),
+                        move_list[v].end());
+    cost[u] += cost[v];
+    _enable_moves(v);
+    for (int t : adj_list[v]) {
+        if (state[t] == NODE_SELECT || state[t] == NODE_COALESCED) continue;
+        add_edge(t, u);
+        _decrement_degree(t);
+    }
+    if (degree[u] >= NUM_COLORS && state[u] == NODE_FREEZE)
+        _push(u, NODE_SPILL);
+}
+
+void GraphColoring::_freeze_moves(int u) {
+    for (int m : move_list[u]) {
+        auto &move = moves[m];
+        if (move.state != MOVE_ACTIVE && move.state != MOVE_WORKLIST)
+            continue;
+        int x = _get_alias(move.src), y = _get_alias(move.dst);
+        int v = y == _get_alias(u) ? x : y;
+        move.state = MOVE_FROZEN;
+        if (state[v] == NODE_FREEZE && !_is_move_related(v))
+            _push(v, NODE_SIMPLIFY);
+    }
+}
+
+void GraphColoring::_make_worklist() {
+    for (int n = NUM_COLORS; n < (int)state.size(); n++) {
+        if (degree[n] >= NUM_COLORS)
+            _push(n, NODE_SPILL);
+        else if (_is_move_related(n))
+            _push(n, NODE_FREEZE);
+        else
+            _push(n, NODE_SIMPLIFY);
+    }
+}
+
+void GraphColoring::_simplify(int n) {
+    state[n] = NODE_SELECT;
+    select_stack.push_back(n);
+    for (int t : adj_list[n])
+        if (state[t] != NODE_SELECT && state[t] != NODE_COALESCED)
+            _decrement_degree(t);
+}
+
+void GraphColoring::_coalesce(int m) {
+    auto &move = moves[m];
+    int u = _get_alias(move.src), v = _get_alias(move.dst);
+    if (state[v] == NODE_PRECOLORED) std::swap(u, v);
+    if (u == v) {
+        move.state = MOVE_COALESCED;
+        num_coalesced++;
+        _add_worklist(u);
+    } else if (state[v] == NODE_PRECOLORED || _is_adjacent(u, v)) {
+        move.state = MOVE_CONSTRAINED;
+        _add_worklist(u);
+        _add_worklist(v);
+    } else {
+        bool can_coalesce;
+        if (state[u] == NODE_PRECOLORED) {
+            can_coalesce = true;
+            for (int t : adj_list[v]) {
+                if (state[t] == NODE_SELECT || state[t] == NODE_COALESCED)
+                    continue;
+                can_coalesce = can_coalesce && _is_ok(t, u);
+            }
+        } else {
+            can_coalesce = _is_conservative(u, v);
+        }
+        if (can_coalesce) {
+            move.state = MOVE_COALESCED;
+            num_coalesced++;
+            _combine(u, v);
+            _add_worklist(u);
+        } else {
+            move.state = MOVE_ACTIVE;
+        }
+    }
+}
+
+// spill the node of least cost for each of its neighbors,
+// false if there's no node of high degree
+bool GraphColoring::_select_spill() {
+    int best = -1;
+    size_t end = 0;
+    for (int n : spill_worklist) {
+        if (state[n] != NODE_SPILL) continue;
+        spill_worklist[end++] = n;
+        if (best == -1 || cost[n] * degree[best] < cost[best] * degree[n])
+            best = n;
+    }
+    spill_worklist.resize(end);
+    if (best == -1) return false;
+    _push(best, NODE_SIMPLIFY);
+    _freeze_moves(best);
+    return true;
+}
+
+void GraphColoring::_assign_colors() {
+    while (!select_stack.empty()) {
+        int n = select_stack.back();
+        select_stack.pop_back();
+        uint32_t ok_colors = ((uint32_t)1 << NUM_COLORS) - 1;
+        for (int w : adj_list[n]) {
+            int a = _get_alias(w);
+            if (state[a] == NODE_COLORED || state[a] == NODE_PRECOLORED)
+                ok_colors &= ~((uint32_t)1 << color[a]);
+        }
+        if (!ok_colors) {
+            state[n] = NODE_SPILLED;
+            continue;
+        }
+        state[n] = NODE_COLORED;
+        color[n] = __builtin_ctz(ok_colors);
+        // take the color of a frozen move partner, to save the move
+        for (int m : move_list[n]) {
+            int partner = _get_alias(moves[m].src == n ? moves[m].dst
+                                                       : moves[m].src);
+            if (state[partner] != NODE_COLORED &&
+                state[partner] != NODE_PRECOLORED)
+                continue;
+            if (ok_colors >> color[partner] & 1) {
+                color[n] = color[partner];
+                break;
+            }
+        }
+    }
+}
+
+void GraphColoring::run() {
+    _make_worklist();
+    while (true) {
+        int n = _pop(simplify_worklist, NODE_SIMPLIFY);
+        if (n != -1) {
+            _simplify(n);
+            continue;
+        }
+        bool has_move = false;
+        while (!move_worklist.empty()) {
+            int m = move_worklist.back();
+            move_worklist.pop_back();
+            if (moves[m].state != MOVE_WORKLIST) continue;
+            _coalesce(m);
+            has_move = true;
+            break;
+        }
+        if (has_move) continue;
+        n = _pop(freeze_worklist, NODE_FREEZE);
+        if (n != -1) {
+            _push(n, NODE_SIMPLIFY);
+            _freeze_moves(n);
+            continue;
+        }
+        if (!_select_spill()) break;
+    }
+    _assign_colors();
+}
+
+// Interference of values live at the same point, found by walking each
+// block backward from its live-out values
+void allocate_registers_graph_coloring(koopa_raw_function_t func,
+                                       RegisterAssignment &assignment) {
+    Liveness liveness(func);
+    auto &values = liveness.values;
+    auto &cfg = liveness.cfg;
+    DominatorTree dom(cfg);
+    LoopForest loops(cfg, dom);
+    GraphColoring graph(values.get_size());
+
+    // values live at current point, as a sparse set
+    std::vector<int> live;
+    std::vector<int> live_pos(values.get_size(), -1);
+    auto add_live = [&](int v) {
+        if (v == -1 || live_pos[v] != -1) return;
+        live_pos[v] = live.size();
+        live.push_back(v);
+    };
+    auto remove_live = [&](int v) {
+        if (v == -1 || live_pos[v] == -1) return;
+        live_pos[live.back()] = live_pos[v];
+        live[live_pos[v]] = live.back();
+        live.pop_back();
+        live_pos[v] = -1;
+    };
+    auto node = [&](koopa_raw_value_t val) {
+        int i = values.get_index(val);
+        return i == -1 ? -1 : graph.get_value_node(i);
+    };
+    // defined at current point, interfering with values live after it
+    auto define = [&](koopa_raw_value_t val, double weight) {
+        int v = values.get_index(val);
+        if (v == -1) return;
+        remove_live(v);
+        for (int l : live)
+            graph.add_edge(graph.get_value_node(v), graph.get_value_node(l));
+        graph.add_cost(graph.get_value_node(v), weight);
+    };
+    auto add_block_moves = [&](koopa_raw_slice_t args,
+                               koopa_raw_basic_block_t target) {
+        for (size_t i = 0; i < args.len; i++) {
+            int arg = node((koopa_raw_value_t)args.buffer[i]);
+            int param = node((koopa_raw_value_t)target->params.buffer[i]);
+            if (arg != -1) graph.add_move(arg, param);
+        }
+    };
+
+    std::vector<koopa_raw_value_t> operands;
+    for (int b = 0; b < cfg.get_num_blocks(); b++) {
+        auto bb = cfg.blocks[b];
+        double weight = std::pow(10.0, std::min(loops.get_depth(b), 8));
+        while (!live.empty()) remove_live(live.back());
+        auto &live_out = liveness.result.out[b];
+        for (int bit = live_out.find_next(0); bit != -1;
+             bit = live_out.find_next(bit + 1))
+            add_live(values.get_index(liveness.get_value(bit)));
+
+        for (int j = (int)bb->insts.len - 1; j >= 0; j--) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            define(inst, weight);
+            auto &kind = inst->kind;
+            if (kind.tag == KOOPA_RVT_CALL) {
+                // values live through a call are clobbered in caller-saved
+                // registers, and args mustn't be in a0-a7 being filled
+                for (int l : live)
+                    for (auto reg : caller_saved_regs)
+                        graph.add_edge(graph.get_value_node(l),
+                                       graph.get_reg_node(reg));
+                auto args = kind.data.call.args;
+                for (size_t i = 0; i < args.len; i++) {
+                    int arg = node((koopa_raw_value_t)args.buffer[i]);
+                    if (arg == -1) continue;
+                    for (int r = REG_A0; r <= REG_A7; r++)
+                        graph.add_edge(arg,
+                                       graph.get_reg_node((riscv_reg_t)r));
+                }
+                if (node(inst) != -1)
+                    graph.add_move(graph.get_reg_node(REG_A0), node(inst));
+            } else if (kind.tag == KOOPA_RVT_RETURN && kind.data.ret.value) {
+                int ret = node(kind.data.ret.value);
+                if (ret != -1) graph.add_move(ret, graph.get_reg_node(REG_A0));
+            } else if (kind.tag == KOOPA_RVT_BRANCH) {
+                add_block_moves(kind.data.branch.true_args,
+                                kind.data.branch.true_bb);
+                add_block_moves(kind.data.branch.false_args,
+                                kind.data.branch.false_bb);
+            } else if (kind.tag == KOOPA_RVT_JUMP) {
+                add_block_moves(kind.data.jump.args, kind.data.jump.target);
+            }
+            get_koopa_raw_value_operands(inst, operands);
+            for (auto operand : operands) {
+                int v = values.get_index(operand);
+                if (v == -1) continue;
+                add_live(v);
+                graph.add_cost(graph.get_value_node(v), weight);
+            }
+        }
+
+        // params are defined together at the start, before anything
+        std::vector<koopa_raw_value_t> params;
+        for (size_t i = 0; i < bb->params.len; i++)
+            params.push_back((koopa_raw_value_t)bb->params.buffer[i]);
+        if (b == 0) {
+            for (size_t i = 0; i < func->params.len; i++)
+                params.push_back((koopa_raw_value_t)func->params.buffer[i]);
+        }
+        for (auto param : params) add_live(values.get_index(param));
+        for (auto param : params) define(param, weight);
+    }
+
+    // params are moved out of a0-a7 one by one in prologue, so none of
+    // them could take the register of another one not moved yet
+    int num_reg_params = std::min((int)func->params.len, 8);
+    for (int i = 0; i < (int)func->params.len; i++) {
+        int param = node((koopa_raw_value_t)func->params.buffer[i]);
+        for (int j = 0; j < num_reg_params; j++) {
+            auto reg = graph.get_reg_node((riscv_reg_t)(REG_A0 + j));
+            if (i == j)
+                graph.add_move(reg, param);
+            else if (i < 8)
+                graph.add_edge(param, reg);
+        }
+    }
+
+    graph.run();
+
+    assignment.regs.assign(values.get_size(), REG_NONE);
+    assignment.saved_regs.clear();
+    assignment.num_spilled = 0;
+    assignment.num_coalesced = graph.num_coalesced;
+    bool is_saved[REG_NONE] = {};
+    for (int v = 0; v < values.get_size(); v++) {
+        auto reg = graph.get_reg(graph.get_value_node(v));
+        assignment.regs[v] = reg;
+        if (reg == REG_NONE)
+            assignment.num_spilled++;
+        else
+            is_saved[reg] = is_callee_saved(reg);
+    }
+    for (auto reg : callee_saved_regs)
+        if (is_saved[reg]) assignment.saved_regs.push_back(reg);
+    assignment.values = std::move(liveness.values);
+}
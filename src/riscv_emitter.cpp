@@ -0,0 +1,422 @@
+#include <riscv_emitter.h>
+
+#include <algorithm>
+#include <cstring>
+
+// ra and s0 of the caller are saved right below s0
+static const int RA_OFFSET = -4;
+static const int S0_OFFSET = -8;
+
+static bool is_imm12(int imm) { return imm >= -2048 && imm <= 2047; }
+
+static bool is_number(const std::string &name) {
+    return name[0] != '%' && name[0] != '@';
+}
+
+const char *RiscvEmitter::_copy_symbol(const char *name) {
+    auto len = strlen(name);
+    auto symbol = arena.allocate<char>(len + 1);
+    memcpy(symbol, name, len + 1);
+    return symbol;
+}
+
+const EmittedValue &RiscvEmitter::_find(const std::string &name) {
+    auto it = locals.find(name);
+    if (it != locals.end()) return it->second;
+    auto it_global = globals.find(name);
+    assert(it_global != globals.end());
+    return it_global->second;
+}
+
+const EmittedValue &RiscvEmitter::_new_slot(const std::string &name,
+                                            const KoopaType *ty) {
+    frame_length += 4;
+    auto &value = locals[name];
+    value.tag = EMITTED_VALUE_SLOT;
+    value.ty = ty;
+    value.offset = -frame_length;
+    return value;
+}
+
+// append an inst to current machine block
+
+void RiscvEmitter::_dump_inst(riscv_opcode_t op, riscv_reg_t rd,
+                              riscv_reg_t rs1, riscv_reg_t rs2) {
+    MachineInst inst(op);
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+// sw stores reg to imm(base), others write reg
+void RiscvEmitter::_dump_inst(riscv_opcode_t op, riscv_reg_t reg,
+                              riscv_reg_t base, int imm) {
+    MachineInst inst(op);
+    if (op == RV_SW)
+        inst.rs2 = reg;
+    else
+        inst.rd = reg;
+    inst.rs1 = base;
+    inst.imm = imm;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+void RiscvEmitter::_dump_inst(riscv_opcode_t op, riscv_reg_t rd, int imm) {
+    MachineInst inst(op);
+    inst.rd = rd;
+    inst.imm = imm;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+// branches read reg, la writes it
+void RiscvEmitter::_dump_inst(riscv_opcode_t op, riscv_reg_t reg,
+                              const char *symbol) {
+    MachineInst inst(op);
+    if (op == RV_BNEZ || op == RV_BEQZ)
+        inst.rs1 = reg;
+    else
+        inst.rd = reg;
+    inst.symbol = symbol;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+void RiscvEmitter::_dump_inst(riscv_opcode_t op, const char *symbol) {
+    MachineInst inst(op);
+    inst.symbol = symbol;
+    mfunc.blocks.back().insts.push_back(inst);
+}
+
+// frame is addressed from s0, t3 takes the offsets out of imm12
+
+void RiscvEmitter::_dump_frame_addr(riscv_reg_t reg, int offset) {
+    if (is_imm12(offset)) {
+        _dump_inst(RV_ADDI, reg, REG_S0, offset);
+    } else {
+        _dump_inst(RV_LI, reg, offset);
+        _dump_inst(RV_ADD, reg, reg, REG_S0);
+    }
+}
+
+void RiscvEmitter::_dump_lw(riscv_reg_t reg, int offset) {
+    if (is_imm12(offset)) {
+        _dump_inst(RV_LW, reg, REG_S0, offset);
+    } else {
+        _dump_frame_addr(REG_T3, offset);
+        _dump_inst(RV_LW, reg, REG_T3, 0);
+    }
+}
+
+void RiscvEmitter::_dump_sw(riscv_reg_t reg, int offset) {
+    if (is_imm12(offset)) {
+        _dump_inst(RV_SW, reg, REG_S0, offset);
+    } else {
+        _dump_frame_addr(REG_T3, offset);
+        _dump_inst(RV_SW, reg, REG_T3, 0);
+    }
+}
+
+void RiscvEmitter::_dump_add_imm(riscv_reg_t reg, int imm) {
+    if (imm == 0) return;
+    if (is_imm12(imm)) {
+        _dump_inst(RV_ADDI, reg, reg, imm);
+    } else {
+        _dump_inst(RV_LI, REG_T3, imm);
+        _dump_inst(RV_ADD, reg, reg, REG_T3);
+    }
+}
+
+void RiscvEmitter::_load_value(const std::string &name, riscv_reg_t reg) {
+    if (is_number(name)) {
+        _dump_inst(RV_LI, reg, std::stoi(name));
+        return;
+    }
+    auto &value = _find(name);
+    if (value.tag == EMITTED_VALUE_FRAME) {
+        _dump_frame_addr(reg, value.offset);
+    } else if (value.tag == EMITTED_VALUE_SLOT) {
+        _dump_lw(reg, value.offset);
+    } else if (value.tag == EMITTED_VALUE_GLOBAL) {
+        _dump_inst(RV_LA, reg, value.symbol);
+    } else if (value.offset < 8) {
+        _dump_inst(RV_MV, reg, (riscv_reg_t)(REG_A0 + value.offset));
+    } else {
+        // on the caller's frame, right above s0
+        _dump_lw(reg, (value.offset - 8) * 4);
+    }
+}
+
+// src + index * stride
+void RiscvEmitter::_dump_ptr(const std::string &dst, const std::string &src,
+                             const std::string &index, int stride,
+                             const KoopaType *ty) {
+    auto base = _find(src);
+    if (is_number(index) && base.tag == EMITTED_VALUE_FRAME) {
+        // another address in the frame, known without any inst
+        auto &value = locals[dst];
+        value.tag = EMITTED_VALUE_FRAME;
+        value.ty = ty;
+        value.offset = base.offset + std::stoi(index) * stride;
+        return;
+    }
+
+    _load_value(src, REG_T0);
+    if (is_number(index)) {
+        _dump_add_imm(REG_T0, std::stoi(index) * stride);
+    } else {
+        _load_value(index, REG_T1);
+        _dump_inst(RV_LI, REG_T2, stride);
+        _dump_inst(RV_MUL, REG_T1, REG_T1, REG_T2);
+        _dump_inst(RV_ADD, REG_T0, REG_T0, REG_T1);
+    }
+    _dump_sw(REG_T0, _new_slot(dst, ty).offset);
+}
+
+// globals
+
+void RiscvEmitter::global_alloc(std::ostream &out, const std::string &name,
+                                const KoopaType *type,
+                                const std::vector<int> &init) {
+    auto it = globals.insert(std::make_pair(name, EmittedValue())).first;
+    auto &value = it->second;
+    value.tag = EMITTED_VALUE_GLOBAL;
+    value.ty = types.get_pointer(type);
+    value.symbol = it->first.c_str() + 1;  // kept by the map
+
+    if (elf) {
+        elf->begin_data(value.symbol);
+    } else {
+        out << "  .data" << std::endl;
+        out << "  .globl " << value.symbol << std::endl;
+        out << value.symbol << ":" << std::endl;
+    }
+    if (init.empty()) {
+        if (elf)
+            elf->append_data_zero(type->size);
+        else
+            out << "  .zero " << type->size << std::endl;
+    }
+    // runs of zeros are merged
+    for (size_t i = 0; i < init.size();) {
+        size_t j = i;
+        while (j < init.size() && init[j] == 0) j++;
+        if (j > i) {
+            int size = (j - i) * 4;
+            if (elf)
+                elf->append_data_zero(size);
+            else
+                out << "  .zero " << size << std::endl;
+            i = j;
+            continue;
+        }
+        if (elf)
+            elf->append_data_word(init[i]);
+        else
+            out << "  .word " << init[i] << std::endl;
+        i++;
+    }
+    if (!elf) out << std::endl;
+}
+
+// functions
+
+void RiscvEmitter::func_begin(std::ostream &out, const std::string &name,
+                              const params_t &params, bool is_int) {
+    mfunc.name = _copy_symbol(name.c_str());
+    mfunc.arena = &arena;
+    frame_length = -S0_OFFSET;
+    max_stack_args = 0;
+    for (int i = 0; i < (int)params.size(); i++) {
+        auto &value = locals[params[i].first];
+        value.tag = EMITTED_VALUE_PARAM;
+        value.ty = params[i].second;
+        value.offset = i;
+    }
+
+    // prologue, sp is moved at the end of the function
+    mfunc.blocks.push_back(MachineBlock(nullptr, &arena));
+    _dump_inst(RV_SW, REG_RA, REG_SP, RA_OFFSET);
+    _dump_inst(RV_SW, REG_S0, REG_SP, S0_OFFSET);
+    _dump_inst(RV_MV, REG_S0, REG_SP);
+}
+
+void RiscvEmitter::func_end(std::ostream &out) {
+    // args beyond a7 are at the bottom of the frame
+    int length = frame_length + max_stack_args * 4;
+    length = (length + 15) / 16 * 16;
+    auto &prologue = mfunc.blocks.front().insts;
+    MachineInst move_sp(RV_ADDI);
+    move_sp.rd = REG_SP;
+    move_sp.rs1 = REG_SP;
+    move_sp.imm = -length;
+    if (is_imm12(-length)) {
+        prologue.push_back(move_sp);
+    } else {
+        MachineInst li(RV_LI);
+        li.rd = REG_T0;
+        li.imm = -length;
+        prologue.push_back(li);
+        move_sp.op = RV_ADD;
+        move_sp.rs2 = REG_T0;
+        prologue.push_back(move_sp);
+    }
+
+    if (elf)
+        elf->add_function(mfunc);
+    else
+        print_machine_function(mfunc, out);
+
+    // nothing of this function on the arena is alive from here
+    mfunc.blocks.clear();
+    locals.clear();
+    arena.reset();
+}
+
+void RiscvEmitter::block(std::ostream &out, const std::string &name) {
+    auto label = _copy_symbol(name.c_str() + 1);
+    mfunc.blocks.push_back(MachineBlock(label, &arena));
+}
+
+// insts
+
+void RiscvEmitter::alloc(std::ostream &out, const std::string &name,
+                         const KoopaType *type) {
+    frame_length += type->size;
+    auto &value = locals[name];
+    value.tag = EMITTED_VALUE_FRAME;
+    value.ty = types.get_pointer(type);
+    value.offset = -frame_length;
+}
+
+void RiscvEmitter::load(std::ostream &out, const std::string &dst,
+                        const std::string &src) {
+    auto &ptr = _find(src);
+    auto ty = ptr.ty->base;
+    if (ptr.tag == EMITTED_VALUE_FRAME) {
+        _dump_lw(REG_T0, ptr.offset);
+    } else {
+        _load_value(src, REG_T0);
+        _dump_inst(RV_LW, REG_T0, REG_T0, 0);
+    }
+    _dump_sw(REG_T0, _new_slot(dst, ty).offset);
+}
+
+void RiscvEmitter::store(std::ostream &out, const std::string &val,
+                         const std::string &dst) {
+    _load_value(val, REG_T0);
+    auto &ptr = _find(dst);
+    if (ptr.tag == EMITTED_VALUE_FRAME) {
+        _dump_sw(REG_T0, ptr.offset);
+    } else {
+        _load_value(dst, REG_T1);
+        _dump_inst(RV_SW, REG_T0, REG_T1, 0);
+    }
+}
+
+void RiscvEmitter::store_init(std::ostream &out, const std::string &dst,
+                              const KoopaType *type,
+                              const std::vector<int> &init) {
+    auto &ptr = _find(dst);
+    assert(ptr.tag == EMITTED_VALUE_FRAME);
+    for (int i = 0; i < (int)init.size(); i++) {
+        auto reg = REG_ZERO;
+        if (init[i] != 0) {
+            reg = REG_T0;
+            _dump_inst(RV_LI, reg, init[i]);
+        }
+        _dump_sw(reg, ptr.offset + i * 4);
+    }
+}
+
+void RiscvEmitter::get_ptr(std::ostream &out, const std::string &dst,
+                           const std::string &src, const std::string &index) {
+    auto ty = _find(src).ty;
+    _dump_ptr(dst, src, index, ty->stride, ty);
+}
+
+void RiscvEmitter::get_elem_ptr(std::ostream &out, const std::string &dst,
+                                const std::string &src,
+                                const std::string &index) {
+    auto array_ty = _find(src).ty->base;
+    assert(array_ty->tag == KOOPA_TYPE_ARRAY);
+    _dump_ptr(dst, src, index, array_ty->stride,
+              types.get_pointer(array_ty->base));
+}
+
+void RiscvEmitter::binary(std::ostream &out, const std::string &dst,
+                          koopa_raw_binary_op_t op, const std::string &lhs,
+                          const std::string &rhs) {
+    riscv_reg_t reg = REG_T0, l_reg = REG_T1, r_reg = REG_T2;
+    _load_value(lhs, l_reg);
+    _load_value(rhs, r_reg);
+
+    if (op == KOOPA_RBO_NOT_EQ) {
+        _dump_inst(RV_XOR, reg, l_reg, r_reg);
+        _dump_inst(RV_SNEZ, reg, reg);
+    } else if (op == KOOPA_RBO_EQ) {
+        _dump_inst(RV_XOR, reg, l_reg, r_reg);
+        _dump_inst(RV_SEQZ, reg, reg);
+    } else if (op == KOOPA_RBO_GT) {
+        _dump_inst(RV_SGT, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_LT) {
+        _dump_inst(RV_SLT, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_GE) {  // not less than
+        _dump_inst(RV_SLT, reg, l_reg, r_reg);
+        _dump_inst(RV_XORI, reg, reg, 1);
+    } else if (op == KOOPA_RBO_LE) {  // not greater than
+        _dump_inst(RV_SGT, reg, l_reg, r_reg);
+        _dump_inst(RV_XORI, reg, reg, 1);
+    } else if (op == KOOPA_RBO_ADD) {
+        _dump_inst(RV_ADD, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_SUB) {
+        _dump_inst(RV_SUB, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_MUL) {
+        _dump_inst(RV_MUL, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_DIV) {
+        _dump_inst(RV_DIV, reg, l_reg, r_reg);
+    } else if (op == KOOPA_RBO_MOD) {
+        _dump_inst(RV_REM, reg, l_reg, r_reg);
+    } else {
+        std::cerr << "RiscvEmitter: invalid binary op " << op << std::endl;
+        assert(false);
+    }
+    _dump_sw(reg, _new_slot(dst, types.get_int32()).offset);
+}
+
+void RiscvEmitter::call(std::ostream &out, const std::string &dst,
+                        const std::string &func,
+                        const std::vector<std::string> &args) {
+    for (int i = 0; i < (int)args.size(); i++) {
+        if (i < 8) {
+            _load_value(args[i], (riscv_reg_t)(REG_A0 + i));
+        } else {
+            _load_value(args[i], REG_T0);
+            _dump_inst(RV_SW, REG_T0, REG_SP, (i - 8) * 4);
+        }
+    }
+    max_stack_args = std::max(max_stack_args, (int)args.size() - 8);
+    _dump_inst(RV_CALL, _copy_symbol(func.c_str()));
+    if (!dst.empty())
+        _dump_sw(REG_A0, _new_slot(dst, types.get_int32()).offset);
+}
+
+void RiscvEmitter::branch(std::ostream &out, const std::string &cond,
+                          const std::string &true_bb,
+                          const std::string &false_bb) {
+    _load_value(cond, REG_T0);
+    _dump_inst(RV_BNEZ, REG_T0, _copy_symbol(true_bb.c_str() + 1));
+    _dump_inst(RV_J, _copy_symbol(false_bb.c_str() + 1));
+}
+
+void RiscvEmitter::jump(std::ostream &out, const std::string &target) {
+    _dump_inst(RV_J, _copy_symbol(target.c_str() + 1));
+}
+
+void RiscvEmitter::ret(std::ostream &out, const std::string &val) {
+    if (!val.empty()) _load_value(val, REG_A0);
+    // epilogue, s0 is the sp of the caller
+    _dump_inst(RV_LW, REG_RA, REG_S0, RA_OFFSET);
+    _dump_inst(RV_MV, REG_SP, REG_S0);
+    _dump_inst(RV_LW, REG_S0, REG_S0, S0_OFFSET);
+    _dump_inst(RV_RET);
+}
@@ -1,19 +1,38 @@
 #include "tcgen.h"
 
-StackFrame::StackFrame(koopa_raw_function_t func) {
+StackFrame::StackFrame(koopa_raw_function_t func, Arena *arena,
+                       const RegisterAssignment *assignment)
+    : saved_registers(arena),
+      values(arena),
+      koopa_values(arena),
+      alloc_index(arena),
+      alloc_memory(arena) {
+    std::fill(saved_register_index, saved_register_index + REG_NONE, -1);
     auto bb_slice = func->bbs;
     assert(bb_slice.kind == KOOPA_RSIK_BASIC_BLOCK);
 
     bool is_leaf_function = true;
+    size_t num_insts = 0;
+    has_param_values = assignment != nullptr;
+    std::vector<koopa_raw_value_t> operands;
 
     // first round: calculate length A
     for (size_t i = 0; i < bb_slice.len; i++) {
         auto bb = (koopa_raw_basic_block_t)bb_slice.buffer[i];
         auto val_slice = bb->insts;
         assert(val_slice.kind == KOOPA_RSIK_VALUE);
+        num_insts += bb->params.len + val_slice.len;
 
         for (size_t j = 0; j < val_slice.len; j++) {
             auto val = (koopa_raw_value_t)val_slice.buffer[j];
+            if (!has_param_values) {
+                get_koopa_raw_value_operands(val, operands);
+                // the value of a store is read where it's passed
+                size_t k = val->kind.tag == KOOPA_RVT_STORE ? 1 : 0;
+                for (; k < operands.size(); k++)
+                    if (operands[k]->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+                        has_param_values = true;
+            }
             if (val->kind.tag != KOOPA_RVT_CALL) continue;
 
             auto param_len = int(val->kind.data.call.args.len);
@@ -23,16 +42,39 @@ StackFrame::StackFrame(koopa_raw_function_t func) {
     }
 
     // second round: scan temporary variables & alloc memory
+    koopa_values.reserve(num_insts);
+    alloc_index.reserve(num_insts);
+    if (has_param_values) {
+        // spilled params are moved to slots by prologue
+        for (size_t i = 0; i < func->params.len; i++) {
+            auto val = (koopa_raw_value_t)func->params.buffer[i];
+            StackInfo val_info;
+            if (assignment && !assignment->is_spilled(val)) val_info.size = 0;
+            _insert_koopa_value(val, val_info);
+        }
+    }
     for (size_t i = 0; i < bb_slice.len; i++) {
         auto bb = (koopa_raw_basic_block_t)bb_slice.buffer[i];
         auto val_slice = bb->insts;
         assert(val_slice.kind == KOOPA_RSIK_VALUE);
 
+        // block params are filled by jumps to the block
+        for (size_t j = 0; j < bb->params.len; j++) {
+            auto val = (koopa_raw_value_t)bb->params.buffer[j];
+            StackInfo val_info;
+            if (assignment && !assignment->is_spilled(val)) val_info.size = 0;
+            _insert_koopa_value(val, val_info);
+        }
+
         for (size_t j = 0; j < val_slice.len; j++) {
             auto val = (koopa_raw_value_t)val_slice.buffer[j];
 
             StackInfo val_info;
             val_info.size = get_koopa_raw_value_size(val->ty);
+            // allocs are addressed from sp directly
+            if (assignment && (val->kind.tag == KOOPA_RVT_ALLOC ||
+                               !assignment->is_spilled(val)))
+                val_info.size = 0;
             _insert_koopa_value(val, val_info);
 
             if (val->kind.tag == KOOPA_RVT_ALLOC) {
@@ -46,8 +88,11 @@ StackFrame::StackFrame(koopa_raw_function_t func) {
     }
 
     // save registers
-    _insert_saved_registers("ra", StackInfo());
-    _insert_saved_registers("s0", StackInfo());
+    _insert_saved_registers(REG_RA, StackInfo());
+    _insert_saved_registers(REG_S0, StackInfo());
+    if (assignment)
+        for (auto reg : assignment->saved_regs)
+            _insert_saved_registers(reg, StackInfo());
 
     // length align to 16
     length = ((length + 15) >> 4) << 4;
@@ -55,49 +100,57 @@ StackFrame::StackFrame(koopa_raw_function_t func) {
 
 // insert info entry (add type and offset, handle length automatically)
 
-void StackFrame::_insert_saved_registers(std::string name, StackInfo info) {
+void StackFrame::_insert_saved_registers(riscv_reg_t reg, StackInfo info) {
     info.type = STACK_INFO_SAVED_REGISTER;
-    assert(saved_registers.find(name) == saved_registers.end());
+    assert(saved_register_index[reg] == -1);
     info.offset = length;
     length += info.size;
-    saved_registers.insert(std::make_pair(name, info));
+    saved_register_index[reg] = saved_registers.size();
+    saved_registers.push_back(std::make_pair(reg, info));
 }
 
 void StackFrame::_insert_koopa_value(koopa_raw_value_t val, StackInfo info) {
     info.type = STACK_INFO_KOOPA_VALUE;
-    assert(koopa_values.find(val) == koopa_values.end());
+    int index = values.insert(val);
+    assert(index == (int)koopa_values.size());
     info.offset = length;
     length += info.size;
-    koopa_values.insert(std::make_pair(val, info));
+    koopa_values.push_back(info);
+    alloc_index.push_back(-1);
 }
 
+// val should have been inserted as a koopa value
 void StackFrame::_insert_alloc_memory(koopa_raw_value_t val, StackInfo info) {
     info.type = STACK_INFO_ALLOC_MEMORY;
-    assert(alloc_memory.find(val) == alloc_memory.end());
+    int index = values.get_index(val);
+    assert(index != -1 && alloc_index[index] == -1);
     info.offset = length;
     length += info.size;
-    alloc_memory.insert(std::make_pair(val, info));
+    alloc_index[index] = alloc_memory.size();
+    alloc_memory.push_back(info);
 }
 
 // Get offset from current sp
 // (Support transforming negative offset)
-StackInfo StackFrame::get_saved_register(std::string name) {
-    assert(saved_registers.find(name) != saved_registers.end());
-    auto info = saved_registers[name];
+StackInfo StackFrame::get_saved_register(riscv_reg_t reg) {
+    assert(saved_register_index[reg] != -1);
+    auto info = saved_registers[saved_register_index[reg]].second;
     if (info.offset < 0) info.offset += length;
     return info;
 }
 
 StackInfo StackFrame::get_koopa_value(koopa_raw_value_t val) {
-    assert(koopa_values.find(val) != koopa_values.end());
-    auto info = koopa_values[val];
+    int index = values.get_index(val);
+    assert(index != -1);
+    auto info = koopa_values[index];
     if (info.offset < 0) info.offset += length;
     return info;
 }
 
 StackInfo StackFrame::get_alloc_memory(koopa_raw_value_t val) {
-    assert(alloc_memory.find(val) != alloc_memory.end());
-    auto info = alloc_memory[val];
+    int index = values.get_index(val);
+    assert(index != -1 && alloc_index[index] != -1);
+    auto info = alloc_memory[alloc_index[index]];
     if (info.offset < 0) info.offset += length;
     return info;
-}
\ No newline at end of file
+}
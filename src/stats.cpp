@@ -0,0 +1,74 @@
+#include <stats.h>
+
+void FunctionStats::add(const FunctionStats &other) {
+    koopa_insts += other.koopa_insts;
+    koopa_blocks += other.koopa_blocks;
+    frame_length += other.frame_length;
+    spilled_values += other.spilled_values;
+    coalesced_moves += other.coalesced_moves;
+    stack_loads += other.stack_loads;
+    stack_stores += other.stack_stores;
+    large_offsets += other.large_offsets;
+    insts += other.insts;
+    for (auto &it : other.mnemonics) mnemonics[it.first] += it.second;
+}
+
+void CompileStats::begin_function(koopa_raw_function_t func) {
+    FunctionStats stats;
+    stats.name = func->name + 1;
+    stats.koopa_blocks = func->bbs.len;
+    for (size_t i = 0; i < func->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        stats.koopa_insts += bb->insts.len;
+    }
+    functions.push_back(stats);
+}
+
+void CompileStats::end_function(const MachineFunction &func) {
+    auto &stats = get_current();
+    for (auto &block : func.blocks) {
+        for (auto &inst : block.insts) {
+            stats.insts++;
+            stats.mnemonics[to_riscv_opcode(inst.op)]++;
+        }
+    }
+}
+
+static void dump_function_json(const FunctionStats &stats, std::ostream &out,
+                               std::string indent) {
+    out << "{\n";
+    auto field = [&](std::string key, int value) {
+        out << indent << "  \"" << key << "\": " << value << ",\n";
+    };
+    if (!stats.name.empty())
+        out << indent << "  \"name\": \"" << stats.name << "\",\n";
+    field("koopa_insts", stats.koopa_insts);
+    field("koopa_blocks", stats.koopa_blocks);
+    field("frame_length", stats.frame_length);
+    field("spilled_values", stats.spilled_values);
+    field("coalesced_moves", stats.coalesced_moves);
+    field("stack_loads", stats.stack_loads);
+    field("stack_stores", stats.stack_stores);
+    field("large_offsets", stats.large_offsets);
+    field("insts", stats.insts);
+    out << indent << "  \"mnemonics\": {";
+    bool first = true;
+    for (auto &it : stats.mnemonics) {
+        out << (first ? "" : ", ") << "\"" << it.first << "\": " << it.second;
+        first = false;
+    }
+    out << "}\n" << indent << "}";
+}
+
+void CompileStats::dump_json(std::ostream &out) {
+    FunctionStats total;
+    out << "{\n  \"functions\": [";
+    for (size_t i = 0; i < functions.size(); i++) {
+        out << (i ? ", " : "\n    ");
+        dump_function_json(functions[i], out, "    ");
+        total.add(functions[i]);
+    }
+    out << "\n  ],\n  \"total\": ";
+    dump_function_json(total, out, "  ");
+    out << "\n}" << std::endl;
+}
@@ -27,24 +27,31 @@ bool SymbolTable::_get_local_table(symbol_table_block_t *&table) {
 
 // return symbol entry if successful
 bool SymbolTable::_get_entry(std::string name, SymbolTableEntry *&entry) {
-    // recursive searching on local symbol table stack
-    for (auto it_b = block_stack.rbegin(); it_b != block_stack.rend(); it_b++) {
-        auto it_entry = it_b->find(name);
-        if (it_entry != it_b->end()) {
-            entry = &(it_entry->second);
-            return true;
-        }
+    // innermost local entry
+    auto it_local = local_entries.find(name);
+    if (it_local != local_entries.end() && !it_local->second.empty()) {
+        entry = it_local->second.back();
+        return true;
     }
     // check global symbol table
     auto it_entry = global_table.find(name);
     if (it_entry != global_table.end()) {
         entry = &(it_entry->second);
+        used_globals.insert(name);
         return true;
     }
     entry = nullptr;
     return false;
 }
 
+// insert entry into table, and keep track of it if it's local
+void SymbolTable::_insert_entry(symbol_table_block_t *table, bool is_local,
+                                std::string name,
+                                const SymbolTableEntry &entry) {
+    auto it_entry = table->insert(std::make_pair(name, entry)).first;
+    if (is_local) local_entries[name].push_back(&(it_entry->second));
+}
+
 // insert new entry
 
 void SymbolTable::insert_var_entry(std::string name) {
@@ -63,7 +70,7 @@ void SymbolTable::insert_var_entry(std::string name) {
     }
     entry.is_const = false;
 
-    table->insert(std::make_pair(name, entry));
+    _insert_entry(table, is_local, name, entry);
 }
 
 void SymbolTable::insert_const_var_entry(std::string name, int val) {
@@ -83,7 +90,7 @@ void SymbolTable::insert_const_var_entry(std::string name, int val) {
     entry.is_const = true;
     entry.val = val;
 
-    table->insert(std::make_pair(name, entry));
+    _insert_entry(table, is_local, name, entry);
 }
 
 void SymbolTable::insert_func_entry(std::string name, std::string func_type,
@@ -100,7 +107,7 @@ void SymbolTable::insert_func_entry(std::string name, std::string func_type,
 }
 
 void SymbolTable::insert_array_entry(std::string name,
-                                     std::vector<int> array_size, bool is_ptr) {
+                                     const KoopaType *array_type) {
     symbol_table_block_t *table = nullptr;
     bool is_local = _get_local_table(table);
     assert(table->find(name) == table->end());  // no duplication
@@ -115,10 +122,9 @@ void SymbolTable::insert_array_entry(std::string name,
         entry.alias = -1;
     }
     entry.is_const = false;
-    entry.array_size = array_size;
-    entry.is_ptr = is_ptr;
+    entry.array_type = array_type;
 
-    table->insert(std::make_pair(name, entry));
+    _insert_entry(table, is_local, name, entry);
 }
 
 // fetch entry info
@@ -178,6 +184,7 @@ std::string SymbolTable::get_func_entry_type(std::string name) {
     auto it_entry = global_table.find(name);
     assert(it_entry != global_table.end());
     assert(it_entry->second.type == SYMBOL_TABLE_ENTRY_FUNC);
+    used_globals.insert(name);
     return it_entry->second.func_type;
 }
 
@@ -193,21 +200,14 @@ bool SymbolTable::is_ptr_array_entry(std::string name) {
     SymbolTableEntry *entry = nullptr;
     assert(_get_entry(name, entry));
     assert(entry->type == SYMBOL_TABLE_ENTRY_ARRAY);
-    return entry->is_ptr;
+    return entry->array_type->tag == KOOPA_TYPE_POINTER;
 }
 
-std::string SymbolTable::get_array_entry_type(std::string name) {
+const KoopaType *SymbolTable::get_array_entry_type(std::string name) {
     SymbolTableEntry *entry = nullptr;
     assert(_get_entry(name, entry));
     assert(entry->type == SYMBOL_TABLE_ENTRY_ARRAY);
-    std::string type = "i32";
-    for (auto it_index = entry->array_size.rbegin();
-         it_index != entry->array_size.rend(); it_index++) {
-        type = "[" + type + ", " + std::to_string(*it_index) + "]";
-    }
-    if (entry->is_ptr)
-        type = "*" + type;
-    return type;
+    return entry->array_type;
 }
 
 // basic block stacking
@@ -216,4 +216,30 @@ void SymbolTable::push_block() {
     block_stack.push_back(symbol_table_block_t());
 }
 
-void SymbolTable::pop_block() { block_stack.pop_back(); }
+void SymbolTable::pop_block() {
+    for (auto &it_entry : block_stack.back())
+        local_entries[it_entry.first].pop_back();
+    block_stack.pop_back();
+}
+
+// streaming mode
+
+// Symbol is declared by the unit defining it,
+// which shouldn't declare it again in its own prelude.
+void SymbolTable::insert_global_decl(std::string name, std::string decl) {
+    assert(global_decls.find(name) == global_decls.end());
+    global_decls.insert(std::make_pair(name, decl));
+    used_globals.erase(name);
+}
+
+// Collect decls of global symbols used since last call.
+// Consts are folded, so they have no decl and are skipped.
+std::string SymbolTable::get_used_global_decls() {
+    std::string ret;
+    for (auto &name : used_globals) {
+        auto it_decl = global_decls.find(name);
+        if (it_decl != global_decls.end()) ret += it_decl->second + "\n";
+    }
+    used_globals.clear();
+    return ret;
+}
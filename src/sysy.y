@@ -19,16 +19,32 @@
 #include <string>
 #include <ast.h>
 
+// Deeply nested statements and expressions of generated code would
+// exhaust the default 10000, the stacks are on heap and grow by doubling
+#define YYMAXDEPTH 10000000
+
 int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
+void yyerror(std::unique_ptr<BaseAST> &ast, comp_unit_handler_t &handler,
+             const char *s);
 extern int yylineno;
 
 using namespace std;
 
+// In streaming mode, hand the unit over and drop it from the CompUnit list.
+static BaseAST *stream_comp_unit(comp_unit_handler_t &handler,
+                                 CompUnitAST *unit) {
+  if (!handler) return unit;
+  auto next = unit->next;
+  unit->next = nullptr;
+  handler(unique_ptr<BaseAST>(unit));
+  return next;
+}
+
 %}
 
 // parser func yyparse's & yyerror's arguments
 %parse-param { std::unique_ptr<BaseAST> &ast }
+%parse-param { comp_unit_handler_t &handler }
 
 // definition of yylval as union, where lexer returns token's attribute value
 // NOTICE that we don't use unique ptr in union, since it causes bugs.
@@ -57,7 +73,7 @@ using namespace std;
                 Stmt MatchedStmt OpenStmt
                 LVal
                 ConstExp Exp LOrExp LAndExp EqExp RelExp AddExp MulExp UnaryExp PrimaryExp
-                OptionalConstExpIndex OptionalExpIndex OptionalConstInitVal OptionalInitVal
+                OptionalConstExpIndex OptionalExpIndex ConstInitValList InitValList
 %type <str_val>
                 BType
                 UnaryOp MulOp AddOp RelOp EqOp
@@ -86,28 +102,28 @@ CompUnit
     ast->type = COMP_UNIT_AST_TYPE_FUNC;
     ast->func_def = unique_ptr<BaseAST>($1);
     ast->next = nullptr;
-    $$ = ast;
+    $$ = stream_comp_unit(handler, ast);
   }
   | Decl {
     auto ast = new CompUnitAST();
     ast->type = COMP_UNIT_AST_TYPE_DECL;
     ast->decl = unique_ptr<BaseAST>($1);
     ast->next = nullptr;
-    $$ = ast;
+    $$ = stream_comp_unit(handler, ast);
   }
   | CompUnit FuncDef {
     auto ast = new CompUnitAST();
     ast->type = COMP_UNIT_AST_TYPE_FUNC;
     ast->func_def = unique_ptr<BaseAST>($2);
     ast->next = (CompUnitAST*)$1;
-    $$ = ast;
+    $$ = stream_comp_unit(handler, ast);
   }
   | CompUnit Decl {
     auto ast = new CompUnitAST();
     ast->type = COMP_UNIT_AST_TYPE_DECL;
     ast->decl = unique_ptr<BaseAST>($2);
     ast->next = (CompUnitAST*)$1;
-    $$ = ast;
+    $$ = stream_comp_unit(handler, ast);
   }
   ;
 
@@ -171,14 +187,20 @@ ConstDef
   }
   ;
 
-OptionalConstInitVal
-  : ',' ConstInitVal OptionalConstInitVal {
-    auto ast = $2;
-    ((InitValAST*)ast)->next = ((InitValAST*)$3);
+// left recursive, so that long initializer lists don't fill the parser
+// stack
+ConstInitValList
+  : ConstInitVal {
+    auto ast = new InitValAST();
+    ast->type = INIT_VAL_AST_TYPE_SUB_VALS;
+    ast->is_const = true;
+    ast->init_vals.push_back(unique_ptr<BaseAST>($1));
     $$ = ast;
   }
-  | {
-    $$ = nullptr;
+  | ConstInitValList ',' ConstInitVal {
+    auto ast = $1;
+    ((InitValAST*)ast)->init_vals.push_back(unique_ptr<BaseAST>($3));
+    $$ = ast;
   }
   ;
 
@@ -196,19 +218,8 @@ ConstInitVal
     ast->is_const = true;
     $$ = ast;
   }
-  | '{' ConstInitVal OptionalConstInitVal '}' {
-    auto ast = new InitValAST();
-    ast->type = INIT_VAL_AST_TYPE_SUB_VALS;
-    ast->is_const = true;
-    ast->init_vals.push_back(unique_ptr<BaseAST>($2));
-    InitValAST* cur = (InitValAST*) $3;
-    InitValAST* tmp;
-    while (cur != nullptr) {
-      tmp = cur->next;
-      ast->init_vals.push_back(unique_ptr<BaseAST>((BaseAST*)cur));
-      cur = tmp;
-    }
-    $$ = ast;
+  | '{' ConstInitValList '}' {
+    $$ = $2;
   }
   ;
 
@@ -284,31 +295,25 @@ InitVal
     ast->is_const = false;
     $$ = ast;
   }
-  | '{' InitVal OptionalInitVal '}' {
+  | '{' InitValList '}' {
+    $$ = $2;
+  }
+  ;
+
+// left recursive like ConstInitValList
+InitValList
+  : InitVal {
     auto ast = new InitValAST();
     ast->type = INIT_VAL_AST_TYPE_SUB_VALS;
     ast->is_const = false;
-    ast->init_vals.push_back(unique_ptr<BaseAST>($2));
-    InitValAST* cur = (InitValAST*) $3;
-    InitValAST* tmp;
-    while (cur != nullptr) {
-      tmp = cur->next;
-      ast->init_vals.push_back(unique_ptr<BaseAST>((BaseAST*)cur));
-      cur = tmp;
-    }
+    ast->init_vals.push_back(unique_ptr<BaseAST>($1));
     $$ = ast;
   }
-  ;
-
-OptionalInitVal
-  : ',' InitVal OptionalInitVal {
-    auto ast = $2;
-    ((InitValAST*)ast)->next = ((InitValAST*)$3);
+  | InitValList ',' InitVal {
+    auto ast = $1;
+    ((InitValAST*)ast)->init_vals.push_back(unique_ptr<BaseAST>($3));
     $$ = ast;
   }
-  | {
-    $$ = nullptr;
-  }
   ;
 
 FuncDef
@@ -782,6 +787,7 @@ Number
 
 %%
 
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s) {
+void yyerror(std::unique_ptr<BaseAST> &ast, comp_unit_handler_t &handler,
+             const char *s) {
   cerr << "line " << yylineno << ": " << s << endl;
 }
\ No newline at end of file
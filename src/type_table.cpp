@@ -0,0 +1,50 @@
+#include "irgen.h"
+
+TypeTable::TypeTable() {
+    types.emplace_back();
+    auto &type = types.back();
+    type.tag = KOOPA_TYPE_INT32;
+    type.size = 4;
+    type.str = "i32";
+    int32 = &type;
+}
+
+const KoopaType *TypeTable::get_array(const KoopaType *base, int len) {
+    auto key = std::make_pair(base, len);
+    auto it = arrays.find(key);
+    if (it != arrays.end()) return it->second;
+
+    types.emplace_back();
+    auto &type = types.back();
+    type.tag = KOOPA_TYPE_ARRAY;
+    type.base = base;
+    type.len = len;
+    type.size = base->size * len;
+    type.stride = base->size;
+    type.str = "[" + base->str + ", " + std::to_string(len) + "]";
+    arrays.insert(std::make_pair(key, &type));
+    return &type;
+}
+
+const KoopaType *TypeTable::get_pointer(const KoopaType *base) {
+    auto it = pointers.find(base);
+    if (it != pointers.end()) return it->second;
+
+    types.emplace_back();
+    auto &type = types.back();
+    type.tag = KOOPA_TYPE_POINTER;
+    type.base = base;
+    type.size = 4;
+    type.stride = base->size;
+    type.str = "*" + base->str;
+    pointers.insert(std::make_pair(base, &type));
+    return &type;
+}
+
+const KoopaType *TypeTable::get_array(const KoopaType *elem,
+                                      const std::vector<int> &dims) {
+    auto type = elem;
+    for (auto it = dims.rbegin(); it != dims.rend(); it++)
+        type = get_array(type, *it);
+    return type;
+}
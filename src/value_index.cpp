@@ -0,0 +1,41 @@
+#include <value_index.h>
+
+ValueIndex::ValueIndex(koopa_raw_function_t func) : ValueIndex() {
+    for (size_t i = 0; i < func->params.len; i++)
+        insert((koopa_raw_value_t)func->params.buffer[i]);
+    for (size_t i = 0; i < func->bbs.len; i++) {
+        auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->params.len; j++)
+            insert((koopa_raw_value_t)bb->params.buffer[j]);
+        for (size_t j = 0; j < bb->insts.len; j++) {
+            auto inst = (koopa_raw_value_t)bb->insts.buffer[j];
+            if (inst->ty->tag == KOOPA_RTT_UNIT) continue;
+            if (inst->kind.tag == KOOPA_RVT_ALLOC) continue;
+            insert(inst);
+        }
+    }
+}
+
+int ValueIndex::insert(koopa_raw_value_t val) {
+    assert(val != nullptr);
+    auto slot = _find_slot(val);
+    if (keys[slot] == val) return numbers[slot];
+
+    keys[slot] = val;
+    numbers[slot] = values.size();
+    values.push_back(val);
+    // keep load factor under 1/2
+    if (values.size() * 2 > keys.size()) _grow();
+    return values.size() - 1;
+}
+
+void ValueIndex::_grow() {
+    keys.assign(keys.size() * 2, nullptr);
+    numbers.assign(numbers.size() * 2, -1);
+    shift--;
+    for (size_t i = 0; i < values.size(); i++) {
+        auto slot = _find_slot(values[i]);
+        keys[slot] = values[i];
+        numbers[slot] = i;
+    }
+}